@@ -0,0 +1,51 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Minimal helpers shared by the microbenchmarks. Each benchmark is a
+ * standalone executable that prints one line per case; results are
+ * only comparable between runs on the same machine and build type
+ * (use -DCMAKE_BUILD_TYPE=Release).
+ */
+
+/**
+ * Monotonic wall-clock time in seconds.
+ */
+static inline double buBenchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Prints the time per operation for a case, and its speedup relative
+ * to baseline seconds when baseline is positive.
+ */
+static inline void buBenchReport(const char *name, double seconds, double operations, double baseline) {
+    if (baseline > 0.0) {
+        printf("  %-32s %9.3f ns/op  %6.2fx\n", name, seconds * 1e9 / operations, baseline / seconds);
+    } else {
+        printf("  %-32s %9.3f ns/op\n", name, seconds * 1e9 / operations);
+    }
+}
+
+/**
+ * Forces the compiler to assume memory changed, so repeated passes over
+ * the same data are not folded into one.
+ */
+#if defined(__GNUC__)
+    #define buBenchClobber() __asm__ volatile("" ::: "memory")
+#else
+    #define buBenchClobber() ((void)0)
+#endif
+
+/**
+ * Keeps the optimiser from discarding a computed result.
+ */
+static volatile double buBenchSink;
+
+#endif // BENCH_H
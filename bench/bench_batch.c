@@ -0,0 +1,136 @@
+#include "bench.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pfgen.h"
+#include "../src/budgie/pworld.h"
+#include <stdlib.h>
+
+/**
+ * Times ParticleDrag, ParticleBuoyancy and ParticleAnchoredBungee on a
+ * fireworks-sized population that shares one instance of each: once
+ * as a registry of per-particle registrations (consecutive buoyancy
+ * and bungee registrations are handed to the batch kernels), once through
+ * updateForceBatch on separately allocated particles, and once
+ * straight over the world arrays with updateWorldForces, and through
+ * one group registration on a list group of the particles and on a
+ * range group of the world. The baseline
+ * is a loop of updateForce calls, the registry's path before the
+ * batch kernels.
+ */
+
+#define NUMBER_OF_PARTICLES 100000
+#define REPEATS 50
+#define DURATION ((buReal)1.0 / 60.0)
+
+static Particle *particles[NUMBER_OF_PARTICLES];
+
+static buReal random01(void) {
+    return (buReal)rand() / RAND_MAX;
+}
+
+static void clearForces(ParticleWorld *world) {
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], clearAccumulator);
+    }
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, clearAccumulators);
+}
+
+int main(void) {
+    ParticleCreateClass();
+    ParticleForceGeneratorCreateClass();
+    ParticleDragCreateClass();
+    ParticleBuoyancyCreateClass();
+    ParticleAnchoredBungeeCreateClass();
+    ParticleForceRegistryCreateClass();
+    ParticleWorldCreateClass();
+
+    srand(5);
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 position = {random01() * 10, random01() * 4 - 2, random01() * 10};
+        buVector3 velocity = {random01() - (buReal)0.5, random01() * 5, random01() - (buReal)0.5};
+        particles[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], set, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+    }
+
+    const char *names[3] = {"drag", "buoyancy", "anchored bungee"};
+    ParticleForceGenerator *generators[3] = {
+        (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleDragClass, &particleDragClass, new_instance, 0.1, 0.01),
+        (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleBuoyancyClass, &particleBuoyancyClass, new_instance, 0.5, 0.002, 0.0, 1000.0),
+        (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleAnchoredBungeeClass, &particleAnchoredBungeeClass, new_instance, (buVector3){5.0, 0.0, 5.0}, 3.0, 4.0),
+    };
+
+    for (int g = 0; g < 3; g++) {
+        ParticleForceGenerator *fg = generators[g];
+        ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+        for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], fg);
+        }
+        ParticleForceRegistry *listGroup = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+        uint32_t list = INSTANCE_METHOD_AS(ParticleForceRegistryVTable, listGroup, addGroup, particles, NUMBER_OF_PARTICLES);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, listGroup, addGroupForce, list, fg);
+        ParticleForceRegistry *rangeGroup = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+        uint32_t range = INSTANCE_METHOD_AS(ParticleForceRegistryVTable, rangeGroup, addRangeGroup, world, 0, NUMBER_OF_PARTICLES);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, rangeGroup, addGroupForce, range, fg);
+        printf("%s, %d particles\n", names[g], NUMBER_OF_PARTICLES);
+
+        double loop = 0.0, batch = 0.0, registered = 0.0, arrays = 0.0, listed = 0.0, ranged = 0.0;
+        for (int r = 0; r < REPEATS; r++) {
+            clearForces(world);
+            double start = buBenchNow();
+            for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+                INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, fg, updateForce, particles[i], DURATION);
+            }
+            loop += buBenchNow() - start;
+            buBenchClobber();
+
+            start = buBenchNow();
+            INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, fg, updateForceBatch, particles, NUMBER_OF_PARTICLES, DURATION);
+            batch += buBenchNow() - start;
+            buBenchClobber();
+
+            start = buBenchNow();
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, DURATION);
+            registered += buBenchNow() - start;
+            buBenchClobber();
+
+            start = buBenchNow();
+            INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, fg, updateWorldForces, world, 0, NUMBER_OF_PARTICLES, DURATION);
+            arrays += buBenchNow() - start;
+            buBenchClobber();
+
+            start = buBenchNow();
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, listGroup, updateForces, DURATION);
+            listed += buBenchNow() - start;
+            buBenchClobber();
+
+            start = buBenchNow();
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, rangeGroup, updateForces, DURATION);
+            ranged += buBenchNow() - start;
+            buBenchClobber();
+        }
+        double ops = (double)NUMBER_OF_PARTICLES * REPEATS;
+        buBenchReport("updateForce loop", loop, ops, 0.0);
+        buBenchReport("updateForceBatch", batch, ops, loop);
+        buBenchReport("registry updateForces", registered, ops, loop);
+        buBenchReport("updateWorldForces", arrays, ops, loop);
+        buBenchReport("registry, one list group", listed, ops, loop);
+        buBenchReport("registry, one range group", ranged, ops, loop);
+        CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+        CLASS_METHOD(&particleForceRegistryClass, free, (Object *)listGroup);
+        CLASS_METHOD(&particleForceRegistryClass, free, (Object *)rangeGroup);
+    }
+
+    buBenchSink = world->_arrays.forceAccum[1][NUMBER_OF_PARTICLES / 2]
+        + INSTANCE_METHOD_AS(ParticleVTable, particles[0], getForceAccum).y;
+    CLASS_METHOD_AS(ParticleDragClass, &particleDragClass, free, (ParticleDrag *)generators[0]);
+    CLASS_METHOD_AS(ParticleBuoyancyClass, &particleBuoyancyClass, free, (ParticleBuoyancy *)generators[1]);
+    CLASS_METHOD_AS(ParticleAnchoredBungeeClass, &particleAnchoredBungeeClass, free, (ParticleAnchoredBungee *)generators[2]);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        CLASS_METHOD(&particleClass, free, (Object *)particles[i]);
+    }
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include "bench.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pcontacts.h"
+#include <stdlib.h>
+#include <math.h>
+#include <limits.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Times ParticleContactResolver resolveContacts on particle piles of
+ * about 500 to 8000 contacts: a side x side grid of particles stacked
+ * in rows, each touching the ground (bottom row), the particle below
+ * and the particle to its left, all closing and interpenetrating. Each
+ * grid is timed as one pile and split into towers 8 particles wide,
+ * which do not touch each other. The
+ * iteration budget is four times the number of contacts. Every mode is
+ * reset to the same starting state and reports the time per solve,
+ * the resolutions it made, the largest difference from the scan's
+ * final positions and velocities, and the residual it left: the
+ * largest closing velocity or penetration of any contact.
+ * PCR_MODE_COLORED (tolerance 1e-4) and PCR_MODE_ISLANDS are timed on
+ * 1 thread and, with OpenMP, on every processor. The coloured mode
+ * resolves in a different order, so it differs from the scan; islands
+ * share the budget out by island size, so they differ from it only
+ * where the budget ran out. For islands the
+ * island count, the smallest and largest island and the time spent
+ * per island are printed too. Last, resolveBuffer is timed on the
+ * same contacts copied into a ParticleContactBuffer.
+ */
+
+#define DURATION ((buReal)1.0 / 60.0)
+#define TOWER_WIDTH 8
+
+static const int sides[] = {16, 32, 64};
+
+typedef struct Pile {
+    int particleCount;
+    unsigned contactCount;
+    Particle **particles;
+    ParticleContact **contacts;
+    buVector3 *position;   // starting state, restored by resetPile
+    buVector3 *velocity;
+    buReal *penetration;
+} Pile;
+
+static buReal random01(void) {
+    return (buReal)rand() / RAND_MAX;
+}
+
+static void addContact(Pile *pile, Particle *a, Particle *b, buVector3 normal, buReal penetration) {
+    ParticleContact *contact = (ParticleContact *)CLASS_METHOD(&particleContactClass, new_instance);
+    contact->_particle[0] = a;
+    contact->_particle[1] = b;
+    contact->_restitution = 0.4;
+    contact->_contactNormal = normal;
+    contact->_particleMovement[0] = (buVector3){0.0, 0.0, 0.0};
+    contact->_particleMovement[1] = (buVector3){0.0, 0.0, 0.0};
+    pile->penetration[pile->contactCount] = penetration;
+    pile->contacts[pile->contactCount++] = contact;
+}
+
+// A side x side grid, with no contacts between columns width apart
+static void buildPile(Pile *pile, int side, int width) {
+    srand(13);
+    pile->particleCount = side * side;
+    pile->contactCount = 0;
+    pile->particles = malloc(pile->particleCount * sizeof(Particle *));
+    pile->position = malloc(pile->particleCount * sizeof(buVector3));
+    pile->velocity = malloc(pile->particleCount * sizeof(buVector3));
+    pile->contacts = malloc(3 * pile->particleCount * sizeof(ParticleContact *));
+    pile->penetration = malloc(3 * pile->particleCount * sizeof(buReal));
+
+    for (int i = 0; i < pile->particleCount; i++) {
+        int x = i % side, y = i / side;
+        pile->position[i] = (buVector3){(buReal)x * 0.95f, (buReal)0.5 + (buReal)y * 0.95f, random01() * 0.01f};
+        pile->velocity[i] = (buVector3){random01() * 0.2f - 0.1f, -random01() * 2, 0.0};
+        pile->particles[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, pile->particles[i], set, pile->position[i], pile->velocity[i], (buVector3){0.0, -9.81, 0.0}, 0.99, (buReal)1.0 / (1 + (buReal)(i % 3)));
+    }
+    for (int i = 0; i < pile->particleCount; i++) {
+        int x = i % side, y = i / side;
+        if (y == 0) addContact(pile, pile->particles[i], NULL, (buVector3){0.0, 1.0, 0.0}, 0.02f);
+        int others[2] = {y > 0 ? i - side : -1, x % width ? i - 1 : -1};
+        for (int o = 0; o < 2; o++) {
+            if (others[o] < 0) continue;
+            buVector3 normal = buVector3Difference(pile->position[i], pile->position[others[o]]);
+            buReal distance = buVector3Norm(normal);
+            addContact(pile, pile->particles[i], pile->particles[others[o]], buVector3Scalar(normal, (buReal)1.0 / distance), (buReal)1.0 - distance);
+        }
+    }
+}
+
+static void resetPile(Pile *pile) {
+    for (int i = 0; i < pile->particleCount; i++) {
+        INSTANCE_METHOD_AS(ParticleVTable, pile->particles[i], setPosition, pile->position[i]);
+        INSTANCE_METHOD_AS(ParticleVTable, pile->particles[i], setVelocity, pile->velocity[i]);
+    }
+    for (unsigned c = 0; c < pile->contactCount; c++) {
+        pile->contacts[c]->_penetration = pile->penetration[c];
+    }
+}
+
+static void freePile(Pile *pile) {
+    for (int i = 0; i < pile->particleCount; i++) {
+        CLASS_METHOD(&particleClass, free, (Object *)pile->particles[i]);
+    }
+    for (unsigned c = 0; c < pile->contactCount; c++) {
+        CLASS_METHOD(&particleContactClass, free, (Object *)pile->contacts[c]);
+    }
+    free(pile->particles);
+    free(pile->contacts);
+    free(pile->position);
+    free(pile->velocity);
+    free(pile->penetration);
+}
+
+// Final state of the first mode timed, to compare the others against
+static buVector3 *reference;
+
+static double maxDifference(const Pile *pile, bool store) {
+    double difference = 0.0;
+    for (int i = 0; i < pile->particleCount; i++) {
+        buVector3 state[2] = {
+            INSTANCE_METHOD_AS(ParticleVTable, pile->particles[i], getPosition),
+            INSTANCE_METHOD_AS(ParticleVTable, pile->particles[i], getVelocity),
+        };
+        for (int s = 0; s < 2; s++) {
+            if (store) {
+                reference[2 * i + s] = state[s];
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                double d = fabs((double)state[s].v[k] - (double)reference[2 * i + s].v[k]);
+                if (d > difference) difference = d;
+            }
+        }
+    }
+    return difference;
+}
+
+static void printIslands(const ParticleContactResolver *resolver) {
+    unsigned count = INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, getIslandCount);
+    unsigned smallest = UINT_MAX, largest = 0;
+    double seconds = 0.0, slowest = 0.0;
+    for (unsigned k = 0; k < count; k++) {
+        const ParticleContactIsland *island = INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, getIsland, k);
+        if (island->contactCount < smallest) smallest = island->contactCount;
+        if (island->contactCount > largest) largest = island->contactCount;
+        if (island->seconds > slowest) slowest = island->seconds;
+        seconds += island->seconds;
+    }
+    printf("  %-32s %u islands of %u to %u contacts, %.1f us per island (slowest %.1f us)\n", "",
+        count, smallest, largest, seconds / count * 1e6, slowest * 1e6);
+}
+
+static double residual(const Pile *pile) {
+    double worst = 0.0;
+    for (unsigned c = 0; c < pile->contactCount; c++) {
+        ParticleContact *contact = pile->contacts[c];
+        double closing = -(double)ParticleContact_calculateSeparatingVelocity(contact);
+        if (closing > worst) worst = closing;
+        if ((double)contact->_penetration > worst) worst = (double)contact->_penetration;
+    }
+    return worst;
+}
+
+int main(void) {
+    ParticleCreateClass();
+    ParticleContactResolverCreateClass();
+    ParticleContactBufferCreateClass();
+
+    int processors = 1;
+#ifdef _OPENMP
+    processors = omp_get_num_procs();
+#endif
+    // The multi-threaded modes run only when there is more than one processor
+    const ParticleContactResolverMode modes[6] = {PCR_MODE_SCAN, PCR_MODE_HEAP, PCR_MODE_COLORED, PCR_MODE_ISLANDS, PCR_MODE_COLORED, PCR_MODE_ISLANDS};
+    const unsigned threads[6] = {1, 1, 1, 1, (unsigned)processors, (unsigned)processors};
+    char names[6][64] = {"scan", "heap", "coloured, 1 thread", "islands, 1 thread", "", ""};
+    snprintf(names[4], sizeof(names[4]), "coloured, %d threads", processors);
+    snprintf(names[5], sizeof(names[5]), "islands, %d threads", processors);
+    const int modeCount = processors > 1 ? 6 : 4;
+
+    for (size_t n = 0; n < 2 * sizeof(sides) / sizeof(sides[0]); n++) {
+        const int side = sides[n / 2];
+        const int width = n % 2 ? TOWER_WIDTH : side;
+        Pile pile;
+        buildPile(&pile, side, width);
+        reference = malloc(2 * pile.particleCount * sizeof(buVector3));
+        ParticleContactResolver *resolver = (ParticleContactResolver *)CLASS_METHOD(&particleContactResolverClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setIterations, 4 * pile.contactCount);
+        if (width == side) {
+            printf("pile of %d particles, %u contacts\n", pile.particleCount, pile.contactCount);
+        } else {
+            printf("%d towers of %d particles, %u contacts\n", side / width, pile.particleCount / (side / width), pile.contactCount);
+        }
+
+        // Roughly the same total work for every size
+        int repeats = (int)(1000000 / ((double)pile.contactCount * pile.contactCount));
+        if (repeats < 2) repeats = 2;
+
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setTolerance, 1e-4);
+        double baseline = 0.0;
+        for (int m = 0; m < modeCount; m++) {
+            INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setMode, modes[m]);
+            INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setThreadCount, threads[m]);
+            double seconds = 0.0;
+            unsigned iterations = 0;
+            for (int r = 0; r < repeats; r++) {
+                resetPile(&pile);
+                double start = buBenchNow();
+                INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveContacts, pile.contacts, pile.contactCount, DURATION);
+                seconds += buBenchNow() - start;
+                iterations += resolver->_iterationsUsed;
+                buBenchClobber();
+            }
+            if (m == 0) baseline = seconds;
+
+            char name[80];
+            snprintf(name, sizeof(name), "%s (per solve)", names[m]);
+            buBenchReport(name, seconds, (double)repeats, m ? baseline : 0.0);
+            printf("  %-32s %u resolutions, max |difference| %g, residual %g\n", "",
+                iterations / repeats, maxDifference(&pile, m == 0), residual(&pile));
+            if (modes[m] == PCR_MODE_ISLANDS) printIslands(resolver);
+        }
+
+        // The same contacts copied into one flat buffer
+        ParticleContactBuffer *buffer = (ParticleContactBuffer *)CLASS_METHOD(&particleContactBufferClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, appendContacts, pile.contacts, pile.contactCount);
+        double seconds = 0.0;
+        unsigned iterations = 0;
+        for (int r = 0; r < repeats; r++) {
+            resetPile(&pile);
+            for (unsigned c = 0; c < pile.contactCount; c++) {
+                INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, get, c)->penetration = pile.penetration[c];
+            }
+            double start = buBenchNow();
+            INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveBuffer, buffer, DURATION);
+            seconds += buBenchNow() - start;
+            iterations += resolver->_iterationsUsed;
+            buBenchClobber();
+        }
+        INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, storeContacts, 0, pile.contacts, pile.contactCount);
+        buBenchReport("buffer (per solve)", seconds, (double)repeats, baseline);
+        printf("  %-32s %u resolutions, max |difference| %g, residual %g\n", "",
+            iterations / repeats, maxDifference(&pile, false), residual(&pile));
+        CLASS_METHOD(&particleContactBufferClass, free, (Object *)buffer);
+
+        buBenchSink = INSTANCE_METHOD_AS(ParticleVTable, pile.particles[0], getPosition).y;
+        CLASS_METHOD(&particleContactResolverClass, free, (Object *)resolver);
+        free(reference);
+        freePile(&pile);
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "bench.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pworld.h"
+#include "../src/budgie/pcontacts.h"
+#include "../src/budgie/plinks.h"
+#include <stdlib.h>
+
+/**
+ * Times contact generation for ropes of 1k to 100k links, alternating
+ * cables and rods with every tenth particle hung from an anchor by a
+ * cable; nearly every rod and some cables are violated, about two
+ * thirds of the links in all. The baseline is one
+ * ParticleCable, ParticleRod or ParticleCableConstraint per link on
+ * views of the world particles, each called through addContact; the
+ * link set generates the same contacts in one sweep, both into a
+ * ParticleContact array and into a ParticleContactBuffer.
+ */
+
+static const int sizes[] = {1000, 10000, 100000};
+
+static buReal random01(void) {
+    return (buReal)rand() / RAND_MAX;
+}
+
+int main(void) {
+    ParticleWorldCreateClass();
+    ParticleCableCreateClass();
+    ParticleRodCreateClass();
+    ParticleCableConstraintCreateClass();
+    ParticleLinkSetCreateClass();
+
+    srand(17);
+    for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+        const int particles = sizes[n];
+        ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, particles);
+        for (int i = 0; i < particles; i++) {
+            buVector3 position = {(buReal)i + random01() * 0.2f, random01() * 0.2f, 0.0};
+            INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, position, (buVector3){0.0, 0.0, 0.0}, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+        }
+
+        ParticleLinkSet *set = CLASS_METHOD_AS(ParticleLinkSetClass, &particleLinkSetClass, new_instance, world);
+        ParticleContactGenerator **links = malloc(2 * particles * sizeof(ParticleContactGenerator *));
+        size_t count = 0;
+        for (uint32_t i = 0; i < (uint32_t)particles; i++) {
+            Particle *a = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i);
+            if (i + 1 < (uint32_t)particles) {
+                Particle *b = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i + 1);
+                if (i % 2) {
+                    ParticleCable *cable = (ParticleCable *)CLASS_METHOD(&particleCableClass, new_instance);
+                    cable->base._particle[0] = a;
+                    cable->base._particle[1] = b;
+                    cable->_maxLength = 1.05;
+                    cable->_restitution = 0.3;
+                    links[count++] = (ParticleContactGenerator *)cable;
+                    INSTANCE_METHOD_AS(ParticleLinkSetVTable, set, addCable, i, i + 1, 1.05, 0.3);
+                } else {
+                    ParticleRod *rod = (ParticleRod *)CLASS_METHOD(&particleRodClass, new_instance);
+                    rod->base._particle[0] = a;
+                    rod->base._particle[1] = b;
+                    rod->_length = 1.0;
+                    links[count++] = (ParticleContactGenerator *)rod;
+                    INSTANCE_METHOD_AS(ParticleLinkSetVTable, set, addRod, i, i + 1, 1.0);
+                }
+            }
+            if (i % 10 == 0) {
+                buVector3 anchor = {(buReal)i, 3.0, 0.0};
+                ParticleCableConstraint *cable = (ParticleCableConstraint *)CLASS_METHOD(&particleCableConstraintClass, new_instance);
+                cable->base._particle = a;
+                cable->base._anchor = anchor;
+                cable->_maxLength = 2.9;
+                cable->_restitution = 0.3;
+                links[count++] = (ParticleContactGenerator *)cable;
+                INSTANCE_METHOD_AS(ParticleLinkSetVTable, set, addCableConstraint, i, anchor, 2.9, 0.3);
+            }
+        }
+
+        ParticleContact *contacts = calloc(count, sizeof(ParticleContact));
+        ParticleContactBuffer *buffer = (ParticleContactBuffer *)CLASS_METHOD(&particleContactBufferClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, reserve, (unsigned)count);
+
+        // Roughly the same total work for every size
+        int repeats = (int)(20000000 / count);
+        if (repeats < 5) repeats = 5;
+
+        unsigned objectContacts = 0;
+        double objectSeconds = 0.0;
+        for (int r = 0; r < repeats; r++) {
+            double start = buBenchNow();
+            unsigned used = 0;
+            for (size_t l = 0; l < count; l++) {
+                used += INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, links[l], addContact, contacts + used, (unsigned)count - used);
+            }
+            objectSeconds += buBenchNow() - start;
+            objectContacts = used;
+            buBenchClobber();
+        }
+
+        unsigned setContacts = 0;
+        double setSeconds = 0.0;
+        for (int r = 0; r < repeats; r++) {
+            double start = buBenchNow();
+            setContacts = INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, (ParticleContactGenerator *)set, addContact, contacts, (unsigned)count);
+            setSeconds += buBenchNow() - start;
+            buBenchClobber();
+        }
+
+        double bufferSeconds = 0.0;
+        for (int r = 0; r < repeats; r++) {
+            INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, clear);
+            double start = buBenchNow();
+            INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, (ParticleContactGenerator *)set, addContactsToBuffer, buffer, (unsigned)count);
+            bufferSeconds += buBenchNow() - start;
+            buBenchClobber();
+        }
+
+        printf("%zu links, %u contacts (link set %u)\n", count, objectContacts, setContacts);
+        buBenchReport("link objects, addContact", objectSeconds, (double)count * repeats, 0.0);
+        buBenchReport("link set, addContact", setSeconds, (double)count * repeats, objectSeconds);
+        buBenchReport("link set, addContactsToBuffer", bufferSeconds, (double)count * repeats, objectSeconds);
+        buBenchSink = contacts[0]._penetration;
+
+        for (size_t l = 0; l < count; l++) {
+            CLASS_METHOD(((Object *)links[l])->klass, free, (Object *)links[l]);
+        }
+        free(links);
+        free(contacts);
+        CLASS_METHOD(&particleContactBufferClass, free, (Object *)buffer);
+        CLASS_METHOD_AS(ParticleLinkSetClass, &particleLinkSetClass, free, set);
+        CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include "bench.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pfgen.h"
+#include "../src/budgie/pcontacts.h"
+#include <stdlib.h>
+
+/**
+ * Times ParticleForceRegistry updateForces and ParticleContactResolver
+ * resolveContacts on a fixed synthetic scene. The same source is built
+ * as bench_physics (core.h math inlined when USE_INLINE_MATH is on) and
+ * bench_physics_outofline (BU_NO_INLINE_MATH, every vector op is a call
+ * into core.c), so comparing the two shows the cost of the calls.
+ *
+ * resolveContacts is timed in both PCR_MODE_SCAN and PCR_MODE_HEAP,
+ * which resolve the same contacts in the same order.
+ *
+ * It also compares linking the particles into a chain with two
+ * ParticleSprings per link against one ParticlePairSpring per link.
+ */
+
+#define NUMBER_OF_PARTICLES 4096
+#define FORCE_REPEATS 200
+#define NUMBER_OF_CONTACTS 512
+#define CONTACT_REPEATS 20
+#define DURATION ((buReal)1.0 / 60.0)
+
+static Particle *particles[NUMBER_OF_PARTICLES];
+static ParticleContact *contacts[NUMBER_OF_CONTACTS];
+
+static buReal random01(void) {
+    return (buReal)rand() / RAND_MAX;
+}
+
+static void resetParticles(void) {
+    srand(7);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], set,
+            (buVector3){random01() * 10, random01() * 10, random01() * 10},
+            (buVector3){random01() - (buReal)0.5, random01() - (buReal)0.5, random01() - (buReal)0.5},
+            (buVector3){0.0, -9.81, 0.0}, 0.99, (buReal)1.0 / (1 + random01()));
+    }
+}
+
+// Ground contacts and particle pairs, all closing and interpenetrating
+static void resetContacts(void) {
+    for (int i = 0; i < NUMBER_OF_CONTACTS; i++) {
+        ParticleContact *contact = contacts[i];
+        contact->_particle[0] = particles[i % 256];
+        contact->_particle[1] = (i % 2) ? particles[256 + i % 128] : NULL;
+        contact->_restitution = 0.5;
+        contact->_contactNormal = (buVector3){0.0, 1.0, 0.0};
+        contact->_penetration = (buReal)0.01 * (1 + i % 5);
+        contact->_particleMovement[0] = (buVector3){0.0, 0.0, 0.0};
+        contact->_particleMovement[1] = (buVector3){0.0, 0.0, 0.0};
+        INSTANCE_METHOD_AS(ParticleVTable, contact->_particle[0], setVelocity, (buVector3){0.0, -1.0 - random01(), 0.0});
+    }
+}
+
+int main(void) {
+    ParticleCreateClass();
+    ParticleForceGeneratorCreateClass();
+    ParticleGravityCreateClass();
+    ParticleDragCreateClass();
+    ParticleAnchoredSpringCreateClass();
+    ParticleSpringCreateClass();
+    ParticlePairSpringCreateClass();
+    ParticleBuoyancyCreateClass();
+    ParticleForceRegistryCreateClass();
+    ParticleContactCreateClass();
+    ParticleContactResolverCreateClass();
+
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        particles[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+    }
+    resetParticles();
+
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    ParticleForceGenerator *gravity = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleGravityClass, &particleGravityClass, new_instance, GRAVITY);
+    ParticleForceGenerator *drag = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleDragClass, &particleDragClass, new_instance, 0.1, 0.01);
+    ParticleForceGenerator *anchored = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleAnchoredSpringClass, &particleAnchoredSpringClass, new_instance, (buVector3){5.0, 10.0, 5.0}, 2.0, 3.0);
+    ParticleForceGenerator *buoyancy = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleBuoyancyClass, &particleBuoyancyClass, new_instance, 1.0, 0.1, 5.0, 1000.0);
+    size_t registrations = 0;
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], gravity); registrations++;
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], drag); registrations++;
+        if (i % 2 == 0) {
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], anchored); registrations++;
+        } else {
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], buoyancy); registrations++;
+        }
+        ParticleForceGenerator *spring = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, new_instance, particles[(i + 1) % NUMBER_OF_PARTICLES], 5.0, 1.0);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], spring); registrations++;
+    }
+
+    ParticleContactResolver *resolver = (ParticleContactResolver *)CLASS_METHOD(&particleContactResolverClass, new_instance);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setIterations, NUMBER_OF_CONTACTS * 2);
+    for (int i = 0; i < NUMBER_OF_CONTACTS; i++) {
+        contacts[i] = (ParticleContact *)CLASS_METHOD(&particleContactClass, new_instance);
+    }
+
+#if defined(USE_INLINE_MATH) && !defined(BU_NO_INLINE_MATH)
+    printf("core.h math: inline (%s)\n", sizeof(buReal) == sizeof(float) ? "float" : "double");
+#else
+    printf("core.h math: out-of-line (%s)\n", sizeof(buReal) == sizeof(float) ? "float" : "double");
+#endif
+
+    double forceSeconds = 0.0;
+    for (int r = 0; r < FORCE_REPEATS; r++) {
+        for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+            INSTANCE_METHOD_AS(ParticleVTable, particles[i], clearAccumulator);
+        }
+        double start = buBenchNow();
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, DURATION);
+        forceSeconds += buBenchNow() - start;
+    }
+    buBenchReport("updateForces (per registration)", forceSeconds, (double)registrations * FORCE_REPEATS, 0.0);
+
+    // The same chain, linked both ways
+    ParticleForceRegistry *singles = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    ParticleForceRegistry *pairs = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    for (int i = 0; i + 1 < NUMBER_OF_PARTICLES; i++) {
+        Particle *a = particles[i];
+        Particle *b = particles[i + 1];
+        ParticleForceGenerator *toB = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, new_instance, b, 5.0, 1.0);
+        ParticleForceGenerator *toA = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, new_instance, a, 5.0, 1.0);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, singles, add, a, toB);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, singles, add, b, toA);
+        ParticleForceGenerator *pair = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticlePairSpringClass, &particlePairSpringClass, new_instance, a, b, 5.0, 1.0);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, pairs, add, a, pair);
+    }
+    double chainSeconds[2] = {0.0, 0.0};
+    ParticleForceRegistry *chains[2] = {singles, pairs};
+    for (int r = 0; r < FORCE_REPEATS; r++) {
+        for (int c = 0; c < 2; c++) {
+            double start = buBenchNow();
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, chains[c], updateForces, DURATION);
+            chainSeconds[c] += buBenchNow() - start;
+        }
+    }
+    buBenchReport("chain, 2 springs (per link)", chainSeconds[0], (double)(NUMBER_OF_PARTICLES - 1) * FORCE_REPEATS, 0.0);
+    buBenchReport("chain, pair spring (per link)", chainSeconds[1], (double)(NUMBER_OF_PARTICLES - 1) * FORCE_REPEATS, chainSeconds[0]);
+
+    const char *modeNames[2] = {"resolveContacts, scan (per iteration)", "resolveContacts, heap (per iteration)"};
+    const ParticleContactResolverMode modes[2] = {PCR_MODE_SCAN, PCR_MODE_HEAP};
+    double contactSeconds[2] = {0.0, 0.0};
+    unsigned iterationsUsed[2] = {0, 0};
+    for (int m = 0; m < 2; m++) {
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setMode, modes[m]);
+        for (int r = 0; r < CONTACT_REPEATS; r++) {
+            resetParticles();
+            resetContacts();
+            double start = buBenchNow();
+            INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveContacts, contacts, NUMBER_OF_CONTACTS, DURATION);
+            contactSeconds[m] += buBenchNow() - start;
+            iterationsUsed[m] += resolver->_iterationsUsed;
+        }
+        buBenchReport(modeNames[m], contactSeconds[m], (double)iterationsUsed[m], m ? contactSeconds[0] : 0.0);
+    }
+
+    buBenchSink = INSTANCE_METHOD_AS(ParticleVTable, particles[0], getForceAccum).y;
+    return 0;
+}
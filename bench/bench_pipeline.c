@@ -0,0 +1,103 @@
+#include "bench.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pfgen.h"
+#include <stdlib.h>
+#include <math.h>
+
+/**
+ * Times a ParticleForcePipeline against the ParticleForceRegistry it
+ * reads, on fireworks that all carry gravity + drag, half of them with
+ * buoyancy as well. Also reports the largest difference between the
+ * two, which should be zero.
+ */
+
+#define NUMBER_OF_PARTICLES 100000
+#define REPEATS 50
+#define DURATION ((buReal)1.0 / 60.0)
+
+static Particle *particles[NUMBER_OF_PARTICLES];
+static buVector3 reference[NUMBER_OF_PARTICLES];
+
+static buReal random01(void) {
+    return (buReal)rand() / RAND_MAX;
+}
+
+static void clearForces(void) {
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], clearAccumulator);
+    }
+}
+
+int main(void) {
+    ParticleCreateClass();
+    ParticleForceGeneratorCreateClass();
+    ParticleGravityCreateClass();
+    ParticleDragCreateClass();
+    ParticleBuoyancyCreateClass();
+    ParticleForceRegistryCreateClass();
+    ParticleForcePipelineCreateClass();
+
+    ParticleForceGenerator *gravity = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleGravityClass, &particleGravityClass, new_instance, GRAVITY);
+    ParticleForceGenerator *drag = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleDragClass, &particleDragClass, new_instance, 0.1, 0.01);
+    ParticleForceGenerator *buoyancy = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleBuoyancyClass, &particleBuoyancyClass, new_instance, 0.5, 0.002, 0.0, 1000.0);
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+
+    srand(3);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        particles[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], set,
+            (buVector3){random01() * 10, random01() * 4 - 2, random01() * 10},
+            (buVector3){random01() - (buReal)0.5, random01() * 5, random01() - (buReal)0.5},
+            (buVector3){0.0, 0.0, 0.0}, 0.99, (buReal)1.0 / (1 + random01()));
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], gravity);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], drag);
+        if (i % 2) INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], buoyancy);
+    }
+    ParticleForcePipeline *pipeline = CLASS_METHOD_AS(ParticleForcePipelineClass, &particleForcePipelineClass, new_instance, registry);
+
+    double start = buBenchNow();
+    INSTANCE_METHOD_AS(ParticleForcePipelineVTable, pipeline, build);
+    printf("%d particles, %zu generator lists (build %.1f ms)\n", NUMBER_OF_PARTICLES,
+        INSTANCE_METHOD_AS(ParticleForcePipelineVTable, pipeline, getStackCount), (buBenchNow() - start) * 1e3);
+
+    double registrySeconds = 0.0, pipelineSeconds = 0.0;
+    for (int r = 0; r < REPEATS; r++) {
+        clearForces();
+        start = buBenchNow();
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, DURATION);
+        registrySeconds += buBenchNow() - start;
+        buBenchClobber();
+        if (r == 0) {
+            for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+                reference[i] = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getForceAccum);
+            }
+        }
+
+        clearForces();
+        start = buBenchNow();
+        INSTANCE_METHOD_AS(ParticleForcePipelineVTable, pipeline, updateForces, DURATION);
+        pipelineSeconds += buBenchNow() - start;
+        buBenchClobber();
+    }
+
+    double maxDifference = 0.0;
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getForceAccum);
+        for (int k = 0; k < 3; k++) {
+            double difference = fabs((double)force.v[k] - (double)reference[i].v[k]);
+            if (difference > maxDifference) maxDifference = difference;
+        }
+    }
+
+    double ops = (double)NUMBER_OF_PARTICLES * REPEATS;
+    buBenchReport("registry updateForces", registrySeconds, ops, 0.0);
+    buBenchReport("pipeline updateForces", pipelineSeconds, ops, registrySeconds);
+    printf("  %-32s max |difference| %g\n", "", maxDifference);
+
+    buBenchSink = INSTANCE_METHOD_AS(ParticleVTable, particles[0], getForceAccum).y;
+    CLASS_METHOD_AS(ParticleForcePipelineClass, &particleForcePipelineClass, free, pipeline);
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "bench.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pfgen.h"
+#include "../src/budgie/pworld.h"
+#include "../src/budgie/pspringnet.h"
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Times a square cloth (structural springs along the grid plus both
+ * shear diagonals, about four springs per particle) from 10k up to a
+ * million springs, evaluated by a ParticleSpringNetwork and, as the
+ * baseline, by a ParticleForceRegistry of ParticlePairSprings on views
+ * of the same world particles. With OpenMP the network is also timed
+ * on every processor.
+ */
+
+#define DURATION ((buReal)1.0 / 60.0)
+
+static const int sides[] = {50, 159, 500};
+
+static double timeNetwork(ParticleSpringNetwork *network, ParticleWorld *world, int repeats) {
+    double seconds = 0.0;
+    for (int r = 0; r < repeats; r++) {
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, clearAccumulators);
+        double start = buBenchNow();
+        INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, updateForces, DURATION);
+        seconds += buBenchNow() - start;
+        buBenchClobber();
+    }
+    return seconds;
+}
+
+int main(void) {
+    ParticleCreateClass();
+    ParticleForceGeneratorCreateClass();
+    ParticlePairSpringCreateClass();
+    ParticleForceRegistryCreateClass();
+    ParticleWorldCreateClass();
+    ParticleSpringNetworkCreateClass();
+
+    int processors = 1;
+#ifdef _OPENMP
+    processors = omp_get_num_procs();
+#endif
+
+    for (size_t n = 0; n < sizeof(sides) / sizeof(sides[0]); n++) {
+        const int side = sides[n];
+        const size_t particles = (size_t)side * side;
+        ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, particles);
+        for (size_t i = 0; i < particles; i++) {
+            buVector3 position = {(buReal)(i % side) * 1.1f, (buReal)(i / side) * 0.9f, (buReal)(i % 7) * 0.01f};
+            INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, position, (buVector3){0.0, 0.0, 0.0}, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+        }
+
+        ParticleSpringNetwork *network = CLASS_METHOD_AS(ParticleSpringNetworkClass, &particleSpringNetworkClass, new_instance, world);
+        ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, reserve, 4 * particles);
+        ParticleForceGenerator **pairs = malloc(4 * particles * sizeof(ParticleForceGenerator *));
+        size_t springs = 0;
+        for (int y = 0; y < side; y++) {
+            for (int x = 0; x < side; x++) {
+                uint32_t i = (uint32_t)(y * side + x);
+                uint32_t others[4];
+                int count = 0;
+                if (x + 1 < side) others[count++] = i + 1;
+                if (y + 1 < side) others[count++] = i + side;
+                if (x + 1 < side && y + 1 < side) others[count++] = i + side + 1;
+                if (x > 0 && y + 1 < side) others[count++] = i + side - 1;
+                for (int o = 0; o < count; o++) {
+                    INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, addSpring, i, others[o], 5.0, 1.0);
+                    Particle *a = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i);
+                    Particle *b = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, others[o]);
+                    pairs[springs] = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticlePairSpringClass, &particlePairSpringClass, new_instance, a, b, 5.0, 1.0);
+                    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, a, pairs[springs]);
+                    springs++;
+                }
+            }
+        }
+
+        double start = buBenchNow();
+        INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, build);
+        double buildSeconds = buBenchNow() - start;
+        size_t colors = INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, getColorCount);
+        printf("%zu springs, %zu particles, %zu colours (build %.1f ms)\n", springs, particles, colors, buildSeconds * 1e3);
+
+        // Roughly the same total work for every size
+        int repeats = (int)(20000000 / springs);
+        if (repeats < 5) repeats = 5;
+
+        double registrySeconds = 0.0;
+        for (int r = 0; r < repeats; r++) {
+            INSTANCE_METHOD_AS(ParticleWorldVTable, world, clearAccumulators);
+            start = buBenchNow();
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, DURATION);
+            registrySeconds += buBenchNow() - start;
+            buBenchClobber();
+        }
+        buBenchReport("registry of pair springs", registrySeconds, (double)springs * repeats, 0.0);
+        buBenchReport("network, 1 thread", timeNetwork(network, world, repeats), (double)springs * repeats, registrySeconds);
+        if (processors > 1) {
+            char name[64];
+            snprintf(name, sizeof(name), "network, %d threads", processors);
+            INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, setThreadCount, (unsigned)processors);
+            buBenchReport(name, timeNetwork(network, world, repeats), (double)springs * repeats, registrySeconds);
+        }
+        buBenchSink = world->_arrays.forceAccum[1][particles / 2];
+
+        for (size_t s = 0; s < springs; s++) {
+            free(pairs[s]);
+        }
+        free(pairs);
+        CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+        CLASS_METHOD_AS(ParticleSpringNetworkClass, &particleSpringNetworkClass, free, network);
+        CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include "bench.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pfgen.h"
+#include <stdlib.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Times ParticleForceRegistry updateForces with 1 to N threads (see
+ * setThreadCount) on a spring mesh: every particle has gravity, drag
+ * and springs to two neighbours, so several registrations write to the
+ * same particle. N is the first argument, or the number of processors.
+ * Each case also reports the largest difference from the
+ * single-threaded forces.
+ */
+
+#define NUMBER_OF_PARTICLES 65536
+#define REPEATS 20
+#define DURATION ((buReal)1.0 / 60.0)
+
+static Particle *particles[NUMBER_OF_PARTICLES];
+static buVector3 reference[NUMBER_OF_PARTICLES];
+
+static buReal random01(void) {
+    return (buReal)rand() / RAND_MAX;
+}
+
+static void clearForces(void) {
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], clearAccumulator);
+    }
+}
+
+int main(int argc, char **argv) {
+    int maxThreads = 1;
+#ifdef _OPENMP
+    maxThreads = omp_get_num_procs();
+#endif
+    if (argc > 1) maxThreads = atoi(argv[1]);
+    if (maxThreads < 1) maxThreads = 1;
+
+    ParticleCreateClass();
+    ParticleForceGeneratorCreateClass();
+    ParticleGravityCreateClass();
+    ParticleDragCreateClass();
+    ParticleSpringCreateClass();
+    ParticleForceRegistryCreateClass();
+
+    srand(11);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        particles[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], set,
+            (buVector3){(buReal)(i % 256) + random01(), (buReal)(i / 256) + random01(), random01()},
+            (buVector3){random01() - (buReal)0.5, random01() - (buReal)0.5, random01() - (buReal)0.5},
+            (buVector3){0.0, 0.0, 0.0}, 0.99, (buReal)1.0 / (1 + random01()));
+    }
+
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    ParticleForceGenerator *gravity = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleGravityClass, &particleGravityClass, new_instance, GRAVITY);
+    ParticleForceGenerator *drag = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleDragClass, &particleDragClass, new_instance, 0.1, 0.01);
+    static ParticleForceGenerator *springs[2 * NUMBER_OF_PARTICLES];
+    size_t registrations = 0;
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], gravity); registrations++;
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], drag); registrations++;
+        int neighbours[2] = {(i + 1) % NUMBER_OF_PARTICLES, (i + 256) % NUMBER_OF_PARTICLES};
+        for (int n = 0; n < 2; n++) {
+            springs[2 * i + n] = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, new_instance, particles[neighbours[n]], 5.0, 1.0);
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], springs[2 * i + n]); registrations++;
+        }
+    }
+
+#ifdef _OPENMP
+    printf("updateForces, %zu registrations, OpenMP with %d processors\n", registrations, omp_get_num_procs());
+#else
+    printf("updateForces, %zu registrations, no OpenMP (chunks run serially)\n", registrations);
+#endif
+
+    clearForces();
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, DURATION);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        reference[i] = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getForceAccum);
+    }
+
+    double baseline = 0.0;
+    for (int threads = 1; threads <= maxThreads; threads++) {
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, setThreadCount, (unsigned)threads);
+
+        double seconds = 0.0;
+        for (int r = 0; r < REPEATS; r++) {
+            clearForces();
+            double start = buBenchNow();
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, DURATION);
+            seconds += buBenchNow() - start;
+            buBenchClobber();
+        }
+        if (threads == 1) baseline = seconds;
+
+        double maxDifference = 0.0;
+        for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+            buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getForceAccum);
+            for (int k = 0; k < 3; k++) {
+                double difference = fabs((double)force.v[k] - (double)reference[i].v[k]);
+                if (difference > maxDifference) maxDifference = difference;
+            }
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "%d thread%s", threads, threads == 1 ? "" : "s");
+        buBenchReport(name, seconds, (double)registrations * REPEATS, baseline);
+        printf("  %-32s max |difference| %g\n", "", maxDifference);
+    }
+
+    buBenchSink = INSTANCE_METHOD_AS(ParticleVTable, particles[0], getForceAccum).y;
+    return 0;
+}
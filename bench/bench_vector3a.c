@@ -0,0 +1,134 @@
+#include "bench.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/vector3a.h"
+#include <stdlib.h>
+
+/**
+ * Compares the packed buVector3 functions from core.c with the aligned
+ * buVector3A inline operations on the patterns that dominate the force
+ * generators (spring force) and the contact resolver (separating
+ * velocity and impulse application).
+ */
+
+#define COUNT 1024
+#define REPEATS 20000
+
+static buVector3 a[COUNT], b[COUNT], out[COUNT];
+static buVector3A aa[COUNT], ba[COUNT], outa[COUNT];
+
+static void fill(void) {
+    srand(1);
+    for (int i = 0; i < COUNT; i++) {
+        for (int k = 0; k < 3; k++) {
+            a[i].v[k] = (buReal)rand() / RAND_MAX - (buReal)0.5;
+            b[i].v[k] = (buReal)rand() / RAND_MAX + (buReal)0.5;
+        }
+        aa[i] = buVector3AFromVector3(a[i]);
+        ba[i] = buVector3AFromVector3(b[i]);
+    }
+}
+
+static double checksum(void) {
+    double s = 0.0;
+    for (int i = 0; i < COUNT; i++) {
+        s += out[i].x + out[i].y + out[i].z + outa[i].x + outa[i].y + outa[i].z;
+    }
+    return s;
+}
+
+// Spring: f = -k (|d| - rest) d/|d| with d = a - b
+static double springPacked(void) {
+    double start = buBenchNow();
+    for (int r = 0; r < REPEATS; r++) {
+        buBenchClobber();
+        for (int i = 0; i < COUNT; i++) {
+            buVector3 d = buVector3Difference(a[i], b[i]);
+            buReal magnitude = buVector3Norm(d);
+            out[i] = buVector3Scalar(buVector3Normalise(d), (buReal)-10.0 * (magnitude - (buReal)1.0));
+        }
+    }
+    return buBenchNow() - start;
+}
+
+static double springAligned(void) {
+    double start = buBenchNow();
+    for (int r = 0; r < REPEATS; r++) {
+        buBenchClobber();
+        for (int i = 0; i < COUNT; i++) {
+            buVector3A d = buVector3ADifference(aa[i], ba[i]);
+            buReal magnitude = buVector3ANorm(d);
+            outa[i] = buVector3AScalar(buVector3ANormalise(d), (buReal)-10.0 * (magnitude - (buReal)1.0));
+        }
+    }
+    return buBenchNow() - start;
+}
+
+// Resolver: separating velocity along the normal, then v += n * impulse
+static double impulsePacked(void) {
+    double start = buBenchNow();
+    for (int r = 0; r < REPEATS; r++) {
+        buBenchClobber();
+        for (int i = 0; i < COUNT; i++) {
+            buReal separating = buVector3Dot(a[i], b[i]);
+            out[i] = buVector3Add(a[i], buVector3Scalar(b[i], (buReal)-0.5 * separating));
+        }
+    }
+    return buBenchNow() - start;
+}
+
+static double impulseAligned(void) {
+    double start = buBenchNow();
+    for (int r = 0; r < REPEATS; r++) {
+        buBenchClobber();
+        for (int i = 0; i < COUNT; i++) {
+            buReal separating = buVector3ADot(aa[i], ba[i]);
+            outa[i] = buVector3AAddScaled(aa[i], ba[i], (buReal)-0.5 * separating);
+        }
+    }
+    return buBenchNow() - start;
+}
+
+static double crossPacked(void) {
+    double start = buBenchNow();
+    for (int r = 0; r < REPEATS; r++) {
+        buBenchClobber();
+        for (int i = 0; i < COUNT; i++) {
+            out[i] = buVector3Cross(a[i], b[i]);
+        }
+    }
+    return buBenchNow() - start;
+}
+
+static double crossAligned(void) {
+    double start = buBenchNow();
+    for (int r = 0; r < REPEATS; r++) {
+        buBenchClobber();
+        for (int i = 0; i < COUNT; i++) {
+            outa[i] = buVector3ACross(aa[i], ba[i]);
+        }
+    }
+    return buBenchNow() - start;
+}
+
+int main(void) {
+    double operations = (double)COUNT * REPEATS;
+    double baseline;
+
+    fill();
+    printf("buVector3 vs buVector3A (%d vectors x %d repeats, %s)\n", COUNT, REPEATS, sizeof(buReal) == sizeof(float) ? "float" : "double");
+
+    baseline = springPacked();
+    buBenchReport("spring force  buVector3", baseline, operations, 0.0);
+    buBenchReport("spring force  buVector3A", springAligned(), operations, baseline);
+
+    baseline = impulsePacked();
+    buBenchReport("impulse       buVector3", baseline, operations, 0.0);
+    buBenchReport("impulse       buVector3A", impulseAligned(), operations, baseline);
+
+    baseline = crossPacked();
+    buBenchReport("cross         buVector3", baseline, operations, 0.0);
+    buBenchReport("cross         buVector3A", crossAligned(), operations, baseline);
+
+    buBenchSink = checksum();
+    return 0;
+}
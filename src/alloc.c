@@ -0,0 +1,28 @@
+#include "budgie/alloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+void *buAlignedAlloc(size_t size) {
+    // Over-allocate and stash the pointer malloc gave us just in front of
+    // the aligned block so that buAlignedFree can recover it.
+    void *raw = malloc(size + BU_ALIGNMENT + sizeof(void *));
+    assert(raw);  // Check for allocation failure
+    uintptr_t aligned = ((uintptr_t)raw + sizeof(void *) + BU_ALIGNMENT - 1) & ~(uintptr_t)(BU_ALIGNMENT - 1);
+    ((void **)aligned)[-1] = raw;
+    return (void *)aligned;
+}
+
+void *buAlignedRealloc(void *ptr, size_t oldSize, size_t newSize) {
+    void *block = buAlignedAlloc(newSize);
+    if (ptr) {
+        memcpy(block, ptr, oldSize < newSize ? oldSize : newSize);
+        buAlignedFree(ptr);
+    }
+    return block;
+}
+
+void buAlignedFree(void *ptr) {
+    if (ptr) free(((void **)ptr)[-1]);
+}
@@ -0,0 +1,30 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+
+/**
+ * Alignment, in bytes, of the contiguous arrays used for bulk particle
+ * data. Wide enough for a full AVX register in either precision.
+ */
+#define BU_ALIGNMENT 32
+
+/**
+ * Allocates size bytes aligned to BU_ALIGNMENT. Memory must be released
+ * with buAlignedFree.
+ */
+void *buAlignedAlloc(size_t size);
+
+/**
+ * Grows (or shrinks) an aligned block, preserving the first
+ * min(oldSize, newSize) bytes. ptr may be NULL.
+ */
+void *buAlignedRealloc(void *ptr, size_t oldSize, size_t newSize);
+
+/**
+ * Releases a block returned by buAlignedAlloc/buAlignedRealloc. NULL is
+ * ignored.
+ */
+void buAlignedFree(void *ptr);
+
+#endif // ALLOC_H
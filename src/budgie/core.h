@@ -8,8 +8,6 @@ typedef union {
     buReal v[3];
 } buVector3;
 
-void buCopyFromTo(buVector3 from, buVector3 *to);
-
 typedef struct {
     buVector3 X;
     buVector3 Y;
@@ -26,6 +24,22 @@ typedef union {
     buReal data[4];
 } buQuaternion;
 
+/**
+ * The vector and quaternion helpers below are tiny and sit on every hot
+ * path, so when USE_INLINE_MATH is defined they are provided as static
+ * inline definitions (see core_inline.h) instead of calls into core.c.
+ * core.c always exports the out-of-line symbols as well. Define
+ * BU_NO_INLINE_MATH before including this header to force calls for a
+ * single translation unit.
+ */
+#if defined(USE_INLINE_MATH) && !defined(BU_NO_INLINE_MATH) && !defined(BU_CORE_IMPLEMENTATION)
+
+#define BU_MATH_API static inline
+#include "core_inline.h"
+
+#else
+
+void buCopyFromTo(buVector3 from, buVector3 *to);
 buReal buVector3Norm(buVector3 v);
 buReal buVector3SquareNorm(buVector3 v);
 buVector3 buVector3Normalise(buVector3 v);
@@ -40,5 +54,7 @@ void buNormaliseQuaternion(buQuaternion *q);
 buReal buQuaternionLength(buQuaternion q);
 buVector3 buDivideVectorComponents(buVector3 a, buVector3 b);
 
+#endif
+
 
 #endif // CORE_H
\ No newline at end of file
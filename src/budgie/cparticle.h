@@ -12,46 +12,49 @@ typedef struct Particle Particle;
 typedef struct ParticleClass ParticleClass;
 typedef struct ParticleVTable ParticleVTable;
 
-// methods of object
-struct ParticleVTable {
-    VTable base; // inherit from VTable
-
-    void (*integrate)(Particle *particle, buReal duration);
-    void (*set)(Particle *particle, buVector3 position, buVector3 velocity, buVector3 acceleration, buReal damping, buReal inverseMass);
-    void (*setMass)(Particle *particle, const buReal mass);
-    buReal (*getMass)(Particle *particle);
-    void (*setInverseMass)(Particle *particle, const buReal inverseMass);
-    buReal (*getInverseMass)(Particle *particle);
-    bool (*hasFiniteMass)(Particle *particle);
-    void (*setDamping)(Particle *particle, const buReal damping);
-    buReal (*getDamping)(Particle *particle);
-    void (*setPosition)(Particle *particle, const buVector3 position);
-    buVector3 (*getPosition)(Particle *particle);
-    void (*setVelocity)(Particle *particle, const buVector3 velocity);
-    buVector3 (*getVelocity)(Particle *particle);
-    void (*setAcceleration)(Particle *particle, const buVector3 acceleration);
-    buVector3 (*getAcceleration)(Particle *particle);
-    void (*clearAccumulator)(Particle *particle);
-    void (*addForce)(Particle *particle, const buVector3 force);
-    buVector3 (*getForceAccum)(Particle *particle);
+// fields of object
+#define PARTICLE_FIELDS(F) \
+    F(buReal, _inverseMass) \
+    F(buReal, _damping) \
+    F(buVector3, _position) \
+    F(buVector3, _initial_position) /* initial position */ \
+    F(buVector3, _velocity) \
+    F(buVector3, _forceAccum) \
+    F(buVector3, _acceleration)
 
-    buReal (*getKE)(Particle *particle);
-    buReal (*getPE)(Particle *particle, buReal y); // PE relative to y
-    buReal (*getEnergy)(Particle *particle); // KE + PE
-};
-
-typedef struct Particle {
-    Object base;
+// methods of object
+#define PARTICLE_METHODS(R, V, C) \
+    V(C, integrate, (Particle *self, buReal duration), (self, duration)) \
+    V(C, set, (Particle *self, buVector3 position, buVector3 velocity, buVector3 acceleration, buReal damping, buReal inverseMass), \
+        (self, position, velocity, acceleration, damping, inverseMass)) \
+    V(C, setMass, (Particle *self, const buReal mass), (self, mass)) \
+    R(C, buReal, getMass, (Particle *self), (self)) \
+    V(C, setInverseMass, (Particle *self, const buReal inverseMass), (self, inverseMass)) \
+    R(C, buReal, getInverseMass, (Particle *self), (self)) \
+    R(C, bool, hasFiniteMass, (Particle *self), (self)) \
+    V(C, setDamping, (Particle *self, const buReal damping), (self, damping)) \
+    R(C, buReal, getDamping, (Particle *self), (self)) \
+    V(C, setPosition, (Particle *self, const buVector3 position), (self, position)) \
+    R(C, buVector3, getPosition, (Particle *self), (self)) \
+    V(C, setVelocity, (Particle *self, const buVector3 velocity), (self, velocity)) \
+    R(C, buVector3, getVelocity, (Particle *self), (self)) \
+    V(C, setAcceleration, (Particle *self, const buVector3 acceleration), (self, acceleration)) \
+    R(C, buVector3, getAcceleration, (Particle *self), (self)) \
+    V(C, clearAccumulator, (Particle *self), (self)) \
+    V(C, addForce, (Particle *self, const buVector3 force), (self, force)) \
+    R(C, buVector3, getForceAccum, (Particle *self), (self)) \
+    R(C, buReal, getKE, (Particle *self), (self)) \
+    R(C, buReal, getPE, (Particle *self, buReal y), (self, y)) /* PE relative to y */ \
+    R(C, buReal, getEnergy, (Particle *self), (self)) /* KE + PE */
 
-    // private
-    buReal _inverseMass;
-    buReal _damping;
-    buVector3 _position;
-    buVector3 _initial_position; // initial position
-    buVector3 _velocity;
-    buVector3 _forceAccum;
-    buVector3 _acceleration; 
-} Particle;
+/**
+ * Generates struct ParticleVTable, struct Particle, and the direct
+ * wrappers Particle_integrate(), Particle_getPosition(), ... Use those
+ * only on objects known to be plain Particles; anything that may be a
+ * subclass (WorldParticle views, for example) goes through
+ * INSTANCE_METHOD_AS(ParticleVTable, ...).
+ */
+OOP_DEFINE_CLASS(Particle, Object, PARTICLE_FIELDS, PARTICLE_METHODS)
 
 typedef struct ParticleClass {
     Class base; // inherit from Class
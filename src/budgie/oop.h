@@ -15,9 +15,78 @@
 
 #define UNUSED(x) (void)(x)
 
+/**
+ * X-macro class definitions.
+ *
+ * A class lists its fields and methods once:
+ *
+ *     #define FOO_FIELDS(F) \
+ *         F(int, _size)
+ *
+ *     #define FOO_METHODS(R, V, C) \
+ *         R(C, int, getSize, (Foo *self), (self)) \
+ *         V(C, setSize, (Foo *self, int size), (self, size))
+ *
+ * R is used for methods returning a value and V for void methods; C is
+ * passed through untouched. OOP_DEFINE_CLASS(Foo, Object, FOO_FIELDS,
+ * FOO_METHODS) then generates
+ *
+ *     struct FooVTable    parent vtable as base, one pointer per method
+ *     struct Foo          parent object as base, then the fields
+ *     Foo_getSize_impl    prototypes of the implementations, which the
+ *                         class's .c file defines
+ *     Foo_getSize(self)   static inline wrappers calling the
+ *                         implementation directly
+ *
+ * and OOP_VTABLE_INIT(FOO_METHODS, Foo, foo_vtable) fills a vtable
+ * with the implementations in CreateClass.
+ *
+ * The direct wrappers skip the klass->vtable->method loads and the
+ * indirect call, so they may only be used where the object is known to
+ * be exactly that class (not a subclass that overrides the method).
+ * Polymorphic call sites keep using INSTANCE_METHOD_AS, which works
+ * unchanged on the generated vtable.
+ */
+#define OOP_FIELD(type, name) type name;
+
+#define OOP_METHOD_POINTER(C, ret, name, params, args) ret (*name) params;
+#define OOP_METHOD_POINTER_VOID(C, name, params, args) void (*name) params;
+#define OOP_VTABLE_MEMBERS(METHODS, C) METHODS(OOP_METHOD_POINTER, OOP_METHOD_POINTER_VOID, C)
+
+#define OOP_METHOD_IMPL(C, ret, name, params, args) ret C##_##name##_impl params;
+#define OOP_METHOD_IMPL_VOID(C, name, params, args) void C##_##name##_impl params;
+#define OOP_DECLARE_IMPLS(METHODS, C) METHODS(OOP_METHOD_IMPL, OOP_METHOD_IMPL_VOID, C)
+
+#define OOP_METHOD_DIRECT(C, ret, name, params, args) \
+    static inline ret C##_##name params { return C##_##name##_impl args; }
+#define OOP_METHOD_DIRECT_VOID(C, name, params, args) \
+    static inline void C##_##name params { C##_##name##_impl args; }
+#define OOP_DIRECT_METHODS(METHODS, C) METHODS(OOP_METHOD_DIRECT, OOP_METHOD_DIRECT_VOID, C)
+
+#define OOP_METHOD_INIT(C, ret, name, params, args) oop_vtable->name = C##_##name##_impl;
+#define OOP_METHOD_INIT_VOID(C, name, params, args) oop_vtable->name = C##_##name##_impl;
+#define OOP_VTABLE_INIT(METHODS, C, vtable) \
+    do { \
+        C##VTable *oop_vtable = &(vtable); \
+        METHODS(OOP_METHOD_INIT, OOP_METHOD_INIT_VOID, C) \
+    } while (0)
+
+#define OOP_DEFINE_CLASS(C, PARENT, FIELDS, METHODS) \
+    struct C##VTable { \
+        PARENT##VTable base; \
+        OOP_VTABLE_MEMBERS(METHODS, C) \
+    }; \
+    struct C { \
+        PARENT base; \
+        FIELDS(OOP_FIELD) \
+    }; \
+    OOP_DECLARE_IMPLS(METHODS, C) \
+    OOP_DIRECT_METHODS(METHODS, C)
+
 typedef struct Object Object;
 typedef struct Class Class;
 typedef struct VTable VTable;
+typedef VTable ObjectVTable; // so root classes can name Object as their parent
 
 struct VTable {
     const char* (*get_name)(Object *self);
@@ -4,6 +4,8 @@
 #include "oop.h"
 #include "core.h"
 #include "cparticle.h"
+#include <limits.h>
+#include <stdint.h>
 
 /**
  * A Contact represents two objects in contact (in this case
@@ -19,60 +21,277 @@ typedef struct ParticleContact ParticleContact;
 typedef struct ParticleContactClass ParticleContactClass;
 typedef struct ParticleContactVTable ParticleContactVTable;
 
-typedef struct ParticleContact {
+#define PARTICLE_CONTACT_FIELDS(F) \
+    /** \
+     * Holds the particles that are involved in the contact. The \
+     * second of these can be NULL, for contacts with the scenery. \
+     */ \
+    F(Particle*, _particle[2]) \
+    \
+    /** \
+     * Holds the normal restitution coefficient at the contact. \
+     */ \
+    F(buReal, _restitution) \
+    \
+    /** \
+     * Holds the direction of the contact in world coordinates. \
+     */ \
+    F(buVector3, _contactNormal) \
+    \
+    /** \
+     * Holds the depth of penetration at the contact. \
+     */ \
+    F(buReal, _penetration) \
+    \
+    /** \
+     * Holds the amount each particle is moved by during interpenetration \
+     * resolution. \
+     */ \
+    F(buVector3, _particleMovement[2]) \
+    \
+    /** \
+     * Identifies the contact between its two particles across steps, \
+     * together with the pair, for the ParticleContactCache: for \
+     * example the corner of a body or the index of a link. 0 for \
+     * new contacts. \
+     */ \
+    F(unsigned, _feature) \
+    \
+    /** \
+     * Holds the impulse applied along the normal by the last call of \
+     * resolveContacts, including any warm start. \
+     */ \
+    F(buReal, _impulse)
+
+#define PARTICLE_CONTACT_METHODS(R, V, C) \
+    /** \
+     * Resolves this contact, for both velocity and interpenetration. \
+     */ \
+    V(C, resolve, (ParticleContact *self, buReal duration), (self, duration)) \
+    \
+    /** \
+     * Calculates the separating velocity at this contact. \
+     */ \
+    R(C, buReal, calculateSeparatingVelocity, (ParticleContact *self), (self))
+
+/**
+ * ParticleContact is not subclassed, so the resolver calls it through
+ * the generated direct wrappers ParticleContact_resolve() and
+ * ParticleContact_calculateSeparatingVelocity().
+ */
+OOP_DEFINE_CLASS(ParticleContact, Object, PARTICLE_CONTACT_FIELDS, PARTICLE_CONTACT_METHODS)
+
+typedef struct ParticleContactClass {
+    Class base; // inherit from Class
+    
+    const char *class_name; // class name
+    const char *(*get_name)(ParticleContactClass *cls);
+} ParticleContactClass;
+
+extern ParticleContactClass particleContactClass;
+void ParticleContactCreateClass();
+
+#define PCR_NONE UINT_MAX
+
+/**
+ * One contact in a ParticleContactBuffer: only what the resolver
+ * reads and writes on every iteration, packed so a buffer of them is
+ * one contiguous array. The fields mean the same as in
+ * ParticleContact.
+ */
+typedef struct ParticleContactRecord {
+    Particle *particle[2];   // the second is NULL for contacts with the scenery
+    buVector3 contactNormal;
+    buReal penetration;
+    buReal restitution;
+    buReal impulse;          // set by the resolver
+    unsigned feature;
+} ParticleContactRecord;
+
+typedef struct ParticleContactBuffer ParticleContactBuffer;
+typedef struct ParticleContactBufferClass ParticleContactBufferClass;
+typedef struct ParticleContactBufferVTable ParticleContactBufferVTable;
+
+/**
+ * A reusable, contiguous array of contacts for generators to append
+ * to and the resolver to consume directly (see resolveBuffer),
+ * instead of an array of pointers to separately allocated
+ * ParticleContact objects. The records hold the hot fields; the
+ * movement each resolution applies to the particles, only needed
+ * while resolving, is kept in a parallel scratch array. clear keeps
+ * the memory, so a buffer refilled every step stops allocating once
+ * it has grown to the largest contact count.
+ *
+ * appendContacts and storeContacts adapt code that still builds
+ * ParticleContact objects: copy them in, resolve the buffer, and copy
+ * the results back out.
+ */
+typedef struct ParticleContactBuffer {
     Object base;
 
+    // private
+    ParticleContactRecord *_records;
+    buVector3 (*_movement)[2];  // scratch: the particle movement of each record's last resolution
+    unsigned _count;
+    unsigned _capacity;
+    ParticleContact *_contacts; // scratch: contacts of a generator without addContactsToBuffer, before they are appended
+    unsigned _contactCapacity;
+} ParticleContactBuffer;
+
+typedef struct ParticleContactBufferVTable {
+    VTable base;
+
+    /**
+     * Makes sure the buffer can hold at least capacity contacts
+     * without reallocating.
+     */
+    void (*reserve)(ParticleContactBuffer *self, unsigned capacity);
+
+    /**
+     * Empties the buffer, keeping its memory.
+     */
+    void (*clear)(ParticleContactBuffer *self);
+
     /**
-     * Holds the particles that are involved in the contact. The
-     * second of these can be NULL, for contacts with the scenery.
+     * Returns the number of contacts in the buffer.
      */
-    Particle* _particle[2];
+    unsigned (*getCount)(const ParticleContactBuffer *self);
 
     /**
-     * Holds the normal restitution coefficient at the contact.
+     * Returns contact index. The pointer is valid until the next
+     * append or reserve.
      */
-    buReal _restitution;
+    ParticleContactRecord *(*get)(ParticleContactBuffer *self, unsigned index);
 
     /**
-     * Holds the direction of the contact in world coordinates.
+     * Adds a contact and returns it to be filled in: without
+     * particles, feature 0 and no penetration. The pointer is valid
+     * until the next append or reserve.
      */
-    buVector3 _contactNormal;
+    ParticleContactRecord *(*append)(ParticleContactBuffer *self);
 
     /**
-     * Holds the depth of penetration at the contact.
+     * Appends a copy of each of the given contacts, in order.
      */
-    buReal _penetration;
+    void (*appendContacts)(ParticleContactBuffer *self, ParticleContact **contactArray, unsigned numContacts);
 
     /**
-     * Holds the amount each particle is moved by during interpenetration
-     * resolution.
+     * Copies the penetration, impulse and particle movement of the
+     * contacts from index first on back into the given contacts, the
+     * reverse of appendContacts.
      */
-    buVector3 _particleMovement[2];
-} ParticleContact;
+    void (*storeContacts)(const ParticleContactBuffer *self, unsigned first, ParticleContact **contactArray, unsigned numContacts);
+} ParticleContactBufferVTable;
+
+typedef struct ParticleContactBufferClass {
+    Class base; // inherit from Class
+
+    const char *class_name; // class name
+    const char *(*get_name)(ParticleContactBufferClass *cls);
+} ParticleContactBufferClass;
+
+extern ParticleContactBufferClass particleContactBufferClass;
+void ParticleContactBufferCreateClass();
 
-typedef struct ParticleContactVTable {
+/**
+ * Remembers the impulse every contact received across steps, keyed
+ * by its particle pair (in order) and feature id, so contacts that
+ * persist, such as those of resting and stacked particles, can be
+ * warm started: before resolving, a contact found in the cache is
+ * given last step's impulse again, scaled by the warm start factor
+ * and by how far its normal turned. The resolver then only has to
+ * correct what changed since the last step, so a stack settles with
+ * far fewer iterations and jitters less.
+ *
+ * Contacts that are already separating, such as one that just
+ * bounced, are not warm started. As the resolver can only push
+ * contacts apart, never take an impulse back, a warm start factor
+ * of 1 would let the cached impulses grow and push stacks apart; the
+ * default of 0.9 lets them settle just below what holds the stack.
+ *
+ * Set a cache on a ParticleContactResolver with setCache. Contacts
+ * not passed to the last resolveContacts are forgotten. Keys should
+ * be unique within one call; of duplicates, the first is kept.
+ */
+typedef struct ParticleContactCache ParticleContactCache;
+typedef struct ParticleContactCacheClass ParticleContactCacheClass;
+typedef struct ParticleContactCacheVTable ParticleContactCacheVTable;
+
+typedef struct ParticleContactCacheEntry {
+    Particle *particle[2];
+    unsigned feature;
+    buVector3 normal;
+    buReal impulse;
+} ParticleContactCacheEntry;
+
+typedef struct ParticleContactCache {
+    Object base;
+
+    // private
+    ParticleContactCacheEntry *_entries;
+    unsigned _count;
+    unsigned _capacity;
+    unsigned *_table;       // open-addressed key -> entry, PCR_NONE if empty
+    unsigned _tableSize;    // power of two
+    buReal _warmStartFactor;
+    unsigned _hits;         // contacts warm started by the last call
+} ParticleContactCache;
+
+typedef struct ParticleContactCacheVTable {
     VTable base;
 
     /**
-     * Resolves this contact, for both velocity and interpenetration.
+     * Sets the fraction of the cached impulse applied as the warm
+     * start, from 0 (off) to 1; 0.9 by default.
      */
-    void (*resolve)(ParticleContact *self, buReal duration);
+    void (*setWarmStartFactor)(ParticleContactCache *self, buReal factor);
 
     /**
-     * Calculates the separating velocity at this contact.
+     * Returns the number of contacts remembered.
      */
-    buReal (*calculateSeparatingVelocity)(ParticleContact *self);
-} ParticleContactVTable;
+    unsigned (*getCount)(const ParticleContactCache *self);
 
-typedef struct ParticleContactClass {
+    /**
+     * Returns how many contacts the last warmStart found in the cache.
+     */
+    unsigned (*getHitCount)(const ParticleContactCache *self);
+
+    /**
+     * Sets the impulse of every contact to its warm start, applying
+     * it to the particles, or to 0 for contacts not in the cache.
+     */
+    void (*warmStart)(ParticleContactCache *self, ParticleContact **contactArray, unsigned numContacts);
+
+    /**
+     * Replaces the cache with the impulses of the given contacts.
+     */
+    void (*store)(ParticleContactCache *self, ParticleContact **contactArray, unsigned numContacts);
+
+    /**
+     * warmStart for the contacts of a buffer.
+     */
+    void (*warmStartBuffer)(ParticleContactCache *self, ParticleContactBuffer *buffer);
+
+    /**
+     * store for the contacts of a buffer.
+     */
+    void (*storeBuffer)(ParticleContactCache *self, const ParticleContactBuffer *buffer);
+
+    /**
+     * Forgets every contact.
+     */
+    void (*clear)(ParticleContactCache *self);
+} ParticleContactCacheVTable;
+
+typedef struct ParticleContactCacheClass {
     Class base; // inherit from Class
-    
+
     const char *class_name; // class name
-    const char *(*get_name)(ParticleContactClass *cls);
-} ParticleContactClass;
+    const char *(*get_name)(ParticleContactCacheClass *cls);
+} ParticleContactCacheClass;
 
-extern ParticleContactClass particleContactClass;
-void ParticleContactCreateClass();
+extern ParticleContactCacheClass particleContactCacheClass;
+void ParticleContactCacheCreateClass();
 
 /**
  * The contact resolution routine for particle contacts. One
@@ -82,6 +301,77 @@ typedef struct ParticleContactResolver ParticleContactResolver;
 typedef struct ParticleContactResolverClass ParticleContactResolverClass;
 typedef struct ParticleContactResolverVTable ParticleContactResolverVTable;
 
+/**
+ * How resolveContacts finds the contact with the largest closing
+ * velocity on each iteration.
+ */
+typedef enum ParticleContactResolverMode {
+    /**
+     * Recomputes the separating velocity of every contact on every
+     * iteration. Cheapest for a handful of contacts.
+     */
+    PCR_MODE_SCAN,
+
+    /**
+     * Keeps the contacts in an indexed min-heap keyed by separating
+     * velocity, and after each resolution re-keys only the contacts
+     * that share a particle with the one just resolved. Resolves the
+     * contacts in exactly the order PCR_MODE_SCAN does, ties going to
+     * the lowest index.
+     */
+    PCR_MODE_HEAP,
+
+    /**
+     * Colours the contacts so that no two of a colour share a
+     * particle, then sweeps over the colours, resolving every contact
+     * of a colour that is closing or interpenetrating by more than
+     * the tolerance (see setTolerance) in parallel (see
+     * setThreadCount). Sweeps repeat until one finds nothing to
+     * resolve, or the iteration budget, counted in resolutions, runs
+     * out at the end of a colour. A contact's penetration is
+     * recomputed from the movement of its own particles before it is
+     * resolved, so the result does not depend on the thread count,
+     * but it differs from the sequential modes, which always resolve
+     * the worst contact first.
+     */
+    PCR_MODE_COLORED,
+
+    /**
+     * Splits the contacts into islands, the connected groups of
+     * contacts that share particles (found by union-find), and solves
+     * each island as PCR_MODE_HEAP would on its own. Every island
+     * has its own budget, its share of setIterations in proportion to
+     * its contacts (rounded up), so one busy island cannot starve the
+     * others. Islands are handed to setThreadCount threads as
+     * independent jobs. An island where no contact is closing or
+     * interpenetrating by more than the tolerance is at rest and
+     * skipped. As islands cannot affect each other, this gives the
+     * PCR_MODE_SCAN result whenever neither the budget nor the
+     * tolerance cuts the scan short. See getIsland for what is
+     * recorded about each island.
+     */
+    PCR_MODE_ISLANDS
+} ParticleContactResolverMode;
+
+/**
+ * What PCR_MODE_ISLANDS recorded about one island in the last call of
+ * resolveContacts.
+ */
+typedef struct ParticleContactIsland {
+    unsigned begin;          // first contact of the island in the resolver's island order
+    unsigned contactCount;
+    unsigned particleCount;
+    unsigned iterationsUsed;
+    bool resting;            // skipped, nothing to resolve
+    double seconds;          // time spent on the island
+} ParticleContactIsland;
+
+/**
+ * Most colours PCR_MODE_COLORED hands out; contacts that do not fit go
+ * into a final batch that is resolved on one thread.
+ */
+#define PCR_MAX_COLORS 64
+
 typedef struct ParticleContactResolver {
     Object base;
 
@@ -95,6 +385,58 @@ typedef struct ParticleContactResolver {
      * of the actual number of iterations used.
      */
     unsigned _iterationsUsed;
+
+    /**
+     * Holds how the next contact to resolve is found.
+     */
+    ParticleContactResolverMode _mode;
+
+    // Scratch, grown to the largest contact count seen
+    unsigned _capacity;
+
+    // Particle -> contact adjacency, rebuilt by every resolveContacts:
+    // the particles get dense ids, and the contacts touching particle
+    // id are _adjacency[_adjacencyStart[id] .. _adjacencyStart[id + 1])
+    unsigned *_contactEnds;       // 2 per contact: particle ids, PCR_NONE for no particle
+    unsigned *_adjacencyStart;
+    unsigned *_adjacency;         // contact indices, ascending for each particle
+    Particle **_particles;        // id -> particle
+    unsigned *_particleTable;     // open-addressed particle -> id, PCR_NONE if empty
+    unsigned _particleTableSize;  // power of two
+
+    // PCR_MODE_HEAP
+    unsigned *_heap;              // contact indices, worst first
+    unsigned *_heapPosition;      // contact index -> position in _heap
+    buReal *_separatingVelocity;  // contact index -> heap key
+    bool *_resolvable;            // contact index -> closing or interpenetrating
+    unsigned *_touched;           // contacts sharing a particle with the last one resolved
+
+    // PCR_MODE_COLORED
+    unsigned _threadCount;
+    buReal _tolerance;
+    unsigned _sweepsUsed;         // sweeps over all colours in the last call
+    uint64_t *_particleColors;    // particle id -> colours taken
+    unsigned *_colorOrder;        // contact indices sorted by colour
+    unsigned _colorStart[PCR_MAX_COLORS + 2]; // colour c is _colorOrder[_colorStart[c] .. _colorStart[c + 1])
+    unsigned _colorCount;
+    bool _overflow;               // the last colour may share particles and runs serially
+    buReal *_basePenetration;     // contact index -> penetration when the call started
+    buVector3 *_displacement;     // particle id -> movement since the call started
+
+    ParticleContactCache *_cache; // warm starts the contacts, or NULL
+
+    // PCR_MODE_ISLANDS
+    unsigned *_islandParent;      // particle id -> union-find parent, then island
+    ParticleContact **_islandContacts; // the contacts sorted by island
+    ParticleContactIsland *_islands;
+    unsigned _islandCount;
+
+    // resolveBuffer works on a copy of the particle state, by id
+    unsigned *_recordEnds;        // record -> particle ids, the second PCR_NONE only without a second particle
+    buVector3 *_statePosition;
+    buVector3 *_stateVelocity;
+    buVector3 *_stateAcceleration;
+    buReal *_stateInverseMass;
 } ParticleContactResolver;
 
 typedef struct ParticleContactResolverVTable {
@@ -105,10 +447,57 @@ typedef struct ParticleContactResolverVTable {
      */
     void (*setIterations)(ParticleContactResolver *self, unsigned iterations);
 
+    /**
+     * Selects how the next contact to resolve is found
+     * (PCR_MODE_SCAN by default). The scan and the heap give the
+     * same result.
+     */
+    void (*setMode)(ParticleContactResolver *self, ParticleContactResolverMode mode);
+
+    /**
+     * Sets how many threads PCR_MODE_COLORED and PCR_MODE_ISLANDS
+     * use (1 by default).
+     * Without OpenMP everything runs on the calling thread.
+     */
+    void (*setThreadCount)(ParticleContactResolver *self, unsigned threads);
+
+    /**
+     * Sets the closing velocity and penetration PCR_MODE_COLORED
+     * leaves unresolved, and below which PCR_MODE_ISLANDS considers an
+     * island at rest (0 by default).
+     */
+    void (*setTolerance)(ParticleContactResolver *self, buReal tolerance);
+
+    /**
+     * Returns the number of islands the last PCR_MODE_ISLANDS call of
+     * resolveContacts found.
+     */
+    unsigned (*getIslandCount)(const ParticleContactResolver *self);
+
+    /**
+     * Returns what the last PCR_MODE_ISLANDS call recorded about
+     * island index, numbered in order of each island's first contact.
+     */
+    const ParticleContactIsland *(*getIsland)(const ParticleContactResolver *self, unsigned index);
+
+    /**
+     * Sets the cache resolveContacts warm starts the contacts from
+     * and stores their impulses in, or NULL for none (the default).
+     * The cache is not owned by the resolver.
+     */
+    void (*setCache)(ParticleContactResolver *self, ParticleContactCache *cache);
+
     /**
      * Resolves a set of particle contacts for both penetration
      * and velocity.
      *
+     * Every contact's impulse is reset, or set to its warm start
+     * when a cache is set, before resolution starts.
+     *
+     * Contacts are linked through the particles they share, compared
+     * by pointer: after each resolution only the contacts sharing a
+     * particle with the resolved one have their penetration updated.
+     *
      * Contacts that cannot interact with each other should be
      * passed to separate calls to resolveContacts, as the
      * resolution algorithm takes much longer for lots of contacts
@@ -138,6 +527,20 @@ typedef struct ParticleContactResolverVTable {
         unsigned numContacts,
         buReal duration);
 
+    /**
+     * Resolves the contacts of a buffer in place, as resolveContacts
+     * would resolve the same contacts as objects in PCR_MODE_HEAP,
+     * whatever the mode: the contacts are resolved worst first and the
+     * result is the same. The resolver works on the records directly,
+     * without following a pointer to each contact, and on a copy of
+     * the state of the particles they touch: the positions, velocities,
+     * accelerations and inverse masses are gathered once into arrays,
+     * every velocity change and position correction is made there, and
+     * the positions and velocities are written back to the particles
+     * when the buffer has been resolved.
+     */
+    void (*resolveBuffer)(ParticleContactResolver *self, ParticleContactBuffer *buffer, buReal duration);
+
 } ParticleContactResolverVTable;
 
 typedef struct ParticleContactResolverClass {
@@ -182,6 +585,15 @@ typedef struct ParticleContactGeneratorVTable {
      */
     unsigned (*addContact)(ParticleContactGenerator *self, ParticleContact *contact,
                                 unsigned limit);
+
+    /**
+     * Appends the generated contacts to a buffer, at most limit of
+     * them, and returns how many were added. By default this goes
+     * through addContact, into scratch the buffer keeps for the next
+     * call; generators that can write records directly override it.
+     */
+    unsigned (*addContactsToBuffer)(ParticleContactGenerator *self, ParticleContactBuffer *buffer,
+                                unsigned limit);
 } ParticleContactGeneratorVTable;
 
 
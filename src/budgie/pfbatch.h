@@ -0,0 +1,47 @@
+#ifndef PFBATCH_H
+#define PFBATCH_H
+
+#include "precision.h"
+#include "core.h"
+#include <stddef.h>
+
+/**
+ * Batch kernels for the velocity- and position-dependent built-in
+ * force generators, over structure-of-arrays particle state. Every
+ * particle i in [begin, end) shares one generator's parameters, and
+ * its force is added to force[k][i], so the world's forceAccum arrays
+ * can be passed directly.
+ *
+ * The per-particle branches of the generators become lane masks:
+ * particles a generator would skip get a zero force. The scalar and
+ * SIMD kernels perform the same operations in the same order, so they
+ * produce bit-identical results.
+ */
+
+/**
+ * ParticleDrag: force = -(velocity / |velocity|) * (k1 + k2) * |velocity|.
+ * Particles at rest get no force.
+ */
+void buDragForcesScalar(buReal *const velocity[3], buReal k1, buReal k2, buReal *const force[3], size_t begin, size_t end);
+void buDragForcesSIMD(buReal *const velocity[3], buReal k1, buReal k2, buReal *const force[3], size_t begin, size_t end);
+void buDragForces(buReal *const velocity[3], buReal k1, buReal k2, buReal *const force[3], size_t begin, size_t end);
+
+/**
+ * ParticleBuoyancy, from the height (y coordinate) of every particle:
+ * nothing above waterHeight + maxDepth, liquidDensity * volume below
+ * waterHeight - maxDepth, and the partly submerged force in between.
+ * Only the y component is affected, so forceY is forceAccum[1].
+ */
+void buBuoyancyForcesScalar(const buReal *height, buReal maxDepth, buReal volume, buReal waterHeight, buReal liquidDensity, buReal *forceY, size_t begin, size_t end);
+void buBuoyancyForcesSIMD(const buReal *height, buReal maxDepth, buReal volume, buReal waterHeight, buReal liquidDensity, buReal *forceY, size_t begin, size_t end);
+void buBuoyancyForces(const buReal *height, buReal maxDepth, buReal volume, buReal waterHeight, buReal liquidDensity, buReal *forceY, size_t begin, size_t end);
+
+/**
+ * ParticleAnchoredBungee: pulls every particle further than restLength
+ * from the anchor back towards it. Slack particles get no force.
+ */
+void buAnchoredBungeeForcesScalar(buReal *const position[3], buVector3 anchor, buReal springConstant, buReal restLength, buReal *const force[3], size_t begin, size_t end);
+void buAnchoredBungeeForcesSIMD(buReal *const position[3], buVector3 anchor, buReal springConstant, buReal restLength, buReal *const force[3], size_t begin, size_t end);
+void buAnchoredBungeeForces(buReal *const position[3], buVector3 anchor, buReal springConstant, buReal restLength, buReal *const force[3], size_t begin, size_t end);
+
+#endif // PFBATCH_H
@@ -6,6 +6,9 @@
 #include "cparticle.h"
 #include "vector.h"
 #include "oop.h"
+#include "pworld.h"
+#include <stddef.h>
+#include <stdint.h>
 
 extern const buVector3 GRAVITY;
 
@@ -21,8 +24,29 @@ struct ParticleForceGeneratorVTable {
     VTable base; // inherit from VTable
 
     void (*updateForce)(const ParticleForceGenerator *self, Particle *particle, buReal duration);
+
+    /**
+     * Applies the generator to count particles at once. The default
+     * calls updateForce for each; ParticleBuoyancy and
+     * ParticleAnchoredBungee gather the particles' state in blocks and
+     * evaluate them with the batch kernels in pfbatch.h.
+     */
+    void (*updateForceBatch)(const ParticleForceGenerator *self, Particle *const *particles, size_t count, buReal duration);
+
+    /**
+     * Applies the generator to the particles [begin, end) of a world.
+     * ParticleDrag, ParticleBuoyancy and ParticleAnchoredBungee run
+     * their batch kernel straight over the world arrays; the default
+     * calls updateForce on each particle's view.
+     */
+    void (*updateWorldForces)(const ParticleForceGenerator *self, ParticleWorld *world, size_t begin, size_t end, buReal duration);
 };
 
+/**
+ * Number of particles updateForceBatch gathers per kernel call.
+ */
+#define PFG_BATCH_SIZE 64
+
 typedef struct ParticleForceGenerator {
     Object base;
 } ParticleForceGenerator;
@@ -34,6 +58,8 @@ struct ParticleForceGeneratorClass {
     const char *(*get_name)(const ParticleForceGeneratorClass *cls);
 };
 
+extern ParticleForceGeneratorClass particleForceGeneratorClass;
+extern ParticleForceGeneratorVTable pfg_vtable;
 void ParticleForceGeneratorCreateClass();
 
 ///////////////////////////////////////////////////////////////////
@@ -93,6 +119,9 @@ struct ParticleDragClass {
     void (*free)(const ParticleDragClass *cls, ParticleDrag *self);
 };
 
+extern ParticleDragClass particleDragClass; // singleton object is the class
+void ParticleDragCreateClass();
+
 ///////////////////////////////////////////////////////////////////
 // ParticleAnchoredSpring - applies a spring force to a particle
 ///////////////////////////////////////////////////////////////////
@@ -152,6 +181,9 @@ struct ParticleAnchoredBungeeClass {
     void (*free)(const ParticleAnchoredBungeeClass *cls, ParticleAnchoredBungee *self);
 };
 
+extern ParticleAnchoredBungeeClass particleAnchoredBungeeClass; // singleton object is the class
+void ParticleAnchoredBungeeCreateClass();
+
 ///////////////////////////////////////////////////////////////////
 // ParticleFakeSpring - applies a fake spring force to a particle
 ///////////////////////////////////////////////////////////////////
@@ -180,6 +212,9 @@ struct ParticleFakeSpringClass {
     void (*free)(const ParticleFakeSpringClass *cls, ParticleFakeSpring *self);
 };
 
+extern ParticleFakeSpringClass particleFakeSpringClass; // singleton object is the class
+void ParticleFakeSpringCreateClass();
+
 ///////////////////////////////////////////////////////////////////
 // ParticleSpring - applies a Spring force to a particle
 ///////////////////////////////////////////////////////////////////
@@ -246,6 +281,83 @@ struct ParticleBungeeClass {
     void (*free)(const ParticleBungeeClass *cls, ParticleBungee *self);
 };
 
+extern ParticleBungeeClass particleBungeeClass; // singleton object is the class
+void ParticleBungeeCreateClass();
+
+///////////////////////////////////////////////////////////////////
+// ParticlePairSpring - a spring between two particles, applying
+// equal and opposite forces to both ends in one evaluation.
+///////////////////////////////////////////////////////////////////
+typedef struct ParticlePairSpring ParticlePairSpring;
+typedef struct ParticlePairSpringClass ParticlePairSpringClass;
+typedef struct ParticlePairSpringVTable ParticlePairSpringVTable;
+
+struct ParticlePairSpringVTable {
+    ParticleForceGeneratorVTable base; // Application base VTable
+};
+
+/**
+ * Replaces the two ParticleSpring instances (one registered on each
+ * end) that a link otherwise needs. Register it once, on either end;
+ * updateForce then adds the force to _particle[0] and its opposite to
+ * _particle[1], whichever end it is called with.
+ */
+struct ParticlePairSpring {
+    ParticleForceGenerator base;
+
+    Particle *_particle[2]; /** The particles at the two ends of the spring. */
+    buReal _springConstant; /** Holds the spring constant. */
+    buReal _restLength; /** Holds the rest length of the spring. */
+};
+
+struct ParticlePairSpringClass {
+    ParticleForceGeneratorClass base;
+
+    const char *class_name; // class name
+    const char *(*get_name)(const ParticlePairSpringClass *cls);
+    ParticlePairSpring *(*new_instance)(const ParticlePairSpringClass *cls, Particle *first, Particle *second, buReal springConstant, buReal restLength);
+    void (*free)(const ParticlePairSpringClass *cls, ParticlePairSpring *self);
+};
+
+extern ParticlePairSpringClass particlePairSpringClass; // singleton object is the class
+void ParticlePairSpringCreateClass();
+
+///////////////////////////////////////////////////////////////////
+// ParticlePairBungee - a bungee between two particles, pulling both
+// ends together only when extended.
+///////////////////////////////////////////////////////////////////
+typedef struct ParticlePairBungee ParticlePairBungee;
+typedef struct ParticlePairBungeeClass ParticlePairBungeeClass;
+typedef struct ParticlePairBungeeVTable ParticlePairBungeeVTable;
+
+struct ParticlePairBungeeVTable {
+    ParticleForceGeneratorVTable base; // Application base VTable
+};
+
+struct ParticlePairBungee {
+    ParticleForceGenerator base;
+
+    Particle *_particle[2]; /** The particles at the two ends of the bungee. */
+    buReal _springConstant; /** Holds the spring constant. */
+    /**
+     * Holds the length of the bungee at the point it begins to
+     * generate a force.
+     */
+    buReal _restLength;
+};
+
+struct ParticlePairBungeeClass {
+    ParticleForceGeneratorClass base;
+
+    const char *class_name; // class name
+    const char *(*get_name)(const ParticlePairBungeeClass *cls);
+    ParticlePairBungee *(*new_instance)(const ParticlePairBungeeClass *cls, Particle *first, Particle *second, buReal springConstant, buReal restLength);
+    void (*free)(const ParticlePairBungeeClass *cls, ParticlePairBungee *self);
+};
+
+extern ParticlePairBungeeClass particlePairBungeeClass; // singleton object is the class
+void ParticlePairBungeeCreateClass();
+
 ///////////////////////////////////////////////////////////////////
 // ParticleBuoyancy - applies a buoyancy force to a particle
 ///////////////////////////////////////////////////////////////////
@@ -293,6 +405,9 @@ struct ParticleBuoyancyClass {
     void (*free)(const ParticleBuoyancyClass *cls, ParticleBuoyancy *self);
 };
 
+extern ParticleBuoyancyClass particleBuoyancyClass; // singleton object is the class
+void ParticleBuoyancyCreateClass();
+
 ///////////////////////////////////////////////////////////////////
 // ParticleForceRegistry - manages force generators
 // and their particles
@@ -301,20 +416,123 @@ typedef struct ParticleForceRegistry ParticleForceRegistry;
 typedef struct ParticleForceRegistryClass ParticleForceRegistryClass;
 typedef struct ParticleForceRegistryVTable ParticleForceRegistryVTable;
 
+/**
+ * Generator kinds the registry runs as separate batches. The kind is
+ * decided by the generator's updateForce implementation, so a subclass
+ * that does not override updateForce batches with its parent, and
+ * anything else (including user-defined generators) is
+ * PFK_GENERIC and dispatched through the vtable.
+ */
+typedef enum ParticleForceKind {
+    PFK_GRAVITY,
+    PFK_DRAG,
+    PFK_ANCHORED_SPRING,
+    PFK_ANCHORED_BUNGEE,
+    PFK_FAKE_SPRING,
+    PFK_SPRING,
+    PFK_BUNGEE,
+    PFK_BUOYANCY,
+    PFK_PAIR_SPRING,
+    PFK_PAIR_BUNGEE,
+    PFK_GENERIC,
+    PFK_COUNT
+} ParticleForceKind;
+
+/**
+ * Returns the batch a generator is run in.
+ */
+ParticleForceKind buParticleForceKind(const ParticleForceGenerator *fg);
+
 typedef struct ParticleForceRegistration {
     Particle *particle;
     ParticleForceGenerator *fg;
+    uint32_t slot; // owning ParticleForceSlot, kept up to date as entries move
 } ParticleForceRegistration;
 
+/**
+ * A stable reference to one registration, returned by add. It stays
+ * valid while the registration exists, however other registrations
+ * are added or removed; once the registration is removed the handle
+ * is stale and removeByHandle ignores it. A zeroed handle is never
+ * valid.
+ */
+typedef struct ParticleForceHandle {
+    uint32_t slot;
+    uint32_t generation;
+} ParticleForceHandle;
+
+#define PFR_NONE UINT32_MAX
+
+/**
+ * Registry bookkeeping for one handle: where its registration
+ * currently lives, and its neighbours in the list of registrations for
+ * the same particle.
+ */
+typedef struct ParticleForceSlot {
+    uint32_t generation; // bumped whenever the slot is freed
+    uint32_t kind;       // bucket, PFK_COUNT while the slot is free
+    uint32_t index;      // position in the bucket, or next free slot
+    uint32_t particle;   // dense particle id
+    uint32_t other;      // dense id of the far end of a pair generator, else PFR_NONE
+    uint32_t prev;       // previous slot for the same particle
+    uint32_t next;       // next slot for the same particle
+} ParticleForceSlot;
+
+/**
+ * Registrations stored by value in one contiguous block, grown by
+ * doubling.
+ */
+typedef struct ParticleForceRegistrationArray {
+    ParticleForceRegistration *items;
+    size_t count;
+    size_t capacity;
+} ParticleForceRegistrationArray;
+
+/**
+ * A set of particles a generator can be registered on in one record:
+ * either the particles [begin, end) of a ParticleWorld, or an explicit
+ * list of members.
+ */
+typedef struct ParticleForceGroup {
+    ParticleWorld *world; // range group if set, list group otherwise
+    size_t begin;
+    size_t end;
+
+    Particle **members;
+    uint32_t memberCount;
+    uint32_t memberCapacity;
+    uint32_t *table;      // open-addressed member -> position, PFR_NONE if empty
+    uint32_t tableSize;   // power of two
+
+    bool live;
+} ParticleForceGroup;
+
+typedef struct ParticleForceGroupRegistration {
+    uint32_t group;
+    ParticleForceGenerator *fg;
+} ParticleForceGroupRegistration;
+
 // methods of object
 struct ParticleForceRegistryVTable {
     VTable base; // inherit from VTable
 
     /**
      * Registers the given force generator to apply to the
-     * given particle.
+     * given particle, and returns a handle to the registration.
      */
-    void (* add)(ParticleForceRegistry *self, Particle* particle, ParticleForceGenerator *fg);
+    ParticleForceHandle (* add)(ParticleForceRegistry *self, Particle* particle, ParticleForceGenerator *fg);
+
+    /**
+     * Registers the given force generator to apply to each of
+     * count particles, reserving space for all of them at once.
+     */
+    void (* addMany)(ParticleForceRegistry *self, Particle **particles, size_t count, ParticleForceGenerator *fg);
+
+    /**
+     * Makes room for at least count further registrations of
+     * generators of the same kind as fg without reallocating.
+     */
+    void (* reserve)(ParticleForceRegistry *self, ParticleForceGenerator *fg, size_t count);
 
     /**
      * Removes the given registered pair from the registry.
@@ -323,24 +541,153 @@ struct ParticleForceRegistryVTable {
      */
     void (* remove)(ParticleForceRegistry *self, Particle* particle, ParticleForceGenerator *fg);
 
+    /**
+     * Removes the registration the handle refers to in constant
+     * time. Stale handles are ignored. Returns whether anything
+     * was removed.
+     */
+    bool (* removeByHandle)(ParticleForceRegistry *self, ParticleForceHandle handle);
+
+    /**
+     * Removes every registration for the given particle, in time
+     * proportional to the number of those registrations. A pair
+     * generator counts as registered on the end it was added with.
+     */
+    void (* removeAllForParticle)(ParticleForceRegistry *self, Particle *particle);
+
     /**
      * Clears all registrations from the registry. This will
      * not delete the particles or the force generators
      * themselves, just the records of their connection.
+     * Group registrations go as well; the groups stay.
      */
     void (* clear)(ParticleForceRegistry *self);
 
+    /**
+     * Creates a group with the given members and returns its id.
+     * count may be 0.
+     */
+    uint32_t (* addGroup)(ParticleForceRegistry *self, Particle **particles, size_t count);
+
+    /**
+     * Creates a group of the particles [begin, end) of a world and
+     * returns its id. Generators registered on it run through their
+     * updateWorldForces, straight over the world arrays.
+     */
+    uint32_t (* addRangeGroup)(ParticleForceRegistry *self, ParticleWorld *world, size_t begin, size_t end);
+
+    /**
+     * Moves the range of a range group.
+     */
+    void (* setGroupRange)(ParticleForceRegistry *self, uint32_t group, size_t begin, size_t end);
+
+    /**
+     * Adds a particle to a list group, in constant expected time.
+     * Adding a member twice has no effect.
+     */
+    void (* addToGroup)(ParticleForceRegistry *self, uint32_t group, Particle *particle);
+
+    /**
+     * Removes a particle from a list group, in constant expected
+     * time; the last member takes its place. Returns whether it was a
+     * member.
+     */
+    bool (* removeFromGroup)(ParticleForceRegistry *self, uint32_t group, Particle *particle);
+
+    /**
+     * Returns the number of particles in a group.
+     */
+    size_t (* getGroupSize)(const ParticleForceRegistry *self, uint32_t group);
+
+    /**
+     * Deletes a group and every generator registered on it. Its id
+     * may be handed out again.
+     */
+    void (* removeGroup)(ParticleForceRegistry *self, uint32_t group);
+
+    /**
+     * Registers the given force generator to apply to every member of
+     * a group, whatever the membership is when updateForces runs.
+     */
+    void (* addGroupForce)(ParticleForceRegistry *self, uint32_t group, ParticleForceGenerator *fg);
+
+    /**
+     * Removes one registration of the generator on the group, if
+     * there is one.
+     */
+    void (* removeGroupForce)(ParticleForceRegistry *self, uint32_t group, ParticleForceGenerator *fg);
+
     /**
      * Calls all the force generators to update the forces of
      * their corresponding particles.
+     *
+     * Registrations are run grouped by ParticleForceKind, in enum
+     * order. Within a kind they run in insertion order, except that a
+     * removal moves the last registration of that kind into the gap.
+     * The order therefore depends only on the sequence of calls made
+     * on the registry.
+     *
+     * With more than one thread (see setThreadCount) the built-in kinds
+     * are split into that many contiguous chunks of registrations. Each
+     * chunk sums its forces into a private per-particle buffer, and the
+     * buffers are then added up in chunk order, so each particle gets a
+     * single addForce. The result depends on the thread count but not
+     * on scheduling, nor on whether OpenMP is enabled; it may differ in
+     * the last bits from the single-threaded order. GENERIC
+     * registrations always run afterwards on the calling thread.
+     *
+     * Group registrations run last, in the order they were added, each
+     * as one updateForceBatch call over a list group's members or one
+     * updateWorldForces call over a range group.
      */
     void (* updateForces)(ParticleForceRegistry *self, buReal duration);
+
+    /**
+     * Sets how many threads updateForces uses. 1 (the default) runs
+     * everything on the calling thread. Without OpenMP the chunks run
+     * one after the other, giving the same result.
+     */
+    void (* setThreadCount)(ParticleForceRegistry *self, unsigned threads);
+
+    unsigned (* getThreadCount)(const ParticleForceRegistry *self);
 };
 
 typedef struct ParticleForceRegistry {
     Object base;
 
-    Vector *_registrations; // holds the registrations of particles and force generators
+    ParticleForceRegistrationArray _registrations[PFK_COUNT]; // registrations of particles and force generators, one bucket per kind
+
+    // handles
+    ParticleForceSlot *_slots;
+    uint32_t _slotCount;
+    uint32_t _slotCapacity;
+    uint32_t _freeSlot; // head of the free slot list, PFR_NONE if empty
+
+    // per-particle index: every particle seen gets a dense id
+    Particle **_particles;     // id -> particle
+    uint32_t *_particleHeads;  // id -> first slot registered for it, or the next free id once dead
+    uint32_t *_particleRefs;   // id -> registrations touching it, as either end
+    uint32_t _particleCount;   // ids handed out, dead ones included
+    uint32_t _freeParticle;    // head of the dead id list, PFR_NONE if empty
+    uint32_t _freeParticleCount;
+    uint32_t _particleCapacity;
+    uint32_t *_particleTable;  // open-addressed particle -> id, PFR_NONE if empty
+    uint32_t _particleTableSize; // power of two
+
+    // threaded updateForces
+    unsigned _threadCount;
+    buVector3 *_threadForces; // _threadCount buffers of _particleCount forces
+    size_t _threadForcesCapacity;
+
+    uint64_t _version; // bumped on every add, remove and clear
+
+    // groups; a group id indexes _groups
+    ParticleForceGroup *_groups;
+    uint32_t _groupCount;
+    uint32_t _groupCapacity;
+    ParticleForceGroupRegistration *_groupRegistrations;
+    size_t _groupRegistrationCount;
+    size_t _groupRegistrationCapacity;
 } ParticleForceRegistry;
 
 typedef struct ParticleForceRegistryClass {
@@ -355,4 +702,94 @@ typedef struct ParticleForceRegistryClass {
 extern ParticleForceRegistryClass particleForceRegistryClass; // singleton object is the class
 void ParticleForceRegistryCreateClass();
 
+//////////////////////////////////////////////////////////////////
+// ParticleForcePipeline - fused evaluation of a registry
+//////////////////////////////////////////////////////////////////
+typedef struct ParticleForcePipeline ParticleForcePipeline;
+typedef struct ParticleForcePipelineClass ParticleForcePipelineClass;
+typedef struct ParticleForcePipelineVTable ParticleForcePipelineVTable;
+
+/**
+ * The ordered list of particle-local built-in generators (gravity,
+ * drag, anchored spring, anchored bungee and buoyancy) registered on
+ * a set of particles, and those particles.
+ */
+typedef struct ParticleForceStack {
+    uint32_t generatorBegin; // first entry of the stack in _stackGenerators
+    uint32_t generatorCount;
+    uint32_t memberBegin;    // first entry of the stack in _members
+    uint32_t memberCount;
+} ParticleForceStack;
+
+/**
+ * A force pipeline evaluates the registrations of a
+ * ParticleForceRegistry with exactly the result of its
+ * single-threaded updateForces, but fuses the common case. Particles
+ * whose single-particle registrations are all particle-local
+ * built-ins, such as gravity + drag (+ buoyancy), are grouped by
+ * their ordered list of generators. Each group runs in blocks of
+ * PFG_BATCH_SIZE particles: their state is gathered once, the forces
+ * of the whole list are summed in updateForces order by the batch
+ * kernels of pfbatch.h, and each force accumulator is written once.
+ * Everything else (springs, pair generators, user-defined generators)
+ * runs as in the registry, after the fused groups.
+ */
+struct ParticleForcePipelineVTable {
+    VTable base; // inherit from VTable
+
+    /**
+     * Groups the registry's registrations. Called by updateForces
+     * whenever the registry changed since the last build.
+     */
+    void (*build)(ParticleForcePipeline *self);
+
+    /**
+     * Adds the force of every registration in the registry to its
+     * particle, as the registry's updateForces with one thread would.
+     */
+    void (*updateForces)(ParticleForcePipeline *self, buReal duration);
+
+    /**
+     * Returns the number of distinct generator lists found by build().
+     */
+    size_t (*getStackCount)(const ParticleForcePipeline *self);
+
+    /**
+     * Returns the number of particles evaluated by the fused loop.
+     */
+    size_t (*getFusedCount)(const ParticleForcePipeline *self);
+};
+
+struct ParticleForcePipeline {
+    Object base;
+
+    // private
+    ParticleForceRegistry *_registry;
+    uint64_t _version; // registry version the stacks were built from
+    bool _built;
+
+    ParticleForceStack *_stacks;
+    size_t _stackCount;
+    ParticleForceGenerator **_stackGenerators; // every stack's generators, in order
+    uint8_t *_stackKinds;                      // ParticleForceKind of each of them
+    size_t _stackGeneratorCount;
+    Particle **_members;                       // every stack's particles
+    size_t _memberCount;
+
+    ParticleForceRegistrationArray _rest[PFK_COUNT]; // registrations not fused, in registry order
+};
+
+struct ParticleForcePipelineClass {
+    Class base; // inherit from Class
+
+    const char *class_name; // class name
+    const char *(*get_name)(const ParticleForcePipelineClass *cls);
+    ParticleForcePipeline *(*new_instance)(const ParticleForcePipelineClass *cls, ParticleForceRegistry *registry);
+    void (*free)(const ParticleForcePipelineClass *cls, ParticleForcePipeline *self);
+};
+
+extern ParticleForcePipelineClass particleForcePipelineClass; // singleton object is the class
+extern ParticleForcePipelineVTable pfp_vtable;
+void ParticleForcePipelineCreateClass();
+
 #endif // PFGEN_H
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef PINTEGRATE_H
+#define PINTEGRATE_H
+
+#include "precision.h"
+#include "pworld.h"
+#include <stddef.h>
+
+/**
+ * Semi-implicit Euler kernels over structure-of-arrays particle state.
+ * For every particle i in [begin, end) with a positive inverse mass:
+ *
+ *     position += velocity * duration
+ *     velocity  = (velocity + acceleration * duration) * dampingFactor[i]
+ *
+ * which is Particle integrate() with dampingFactor[i] holding
+ * buPow(damping[i], duration). The factor is passed in rather than
+ * computed per particle so callers can cache it across steps of the
+ * same duration; it is also the only part of the step that cannot be
+ * vectorised.
+ *
+ * The scalar and SIMD kernels perform the same operations in the same
+ * order, so they produce bit-identical results.
+ */
+
+/**
+ * Fills dampingFactor[begin..end) with buPow(damping[i], duration).
+ */
+void buDampingFactors(const buReal *damping, buReal *dampingFactor, size_t begin, size_t end, buReal duration);
+
+/**
+ * Scalar reference kernel.
+ */
+void buIntegrateArraysScalar(const ParticleArrays *arrays, const buReal *dampingFactor, size_t begin, size_t end, buReal duration);
+
+/**
+ * SSE/AVX kernel processing BU_SIMD_WIDTH particles per instruction.
+ * Falls back to the scalar kernel when no SIMD support is compiled in.
+ */
+void buIntegrateArraysSIMD(const ParticleArrays *arrays, const buReal *dampingFactor, size_t begin, size_t end, buReal duration);
+
+/**
+ * The best kernel available in this build.
+ */
+void buIntegrateArrays(const ParticleArrays *arrays, const buReal *dampingFactor, size_t begin, size_t end, buReal duration);
+
+/**
+ * Uniform terms shared by a whole range of particles, the sum of the
+ * world fields that apply to them. acceleration is added as is; force
+ * is scaled by each particle's inverse mass.
+ */
+typedef struct buFieldTerms {
+    buVector3 acceleration;
+    buVector3 force;
+} buFieldTerms;
+
+/**
+ * The same step as buIntegrateArraysScalar, with the acceleration of
+ * every particle replaced by
+ *
+ *     acceleration[i] + (terms.acceleration + inverseMass[i] * terms.force)
+ *
+ * so uniform fields cost a multiply-add per component instead of a
+ * force generator call per particle.
+ */
+void buIntegrateArraysFieldScalar(const ParticleArrays *arrays, const buReal *dampingFactor, const buFieldTerms *terms, size_t begin, size_t end, buReal duration);
+
+/**
+ * SSE/AVX version of buIntegrateArraysFieldScalar.
+ */
+void buIntegrateArraysFieldSIMD(const ParticleArrays *arrays, const buReal *dampingFactor, const buFieldTerms *terms, size_t begin, size_t end, buReal duration);
+
+/**
+ * The best field kernel available in this build.
+ */
+void buIntegrateArraysField(const ParticleArrays *arrays, const buReal *dampingFactor, const buFieldTerms *terms, size_t begin, size_t end, buReal duration);
+
+#endif // PINTEGRATE_H
@@ -3,6 +3,9 @@
 
 
 #include "pcontacts.h"
+#include "pworld.h"
+#include <stddef.h>
+#include <stdint.h>
 
 
 /**
@@ -229,4 +232,140 @@ typedef struct ParticleRodConstraintClass {
 
 extern ParticleRodConstraintClass particleRodConstraintClass;
 void ParticleRodConstraintCreateClass();
+
+/**
+ * Lengths of a whole batch of links stored as arrays. For every link
+ * l in [begin, end), given the separation d of its ends in
+ * difference[k][l]:
+ *
+ *     length[l]  = |d|
+ *     stretch[l] = |d| - restLength[l]
+ *
+ * The scalar and SIMD kernels perform the same operations in the same
+ * order, so they produce bit-identical results.
+ */
+void buLinkStretchScalar(buReal *const difference[3], const buReal *restLength, buReal *length, buReal *stretch, size_t begin, size_t end);
+
+/**
+ * SSE/AVX kernel processing BU_SIMD_WIDTH links per instruction.
+ * Falls back to the scalar kernel when no SIMD support is compiled in.
+ */
+void buLinkStretchSIMD(buReal *const difference[3], const buReal *restLength, buReal *length, buReal *stretch, size_t begin, size_t end);
+
+/**
+ * The best kernel available in this build.
+ */
+void buLinkStretch(buReal *const difference[3], const buReal *restLength, buReal *length, buReal *stretch, size_t begin, size_t end);
+
+/**
+ * The kinds of link a ParticleLinkSet holds: a cable only pulls its
+ * ends together once stretched to its length, a rod also pushes them
+ * apart when compressed.
+ */
+typedef enum ParticleLinkKind {
+    PLK_CABLE,
+    PLK_ROD
+} ParticleLinkKind;
+
+/**
+ * The second end of a link that is anchored to a fixed point instead.
+ */
+#define PLS_ANCHOR UINT32_MAX
+
+typedef struct ParticleLinkSet ParticleLinkSet;
+typedef struct ParticleLinkSetClass ParticleLinkSetClass;
+typedef struct ParticleLinkSetVTable ParticleLinkSetVTable;
+
+/**
+ * A link set holds many cables and rods between the particles of one
+ * ParticleWorld, or between a particle and an anchor point, as flat
+ * arrays (endpoint indices, lengths, restitutions, kinds) rather than
+ * as one ParticleCable, ParticleRod or constraint object per link. It
+ * is a single contact generator for all of them, which
+ *
+ *   1. gathers the separation of every link's ends,
+ *   2. runs buLinkStretch over the whole batch,
+ *   3. emits a contact for every violated link, in link order, until
+ *      the limit is reached.
+ *
+ * The contacts are those the individual classes generate for the
+ * world's views, with the link index as the contact feature. A cable
+ * is violated when stretched by at least the tolerance, a rod when its
+ * length is off by more than the tolerance; the tolerance is 0 by
+ * default, as for the individual classes. Links of zero length have
+ * no direction and make no contact.
+ */
+struct ParticleLinkSetVTable {
+    ParticleContactGeneratorVTable base; // inherit from ParticleContactGeneratorVTable
+
+    /**
+     * Adds a cable between the particles at the given world indices.
+     */
+    void (*addCable)(ParticleLinkSet *self, uint32_t first, uint32_t second, buReal maxLength, buReal restitution);
+
+    /**
+     * Adds a rod between the particles at the given world indices.
+     */
+    void (*addRod)(ParticleLinkSet *self, uint32_t first, uint32_t second, buReal length);
+
+    /**
+     * Adds a cable from a particle to a fixed anchor point.
+     */
+    void (*addCableConstraint)(ParticleLinkSet *self, uint32_t particle, buVector3 anchor, buReal maxLength, buReal restitution);
+
+    /**
+     * Adds a rod from a particle to a fixed anchor point.
+     */
+    void (*addRodConstraint)(ParticleLinkSet *self, uint32_t particle, buVector3 anchor, buReal length);
+
+    /**
+     * Makes sure the set can hold at least capacity links without
+     * reallocating.
+     */
+    void (*reserve)(ParticleLinkSet *self, size_t capacity);
+
+    /**
+     * Returns the number of links in the set.
+     */
+    size_t (*getCount)(const ParticleLinkSet *self);
+
+    /**
+     * Sets how far a link may be off before it makes a contact.
+     */
+    void (*setTolerance)(ParticleLinkSet *self, buReal tolerance);
+};
+
+struct ParticleLinkSet {
+    ParticleContactGenerator base;
+
+    // private
+    ParticleWorld *_world;
+    size_t _count;
+    size_t _capacity;
+    buReal _tolerance;
+
+    // links, one entry each
+    uint32_t *_first;
+    uint32_t *_second;        // PLS_ANCHOR for a constraint
+    buReal *_length;          // maximum length of a cable, length of a rod
+    buReal *_restitution;     // always 0 for rods
+    uint8_t *_kind;           // ParticleLinkKind
+    buVector3 *_anchor;       // anchor point of a constraint
+    buReal *_scratch[3];      // per-link separation of the ends
+    buReal *_currentLength;   // scratch
+    buReal *_stretch;         // scratch
+};
+
+struct ParticleLinkSetClass {
+    ParticleContactGeneratorClass base; // inherit from ParticleContactGeneratorClass
+
+    const char *class_name; // class name
+    const char *(*get_name)(const ParticleLinkSetClass *cls);
+    ParticleLinkSet *(*new_instance)(const ParticleLinkSetClass *cls, ParticleWorld *world);
+    void (*free)(const ParticleLinkSetClass *cls, ParticleLinkSet *self);
+};
+
+extern ParticleLinkSetClass particleLinkSetClass; // singleton object is the class
+extern ParticleLinkSetVTable pls_vtable;
+void ParticleLinkSetCreateClass();
 #endif // PLINKS_H
\ No newline at end of file
@@ -0,0 +1,138 @@
+#ifndef PSIM_H
+#define PSIM_H
+
+#include "precision.h"
+#include "core.h"
+#include "oop.h"
+#include "pworld.h"
+#include "pfgen.h"
+#include "pcontacts.h"
+
+/**
+ * Seconds spent in each phase of the last runPhysics.
+ */
+typedef struct ParticleSimulationTimings {
+    double forces;            // force generators, then accelerations from forces
+    double integration;       // integrateAll over the world arrays
+    double contactGeneration; // every contact generator, into the contact buffer
+    double contactResolution; // resolveBuffer
+} ParticleSimulationTimings;
+
+typedef struct ParticleSimulation ParticleSimulation;
+typedef struct ParticleSimulationClass ParticleSimulationClass;
+typedef struct ParticleSimulationVTable ParticleSimulationVTable;
+
+/**
+ * A particle simulation ties the pieces of a physics step together. It
+ * owns a ParticleWorld holding the particles, a ParticleForceRegistry,
+ * a ParticleContactBuffer and a ParticleContactResolver, and keeps a
+ * list of contact generators. Each frame is
+ *
+ *     startFrame();
+ *     runPhysics(duration);
+ *
+ * where runPhysics runs, in order:
+ *
+ *   1. the registry's force generators, then one pass over the world
+ *      arrays setting every acceleration to force * inverseMass,
+ *   2. integrateAll, which also applies the world's fields,
+ *   3. every contact generator, appending to the contact buffer,
+ *   4. resolveBuffer on what was generated.
+ *
+ * Since step 1 replaces each particle's acceleration, constant
+ * accelerations such as gravity belong in a world field (or a force
+ * generator). The buffer and the resolver's scratch keep their memory
+ * between frames, so a simulation of steady size stops allocating.
+ */
+struct ParticleSimulationVTable {
+    VTable base; // inherit from VTable
+
+    /**
+     * Returns the world that holds the particles. Add particles to it,
+     * and register force generators and build contacts on its views
+     * (see ParticleWorld getParticle).
+     */
+    ParticleWorld *(*getWorld)(ParticleSimulation *self);
+
+    /**
+     * Returns the registry the forces are generated from.
+     */
+    ParticleForceRegistry *(*getRegistry)(ParticleSimulation *self);
+
+    /**
+     * Returns the resolver, to set its cache or tolerance.
+     */
+    ParticleContactResolver *(*getResolver)(ParticleSimulation *self);
+
+    /**
+     * Adds a contact generator. Generators run in the order they were
+     * added, until the simulation's maximum contact count is reached.
+     * The simulation does not take ownership of the generator.
+     */
+    void (*addContactGenerator)(ParticleSimulation *self, ParticleContactGenerator *generator);
+
+    /**
+     * Sets how many threads the registry uses (see its setThreadCount).
+     * Only the forces are threaded: resolveBuffer always resolves in
+     * heap order on the calling thread, whatever the resolver's mode
+     * and thread count.
+     */
+    void (*setThreadCount)(ParticleSimulation *self, unsigned threads);
+
+    /**
+     * Clears the force accumulators of all the particles, ready for
+     * forces to be added this frame.
+     */
+    void (*startFrame)(ParticleSimulation *self);
+
+    /**
+     * Runs the whole step for the given duration.
+     */
+    void (*runPhysics)(ParticleSimulation *self, buReal duration);
+
+    /**
+     * Returns the number of contacts generated by the last runPhysics.
+     */
+    unsigned (*getContactCount)(ParticleSimulation *self);
+
+    /**
+     * Returns the time each phase of the last runPhysics took.
+     */
+    ParticleSimulationTimings (*getTimings)(ParticleSimulation *self);
+};
+
+struct ParticleSimulation {
+    Object base;
+
+    // private
+    ParticleWorld *_world;
+    ParticleForceRegistry *_registry;
+    ParticleContactBuffer *_contacts;
+    ParticleContactResolver *_resolver;
+    ParticleContactGenerator **_generators;
+    unsigned _generatorCount;
+    unsigned _generatorCapacity;
+    unsigned _maxContacts;
+    bool _calculateIterations; // resolve with twice as many iterations as contacts
+    ParticleSimulationTimings _timings;
+};
+
+struct ParticleSimulationClass {
+    Class base; // inherit from Class
+
+    const char *class_name; // class name
+    const char *(*get_name)(const ParticleSimulationClass *cls);
+    /**
+     * Creates a simulation that handles up to maxContacts contacts a
+     * frame. If iterations is 0 the resolver is given twice as many
+     * iterations as there are contacts each frame.
+     */
+    ParticleSimulation *(*new_instance)(const ParticleSimulationClass *cls, unsigned maxContacts, unsigned iterations);
+    void (*free)(const ParticleSimulationClass *cls, ParticleSimulation *self);
+};
+
+extern ParticleSimulationClass particleSimulationClass; // singleton object is the class
+extern ParticleSimulationVTable psim_vtable;
+void ParticleSimulationCreateClass();
+
+#endif // PSIM_H
@@ -0,0 +1,155 @@
+#ifndef PSPRINGNET_H
+#define PSPRINGNET_H
+
+#include "precision.h"
+#include "core.h"
+#include "oop.h"
+#include "pworld.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Spring forces for a whole batch of springs stored as arrays. For
+ * every spring s in [begin, end), given the separation
+ * d = position[first] - position[second] in difference[k][s]:
+ *
+ *     stretch = max(|d| - restLength, minStretch)
+ *     force   = (d / |d|) * -(stretch * springConstant)
+ *
+ * which is the force ParticleSpring applies to the first particle.
+ * minStretch is -infinity for a spring and 0 for a bungee, which
+ * then only pulls. Springs of zero length produce no force. force may
+ * alias difference.
+ *
+ * The scalar and SIMD kernels perform the same operations in the same
+ * order, so they produce bit-identical results.
+ */
+void buSpringForcesScalar(buReal *const difference[3], const buReal *restLength, const buReal *springConstant, const buReal *minStretch, buReal *const force[3], size_t begin, size_t end);
+
+/**
+ * SSE/AVX kernel processing BU_SIMD_WIDTH springs per instruction.
+ * Falls back to the scalar kernel when no SIMD support is compiled in.
+ */
+void buSpringForcesSIMD(buReal *const difference[3], const buReal *restLength, const buReal *springConstant, const buReal *minStretch, buReal *const force[3], size_t begin, size_t end);
+
+/**
+ * The best kernel available in this build.
+ */
+void buSpringForces(buReal *const difference[3], const buReal *restLength, const buReal *springConstant, const buReal *minStretch, buReal *const force[3], size_t begin, size_t end);
+
+/**
+ * Most colours build() hands out; springs that do not fit go into a
+ * final batch that is scattered on one thread.
+ */
+#define PSN_MAX_COLORS 64
+
+typedef struct ParticleSpringNetwork ParticleSpringNetwork;
+typedef struct ParticleSpringNetworkClass ParticleSpringNetworkClass;
+typedef struct ParticleSpringNetworkVTable ParticleSpringNetworkVTable;
+
+/**
+ * A spring network holds many springs between the particles of one
+ * ParticleWorld as flat arrays (endpoint indices, rest lengths,
+ * stiffness), rather than as one ParticleSpring object and registry
+ * entry per spring, and evaluates them all in one batched pass:
+ *
+ *   1. gather the separation of every spring's ends,
+ *   2. run buSpringForces over the whole batch,
+ *   3. scatter +F / -F into the world's force accumulators.
+ *
+ * build() sorts the springs into colours, contiguous ranges in which
+ * no two springs share a particle, so step 3 can run a colour at a
+ * time across threads without conflicting writes. Every particle
+ * receives its forces in colour order however many threads are used,
+ * so the result does not depend on the thread count.
+ */
+struct ParticleSpringNetworkVTable {
+    VTable base; // inherit from VTable
+
+    /**
+     * Adds a spring between the particles at the given world
+     * indices. The first particle is pulled towards the second and
+     * vice versa, as with a ParticleSpring registered on each end.
+     */
+    void (*addSpring)(ParticleSpringNetwork *self, uint32_t first, uint32_t second, buReal springConstant, buReal restLength);
+
+    /**
+     * Adds a bungee, which only pulls when stretched beyond its rest
+     * length.
+     */
+    void (*addBungee)(ParticleSpringNetwork *self, uint32_t first, uint32_t second, buReal springConstant, buReal restLength);
+
+    /**
+     * Makes sure the network can hold at least capacity springs
+     * without reallocating.
+     */
+    void (*reserve)(ParticleSpringNetwork *self, size_t capacity);
+
+    /**
+     * Returns the number of springs in the network.
+     */
+    size_t (*getCount)(const ParticleSpringNetwork *self);
+
+    /**
+     * Colours the springs and sorts them by colour. Called by
+     * updateForces whenever springs were added since the last build;
+     * call it directly to keep that cost out of the first step.
+     */
+    void (*build)(ParticleSpringNetwork *self);
+
+    /**
+     * Returns the number of colour ranges after build(), including
+     * the single-threaded overflow range if there is one.
+     */
+    size_t (*getColorCount)(ParticleSpringNetwork *self);
+
+    /**
+     * Adds the force of every spring to the world's force
+     * accumulators.
+     */
+    void (*updateForces)(ParticleSpringNetwork *self, buReal duration);
+
+    /**
+     * Sets how many threads updateForces uses (1 by default). Without
+     * OpenMP everything runs on the calling thread.
+     */
+    void (*setThreadCount)(ParticleSpringNetwork *self, unsigned threads);
+};
+
+struct ParticleSpringNetwork {
+    Object base;
+
+    // private
+    ParticleWorld *_world;
+    size_t _count;
+    size_t _capacity;
+
+    // springs, one entry each, sorted by colour once built
+    uint32_t *_first;
+    uint32_t *_second;
+    buReal *_restLength;
+    buReal *_springConstant;
+    buReal *_minStretch; // -infinity for springs, 0 for bungees
+    buReal *_scratch[3]; // per-spring separation, then force
+
+    size_t _colorStart[PSN_MAX_COLORS + 2]; // colour c is [_colorStart[c], _colorStart[c + 1])
+    size_t _colorCount;
+    bool _overflow; // the last colour may share particles and is scattered serially
+    bool _built;
+    unsigned _threadCount;
+};
+
+struct ParticleSpringNetworkClass {
+    Class base; // inherit from Class
+
+    const char *class_name; // class name
+    const char *(*get_name)(const ParticleSpringNetworkClass *cls);
+    ParticleSpringNetwork *(*new_instance)(const ParticleSpringNetworkClass *cls, ParticleWorld *world);
+    void (*free)(const ParticleSpringNetworkClass *cls, ParticleSpringNetwork *self);
+};
+
+extern ParticleSpringNetworkClass particleSpringNetworkClass; // singleton object is the class
+extern ParticleSpringNetworkVTable psn_vtable;
+void ParticleSpringNetworkCreateClass();
+
+#endif // PSPRINGNET_H
@@ -0,0 +1,186 @@
+#ifndef PWORLD_H
+#define PWORLD_H
+
+#include "precision.h"
+#include "core.h"
+#include "cparticle.h"
+#include "oop.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Structure-of-arrays particle state. Every array is indexed by
+ * particle and allocated with BU_ALIGNMENT, so position[1][i] is the
+ * y coordinate of particle i.
+ */
+typedef struct ParticleArrays {
+    buReal *position[3];
+    buReal *velocity[3];
+    buReal *acceleration[3];
+    buReal *forceAccum[3];
+    buReal *damping;
+    buReal *inverseMass;
+} ParticleArrays;
+
+/**
+ * How a world field acts on particles: an acceleration is applied to
+ * every particle as is (gravity), a force is divided by each
+ * particle's mass (a constant wind).
+ */
+typedef enum ParticleFieldKind {
+    PW_FIELD_ACCELERATION,
+    PW_FIELD_FORCE
+} ParticleFieldKind;
+
+#define PW_MAX_FIELDS 8
+#define PW_MAX_GROUPS 32
+
+typedef struct ParticleField {
+    ParticleFieldKind kind;
+    buVector3 value;
+    uint32_t excludedGroups; // bit g set if particles of group g opt out
+} ParticleField;
+
+typedef struct ParticleWorld ParticleWorld;
+typedef struct ParticleWorldClass ParticleWorldClass;
+typedef struct ParticleWorldVTable ParticleWorldVTable;
+
+typedef struct WorldParticle WorldParticle;
+typedef struct WorldParticleClass WorldParticleClass;
+typedef struct WorldParticleVTable WorldParticleVTable;
+
+/**
+ * A particle world stores the state of many particles in contiguous
+ * arrays rather than as separately allocated Particle objects, so
+ * that the whole population can be stepped in one pass.
+ */
+struct ParticleWorldVTable {
+    VTable base; // inherit from VTable
+
+    /**
+     * Adds a particle to the world and returns its index. Indices are
+     * dense and stable for the lifetime of the world.
+     */
+    size_t (*add)(ParticleWorld *self, buVector3 position, buVector3 velocity, buVector3 acceleration, buReal damping, buReal inverseMass);
+
+    /**
+     * Makes sure the world can hold at least capacity particles
+     * without reallocating.
+     */
+    void (*reserve)(ParticleWorld *self, size_t capacity);
+
+    /**
+     * Returns the number of particles in the world.
+     */
+    size_t (*getCount)(ParticleWorld *self);
+
+    /**
+     * Returns a Particle that reads and writes the state of the
+     * particle at the given index. The view is owned by the world
+     * and stays valid until the world is freed.
+     */
+    Particle *(*getParticle)(ParticleWorld *self, size_t index);
+
+    /**
+     * Clears the force accumulator of every particle.
+     */
+    void (*clearAccumulators)(ParticleWorld *self);
+
+    /**
+     * Integrates every particle forward by the given duration, with
+     * the same semantics as Particle integrate(), plus the fields
+     * that apply to each particle's group.
+     */
+    void (*integrateAll)(ParticleWorld *self, buReal duration);
+
+    /**
+     * Adds a uniform field, such as gravity or a constant wind, that
+     * acts on every particle of the world and returns its index.
+     * Fields are folded into integrateAll as a constant acceleration
+     * term, so they need no force generator registrations.
+     */
+    size_t (*addField)(ParticleWorld *self, ParticleFieldKind kind, buVector3 value);
+
+    /**
+     * Changes the value of a field.
+     */
+    void (*setField)(ParticleWorld *self, size_t field, buVector3 value);
+
+    /**
+     * Makes the particles of a group ignore (or again feel) a field.
+     */
+    void (*setGroupExcluded)(ParticleWorld *self, size_t field, uint8_t group, bool excluded);
+
+    /**
+     * Moves a particle into a group, below PW_MAX_GROUPS. Particles
+     * start in group 0. integrateAll handles each run of consecutive
+     * particles in the same group in one batch, so keep groups
+     * contiguous where possible.
+     */
+    void (*setGroup)(ParticleWorld *self, size_t index, uint8_t group);
+
+    /**
+     * Returns the group of a particle.
+     */
+    uint8_t (*getGroup)(ParticleWorld *self, size_t index);
+};
+
+struct ParticleWorld {
+    Object base;
+
+    // private
+    size_t _count;
+    size_t _capacity;
+    ParticleArrays _arrays;
+    buReal *_dampingFactor; // buPow(damping, _dampingFactorDuration), cached between steps
+    buReal _dampingFactorDuration; // duration the factors were computed for, 0 if stale
+    buVector3 *_initialPosition; // cold, only used for energy reporting
+    WorldParticle **_views; // lazily created Particle views, one per slot
+    uint8_t *_group; // field group of every particle
+    ParticleField _fields[PW_MAX_FIELDS];
+    size_t _fieldCount;
+};
+
+struct ParticleWorldClass {
+    Class base; // inherit from Class
+
+    const char *class_name; // class name
+    const char *(*get_name)(const ParticleWorldClass *cls);
+    ParticleWorld *(*new_instance)(const ParticleWorldClass *cls, size_t capacity);
+    void (*free)(const ParticleWorldClass *cls, ParticleWorld *self);
+};
+
+extern ParticleWorldClass particleWorldClass; // singleton object is the class
+extern ParticleWorldVTable pw_vtable;
+void ParticleWorldCreateClass();
+
+/**
+ * A Particle whose state lives in a ParticleWorld. All Particle
+ * methods are overridden to go through the world arrays, so a view
+ * can be handed to force generators, contacts and links unchanged.
+ * The inherited Particle fields are not used; always go through the
+ * methods.
+ */
+struct WorldParticleVTable {
+    ParticleVTable base; // inherit from ParticleVTable
+};
+
+struct WorldParticle {
+    Particle base;
+
+    // private
+    ParticleWorld *_world;
+    size_t _index;
+};
+
+struct WorldParticleClass {
+    ParticleClass base; // inherit from ParticleClass
+
+    const char *class_name; // class name
+    const char *(*get_name)(WorldParticleClass *cls);
+};
+
+extern WorldParticleClass worldParticleClass; // singleton object is the class
+void WorldParticleCreateClass();
+
+#endif // PWORLD_H
@@ -0,0 +1,146 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "precision.h"
+
+/**
+ * Thin lane abstraction over the x86 vector extensions, following the
+ * precision chosen in precision.h. buSimd holds BU_SIMD_WIDTH buReals:
+ *
+ *              float   double
+ *     SSE2       4       2
+ *     AVX        8       4
+ *
+ * Kernels are compiled in when USE_SIMD is defined and the compiler
+ * targets SSE2 or better (-mavx2 for the wide variant). Otherwise
+ * BU_SIMD is left undefined, BU_SIMD_WIDTH is 1 and callers use their
+ * scalar loops.
+ *
+ * Comparisons return all-ones/all-zeros lane masks suitable for
+ * buSimdSelect, buSimdAnd and buSimdMoveMask.
+ */
+
+#if defined(USE_SIMD) && defined(__AVX__)
+    #include <immintrin.h>
+    #define BU_SIMD 1
+    #ifdef USE_FLOAT
+        typedef __m256 buSimd;
+        #define BU_SIMD_WIDTH 8
+        #define buSimdLoad _mm256_load_ps
+        #define buSimdLoadU _mm256_loadu_ps
+        #define buSimdStore _mm256_store_ps
+        #define buSimdStoreU _mm256_storeu_ps
+        #define buSimdSet1 _mm256_set1_ps
+        #define buSimdZero _mm256_setzero_ps
+        #define buSimdAdd _mm256_add_ps
+        #define buSimdSub _mm256_sub_ps
+        #define buSimdMul _mm256_mul_ps
+        #define buSimdDiv _mm256_div_ps
+        #define buSimdSqrt _mm256_sqrt_ps
+        #define buSimdMin _mm256_min_ps
+        #define buSimdMax _mm256_max_ps
+        #define buSimdAnd _mm256_and_ps
+        #define buSimdAndNot _mm256_andnot_ps
+        #define buSimdOr _mm256_or_ps
+        #define buSimdCmpLt(a, b) _mm256_cmp_ps((a), (b), _CMP_LT_OQ)
+        #define buSimdCmpLe(a, b) _mm256_cmp_ps((a), (b), _CMP_LE_OQ)
+        #define buSimdCmpGt(a, b) _mm256_cmp_ps((a), (b), _CMP_GT_OQ)
+        #define buSimdCmpGe(a, b) _mm256_cmp_ps((a), (b), _CMP_GE_OQ)
+        #define buSimdCmpNeq(a, b) _mm256_cmp_ps((a), (b), _CMP_NEQ_UQ)
+        #define buSimdSelect(mask, a, b) _mm256_blendv_ps((b), (a), (mask))
+        #define buSimdMoveMask _mm256_movemask_ps
+    #else
+        typedef __m256d buSimd;
+        #define BU_SIMD_WIDTH 4
+        #define buSimdLoad _mm256_load_pd
+        #define buSimdLoadU _mm256_loadu_pd
+        #define buSimdStore _mm256_store_pd
+        #define buSimdStoreU _mm256_storeu_pd
+        #define buSimdSet1 _mm256_set1_pd
+        #define buSimdZero _mm256_setzero_pd
+        #define buSimdAdd _mm256_add_pd
+        #define buSimdSub _mm256_sub_pd
+        #define buSimdMul _mm256_mul_pd
+        #define buSimdDiv _mm256_div_pd
+        #define buSimdSqrt _mm256_sqrt_pd
+        #define buSimdMin _mm256_min_pd
+        #define buSimdMax _mm256_max_pd
+        #define buSimdAnd _mm256_and_pd
+        #define buSimdAndNot _mm256_andnot_pd
+        #define buSimdOr _mm256_or_pd
+        #define buSimdCmpLt(a, b) _mm256_cmp_pd((a), (b), _CMP_LT_OQ)
+        #define buSimdCmpLe(a, b) _mm256_cmp_pd((a), (b), _CMP_LE_OQ)
+        #define buSimdCmpGt(a, b) _mm256_cmp_pd((a), (b), _CMP_GT_OQ)
+        #define buSimdCmpGe(a, b) _mm256_cmp_pd((a), (b), _CMP_GE_OQ)
+        #define buSimdCmpNeq(a, b) _mm256_cmp_pd((a), (b), _CMP_NEQ_UQ)
+        #define buSimdSelect(mask, a, b) _mm256_blendv_pd((b), (a), (mask))
+        #define buSimdMoveMask _mm256_movemask_pd
+    #endif
+#elif defined(USE_SIMD) && defined(__SSE2__)
+    #include <emmintrin.h>
+    #define BU_SIMD 1
+    #ifdef USE_FLOAT
+        typedef __m128 buSimd;
+        #define BU_SIMD_WIDTH 4
+        #define buSimdLoad _mm_load_ps
+        #define buSimdLoadU _mm_loadu_ps
+        #define buSimdStore _mm_store_ps
+        #define buSimdStoreU _mm_storeu_ps
+        #define buSimdSet1 _mm_set1_ps
+        #define buSimdZero _mm_setzero_ps
+        #define buSimdAdd _mm_add_ps
+        #define buSimdSub _mm_sub_ps
+        #define buSimdMul _mm_mul_ps
+        #define buSimdDiv _mm_div_ps
+        #define buSimdSqrt _mm_sqrt_ps
+        #define buSimdMin _mm_min_ps
+        #define buSimdMax _mm_max_ps
+        #define buSimdAnd _mm_and_ps
+        #define buSimdAndNot _mm_andnot_ps
+        #define buSimdOr _mm_or_ps
+        #define buSimdCmpLt _mm_cmplt_ps
+        #define buSimdCmpLe _mm_cmple_ps
+        #define buSimdCmpGt _mm_cmpgt_ps
+        #define buSimdCmpGe _mm_cmpge_ps
+        #define buSimdCmpNeq _mm_cmpneq_ps
+        #define buSimdMoveMask _mm_movemask_ps
+    #else
+        typedef __m128d buSimd;
+        #define BU_SIMD_WIDTH 2
+        #define buSimdLoad _mm_load_pd
+        #define buSimdLoadU _mm_loadu_pd
+        #define buSimdStore _mm_store_pd
+        #define buSimdStoreU _mm_storeu_pd
+        #define buSimdSet1 _mm_set1_pd
+        #define buSimdZero _mm_setzero_pd
+        #define buSimdAdd _mm_add_pd
+        #define buSimdSub _mm_sub_pd
+        #define buSimdMul _mm_mul_pd
+        #define buSimdDiv _mm_div_pd
+        #define buSimdSqrt _mm_sqrt_pd
+        #define buSimdMin _mm_min_pd
+        #define buSimdMax _mm_max_pd
+        #define buSimdAnd _mm_and_pd
+        #define buSimdAndNot _mm_andnot_pd
+        #define buSimdOr _mm_or_pd
+        #define buSimdCmpLt _mm_cmplt_pd
+        #define buSimdCmpLe _mm_cmple_pd
+        #define buSimdCmpGt _mm_cmpgt_pd
+        #define buSimdCmpGe _mm_cmpge_pd
+        #define buSimdCmpNeq _mm_cmpneq_pd
+        #define buSimdMoveMask _mm_movemask_pd
+    #endif
+    // SSE2 has no blend, so build it from the bitwise ops
+    #define buSimdSelect(mask, a, b) buSimdOr(buSimdAnd((mask), (a)), buSimdAndNot((mask), (b)))
+#else
+    #define BU_SIMD_WIDTH 1
+#endif
+
+/**
+ * Size of one register in bytes, and whether a pointer is aligned to it
+ * (so buSimdLoad/buSimdStore may be used instead of the U variants).
+ */
+#define BU_SIMD_BYTES (BU_SIMD_WIDTH * sizeof(buReal))
+#define buSimdIsAligned(p) (((size_t)(p) % BU_SIMD_BYTES) == 0)
+
+#endif // SIMD_H
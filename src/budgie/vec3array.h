@@ -0,0 +1,64 @@
+#ifndef VEC3ARRAY_H
+#define VEC3ARRAY_H
+
+#include "precision.h"
+#include "core.h"
+#include <stddef.h>
+
+/**
+ * Bulk versions of the core.h vector operations, for streams of count
+ * vectors. Each kernel comes in two layouts:
+ *
+ *     buVec3Array*     packed buVector3 arrays (array of structures)
+ *     buVec3Array*SoA  three component arrays, v[0][i], v[1][i], v[2][i]
+ *                      as in ParticleArrays
+ *
+ * Kernels use SSE/AVX (see simd.h) when compiled in and peel leading
+ * elements until the output is register-aligned, so arrays from
+ * buAlignedAlloc run entirely on aligned stores. Any alignment is
+ * accepted. The element-wise kernels (Axpy, Scale) vectorise in both
+ * layouts; the horizontal ones (Dot, Norm, Normalize) need a transpose
+ * for packed input, which is only done for float, so prefer SoA for
+ * those in double builds.
+ *
+ * Results match the single-vector functions in core.h exactly: the
+ * same operations are done in the same order, and no fused
+ * multiply-add is used.
+ *
+ * Input and output arrays may be the same array but must not otherwise
+ * overlap.
+ */
+
+/**
+ * y[i] += a * x[i]
+ */
+void buVec3ArrayAxpy(buVector3 *y, buReal a, const buVector3 *x, size_t count);
+void buVec3ArrayAxpySoA(buReal *const y[3], buReal a, buReal *const x[3], size_t count);
+
+/**
+ * v[i] *= scalar
+ */
+void buVec3ArrayScale(buVector3 *v, buReal scalar, size_t count);
+void buVec3ArrayScaleSoA(buReal *const v[3], buReal scalar, size_t count);
+
+/**
+ * out[i] = a[i] . b[i]
+ */
+void buVec3ArrayDot(buReal *out, const buVector3 *a, const buVector3 *b, size_t count);
+void buVec3ArrayDotSoA(buReal *out, buReal *const a[3], buReal *const b[3], size_t count);
+
+/**
+ * out[i] = |v[i]|
+ */
+void buVec3ArrayNorm(buReal *out, const buVector3 *v, size_t count);
+void buVec3ArrayNormSoA(buReal *out, buReal *const v[3], size_t count);
+
+/**
+ * v[i] = v[i] / |v[i]|. Unlike buVector3Normalise, zero-length vectors
+ * are left unchanged rather than asserted on, so a stream may contain
+ * unused entries.
+ */
+void buVec3ArrayNormalize(buVector3 *v, size_t count);
+void buVec3ArrayNormalizeSoA(buReal *const v[3], size_t count);
+
+#endif // VEC3ARRAY_H
@@ -0,0 +1,201 @@
+#ifndef VECTOR3A_H
+#define VECTOR3A_H
+
+#include "precision.h"
+#include "core.h"
+#include <assert.h>
+
+/**
+ * buVector3A is a 3-vector padded to four lanes and aligned so that it
+ * fits one SIMD register. The fourth lane (w) is kept at zero by every
+ * operation, so it never leaks into dot products or norms.
+ *
+ * Operations are static inline and compile to SSE intrinsics for float
+ * and AVX2 intrinsics for double when USE_SIMD is defined and the
+ * target supports them. Otherwise a portable four-lane loop is used,
+ * which compilers are free to auto-vectorise.
+ *
+ * Convert with buVector3AFromVector3 / buVector3AToVector3 at the edges
+ * of a hot loop; the packed buVector3 remains the storage type used by
+ * the rest of the engine.
+ */
+
+#if defined(_MSC_VER)
+    #define BU_ALIGN(n) __declspec(align(n))
+#else
+    #define BU_ALIGN(n) __attribute__((aligned(n)))
+#endif
+
+#if defined(USE_SIMD) && defined(USE_FLOAT) && defined(__SSE2__)
+    #include <emmintrin.h>
+    #define BU_VECTOR3A_SSE 1
+    #define BU_VECTOR3A_ALIGNMENT 16
+#elif defined(USE_SIMD) && !defined(USE_FLOAT) && defined(__AVX2__)
+    #include <immintrin.h>
+    #define BU_VECTOR3A_AVX 1
+    #define BU_VECTOR3A_ALIGNMENT 32
+#else
+    #define BU_VECTOR3A_ALIGNMENT (4 * sizeof(buReal))
+#endif
+
+typedef union BU_ALIGN(BU_VECTOR3A_ALIGNMENT) {
+    struct { buReal x, y, z, w; };
+    buReal v[4];
+#if defined(BU_VECTOR3A_SSE)
+    __m128 m;
+#elif defined(BU_VECTOR3A_AVX)
+    __m256d m;
+#endif
+} buVector3A;
+
+static inline buVector3A buVector3AMake(buReal x, buReal y, buReal z) {
+    buVector3A r;
+#if defined(BU_VECTOR3A_SSE)
+    r.m = _mm_set_ps(0.0f, z, y, x);
+#elif defined(BU_VECTOR3A_AVX)
+    r.m = _mm256_set_pd(0.0, z, y, x);
+#else
+    r.x = x; r.y = y; r.z = z; r.w = (buReal)0.0;
+#endif
+    return r;
+}
+
+static inline buVector3A buVector3AZero(void) {
+    buVector3A r;
+#if defined(BU_VECTOR3A_SSE)
+    r.m = _mm_setzero_ps();
+#elif defined(BU_VECTOR3A_AVX)
+    r.m = _mm256_setzero_pd();
+#else
+    for (int k = 0; k < 4; k++) r.v[k] = (buReal)0.0;
+#endif
+    return r;
+}
+
+static inline buVector3A buVector3AFromVector3(buVector3 v) {
+    return buVector3AMake(v.x, v.y, v.z);
+}
+
+static inline buVector3 buVector3AToVector3(buVector3A v) {
+    return (buVector3){v.x, v.y, v.z};
+}
+
+static inline buVector3A buVector3AAdd(buVector3A a, buVector3A b) {
+    buVector3A r;
+#if defined(BU_VECTOR3A_SSE)
+    r.m = _mm_add_ps(a.m, b.m);
+#elif defined(BU_VECTOR3A_AVX)
+    r.m = _mm256_add_pd(a.m, b.m);
+#else
+    for (int k = 0; k < 4; k++) r.v[k] = a.v[k] + b.v[k];
+#endif
+    return r;
+}
+
+static inline buVector3A buVector3ADifference(buVector3A a, buVector3A b) {
+    buVector3A r;
+#if defined(BU_VECTOR3A_SSE)
+    r.m = _mm_sub_ps(a.m, b.m);
+#elif defined(BU_VECTOR3A_AVX)
+    r.m = _mm256_sub_pd(a.m, b.m);
+#else
+    for (int k = 0; k < 4; k++) r.v[k] = a.v[k] - b.v[k];
+#endif
+    return r;
+}
+
+static inline buVector3A buVector3AScalar(buVector3A v, buReal scalar) {
+    buVector3A r;
+#if defined(BU_VECTOR3A_SSE)
+    r.m = _mm_mul_ps(v.m, _mm_set1_ps(scalar));
+#elif defined(BU_VECTOR3A_AVX)
+    r.m = _mm256_mul_pd(v.m, _mm256_set1_pd(scalar));
+#else
+    for (int k = 0; k < 4; k++) r.v[k] = v.v[k] * scalar;
+#endif
+    return r;
+}
+
+static inline buVector3A buVector3AComponentProduct(buVector3A a, buVector3A b) {
+    buVector3A r;
+#if defined(BU_VECTOR3A_SSE)
+    r.m = _mm_mul_ps(a.m, b.m);
+#elif defined(BU_VECTOR3A_AVX)
+    r.m = _mm256_mul_pd(a.m, b.m);
+#else
+    for (int k = 0; k < 4; k++) r.v[k] = a.v[k] * b.v[k];
+#endif
+    return r;
+}
+
+/**
+ * Returns a + b * scalar, the update used by integration and contact
+ * resolution.
+ */
+static inline buVector3A buVector3AAddScaled(buVector3A a, buVector3A b, buReal scalar) {
+    return buVector3AAdd(a, buVector3AScalar(b, scalar));
+}
+
+static inline buReal buVector3ADot(buVector3A a, buVector3A b) {
+#if defined(BU_VECTOR3A_SSE)
+    __m128 p = _mm_mul_ps(a.m, b.m);                        // x y z 0
+    __m128 s = _mm_add_ps(p, _mm_movehl_ps(p, p));          // x+z y+0 . .
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(s);
+#elif defined(BU_VECTOR3A_AVX)
+    __m256d p = _mm256_mul_pd(a.m, b.m);
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(p), _mm256_extractf128_pd(p, 1));
+    s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+    return _mm_cvtsd_f64(s);
+#else
+    return a.x*b.x + a.y*b.y + a.z*b.z;
+#endif
+}
+
+static inline buReal buVector3ASquareNorm(buVector3A v) {
+    return buVector3ADot(v, v);
+}
+
+static inline buReal buVector3ANorm(buVector3A v) {
+    return buSqrt(buVector3ADot(v, v));
+}
+
+static inline buVector3A buVector3ANormalise(buVector3A v) {
+    buReal length = buVector3ANorm(v);
+    #ifndef NDEBUG
+        assert(length != 0.0);
+    #endif
+    buVector3A r;
+#if defined(BU_VECTOR3A_SSE)
+    r.m = _mm_div_ps(v.m, _mm_set1_ps(length));
+#elif defined(BU_VECTOR3A_AVX)
+    r.m = _mm256_div_pd(v.m, _mm256_set1_pd(length));
+#else
+    for (int k = 0; k < 4; k++) r.v[k] = v.v[k] / length;
+#endif
+    return r;
+}
+
+static inline buVector3A buVector3ACross(buVector3A a, buVector3A b) {
+    buVector3A r;
+#if defined(BU_VECTOR3A_SSE)
+    // a x b = (a * b.yzx - a.yzx * b).yzx, w stays 0
+    __m128 a_yzx = _mm_shuffle_ps(a.m, a.m, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_yzx = _mm_shuffle_ps(b.m, b.m, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a.m, b_yzx), _mm_mul_ps(a_yzx, b.m));
+    r.m = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+#elif defined(BU_VECTOR3A_AVX)
+    __m256d a_yzx = _mm256_permute4x64_pd(a.m, _MM_SHUFFLE(3, 0, 2, 1));
+    __m256d b_yzx = _mm256_permute4x64_pd(b.m, _MM_SHUFFLE(3, 0, 2, 1));
+    __m256d c = _mm256_sub_pd(_mm256_mul_pd(a.m, b_yzx), _mm256_mul_pd(a_yzx, b.m));
+    r.m = _mm256_permute4x64_pd(c, _MM_SHUFFLE(3, 0, 2, 1));
+#else
+    r.x = a.y*b.z - a.z*b.y;
+    r.y = a.z*b.x - a.x*b.z;
+    r.z = a.x*b.y - a.y*b.x;
+    r.w = (buReal)0.0;
+#endif
+    return r;
+}
+
+#endif // VECTOR3A_H
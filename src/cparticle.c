@@ -7,7 +7,7 @@
 
 // Method definitions
 
-static void integrate(Particle *particle, buReal duration) {
+void Particle_integrate_impl(Particle *particle, buReal duration) {
     //printf("buVector3ParticleIntegrate:enter:duration: " REAL_FMT, duration);
     // Skip integration if particle has infinite mass (i.e. inverse mass is zero or negative)
     if (particle->_inverseMass <= 0.0f) return;
@@ -33,7 +33,7 @@ static void integrate(Particle *particle, buReal duration) {
         buPow(particle->_damping, duration));
 }
 
-static void set(Particle *particle, buVector3 position, buVector3 velocity, buVector3 acceleration, buReal damping, buReal inverseMass) {
+void Particle_set_impl(Particle *particle, buVector3 position, buVector3 velocity, buVector3 acceleration, buReal damping, buReal inverseMass) {
     //printf("Particle::set::enter\n");
     particle->_position = position;
     particle->_initial_position = position; // Store initial position
@@ -44,12 +44,12 @@ static void set(Particle *particle, buVector3 position, buVector3 velocity, buVe
     //printf("Particle::set::leave\n");
 }
 
-static void setMass(Particle *particle, const buReal mass) {
+void Particle_setMass_impl(Particle *particle, const buReal mass) {
     assert(mass != 0);
     particle->_inverseMass = ((buReal)1.0)/mass;
 }
 
-static buReal getMass(Particle *particle) {
+buReal Particle_getMass_impl(Particle *particle) {
     if (particle->_inverseMass == 0) {
         return REAL_MAX;
     } else {
@@ -57,58 +57,58 @@ static buReal getMass(Particle *particle) {
     }
 }
 
-static void setInverseMass(Particle *particle, const buReal inverseMass) {
+void Particle_setInverseMass_impl(Particle *particle, const buReal inverseMass) {
     particle->_inverseMass = inverseMass;
 }
 
-static buReal getInverseMass(Particle *particle) {
+buReal Particle_getInverseMass_impl(Particle *particle) {
     return particle->_inverseMass;
 }
 
-static bool hasFiniteMass(Particle *particle) {
+bool Particle_hasFiniteMass_impl(Particle *particle) {
     return particle->_inverseMass > 0.0f;
 }
 
-static void setDamping(Particle *particle, const buReal damping) {
+void Particle_setDamping_impl(Particle *particle, const buReal damping) {
     particle->_damping = damping;
 }
 
-buReal getDamping(Particle *particle) {
+buReal Particle_getDamping_impl(Particle *particle) {
     return particle->_damping;
 }
 
-static void setPosition(Particle *particle, const buVector3 position) {
+void Particle_setPosition_impl(Particle *particle, const buVector3 position) {
     particle->_position = position;
 }
 
-static buVector3 getPosition(Particle *particle) {
+buVector3 Particle_getPosition_impl(Particle *particle) {
     return particle->_position;
 }
 
-static void setVelocity(Particle *particle, const buVector3 velocity) {
+void Particle_setVelocity_impl(Particle *particle, const buVector3 velocity) {
     particle->_velocity = velocity;
 }
 
-static buVector3 getVelocity(Particle *particle) {
+buVector3 Particle_getVelocity_impl(Particle *particle) {
     return particle->_velocity;
 }
 
-static void setAcceleration(Particle *particle, const buVector3 acceleration) {
+void Particle_setAcceleration_impl(Particle *particle, const buVector3 acceleration) {
     particle->_acceleration = acceleration;
 }
 
-static buVector3 getAcceleration(Particle *particle) {
+buVector3 Particle_getAcceleration_impl(Particle *particle) {
     return particle->_acceleration;
 }
 
-static buReal getKE(Particle *particle) {
+buReal Particle_getKE_impl(Particle *particle) {
     assert(particle->_inverseMass > 0.0f); // Ensure inverse mass is positive
     buReal mass = 1.0 / particle->_inverseMass;
     buReal speedSquared = buVector3Dot(particle->_velocity, particle->_velocity);
     return 0.5 * mass * speedSquared;
 }
 
-static buReal getPE(Particle *particle, buReal y) {
+buReal Particle_getPE_impl(Particle *particle, buReal y) {
     // Potential Energy = m * g * h
     // Assuming g = 9.81 m/s^2 (standard gravity)
     assert(particle->_inverseMass > 0.0); // Ensure inverse mass is positive
@@ -118,22 +118,22 @@ static buReal getPE(Particle *particle, buReal y) {
     return mass * g * height;
 }
 
-static buReal getEnergy(Particle *particle) {
+buReal Particle_getEnergy_impl(Particle *particle) {
     // Total Energy = Kinetic Energy + Potential Energy
-    buReal ke = getKE(particle);
-    buReal pe = getPE(particle, particle->_initial_position.y);
+    buReal ke = Particle_getKE_impl(particle);
+    buReal pe = Particle_getPE_impl(particle, particle->_initial_position.y);
     return ke + pe;
 }
 
-static void clearAccumulator(Particle *particle) {
+void Particle_clearAccumulator_impl(Particle *particle) {
     particle->_forceAccum = (buVector3){0.0, 0.0, 0.0};
 }
 
-static void addForce(Particle *particle, const buVector3 force) {
+void Particle_addForce_impl(Particle *particle, const buVector3 force) {
     particle->_forceAccum = buVector3Add(particle->_forceAccum, force);
 }
 
-static buVector3 getForceAccum(Particle *particle) {
+buVector3 Particle_getForceAccum_impl(Particle *particle) {
     return particle->_forceAccum;
 }
 
@@ -167,27 +167,7 @@ void ParticleCreateClass() {
         particle_vtable.base = vTable; // inherit from VTable
 
         // methods
-        particle_vtable.integrate = integrate,
-        particle_vtable.set = set,
-        particle_vtable.setMass = setMass,
-        particle_vtable.getMass = getMass,
-        particle_vtable.setInverseMass = setInverseMass,
-        particle_vtable.getInverseMass = getInverseMass,
-        particle_vtable.hasFiniteMass = hasFiniteMass,
-        particle_vtable.setDamping = setDamping,
-        particle_vtable.getDamping = getDamping,
-        particle_vtable.setPosition = setPosition,
-        particle_vtable.getPosition = getPosition,
-        particle_vtable.setVelocity = setVelocity,
-        particle_vtable.getVelocity = getVelocity,
-        particle_vtable.setAcceleration = setAcceleration,
-        particle_vtable.getAcceleration = getAcceleration,
-        particle_vtable.clearAccumulator = clearAccumulator,
-        particle_vtable.addForce = addForce,
-        particle_vtable.getForceAccum = getForceAccum,
-        particle_vtable.getKE = getKE,
-        particle_vtable.getPE = getPE,
-        particle_vtable.getEnergy = getEnergy, 
+        OOP_VTABLE_INIT(PARTICLE_METHODS, Particle, particle_vtable);
 
         // init the particle class
         particleClass.base = class; // inherit from Class
@@ -32,9 +32,10 @@
 Cube *cube = NULL;
 ParticleForceRegistry *forceRegistry = NULL;
 Model model;
-ParticleContact *contacts[MAX_CONTACTS];
+ParticleContactBuffer *contactBuffer = NULL;
 Corner *corners[MAX_CONTACTS];
 ParticleContactResolver *contactResolver = NULL;
+ParticleContactCache *contactCache = NULL;
 
 void initCube() {
     printf("Contact::initCube:enter\n");
@@ -79,15 +80,21 @@ void init(Application *self) {
     ParticleContactResolverCreateClass();
     ParticleContactCreateClass();
     ParticleContactGeneratorCreateClass();
+    ParticleContactCacheCreateClass();
+    ParticleContactBufferCreateClass();
 
+    // Corner contacts persist while the cube rests, so warm starting
+    // them from the cache lets the resolver make do with fewer iterations
+    contactCache = (ParticleContactCache *)CLASS_METHOD(&particleContactCacheClass, new_instance);
+    assert(contactCache); // Check for allocation failure
     contactResolver = (ParticleContactResolver *)CLASS_METHOD(&particleContactResolverClass, new_instance);
     assert(contactResolver); // Check for allocation failure
-    INSTANCE_METHOD_AS(ParticleContactResolverVTable, contactResolver, setIterations, 16);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, contactResolver, setIterations, 8);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, contactResolver, setCache, contactCache);
 
-    for (size_t i = 0; i < MAX_CONTACTS; i++) {
-        contacts[i] = (ParticleContact *)CLASS_METHOD(&particleContactClass, new_instance);
-        assert(contacts[i]); // Check for allocation failure
-    }
+    contactBuffer = (ParticleContactBuffer *)CLASS_METHOD(&particleContactBufferClass, new_instance);
+    assert(contactBuffer); // Check for allocation failure
+    INSTANCE_METHOD_AS(ParticleContactBufferVTable, contactBuffer, reserve, MAX_CONTACTS);
 
     for (size_t i = 0; i < MAX_CONTACTS; i++) {
         corners[i] = (Corner *)malloc(sizeof(Corner));
@@ -122,6 +129,7 @@ void update(Application *self, buReal duration) {
     buVector3 position = INSTANCE_METHOD_AS(ParticleVTable, (Particle *)cube, getPosition);
 
     size_t numContacts = 0;
+    INSTANCE_METHOD_AS(ParticleContactBufferVTable, contactBuffer, clear);
     for(size_t i = 0; i < cube->_corners->_length; i++) {
         buVector3 r_b = *(buVector3 *)INSTANCE_METHOD_AS(VectorVTable, cube->_corners, get, i);
         buVector3 r_w = Matrix3x3MultiplyVector(cube->_R, r_b);
@@ -131,17 +139,19 @@ void update(Application *self, buReal duration) {
 
         // Check if corner is below ground
         if (rr_w.y < 0.0) {
-            ParticleContact *contact = contacts[numContacts++];
-            contact->_particle[0] = (Particle *)cube;
-            contact->_particle[1] = NULL; // No second particle
-            contact->_contactNormal = (buVector3){0.0, 1.0, 0.0}; // Normal pointing up
-            contact->_penetration = -rr_w.y; // Depth of penetration
-            contact->_restitution = 0.85; // Example restitution coefficient
+            ParticleContactRecord *contact = INSTANCE_METHOD_AS(ParticleContactBufferVTable, contactBuffer, append);
+            numContacts++;
+            contact->particle[0] = (Particle *)cube;
+            contact->particle[1] = NULL; // No second particle
+            contact->contactNormal = (buVector3){0.0, 1.0, 0.0}; // Normal pointing up
+            contact->penetration = -rr_w.y; // Depth of penetration
+            contact->restitution = 0.85; // Example restitution coefficient
+            contact->feature = (unsigned)i; // The corner, to find it in the cache next step
 
             Corner *corner = corners[numContacts - 1];
             corner->r_b = r_b; // Relative position in body frame
             corner->r_w = r_w; // Relative position in world frame
-            corner->normal = contact->_contactNormal; // Contact normal
+            corner->normal = contact->contactNormal; // Contact normal
             corner->restitution = 1.0; // Example restitution coefficient
         }
 
@@ -153,7 +163,10 @@ void update(Application *self, buReal duration) {
         INSTANCE_METHOD_AS(CubeVTable, cube, applyCornerImpluse, corners, numContacts);
 
         // Resolve contacts
-        INSTANCE_METHOD_AS(ParticleContactResolverVTable, contactResolver, resolveContacts, contacts, numContacts, duration);
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, contactResolver, resolveBuffer, contactBuffer, duration);
+    } else {
+        // In the air: nothing to warm start from when it lands again
+        INSTANCE_METHOD_AS(ParticleContactCacheVTable, contactCache, clear);
     }
 }
 
@@ -56,7 +56,7 @@ void setProjectionParameters() {
     buVector3 position = (buVector3){0.0, 0.0, 0.0};
     buVector3 velocity = (buVector3){initial_speed*buCos(angle_of_elevation*DEG2RAD), initial_speed*buSin(angle_of_elevation*DEG2RAD), 0.0};
     buVector3 acceleration = (buVector3){0.0, 0.0, 0.0};
-    INSTANCE_METHOD_AS(ParticleVTable, particle, set, position, velocity, acceleration, DAMPING, PARTICLE_MASS);
+    Particle_set(particle, position, velocity, acceleration, DAMPING, PARTICLE_MASS);
 }
 
 void init(Application *self) {
@@ -82,7 +82,7 @@ void init(Application *self) {
     assert(gravityForce); // Check for allocation failure
     INSTANCE_METHOD_AS(ParticleForceRegistryVTable, forceRegistry, add, particle, gravityForce);
     
-    total_energy = INSTANCE_METHOD_AS(ParticleVTable, particle, getEnergy);
+    total_energy = Particle_getEnergy(particle);
 
     setTarget(TARGET);
     setCameraDistance(CAMERA_DISTANCE);
@@ -106,18 +106,18 @@ const char* getTitle(Application *self) {
 
 
 void update(Application *self, buReal duration) {
-    INSTANCE_METHOD_AS(ParticleVTable, particle, clearAccumulator);
+    Particle_clearAccumulator(particle);
     INSTANCE_METHOD_AS(ParticleForceRegistryVTable, forceRegistry, updateForces, duration);
 
-    buReal inverseMass = INSTANCE_METHOD_AS(ParticleVTable, particle, getInverseMass);
+    buReal inverseMass = Particle_getInverseMass(particle);
     assert(inverseMass > 0.0); // Ensure inverse mass is positive
-    buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, particle, getForceAccum);
-    INSTANCE_METHOD_AS(ParticleVTable, particle, setAcceleration, buVector3Scalar(force, inverseMass));
-    INSTANCE_METHOD_AS(ParticleVTable, particle, integrate, duration);
+    buVector3 force = Particle_getForceAccum(particle);
+    Particle_setAcceleration(particle, buVector3Scalar(force, inverseMass));
+    Particle_integrate(particle, duration);
     // Calculate total energy
-    total_energy = INSTANCE_METHOD_AS(ParticleVTable, particle, getEnergy);
+    total_energy = Particle_getEnergy(particle);
 
-    buVector3 position = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
+    buVector3 position = Particle_getPosition(particle);
     if (position.y < 0.0) {
         current_max_height = max_height;
         current_range = range;
@@ -145,7 +145,7 @@ void update(Application *self, buReal duration) {
 }
 
 void display(Application *self) {
-    buVector3 position = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
+    buVector3 position = Particle_getPosition(particle);
     DrawCube((Vector3){position.x, position.y, position.z}, PARTICLE_SIZE, PARTICLE_SIZE, PARTICLE_SIZE, PARTICLE_COLOR);
 
 }
@@ -63,7 +63,7 @@ void init(Application *self) {
     ParticleCreateClass();
     ParticleForceGeneratorCreateClass();
     ParticleAnchoredSpringCreateClass();
-    ParticleSpringCreateClass();
+    ParticlePairSpringCreateClass();
     ParticleGravityCreateClass();
     ParticleForceRegistryCreateClass();
 
@@ -94,12 +94,11 @@ void init(Application *self) {
             INSTANCE_METHOD_AS(ParticleForceRegistryVTable, forceRegistry, add, particles[i], spring);
             continue;
         }
+        // One pair spring per link pulls on both ends
         Particle *a = particles[i - 1];
         Particle *b = particles[i];
-        ParticleForceGenerator *spring_a = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, new_instance, a, SPRING_CONSTANT, REST_LENGTH);
-        ParticleForceGenerator *spring_b = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, new_instance, b, SPRING_CONSTANT, REST_LENGTH);
-        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, forceRegistry, add, a, spring_b);
-        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, forceRegistry, add, b, spring_a);
+        ParticleForceGenerator *spring = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticlePairSpringClass, &particlePairSpringClass, new_instance, a, b, SPRING_CONSTANT, REST_LENGTH);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, forceRegistry, add, a, spring);
     }
 
     // Add gravity force generator to all particles
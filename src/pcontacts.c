@@ -3,18 +3,53 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /////////////////////////////////////////////////////////////
 // ParticleContact
 /////////////////////////////////////////////////////////////
 
+// Particle state as the contact kernels see it. Plain particles are
+// read and written in place; anything else, such as a WorldParticle
+// view, goes through its methods
+static inline bool pc_isPlain(const Particle *particle) {
+    return ((const Object *)particle)->klass == (const Class *)&particleClass;
+}
+
+static inline buVector3 pc_getPosition(Particle *particle) {
+    return pc_isPlain(particle) ? particle->_position : INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
+}
+
+static inline buVector3 pc_getVelocity(Particle *particle) {
+    return pc_isPlain(particle) ? particle->_velocity : INSTANCE_METHOD_AS(ParticleVTable, particle, getVelocity);
+}
+
+static inline buVector3 pc_getAcceleration(Particle *particle) {
+    return pc_isPlain(particle) ? particle->_acceleration : INSTANCE_METHOD_AS(ParticleVTable, particle, getAcceleration);
+}
+
+static inline buReal pc_getInverseMass(Particle *particle) {
+    return pc_isPlain(particle) ? particle->_inverseMass : INSTANCE_METHOD_AS(ParticleVTable, particle, getInverseMass);
+}
 
+static inline void pc_setPosition(Particle *particle, buVector3 position) {
+    if (pc_isPlain(particle)) particle->_position = position;
+    else INSTANCE_METHOD_AS(ParticleVTable, particle, setPosition, position);
+}
+
+static inline void pc_setVelocity(Particle *particle, buVector3 velocity) {
+    if (pc_isPlain(particle)) particle->_velocity = velocity;
+    else INSTANCE_METHOD_AS(ParticleVTable, particle, setVelocity, velocity);
+}
 
-static buReal pc_calculateSeparatingVelocity(ParticleContact *self) {
+buReal ParticleContact_calculateSeparatingVelocity_impl(ParticleContact *self) {
     //printf("ParticleContact::calculateSeparatingVelocity:enter\n");
-    buVector3 relativeVelocity = INSTANCE_METHOD_AS(ParticleVTable, self->_particle[0], getVelocity);
+    buVector3 relativeVelocity = pc_getVelocity(self->_particle[0]);
     if (self->_particle[1]) {
-        relativeVelocity = buVector3Difference(relativeVelocity, INSTANCE_METHOD_AS(ParticleVTable, self->_particle[1], getVelocity));
+        relativeVelocity = buVector3Difference(relativeVelocity, pc_getVelocity(self->_particle[1]));
     }
     //printf("ParticleContact::calculateSeparatingVelocity:relativeVelocity:(%f, %f, %f)\n", relativeVelocity.x, relativeVelocity.y, relativeVelocity.z);
     return buVector3Dot(relativeVelocity, self->_contactNormal);
@@ -23,7 +58,7 @@ static buReal pc_calculateSeparatingVelocity(ParticleContact *self) {
 static void pc_resolveVelocity(ParticleContact *self, buReal duration) {
     //printf("ParticleContact::resolveVelocity:enter: duration:%f\n", duration);
     // Find the velocity in the direction of the contact
-    buReal separatingVelocity = pc_calculateSeparatingVelocity(self);
+    buReal separatingVelocity = ParticleContact_calculateSeparatingVelocity_impl(self);
 
     // Check if it needs to be resolved
     if (separatingVelocity > 0)
@@ -37,10 +72,10 @@ static void pc_resolveVelocity(ParticleContact *self, buReal duration) {
     buReal newSepVelocity = -separatingVelocity * self->_restitution;
 
     // Check the velocity build-up due to acceleration only
-    buVector3 accCausedVelocity = INSTANCE_METHOD_AS(ParticleVTable, self->_particle[0], getAcceleration);
+    buVector3 accCausedVelocity = pc_getAcceleration(self->_particle[0]);
     
     if (self->_particle[1]) {
-        accCausedVelocity = buVector3Difference(accCausedVelocity, INSTANCE_METHOD_AS(ParticleVTable, self->_particle[1], getAcceleration));
+        accCausedVelocity = buVector3Difference(accCausedVelocity, pc_getAcceleration(self->_particle[1]));
     }
     buReal accCausedSepVelocity = buVector3Dot(accCausedVelocity, self->_contactNormal) * duration;
 
@@ -60,14 +95,15 @@ static void pc_resolveVelocity(ParticleContact *self, buReal duration) {
     // We apply the change in velocity to each object in proportion to
     // their inverse mass (i.e. those with lower inverse mass [higher
     // actual mass] get less change in velocity)..
-    buReal totalInverseMass = INSTANCE_METHOD_AS(ParticleVTable, self->_particle[0], getInverseMass);
-    if (self->_particle[1]) totalInverseMass += INSTANCE_METHOD_AS(ParticleVTable, self->_particle[1], getInverseMass);
+    buReal totalInverseMass = pc_getInverseMass(self->_particle[0]);
+    if (self->_particle[1]) totalInverseMass += pc_getInverseMass(self->_particle[1]);
 
     // If all particles have infinite mass, then impulses have no effect
     if (totalInverseMass <= 0) return;
 
     // Calculate the impulse to apply
     buReal impulse = deltaVelocity / totalInverseMass;
+    self->_impulse += impulse;
 
     // Find the amount of impulse per unit of inverse mass
     buVector3 impulsePerIMass = buVector3Scalar(self->_contactNormal, impulse);
@@ -75,21 +111,21 @@ static void pc_resolveVelocity(ParticleContact *self, buReal duration) {
     // Apply impulses: they are applied in the direction of the contact,
     // and are proportional to the inverse mass.
     buVector3 velocity = buVector3Add(
-        INSTANCE_METHOD_AS(ParticleVTable, self->_particle[0], getVelocity),
+        pc_getVelocity(self->_particle[0]),
         buVector3Scalar(
             impulsePerIMass,
-            INSTANCE_METHOD_AS(ParticleVTable, self->_particle[0], getInverseMass)));
-    INSTANCE_METHOD_AS(ParticleVTable, self->_particle[0], setVelocity, velocity);
+            pc_getInverseMass(self->_particle[0])));
+    pc_setVelocity(self->_particle[0], velocity);
 
     if (self->_particle[1])
     {
         // Particle 1 goes in the opposite direction
         velocity = buVector3Add(
-                INSTANCE_METHOD_AS(ParticleVTable, self->_particle[1], getVelocity),
+                pc_getVelocity(self->_particle[1]),
                 buVector3Scalar(
                     impulsePerIMass,
-                    -INSTANCE_METHOD_AS(ParticleVTable, self->_particle[1], getInverseMass)));
-        INSTANCE_METHOD_AS(ParticleVTable, self->_particle[1], setVelocity, velocity);
+                    -pc_getInverseMass(self->_particle[1])));
+        pc_setVelocity(self->_particle[1], velocity);
     }
     //printf("ParticleContact::resolveVelocity:leave\n");
 }
@@ -101,10 +137,10 @@ static void pc_resolveInterpenetration(ParticleContact *self, buReal duration) {
 
     // The movement of each object is based on their inverse mass, so
     // total that.
-    buReal totalInverseMass = INSTANCE_METHOD_AS(ParticleVTable, self->_particle[0], getInverseMass);
+    buReal totalInverseMass = pc_getInverseMass(self->_particle[0]);
     //printf("ParticleContact::resolveInterpenetration:totalInverseMass:%f\n", totalInverseMass);
     if (self->_particle[1]) {
-        totalInverseMass += INSTANCE_METHOD_AS(ParticleVTable, self->_particle[1], getInverseMass);
+        totalInverseMass += pc_getInverseMass(self->_particle[1]);
     }
     //printf("ParticleContact::resolveInterpenetration:totalInverseMass:%f\n", totalInverseMass);
     // If all particles have infinite mass, then we do nothing
@@ -117,24 +153,24 @@ static void pc_resolveInterpenetration(ParticleContact *self, buReal duration) {
     buVector3 movePerIMass = buVector3Scalar(self->_contactNormal, (self->_penetration / totalInverseMass));
     //printf("ParticleContact::resolveInterpenetration:movePerIMass:(%f, %f, %f)\n", movePerIMass.x, movePerIMass.y, movePerIMass.z);
     // Calculate the the movement amounts
-    self->_particleMovement[0] = buVector3Scalar(movePerIMass, INSTANCE_METHOD_AS(ParticleVTable, self->_particle[0], getInverseMass));
+    self->_particleMovement[0] = buVector3Scalar(movePerIMass, pc_getInverseMass(self->_particle[0]));
     //printf("ParticleContact::resolveInterpenetration:particleMovement[0]:(%f, %f, %f)\n", self->_particleMovement[0].x, self->_particleMovement[0].y, self->_particleMovement[0].z);
     if (self->_particle[1]) {
-        self->_particleMovement[1] = buVector3Scalar(movePerIMass, -INSTANCE_METHOD_AS(ParticleVTable, self->_particle[1], getInverseMass));
+        self->_particleMovement[1] = buVector3Scalar(movePerIMass, -pc_getInverseMass(self->_particle[1]));
     }
 
     // Apply the penetration resolution
-    buVector3 position = buVector3Add(INSTANCE_METHOD_AS(ParticleVTable, self->_particle[0], getPosition), self->_particleMovement[0]);
+    buVector3 position = buVector3Add(pc_getPosition(self->_particle[0]), self->_particleMovement[0]);
     //printf("ParticleContact::resolveInterpenetration:particle[0] position:(%f, %f, %f)\n", position.x, position.y, position.z);
-    INSTANCE_METHOD_AS(ParticleVTable, self->_particle[0], setPosition, position);
+    pc_setPosition(self->_particle[0], position);
     if (self->_particle[1]) {
-        position = buVector3Add(INSTANCE_METHOD_AS(ParticleVTable, self->_particle[1], getPosition), self->_particleMovement[1]);
-        INSTANCE_METHOD_AS(ParticleVTable, self->_particle[1], setPosition, position);
+        position = buVector3Add(pc_getPosition(self->_particle[1]), self->_particleMovement[1]);
+        pc_setPosition(self->_particle[1], position);
     }
     //printf("ParticleContact::resolveInterpenetration:leave\n");
 }
 
-static void pc_resolve(ParticleContact *self, buReal duration) {
+void ParticleContact_resolve_impl(ParticleContact *self, buReal duration) {
     //printf("ParticleContact::resolve:enter: duration:%f\n", duration);
     pc_resolveVelocity(self, duration);
     pc_resolveInterpenetration(self, duration);
@@ -157,6 +193,10 @@ static Object *pc_new_instance(const Class *cls) {
     ParticleContact *p = malloc(sizeof(ParticleContact));
     assert(p);  // Check for allocation failure
     ((Object *)p)->klass = cls;
+    p->_particleMovement[0] = (buVector3){0.0, 0.0, 0.0};
+    p->_particleMovement[1] = (buVector3){0.0, 0.0, 0.0};
+    p->_feature = 0;
+    p->_impulse = 0;
     //printf("ParticleContact::new_instance:leave\n");
     return (Object *)p;
 }
@@ -173,8 +213,7 @@ void ParticleContactCreateClass() {
         pc_vtable.base = vTable; // inherit from VTable
 
         // methods
-        pc_vtable.resolve = pc_resolve;
-        pc_vtable.calculateSeparatingVelocity = pc_calculateSeparatingVelocity;
+        OOP_VTABLE_INIT(PARTICLE_CONTACT_METHODS, ParticleContact, pc_vtable);
 
 
         // init the particle class
@@ -192,6 +231,335 @@ void ParticleContactCreateClass() {
 
 
 
+/////////////////////////////////////////////////////////////
+// ParticleContactBuffer
+/////////////////////////////////////////////////////////////
+
+static void pcb_reserve(ParticleContactBuffer *self, unsigned capacity) {
+    if (capacity <= self->_capacity) return;
+    self->_records = realloc(self->_records, capacity * sizeof(ParticleContactRecord));
+    self->_movement = realloc(self->_movement, capacity * sizeof(*self->_movement));
+    assert(self->_records && self->_movement);  // Check for allocation failure
+    self->_capacity = capacity;
+}
+
+static void pcb_clear(ParticleContactBuffer *self) {
+    self->_count = 0;
+}
+
+static unsigned pcb_getCount(const ParticleContactBuffer *self) {
+    return self->_count;
+}
+
+static ParticleContactRecord *pcb_get(ParticleContactBuffer *self, unsigned index) {
+    assert(index < self->_count);
+    return &self->_records[index];
+}
+
+static ParticleContactRecord *pcb_append(ParticleContactBuffer *self) {
+    if (self->_count == self->_capacity) {
+        pcb_reserve(self, self->_capacity ? 2 * self->_capacity : 64);
+    }
+    unsigned index = self->_count++;
+    self->_movement[index][0] = (buVector3){0.0, 0.0, 0.0};
+    self->_movement[index][1] = (buVector3){0.0, 0.0, 0.0};
+    ParticleContactRecord *record = &self->_records[index];
+    *record = (ParticleContactRecord){{NULL, NULL}, {{0.0, 0.0, 0.0}}, 0, 0, 0, 0};
+    return record;
+}
+
+static void pcb_appendContacts(ParticleContactBuffer *self, ParticleContact **contactArray, unsigned numContacts) {
+    pcb_reserve(self, self->_count + numContacts);
+    for (unsigned i = 0; i < numContacts; i++) {
+        const ParticleContact *contact = contactArray[i];
+        unsigned index = self->_count++;
+        self->_records[index] = (ParticleContactRecord){
+            {contact->_particle[0], contact->_particle[1]}, contact->_contactNormal,
+            contact->_penetration, contact->_restitution, contact->_impulse, contact->_feature};
+        self->_movement[index][0] = contact->_particleMovement[0];
+        self->_movement[index][1] = contact->_particleMovement[1];
+    }
+}
+
+static void pcb_storeContacts(const ParticleContactBuffer *self, unsigned first, ParticleContact **contactArray, unsigned numContacts) {
+    assert(first + numContacts <= self->_count);
+    for (unsigned i = 0; i < numContacts; i++) {
+        ParticleContact *contact = contactArray[i];
+        const ParticleContactRecord *record = &self->_records[first + i];
+        contact->_penetration = record->penetration;
+        contact->_impulse = record->impulse;
+        contact->_particleMovement[0] = self->_movement[first + i][0];
+        contact->_particleMovement[1] = self->_movement[first + i][1];
+    }
+}
+
+ParticleContactBufferClass particleContactBufferClass;
+ParticleContactBufferVTable pcb_vtable;
+
+// free object
+void pcb_free_instance(const Class *cls, Object *self) {
+    printf("ParticleContactBuffer::free_instance:enter\n");
+    ParticleContactBuffer *buffer = (ParticleContactBuffer *)self;
+    free(buffer->_records);
+    free(buffer->_movement);
+    free(buffer->_contacts);
+    free(self);
+    printf("ParticleContactBuffer::free_instance:leave\n");
+}
+
+// new object
+static Object *pcb_new_instance(const Class *cls) {
+    ParticleContactBuffer *p = malloc(sizeof(ParticleContactBuffer));
+    assert(p);  // Check for allocation failure
+    ((Object *)p)->klass = cls;
+    p->_records = NULL;
+    p->_movement = NULL;
+    p->_count = 0;
+    p->_capacity = 0;
+    p->_contacts = NULL;
+    p->_contactCapacity = 0;
+    return (Object *)p;
+}
+
+static const char *pcb_get_name(ParticleContactBufferClass *cls) {
+    return cls->class_name;
+}
+
+static bool pcb_initialized = false;
+void ParticleContactBufferCreateClass() {
+    printf("ParticleContactBufferCreateClass:enter\n");
+    if (!pcb_initialized) {
+        printf("ParticleContactBufferCreateClass:initializing\n");
+        ParticleContactCreateClass();
+        pcb_vtable.base = vTable; // inherit from VTable
+
+        // methods
+        pcb_vtable.reserve = pcb_reserve;
+        pcb_vtable.clear = pcb_clear;
+        pcb_vtable.getCount = pcb_getCount;
+        pcb_vtable.get = pcb_get;
+        pcb_vtable.append = pcb_append;
+        pcb_vtable.appendContacts = pcb_appendContacts;
+        pcb_vtable.storeContacts = pcb_storeContacts;
+
+        // init the buffer class
+        particleContactBufferClass.base = class; // inherit from Class
+        particleContactBufferClass.base.vtable = (VTable *)&pcb_vtable;
+        particleContactBufferClass.base.new_instance = pcb_new_instance;
+        particleContactBufferClass.base.free = pcb_free_instance;
+        particleContactBufferClass.class_name = strdup("ParticleContactBuffer");
+        particleContactBufferClass.get_name = pcb_get_name;
+
+        pcb_initialized = true;
+    }
+    printf("ParticleContactBufferCreateClass:leave\n");
+}
+
+
+
+/////////////////////////////////////////////////////////////
+// ParticleContactCache
+/////////////////////////////////////////////////////////////
+
+// Fibonacci hashing of the pair and feature
+static unsigned pcc_hash(Particle *const particle[2], unsigned feature, unsigned mask) {
+    uint64_t key = ((uint64_t)(uintptr_t)particle[0] >> 4) * 31 + ((uint64_t)(uintptr_t)particle[1] >> 4);
+    key = key * 31 + feature;
+    return (unsigned)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+static unsigned pcc_find(const ParticleContactCache *self, Particle *const particle[2], unsigned feature) {
+    if (self->_count == 0) return PCR_NONE;
+    unsigned mask = self->_tableSize - 1;
+    for (unsigned h = pcc_hash(particle, feature, mask), e; (e = self->_table[h]) != PCR_NONE; h = (h + 1) & mask) {
+        const ParticleContactCacheEntry *entry = &self->_entries[e];
+        if (entry->particle[0] == particle[0] && entry->particle[1] == particle[1] && entry->feature == feature) return e;
+    }
+    return PCR_NONE;
+}
+
+static void pcc_setWarmStartFactor(ParticleContactCache *self, buReal factor) {
+    assert(factor >= 0 && factor <= 1);
+    self->_warmStartFactor = factor;
+}
+
+static unsigned pcc_getCount(const ParticleContactCache *self) {
+    return self->_count;
+}
+
+static unsigned pcc_getHitCount(const ParticleContactCache *self) {
+    return self->_hits;
+}
+
+// Warm starts one contact, returning the impulse applied
+static buReal pcc_warmStartContact(ParticleContactCache *self, Particle *const particle[2], unsigned feature, buVector3 normal) {
+    unsigned e = pcc_find(self, particle, feature);
+    if (e == PCR_NONE) return 0;
+    self->_hits++;
+
+    // Last step's impulse, less what no longer acts along the normal
+    const ParticleContactCacheEntry *entry = &self->_entries[e];
+    buReal alignment = buVector3Dot(entry->normal, normal);
+    if (alignment <= 0) return 0;
+    buReal impulse = entry->impulse * self->_warmStartFactor * alignment;
+
+    buReal totalInverseMass = pc_getInverseMass(particle[0]);
+    if (particle[1]) totalInverseMass += pc_getInverseMass(particle[1]);
+    if (totalInverseMass <= 0) return 0;
+
+    // A contact already coming apart, say one that just bounced,
+    // is not pushed again
+    buVector3 relativeVelocity = pc_getVelocity(particle[0]);
+    if (particle[1]) {
+        relativeVelocity = buVector3Difference(relativeVelocity, pc_getVelocity(particle[1]));
+    }
+    if (buVector3Dot(relativeVelocity, normal) > 0) return 0;
+    if (impulse <= 0) return 0;
+
+    buVector3 impulsePerIMass = buVector3Scalar(normal, impulse);
+    buVector3 velocity = buVector3Add(
+        pc_getVelocity(particle[0]),
+        buVector3Scalar(impulsePerIMass, pc_getInverseMass(particle[0])));
+    pc_setVelocity(particle[0], velocity);
+    if (particle[1]) {
+        velocity = buVector3Add(
+            pc_getVelocity(particle[1]),
+            buVector3Scalar(impulsePerIMass, -pc_getInverseMass(particle[1])));
+        pc_setVelocity(particle[1], velocity);
+    }
+    return impulse;
+}
+
+static void pcc_warmStart(ParticleContactCache *self, ParticleContact **contactArray, unsigned numContacts) {
+    self->_hits = 0;
+    for (unsigned i = 0; i < numContacts; i++) {
+        ParticleContact *contact = contactArray[i];
+        contact->_impulse = pcc_warmStartContact(self, contact->_particle, contact->_feature, contact->_contactNormal);
+    }
+}
+
+static void pcc_warmStartBuffer(ParticleContactCache *self, ParticleContactBuffer *buffer) {
+    self->_hits = 0;
+    for (unsigned i = 0; i < buffer->_count; i++) {
+        ParticleContactRecord *record = &buffer->_records[i];
+        record->impulse = pcc_warmStartContact(self, record->particle, record->feature, record->contactNormal);
+    }
+}
+
+// Empties the cache, ready for numContacts entries
+static void pcc_reset(ParticleContactCache *self, unsigned numContacts) {
+    if (numContacts > self->_capacity) {
+        unsigned capacity = self->_capacity ? self->_capacity : 16;
+        while (capacity < numContacts) capacity *= 2;
+        self->_entries = realloc(self->_entries, capacity * sizeof(ParticleContactCacheEntry));
+        // At most half full
+        self->_tableSize = 2 * capacity;
+        self->_table = realloc(self->_table, self->_tableSize * sizeof(unsigned));
+        assert(self->_entries && self->_table);  // Check for allocation failure
+        self->_capacity = capacity;
+    }
+    if (self->_tableSize) memset(self->_table, 0xff, self->_tableSize * sizeof(unsigned));
+    self->_count = 0;
+}
+
+// Adds an entry, unless the key is already there
+static void pcc_insert(ParticleContactCache *self, Particle *const particle[2], unsigned feature, buVector3 normal, buReal impulse) {
+    unsigned mask = self->_tableSize - 1;
+    unsigned h = pcc_hash(particle, feature, mask);
+    for (unsigned e; (e = self->_table[h]) != PCR_NONE; h = (h + 1) & mask) {
+        const ParticleContactCacheEntry *entry = &self->_entries[e];
+        if (entry->particle[0] == particle[0] && entry->particle[1] == particle[1] && entry->feature == feature) return;
+    }
+    self->_entries[self->_count] = (ParticleContactCacheEntry){{particle[0], particle[1]}, feature, normal, impulse};
+    self->_table[h] = self->_count++;
+}
+
+static void pcc_store(ParticleContactCache *self, ParticleContact **contactArray, unsigned numContacts) {
+    pcc_reset(self, numContacts);
+    for (unsigned i = 0; i < numContacts; i++) {
+        const ParticleContact *contact = contactArray[i];
+        pcc_insert(self, contact->_particle, contact->_feature, contact->_contactNormal, contact->_impulse);
+    }
+}
+
+static void pcc_storeBuffer(ParticleContactCache *self, const ParticleContactBuffer *buffer) {
+    pcc_reset(self, buffer->_count);
+    for (unsigned i = 0; i < buffer->_count; i++) {
+        const ParticleContactRecord *record = &buffer->_records[i];
+        pcc_insert(self, record->particle, record->feature, record->contactNormal, record->impulse);
+    }
+}
+
+static void pcc_clear(ParticleContactCache *self) {
+    self->_count = 0;
+    self->_hits = 0;
+}
+
+ParticleContactCacheClass particleContactCacheClass;
+ParticleContactCacheVTable pcc_vtable;
+
+// free object
+void pcc_free_instance(const Class *cls, Object *self) {
+    printf("ParticleContactCache::free_instance:enter\n");
+    ParticleContactCache *cache = (ParticleContactCache *)self;
+    free(cache->_entries);
+    free(cache->_table);
+    free(self);
+    printf("ParticleContactCache::free_instance:leave\n");
+}
+
+// new object
+static Object *pcc_new_instance(const Class *cls) {
+    ParticleContactCache *p = malloc(sizeof(ParticleContactCache));
+    assert(p);  // Check for allocation failure
+    ((Object *)p)->klass = cls;
+    p->_entries = NULL;
+    p->_count = 0;
+    p->_capacity = 0;
+    p->_table = NULL;
+    p->_tableSize = 0;
+    p->_warmStartFactor = (buReal)0.9;
+    p->_hits = 0;
+    return (Object *)p;
+}
+
+static const char *pcc_get_name(ParticleContactCacheClass *cls) {
+    return cls->class_name;
+}
+
+static bool pcc_initialized = false;
+void ParticleContactCacheCreateClass() {
+    printf("ParticleContactCacheCreateClass:enter\n");
+    if (!pcc_initialized) {
+        printf("ParticleContactCacheCreateClass:initializing\n");
+        ParticleContactBufferCreateClass();
+        pcc_vtable.base = vTable; // inherit from VTable
+
+        // methods
+        pcc_vtable.setWarmStartFactor = pcc_setWarmStartFactor;
+        pcc_vtable.getCount = pcc_getCount;
+        pcc_vtable.getHitCount = pcc_getHitCount;
+        pcc_vtable.warmStart = pcc_warmStart;
+        pcc_vtable.store = pcc_store;
+        pcc_vtable.warmStartBuffer = pcc_warmStartBuffer;
+        pcc_vtable.storeBuffer = pcc_storeBuffer;
+        pcc_vtable.clear = pcc_clear;
+
+        // init the cache class
+        particleContactCacheClass.base = class; // inherit from Class
+        particleContactCacheClass.base.vtable = (VTable *)&pcc_vtable;
+        particleContactCacheClass.base.new_instance = pcc_new_instance;
+        particleContactCacheClass.base.free = pcc_free_instance;
+        particleContactCacheClass.class_name = strdup("ParticleContactCache");
+        particleContactCacheClass.get_name = pcc_get_name;
+
+        pcc_initialized = true;
+    }
+    printf("ParticleContactCacheCreateClass:leave\n");
+}
+
+
+
 /////////////////////////////////////////////////////////////
 // ParticleContactResolver
 /////////////////////////////////////////////////////////////
@@ -201,22 +569,176 @@ static void pcr_setIterations(ParticleContactResolver *self,  unsigned iteration
     self->_iterations = iterations;
 }
 
-static void pcr_resolveContacts(
-        ParticleContactResolver *self,  
+static void pcr_setMode(ParticleContactResolver *self, ParticleContactResolverMode mode) {
+    self->_mode = mode;
+}
+
+static void pcr_reserve(ParticleContactResolver *self, unsigned numContacts) {
+    if (numContacts <= self->_capacity) return;
+    unsigned capacity = self->_capacity ? self->_capacity : 64;
+    while (capacity < numContacts) capacity *= 2;
+    self->_contactEnds = realloc(self->_contactEnds, 2 * capacity * sizeof(unsigned));
+    self->_adjacencyStart = realloc(self->_adjacencyStart, (2 * capacity + 1) * sizeof(unsigned));
+    self->_adjacency = realloc(self->_adjacency, 2 * capacity * sizeof(unsigned));
+    self->_particles = realloc(self->_particles, 2 * capacity * sizeof(Particle *));
+    assert(self->_contactEnds && self->_adjacencyStart && self->_adjacency && self->_particles);  // Check for allocation failure
+
+    // At most 2 particles per contact, and the table at most a quarter full
+    free(self->_particleTable);
+    self->_particleTableSize = 8 * capacity;
+    self->_particleTable = malloc(self->_particleTableSize * sizeof(unsigned));
+    assert(self->_particleTable);  // Check for allocation failure
+
+    self->_heap = realloc(self->_heap, capacity * sizeof(unsigned));
+    self->_heapPosition = realloc(self->_heapPosition, capacity * sizeof(unsigned));
+    self->_separatingVelocity = realloc(self->_separatingVelocity, capacity * sizeof(buReal));
+    self->_resolvable = realloc(self->_resolvable, capacity * sizeof(bool));
+    self->_touched = realloc(self->_touched, capacity * sizeof(unsigned));
+    assert(self->_heap && self->_heapPosition && self->_separatingVelocity && self->_resolvable && self->_touched);  // Check for allocation failure
+
+    self->_particleColors = realloc(self->_particleColors, 2 * capacity * sizeof(uint64_t));
+    self->_colorOrder = realloc(self->_colorOrder, capacity * sizeof(unsigned));
+    self->_basePenetration = realloc(self->_basePenetration, capacity * sizeof(buReal));
+    self->_displacement = realloc(self->_displacement, 2 * capacity * sizeof(buVector3));
+    assert(self->_particleColors && self->_colorOrder && self->_basePenetration && self->_displacement);  // Check for allocation failure
+
+    self->_islandParent = realloc(self->_islandParent, 2 * capacity * sizeof(unsigned));
+    self->_islandContacts = realloc(self->_islandContacts, capacity * sizeof(ParticleContact *));
+    self->_islands = realloc(self->_islands, capacity * sizeof(ParticleContactIsland));
+    assert(self->_islandParent && self->_islandContacts && self->_islands);  // Check for allocation failure
+
+    self->_recordEnds = realloc(self->_recordEnds, 2 * capacity * sizeof(unsigned));
+    self->_statePosition = realloc(self->_statePosition, 2 * capacity * sizeof(buVector3));
+    self->_stateVelocity = realloc(self->_stateVelocity, 2 * capacity * sizeof(buVector3));
+    self->_stateAcceleration = realloc(self->_stateAcceleration, 2 * capacity * sizeof(buVector3));
+    self->_stateInverseMass = realloc(self->_stateInverseMass, 2 * capacity * sizeof(buReal));
+    assert(self->_recordEnds && self->_statePosition && self->_stateVelocity && self->_stateAcceleration && self->_stateInverseMass);  // Check for allocation failure
+    self->_capacity = capacity;
+}
+
+// Fibonacci hashing of the particle address, as in the force registry
+static unsigned pcr_hashParticle(const Particle *particle, unsigned mask) {
+    uint64_t key = (uint64_t)(uintptr_t)particle >> 4;
+    return (unsigned)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+static unsigned pcr_particleId(ParticleContactResolver *self, Particle *particle, unsigned *particleCount) {
+    unsigned mask = self->_particleTableSize - 1;
+    unsigned h = pcr_hashParticle(particle, mask);
+    for (unsigned id; (id = self->_particleTable[h]) != PCR_NONE; h = (h + 1) & mask) {
+        if (self->_particles[id] == particle) return id;
+    }
+    unsigned id = (*particleCount)++;
+    self->_particles[id] = particle;
+    self->_particleTable[h] = id;
+    return id;
+}
+
+// Builds the particle -> contact adjacency for one call of
+// resolveContacts
+static inline void pcr_setContactEnds(ParticleContactResolver *self, unsigned index, Particle *const particle[2], unsigned *particleCount) {
+    self->_contactEnds[2 * index] = pcr_particleId(self, particle[0], particleCount);
+    // A contact is listed once for a particle, even if it is both ends
+    self->_contactEnds[2 * index + 1] = (particle[1] && particle[1] != particle[0])
+        ? pcr_particleId(self, particle[1], particleCount) : PCR_NONE;
+}
+
+// Turns the contact ends into the adjacency
+static void pcr_fillAdjacency(ParticleContactResolver *self, unsigned numContacts, unsigned particleCount) {
+    // Count, turn the counts into range ends, then fill backwards so
+    // each range ends up starting at _adjacencyStart[id], ascending
+    unsigned *start = self->_adjacencyStart;
+    memset(start, 0, (particleCount + 1) * sizeof(unsigned));
+    for (unsigned e = 0; e < 2 * numContacts; e++) {
+        if (self->_contactEnds[e] != PCR_NONE) start[self->_contactEnds[e]]++;
+    }
+    for (unsigned id = 1; id <= particleCount; id++) {
+        start[id] += start[id - 1];
+    }
+    for (unsigned e = 2 * numContacts; e-- > 0;) {
+        if (self->_contactEnds[e] != PCR_NONE) self->_adjacency[--start[self->_contactEnds[e]]] = e / 2;
+    }
+}
+
+static unsigned pcr_buildAdjacency(ParticleContactResolver *self, ParticleContact **contactArray, unsigned numContacts) {
+    memset(self->_particleTable, 0xff, self->_particleTableSize * sizeof(unsigned));
+    unsigned particleCount = 0;
+    for (unsigned i = 0; i < numContacts; i++) {
+        pcr_setContactEnds(self, i, contactArray[i]->_particle, &particleCount);
+    }
+    pcr_fillAdjacency(self, numContacts, particleCount);
+    return particleCount;
+}
+
+static unsigned pcr_buildBufferAdjacency(ParticleContactResolver *self, const ParticleContactBuffer *buffer) {
+    memset(self->_particleTable, 0xff, self->_particleTableSize * sizeof(unsigned));
+    unsigned particleCount = 0;
+    for (unsigned i = 0; i < buffer->_count; i++) {
+        pcr_setContactEnds(self, i, buffer->_records[i].particle, &particleCount);
+    }
+    pcr_fillAdjacency(self, buffer->_count, particleCount);
+    return particleCount;
+}
+
+// Updates the interpenetration of a contact after another one moved
+// its particles
+static inline void pcr_updatePenetration(ParticleContact *contact, const ParticleContact *resolved) {
+    const buVector3 *move = resolved->_particleMovement;
+    if (contact->_particle[0] == resolved->_particle[0]) {
+        contact->_penetration -= buVector3Dot(move[0], contact->_contactNormal);
+    } else if (contact->_particle[0] == resolved->_particle[1]) {
+        contact->_penetration -= buVector3Dot(move[1], contact->_contactNormal);
+    }
+    if (contact->_particle[1]) {
+        if (contact->_particle[1] == resolved->_particle[0]) {
+            contact->_penetration += buVector3Dot(move[0], contact->_contactNormal);
+        } else if (contact->_particle[1] == resolved->_particle[1]) {
+            contact->_penetration += buVector3Dot(move[1], contact->_contactNormal);
+        }
+    }
+}
+
+// Update the interpenetrations of the contacts that share a particle
+// with the one just resolved, each once, recording which they are if
+// touched is not NULL
+static unsigned pcr_updatePenetrations(const ParticleContactResolver *self, ParticleContact **contactArray, unsigned resolvedIndex, unsigned *touched) {
+    const ParticleContact *resolved = contactArray[resolvedIndex];
+    const unsigned *ends = self->_contactEnds;
+    unsigned first = ends[2 * resolvedIndex];
+    unsigned touchedCount = 0;
+    for (int e = 0; e < 2; e++) {
+        unsigned id = ends[2 * resolvedIndex + e];
+        if (id == PCR_NONE) continue;
+        for (unsigned k = self->_adjacencyStart[id]; k < self->_adjacencyStart[id + 1]; k++) {
+            unsigned i = self->_adjacency[k];
+            // Contacts on both particles were done with the first
+            if (e == 1 && (ends[2 * i] == first || ends[2 * i + 1] == first)) continue;
+            pcr_updatePenetration(contactArray[i], resolved);
+            if (touched) touched[touchedCount++] = i;
+        }
+    }
+    return touchedCount;
+}
+
+static void pcr_resolveContactsScan(
+        ParticleContactResolver *self,
         ParticleContact **contactArray,
         unsigned numContacts,
         buReal duration) {
-    //printf("ParticleContactResolver::resolveContacts:enter: numContacts:%u duration:%f\n", numContacts, duration);
     unsigned i;
 
     self->_iterationsUsed = 0;
+    if (numContacts == 0) return;
+    pcr_reserve(self, numContacts);
+    pcr_buildAdjacency(self, contactArray, numContacts);
+
     while(self->_iterationsUsed < self->_iterations) {
         // Find the contact with the largest closing velocity;
         buReal max = REAL_MAX;
         unsigned maxIndex = numContacts;
         for (i = 0; i < numContacts; i++) {
             ParticleContact *contact = contactArray[i];
-            buReal sepVel = INSTANCE_METHOD_AS(ParticleContactVTable, contact, calculateSeparatingVelocity);
+            buReal sepVel = ParticleContact_calculateSeparatingVelocity(contact);
             if (sepVel < max &&
                 (sepVel < 0 || contactArray[i]->_penetration > 0)) {
                 max = sepVel;
@@ -228,26 +750,636 @@ static void pcr_resolveContacts(
         if (maxIndex == numContacts) break;
 
         // Resolve this contact
-        INSTANCE_METHOD_AS(ParticleContactVTable, contactArray[maxIndex], resolve, duration);
+        ParticleContact_resolve(contactArray[maxIndex], duration);
 
         // Update the interpenetrations for all particles
-        buVector3 *move = contactArray[maxIndex]->_particleMovement;
-        for (i = 0; i < numContacts; i++) {
-            if (contactArray[i]->_particle[0] == contactArray[maxIndex]->_particle[0]) {
-                contactArray[i]->_penetration -= buVector3Dot(move[0], contactArray[i]->_contactNormal);
-            } else if (contactArray[i]->_particle[0] == contactArray[maxIndex]->_particle[1]) {
-                contactArray[i]->_penetration -= buVector3Dot(move[1], contactArray[i]->_contactNormal);
-            }
-            if (contactArray[i]->_particle[1]) {
-                if (contactArray[i]->_particle[1] == contactArray[maxIndex]->_particle[0]) {
-                    contactArray[i]->_penetration += buVector3Dot(move[0], contactArray[i]->_contactNormal);
-                } else if (contactArray[i]->_particle[1] == contactArray[maxIndex]->_particle[1]) {
-                    contactArray[i]->_penetration += buVector3Dot(move[1], contactArray[i]->_contactNormal);
+        pcr_updatePenetrations(self, contactArray, maxIndex, NULL);
+
+        self->_iterationsUsed++;
+    }
+}
+
+// The key of one contact; resolvable matches the scan's test, including
+// that a separating velocity of REAL_MAX (or NaN) is never picked
+static void pcr_heapKey(ParticleContactResolver *self, ParticleContact *contact, unsigned index) {
+    buReal sepVel = ParticleContact_calculateSeparatingVelocity(contact);
+    self->_separatingVelocity[index] = sepVel;
+    self->_resolvable[index] = sepVel < REAL_MAX && (sepVel < 0 || contact->_penetration > 0);
+}
+
+// Whether contact a is resolved before contact b: resolvable contacts
+// first, then by separating velocity, then by index as the scan's
+// strict comparison does
+static inline bool pcr_heapBefore(const ParticleContactResolver *self, unsigned a, unsigned b) {
+    if (self->_resolvable[a] != self->_resolvable[b]) return self->_resolvable[a];
+    if (self->_resolvable[a]) {
+        if (self->_separatingVelocity[a] < self->_separatingVelocity[b]) return true;
+        if (self->_separatingVelocity[b] < self->_separatingVelocity[a]) return false;
+    }
+    return a < b;
+}
+
+// A heap covers one range of contacts: heap points at its slice of
+// _heap, and _heapPosition holds positions within that slice
+static inline void pcr_heapSet(ParticleContactResolver *self, unsigned *heap, unsigned position, unsigned index) {
+    heap[position] = index;
+    self->_heapPosition[index] = position;
+}
+
+static void pcr_heapSiftUp(ParticleContactResolver *self, unsigned *heap, unsigned position) {
+    unsigned index = heap[position];
+    while (position > 0) {
+        unsigned parent = (position - 1) / 2;
+        if (!pcr_heapBefore(self, index, heap[parent])) break;
+        pcr_heapSet(self, heap, position, heap[parent]);
+        position = parent;
+    }
+    pcr_heapSet(self, heap, position, index);
+}
+
+static void pcr_heapSiftDown(ParticleContactResolver *self, unsigned *heap, unsigned position, unsigned count) {
+    unsigned index = heap[position];
+    for (;;) {
+        unsigned child = 2 * position + 1;
+        if (child >= count) break;
+        if (child + 1 < count && pcr_heapBefore(self, heap[child + 1], heap[child])) child++;
+        if (!pcr_heapBefore(self, heap[child], index)) break;
+        pcr_heapSet(self, heap, position, heap[child]);
+        position = child;
+    }
+    pcr_heapSet(self, heap, position, index);
+}
+
+// Resolves the contacts [begin, end) in the scan's order, and returns
+// the iterations used. Only contacts that share a particle with the
+// one just resolved can have a new separating velocity or penetration,
+// so only those are re-keyed. The adjacency must be built, and no
+// contact outside the range may share a particle with one inside it
+static unsigned pcr_resolveHeapRange(
+        ParticleContactResolver *self,
+        ParticleContact **contactArray,
+        unsigned begin,
+        unsigned end,
+        unsigned iterations,
+        buReal duration) {
+    unsigned *heap = self->_heap + begin;
+    unsigned *touched = self->_touched + begin;
+    const unsigned count = end - begin;
+    if (count == 0) return 0;
+
+    for (unsigned i = begin; i < end; i++) {
+        pcr_heapKey(self, contactArray[i], i);
+        pcr_heapSet(self, heap, i - begin, i);
+    }
+    for (unsigned position = count / 2; position-- > 0;) {
+        pcr_heapSiftDown(self, heap, position, count);
+    }
+
+    unsigned iterationsUsed = 0;
+    while(iterationsUsed < iterations) {
+        // Do we have anything worth resolving?
+        unsigned worst = heap[0];
+        if (!self->_resolvable[worst]) break;
+
+        ParticleContact_resolve(contactArray[worst], duration);
+
+        unsigned touchedCount = pcr_updatePenetrations(self, contactArray, worst, touched);
+        for (unsigned t = 0; t < touchedCount; t++) {
+            unsigned index = touched[t];
+            pcr_heapKey(self, contactArray[index], index);
+            pcr_heapSiftUp(self, heap, self->_heapPosition[index]);
+            pcr_heapSiftDown(self, heap, self->_heapPosition[index], count);
+        }
+
+        iterationsUsed++;
+    }
+    return iterationsUsed;
+}
+
+static void pcr_resolveContactsHeap(
+        ParticleContactResolver *self,
+        ParticleContact **contactArray,
+        unsigned numContacts,
+        buReal duration) {
+    self->_iterationsUsed = 0;
+    if (numContacts == 0) return;
+
+    pcr_reserve(self, numContacts);
+    pcr_buildAdjacency(self, contactArray, numContacts);
+    self->_iterationsUsed = pcr_resolveHeapRange(self, contactArray, 0, numContacts, self->_iterations, duration);
+}
+
+// The buffer path: the same arithmetic as ParticleContact's resolve and
+// the heap mode, in the same order, on records and on the gathered
+// particle state. a and b are a record's particle ids, b PCR_NONE
+// without a second particle
+
+// Copies the state of every particle the buffer touches into the
+// state arrays, and records which ids each record's ends have
+static void pcr_gatherState(ParticleContactResolver *self, const ParticleContactBuffer *buffer, unsigned particleCount) {
+    for (unsigned i = 0; i < buffer->_count; i++) {
+        const ParticleContactRecord *record = &buffer->_records[i];
+        unsigned a = self->_contactEnds[2 * i];
+        self->_recordEnds[2 * i] = a;
+        self->_recordEnds[2 * i + 1] = record->particle[1] == record->particle[0] ? a : self->_contactEnds[2 * i + 1];
+    }
+    for (unsigned id = 0; id < particleCount; id++) {
+        Particle *particle = self->_particles[id];
+        self->_statePosition[id] = pc_getPosition(particle);
+        self->_stateVelocity[id] = pc_getVelocity(particle);
+        self->_stateAcceleration[id] = pc_getAcceleration(particle);
+        self->_stateInverseMass[id] = pc_getInverseMass(particle);
+    }
+}
+
+// Writes the resolved positions and velocities back
+static void pcr_scatterState(const ParticleContactResolver *self, unsigned particleCount) {
+    for (unsigned id = 0; id < particleCount; id++) {
+        Particle *particle = self->_particles[id];
+        pc_setPosition(particle, self->_statePosition[id]);
+        pc_setVelocity(particle, self->_stateVelocity[id]);
+    }
+}
+
+static inline buReal pcr_stateSeparatingVelocity(const ParticleContactResolver *self, unsigned a, unsigned b, buVector3 normal) {
+    buVector3 relativeVelocity = self->_stateVelocity[a];
+    if (b != PCR_NONE) {
+        relativeVelocity = buVector3Difference(relativeVelocity, self->_stateVelocity[b]);
+    }
+    return buVector3Dot(relativeVelocity, normal);
+}
+
+static void pcr_resolveStateVelocity(ParticleContactResolver *self, ParticleContactRecord *record, unsigned a, unsigned b, buReal duration) {
+    buReal separatingVelocity = pcr_stateSeparatingVelocity(self, a, b, record->contactNormal);
+    if (separatingVelocity > 0) return;
+
+    buReal newSepVelocity = -separatingVelocity * record->restitution;
+
+    // Take out the closing velocity built up by acceleration alone
+    buVector3 accCausedVelocity = self->_stateAcceleration[a];
+    if (b != PCR_NONE) {
+        accCausedVelocity = buVector3Difference(accCausedVelocity, self->_stateAcceleration[b]);
+    }
+    buReal accCausedSepVelocity = buVector3Dot(accCausedVelocity, record->contactNormal) * duration;
+    if (accCausedSepVelocity < 0) {
+        newSepVelocity += record->restitution * accCausedSepVelocity;
+        if (newSepVelocity < 0) newSepVelocity = 0;
+    }
+
+    buReal deltaVelocity = newSepVelocity - separatingVelocity;
+    buReal totalInverseMass = self->_stateInverseMass[a];
+    if (b != PCR_NONE) totalInverseMass += self->_stateInverseMass[b];
+    if (totalInverseMass <= 0) return;
+
+    buReal impulse = deltaVelocity / totalInverseMass;
+    record->impulse += impulse;
+    buVector3 impulsePerIMass = buVector3Scalar(record->contactNormal, impulse);
+    self->_stateVelocity[a] = buVector3Add(self->_stateVelocity[a], buVector3Scalar(impulsePerIMass, self->_stateInverseMass[a]));
+    if (b != PCR_NONE) {
+        self->_stateVelocity[b] = buVector3Add(self->_stateVelocity[b], buVector3Scalar(impulsePerIMass, -self->_stateInverseMass[b]));
+    }
+}
+
+static void pcr_resolveStateInterpenetration(ParticleContactResolver *self, const ParticleContactRecord *record, unsigned a, unsigned b, buVector3 movement[2]) {
+    if (record->penetration <= 0) return;
+
+    buReal totalInverseMass = self->_stateInverseMass[a];
+    if (b != PCR_NONE) totalInverseMass += self->_stateInverseMass[b];
+    if (totalInverseMass <= 0) return;
+
+    buVector3 movePerIMass = buVector3Scalar(record->contactNormal, (record->penetration / totalInverseMass));
+    movement[0] = buVector3Scalar(movePerIMass, self->_stateInverseMass[a]);
+    if (b != PCR_NONE) {
+        movement[1] = buVector3Scalar(movePerIMass, -self->_stateInverseMass[b]);
+    }
+
+    self->_statePosition[a] = buVector3Add(self->_statePosition[a], movement[0]);
+    if (b != PCR_NONE) {
+        self->_statePosition[b] = buVector3Add(self->_statePosition[b], movement[1]);
+    }
+}
+
+static inline void pcr_updateRecordPenetration(ParticleContactRecord *record, const unsigned ends[2], const unsigned resolvedEnds[2], const buVector3 move[2]) {
+    if (ends[0] == resolvedEnds[0]) {
+        record->penetration -= buVector3Dot(move[0], record->contactNormal);
+    } else if (ends[0] == resolvedEnds[1]) {
+        record->penetration -= buVector3Dot(move[1], record->contactNormal);
+    }
+    if (ends[1] != PCR_NONE) {
+        if (ends[1] == resolvedEnds[0]) {
+            record->penetration += buVector3Dot(move[0], record->contactNormal);
+        } else if (ends[1] == resolvedEnds[1]) {
+            record->penetration += buVector3Dot(move[1], record->contactNormal);
+        }
+    }
+}
+
+static unsigned pcr_updateRecordPenetrations(const ParticleContactResolver *self, ParticleContactBuffer *buffer, unsigned resolvedIndex, unsigned *touched) {
+    ParticleContactRecord *records = buffer->_records;
+    const buVector3 *move = buffer->_movement[resolvedIndex];
+    const unsigned *ends = self->_contactEnds;
+    const unsigned *recordEnds = self->_recordEnds;
+    unsigned first = ends[2 * resolvedIndex];
+    unsigned touchedCount = 0;
+    for (int e = 0; e < 2; e++) {
+        unsigned id = ends[2 * resolvedIndex + e];
+        if (id == PCR_NONE) continue;
+        for (unsigned k = self->_adjacencyStart[id]; k < self->_adjacencyStart[id + 1]; k++) {
+            unsigned i = self->_adjacency[k];
+            // Contacts on both particles were done with the first
+            if (e == 1 && (ends[2 * i] == first || ends[2 * i + 1] == first)) continue;
+            pcr_updateRecordPenetration(&records[i], &recordEnds[2 * i], &recordEnds[2 * resolvedIndex], move);
+            touched[touchedCount++] = i;
+        }
+    }
+    return touchedCount;
+}
+
+static void pcr_heapKeyRecord(ParticleContactResolver *self, const ParticleContactRecord *record, unsigned index) {
+    buReal sepVel = pcr_stateSeparatingVelocity(self, self->_recordEnds[2 * index], self->_recordEnds[2 * index + 1], record->contactNormal);
+    self->_separatingVelocity[index] = sepVel;
+    self->_resolvable[index] = sepVel < REAL_MAX && (sepVel < 0 || record->penetration > 0);
+}
+
+static unsigned pcr_resolveBufferRange(
+        ParticleContactResolver *self,
+        ParticleContactBuffer *buffer,
+        unsigned begin,
+        unsigned end,
+        unsigned iterations,
+        buReal duration) {
+    unsigned *heap = self->_heap + begin;
+    unsigned *touched = self->_touched + begin;
+    const unsigned count = end - begin;
+    if (count == 0) return 0;
+
+    for (unsigned i = begin; i < end; i++) {
+        pcr_heapKeyRecord(self, &buffer->_records[i], i);
+        pcr_heapSet(self, heap, i - begin, i);
+    }
+    for (unsigned position = count / 2; position-- > 0;) {
+        pcr_heapSiftDown(self, heap, position, count);
+    }
+
+    unsigned iterationsUsed = 0;
+    while(iterationsUsed < iterations) {
+        unsigned worst = heap[0];
+        if (!self->_resolvable[worst]) break;
+
+        ParticleContactRecord *record = &buffer->_records[worst];
+        unsigned a = self->_recordEnds[2 * worst];
+        unsigned b = self->_recordEnds[2 * worst + 1];
+        pcr_resolveStateVelocity(self, record, a, b, duration);
+        pcr_resolveStateInterpenetration(self, record, a, b, buffer->_movement[worst]);
+
+        unsigned touchedCount = pcr_updateRecordPenetrations(self, buffer, worst, touched);
+        for (unsigned t = 0; t < touchedCount; t++) {
+            unsigned index = touched[t];
+            pcr_heapKeyRecord(self, &buffer->_records[index], index);
+            pcr_heapSiftUp(self, heap, self->_heapPosition[index]);
+            pcr_heapSiftDown(self, heap, self->_heapPosition[index], count);
+        }
+
+        iterationsUsed++;
+    }
+    return iterationsUsed;
+}
+
+static void pcr_resolveBuffer(ParticleContactResolver *self, ParticleContactBuffer *buffer, buReal duration) {
+    const unsigned numContacts = buffer->_count;
+    if (self->_cache) {
+        INSTANCE_METHOD_AS(ParticleContactCacheVTable, self->_cache, warmStartBuffer, buffer);
+    } else {
+        for (unsigned i = 0; i < numContacts; i++) {
+            buffer->_records[i].impulse = 0;
+        }
+    }
+
+    self->_iterationsUsed = 0;
+    if (numContacts > 0) {
+        pcr_reserve(self, numContacts);
+        unsigned particleCount = pcr_buildBufferAdjacency(self, buffer);
+        pcr_gatherState(self, buffer, particleCount);
+        self->_iterationsUsed = pcr_resolveBufferRange(self, buffer, 0, numContacts, self->_iterations, duration);
+        pcr_scatterState(self, particleCount);
+    }
+
+    if (self->_cache) {
+        INSTANCE_METHOD_AS(ParticleContactCacheVTable, self->_cache, storeBuffer, buffer);
+    }
+}
+
+static void pcr_setThreadCount(ParticleContactResolver *self, unsigned threads) {
+    assert(threads >= 1);
+    self->_threadCount = threads;
+}
+
+static void pcr_setCache(ParticleContactResolver *self, ParticleContactCache *cache) {
+    self->_cache = cache;
+}
+
+static void pcr_setTolerance(ParticleContactResolver *self, buReal tolerance) {
+    assert(tolerance >= 0);
+    self->_tolerance = tolerance;
+}
+
+// Greedy colouring in contact order, then a stable counting sort of
+// the contacts by colour into _colorOrder
+static void pcr_buildColors(ParticleContactResolver *self, unsigned numContacts, unsigned particleCount) {
+    const unsigned *ends = self->_contactEnds;
+    uint64_t *used = self->_particleColors;
+    memset(used, 0, particleCount * sizeof(uint64_t));
+
+    // The heap positions are not used in this mode; they hold each colour
+    unsigned *color = self->_heapPosition;
+    unsigned colorSize[PCR_MAX_COLORS + 1] = {0};
+    for (unsigned i = 0; i < numContacts; i++) {
+        unsigned first = ends[2 * i], second = ends[2 * i + 1];
+        uint64_t taken = used[first] | (second != PCR_NONE ? used[second] : 0);
+        unsigned c = 0;
+        while (c < PCR_MAX_COLORS && (taken & ((uint64_t)1 << c))) c++;
+        if (c < PCR_MAX_COLORS) {
+            used[first] |= (uint64_t)1 << c;
+            if (second != PCR_NONE) used[second] |= (uint64_t)1 << c;
+        }
+        color[i] = c; // PCR_MAX_COLORS is the overflow range
+        colorSize[c]++;
+    }
+
+    // Colour ranges, skipping empty ones
+    unsigned colors = 0;
+    unsigned offset[PCR_MAX_COLORS + 1];
+    self->_colorStart[0] = 0;
+    for (unsigned c = 0; c <= PCR_MAX_COLORS; c++) {
+        offset[c] = self->_colorStart[colors];
+        if (colorSize[c] == 0) continue;
+        self->_colorStart[colors + 1] = self->_colorStart[colors] + colorSize[c];
+        colors++;
+    }
+    self->_colorCount = colors;
+    self->_overflow = colorSize[PCR_MAX_COLORS] > 0;
+
+    for (unsigned i = 0; i < numContacts; i++) {
+        self->_colorOrder[offset[color[i]]++] = i;
+    }
+}
+
+// The penetration of a contact now, from its penetration when the call
+// started and the movement of its particles since
+static inline buReal pcr_currentPenetration(const ParticleContactResolver *self, const ParticleContact *contact, unsigned index) {
+    buReal penetration = self->_basePenetration[index];
+    penetration -= buVector3Dot(self->_displacement[self->_contactEnds[2 * index]], contact->_contactNormal);
+    unsigned second = self->_contactEnds[2 * index + 1];
+    if (second != PCR_NONE) penetration += buVector3Dot(self->_displacement[second], contact->_contactNormal);
+    return penetration;
+}
+
+// Resolves the contacts _colorOrder[begin, end) that need it, and
+// returns how many did. Contacts in the range must not share particles
+// unless the range runs on one thread
+static unsigned pcr_resolveColorRange(ParticleContactResolver *self, ParticleContact **contactArray, unsigned begin, unsigned end, buReal duration) {
+    const buVector3 zero = {0.0, 0.0, 0.0};
+    unsigned resolved = 0;
+    for (unsigned k = begin; k < end; k++) {
+        unsigned index = self->_colorOrder[k];
+        ParticleContact *contact = contactArray[index];
+        contact->_penetration = pcr_currentPenetration(self, contact, index);
+        buReal sepVel = ParticleContact_calculateSeparatingVelocity(contact);
+        if (!(sepVel < -self->_tolerance || contact->_penetration > self->_tolerance)) continue;
+
+        // resolve only sets the movement when it moves the particles
+        contact->_particleMovement[0] = zero;
+        contact->_particleMovement[1] = zero;
+        ParticleContact_resolve(contact, duration);
+
+        buVector3 *displacement = &self->_displacement[self->_contactEnds[2 * index]];
+        *displacement = buVector3Add(*displacement, contact->_particleMovement[0]);
+        unsigned second = self->_contactEnds[2 * index + 1];
+        if (second != PCR_NONE) {
+            self->_displacement[second] = buVector3Add(self->_displacement[second], contact->_particleMovement[1]);
+        }
+        resolved++;
+    }
+    return resolved;
+}
+
+static void pcr_resolveContactsColored(
+        ParticleContactResolver *self,
+        ParticleContact **contactArray,
+        unsigned numContacts,
+        buReal duration) {
+    self->_iterationsUsed = 0;
+    self->_sweepsUsed = 0;
+    if (numContacts == 0) return;
+
+    pcr_reserve(self, numContacts);
+    unsigned particleCount = pcr_buildAdjacency(self, contactArray, numContacts);
+    pcr_buildColors(self, numContacts, particleCount);
+    for (unsigned i = 0; i < numContacts; i++) {
+        self->_basePenetration[i] = contactArray[i]->_penetration;
+    }
+    for (unsigned id = 0; id < particleCount; id++) {
+        self->_displacement[id] = (buVector3){0.0, 0.0, 0.0};
+    }
+
+    const int threads = (int)self->_threadCount;
+    const unsigned parallelColors = self->_colorCount - (self->_overflow ? 1 : 0);
+    bool converged = false;
+    while (!converged && self->_iterationsUsed < self->_iterations) {
+        unsigned sweepResolved = 0;
+        for (unsigned c = 0; c < self->_colorCount && self->_iterationsUsed < self->_iterations; c++) {
+            const unsigned colorBegin = self->_colorStart[c];
+            const unsigned colorSize = self->_colorStart[c + 1] - colorBegin;
+            unsigned resolved = 0;
+            if (c < parallelColors) {
+                // No two contacts of a colour share a particle
+                #pragma omp parallel for num_threads(threads) schedule(static) reduction(+:resolved)
+                for (int t = 0; t < threads; t++) {
+                    resolved += pcr_resolveColorRange(self, contactArray,
+                        colorBegin + (unsigned)((uint64_t)colorSize * t / threads),
+                        colorBegin + (unsigned)((uint64_t)colorSize * (t + 1) / threads), duration);
                 }
+            } else {
+                resolved = pcr_resolveColorRange(self, contactArray, colorBegin, colorBegin + colorSize, duration);
             }
+            self->_iterationsUsed += resolved;
+            sweepResolved += resolved;
         }
+        self->_sweepsUsed++;
+        converged = sweepResolved == 0;
+    }
 
-        self->_iterationsUsed++;
+    // Leave every contact with its penetration after the last sweep
+    for (unsigned i = 0; i < numContacts; i++) {
+        contactArray[i]->_penetration = pcr_currentPenetration(self, contactArray[i], i);
+    }
+}
+
+static unsigned pcr_getIslandCount(const ParticleContactResolver *self) {
+    return self->_islandCount;
+}
+
+static const ParticleContactIsland *pcr_getIsland(const ParticleContactResolver *self, unsigned index) {
+    assert(index < self->_islandCount);
+    return &self->_islands[index];
+}
+
+static double pcr_now(void) {
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static unsigned pcr_findRoot(unsigned *parent, unsigned id) {
+    while (parent[id] != id) {
+        parent[id] = parent[parent[id]]; // path halving
+        id = parent[id];
+    }
+    return id;
+}
+
+// Unions the particles of every contact, numbers the islands in order
+// of their first contact, and sorts the contacts by island into
+// _islandContacts, keeping their order within an island
+static void pcr_buildIslands(ParticleContactResolver *self, ParticleContact **contactArray, unsigned numContacts, unsigned particleCount) {
+    unsigned *parent = self->_islandParent;
+    const unsigned *ends = self->_contactEnds;
+    for (unsigned id = 0; id < particleCount; id++) {
+        parent[id] = id;
+    }
+    for (unsigned i = 0; i < numContacts; i++) {
+        if (ends[2 * i + 1] == PCR_NONE) continue;
+        unsigned a = pcr_findRoot(parent, ends[2 * i]);
+        unsigned b = pcr_findRoot(parent, ends[2 * i + 1]);
+        // The lower id becomes the root, so the result only depends on the contacts
+        if (a < b) parent[b] = a;
+        else if (b < a) parent[a] = b;
+    }
+
+    // Island of every contact, reusing the heap positions as scratch
+    unsigned *island = self->_heapPosition;
+    unsigned islands = 0;
+    for (unsigned id = 0; id < particleCount; id++) {
+        parent[id] = pcr_findRoot(parent, id);
+    }
+    // Roots are marked with PCR_NONE - island until numbered, which
+    // cannot clash with a particle id below 2 * capacity
+    for (unsigned i = 0; i < numContacts; i++) {
+        // A root numbered by an earlier contact is its own root
+        unsigned id = ends[2 * i];
+        unsigned root = parent[id] >= PCR_NONE - islands ? id : parent[id];
+        unsigned islandIndex;
+        if (parent[root] == root) {
+            islandIndex = islands++;
+            parent[root] = PCR_NONE - islandIndex;
+            self->_islands[islandIndex] = (ParticleContactIsland){0, 0, 0, 0, false, 0.0};
+        } else {
+            islandIndex = PCR_NONE - parent[root];
+        }
+        island[i] = islandIndex;
+        self->_islands[islandIndex].contactCount++;
+    }
+    for (unsigned id = 0; id < particleCount; id++) {
+        unsigned root = parent[id] >= PCR_NONE - islands ? id : parent[id];
+        self->_islands[PCR_NONE - parent[root]].particleCount++;
+    }
+
+    unsigned begin = 0;
+    for (unsigned k = 0; k < islands; k++) {
+        self->_islands[k].begin = begin;
+        begin += self->_islands[k].contactCount;
+    }
+    // Fill from each island's begin, using iterationsUsed as the cursor
+    for (unsigned i = 0; i < numContacts; i++) {
+        ParticleContactIsland *target = &self->_islands[island[i]];
+        self->_islandContacts[target->begin + target->iterationsUsed++] = contactArray[i];
+    }
+    for (unsigned k = 0; k < islands; k++) {
+        self->_islands[k].iterationsUsed = 0;
+    }
+    self->_islandCount = islands;
+}
+
+// Whether no contact of an island needs resolving
+static bool pcr_islandAtRest(const ParticleContactResolver *self, const ParticleContactIsland *island) {
+    for (unsigned i = island->begin; i < island->begin + island->contactCount; i++) {
+        ParticleContact *contact = self->_islandContacts[i];
+        buReal sepVel = ParticleContact_calculateSeparatingVelocity(contact);
+        if (sepVel < -self->_tolerance || contact->_penetration > self->_tolerance) return false;
+    }
+    return true;
+}
+
+static void pcr_resolveContactsIslands(
+        ParticleContactResolver *self,
+        ParticleContact **contactArray,
+        unsigned numContacts,
+        buReal duration) {
+    self->_iterationsUsed = 0;
+    self->_islandCount = 0;
+    if (numContacts == 0) return;
+
+    pcr_reserve(self, numContacts);
+    unsigned particleCount = pcr_buildAdjacency(self, contactArray, numContacts);
+    pcr_buildIslands(self, contactArray, numContacts, particleCount);
+    // Index the contacts again in island order, so every island is a
+    // contiguous range of the scratch arrays
+    pcr_buildAdjacency(self, self->_islandContacts, numContacts);
+
+    const int threads = (int)self->_threadCount;
+    const int islands = (int)self->_islandCount;
+    unsigned iterationsUsed = 0;
+    // Islands share no particles or scratch, so any thread can take any
+    // island without changing the result
+    #pragma omp parallel for num_threads(threads) schedule(dynamic, 1) reduction(+:iterationsUsed)
+    for (int k = 0; k < islands; k++) {
+        ParticleContactIsland *island = &self->_islands[k];
+        double start = pcr_now();
+        island->resting = pcr_islandAtRest(self, island);
+        if (!island->resting) {
+            // The island's share of the budget, rounded up
+            unsigned iterations = (unsigned)(((uint64_t)self->_iterations * island->contactCount + numContacts - 1) / numContacts);
+            island->iterationsUsed = pcr_resolveHeapRange(self, self->_islandContacts,
+                island->begin, island->begin + island->contactCount, iterations, duration);
+        }
+        island->seconds = pcr_now() - start;
+        iterationsUsed += island->iterationsUsed;
+    }
+    self->_iterationsUsed = iterationsUsed;
+}
+
+static void pcr_resolveContacts(
+        ParticleContactResolver *self,  
+        ParticleContact **contactArray,
+        unsigned numContacts,
+        buReal duration) {
+    //printf("ParticleContactResolver::resolveContacts:enter: numContacts:%u duration:%f\n", numContacts, duration);
+    if (self->_cache) {
+        INSTANCE_METHOD_AS(ParticleContactCacheVTable, self->_cache, warmStart, contactArray, numContacts);
+    } else {
+        for (unsigned i = 0; i < numContacts; i++) {
+            contactArray[i]->_impulse = 0;
+        }
+    }
+    switch (self->_mode) {
+        case PCR_MODE_HEAP:
+            pcr_resolveContactsHeap(self, contactArray, numContacts, duration);
+            break;
+        case PCR_MODE_COLORED:
+            pcr_resolveContactsColored(self, contactArray, numContacts, duration);
+            break;
+        case PCR_MODE_ISLANDS:
+            pcr_resolveContactsIslands(self, contactArray, numContacts, duration);
+            break;
+        case PCR_MODE_SCAN:
+        default:
+            pcr_resolveContactsScan(self, contactArray, numContacts, duration);
+            break;
+    }
+    if (self->_cache) {
+        INSTANCE_METHOD_AS(ParticleContactCacheVTable, self->_cache, store, contactArray, numContacts);
     }
     //printf("ParticleContactResolver::resolveContacts:leave\n");
 }
@@ -258,6 +1390,29 @@ ParticleContactResolverVTable pcr_vtable;
 // free object
 void pcr_free_instance(const Class *cls, Object *self) {
     printf("ParticleContactResolver::free_instance:enter\n");
+    ParticleContactResolver *resolver = (ParticleContactResolver *)self;
+    free(resolver->_contactEnds);
+    free(resolver->_adjacencyStart);
+    free(resolver->_adjacency);
+    free(resolver->_particles);
+    free(resolver->_particleTable);
+    free(resolver->_heap);
+    free(resolver->_heapPosition);
+    free(resolver->_separatingVelocity);
+    free(resolver->_resolvable);
+    free(resolver->_touched);
+    free(resolver->_particleColors);
+    free(resolver->_colorOrder);
+    free(resolver->_basePenetration);
+    free(resolver->_displacement);
+    free(resolver->_islandParent);
+    free(resolver->_islandContacts);
+    free(resolver->_islands);
+    free(resolver->_recordEnds);
+    free(resolver->_statePosition);
+    free(resolver->_stateVelocity);
+    free(resolver->_stateAcceleration);
+    free(resolver->_stateInverseMass);
     free(self);
     printf("ParticleContactResolver::free_instance:leave\n");
 }
@@ -267,6 +1422,38 @@ static Object *pcr_new_instance(const Class *cls) {
     ParticleContactResolver *p = malloc(sizeof(ParticleContactResolver));
     assert(p);  // Check for allocation failure
     ((Object *)p)->klass = cls;
+    p->_mode = PCR_MODE_SCAN;
+    p->_capacity = 0;
+    p->_contactEnds = NULL;
+    p->_adjacencyStart = NULL;
+    p->_adjacency = NULL;
+    p->_particles = NULL;
+    p->_particleTable = NULL;
+    p->_particleTableSize = 0;
+    p->_heap = NULL;
+    p->_heapPosition = NULL;
+    p->_separatingVelocity = NULL;
+    p->_resolvable = NULL;
+    p->_touched = NULL;
+    p->_threadCount = 1;
+    p->_tolerance = 0;
+    p->_sweepsUsed = 0;
+    p->_particleColors = NULL;
+    p->_colorOrder = NULL;
+    p->_colorCount = 0;
+    p->_overflow = false;
+    p->_basePenetration = NULL;
+    p->_displacement = NULL;
+    p->_islandParent = NULL;
+    p->_islandContacts = NULL;
+    p->_islands = NULL;
+    p->_islandCount = 0;
+    p->_recordEnds = NULL;
+    p->_statePosition = NULL;
+    p->_stateVelocity = NULL;
+    p->_stateAcceleration = NULL;
+    p->_stateInverseMass = NULL;
+    p->_cache = NULL;
     return (Object *)p;
 }
 
@@ -279,12 +1466,19 @@ void ParticleContactResolverCreateClass() {
     printf("ParticleContactResolverCreateClass:enter\n");
     if (!pcr_initialized) {
         printf("ParticleContactResolverCreateClass:initializing\n");
-        ParticleContactCreateClass();
+        ParticleContactCacheCreateClass();
         pcr_vtable.base = vTable; // inherit from VTable
 
         // methods
         pcr_vtable.setIterations = pcr_setIterations;
+        pcr_vtable.setMode = pcr_setMode;
+        pcr_vtable.setThreadCount = pcr_setThreadCount;
+        pcr_vtable.setTolerance = pcr_setTolerance;
+        pcr_vtable.getIslandCount = pcr_getIslandCount;
+        pcr_vtable.getIsland = pcr_getIsland;
+        pcr_vtable.setCache = pcr_setCache;
         pcr_vtable.resolveContacts = pcr_resolveContacts;
+        pcr_vtable.resolveBuffer = pcr_resolveBuffer;
 
 
         // init the particle class
@@ -309,6 +1503,32 @@ unsigned addContact(ParticleContactGenerator *self, ParticleContact *contact, un
     return 0;
 }
 
+// Adapts addContact: generates into temporary contacts, then copies them
+static unsigned pcg_addContactsToBuffer(ParticleContactGenerator *self, ParticleContactBuffer *buffer, unsigned limit) {
+    if (limit == 0) return 0;
+    // The buffer's scratch only grows, so steady frames do not allocate
+    if (limit > buffer->_contactCapacity) {
+        free(buffer->_contacts);
+        buffer->_contacts = malloc(limit * sizeof(ParticleContact));
+        assert(buffer->_contacts);  // Check for allocation failure
+        buffer->_contactCapacity = limit;
+    }
+    ParticleContact *contacts = buffer->_contacts;
+    for (unsigned i = 0; i < limit; i++) {
+        contacts[i]._particleMovement[0] = (buVector3){0.0, 0.0, 0.0};
+        contacts[i]._particleMovement[1] = (buVector3){0.0, 0.0, 0.0};
+        contacts[i]._feature = 0;
+        contacts[i]._impulse = 0;
+    }
+    unsigned used = INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, self, addContact, contacts, limit);
+    assert(used <= limit);
+    for (unsigned i = 0; i < used; i++) {
+        ParticleContact *contact = &contacts[i];
+        pcb_appendContacts(buffer, &contact, 1);
+    }
+    return used;
+}
+
 ParticleContactGeneratorClass particleContactGeneratorClass;
 ParticleContactGeneratorVTable pcg_vtable;
 
@@ -336,10 +1556,12 @@ void ParticleContactGeneratorCreateClass() {
     printf("ParticleContactGeneratorCreateClass:enter\n");
     if (!pcg_initialized) {
         printf("ParticleContactGeneratorCreateClass:initializing\n");
+        ParticleContactBufferCreateClass();
         pcg_vtable.base = vTable; // inherit from VTable
 
         // methods
         pcg_vtable.addContact = addContact;
+        pcg_vtable.addContactsToBuffer = pcg_addContactsToBuffer;
 
         // init the particle class
         particleContactGeneratorClass.base = class; // inherit from Class
@@ -0,0 +1,171 @@
+#include "budgie/pfbatch.h"
+#include "budgie/simd.h"
+#include <math.h>
+
+//////////////////////////////////////////////////////////////////
+// Drag
+//////////////////////////////////////////////////////////////////
+void buDragForcesScalar(buReal *const velocity[3], buReal k1, buReal k2, buReal *const force[3], size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        buReal vx = velocity[0][i], vy = velocity[1][i], vz = velocity[2][i];
+        buReal speed = buSqrt(vx*vx + vy*vy + vz*vz);
+        // Written as a subtraction so that zero forces get the same sign
+        // in both kernels
+        buReal magnitude = 0.0f - (k1 * speed + k2 * speed);
+
+        buReal fx = 0.0f, fy = 0.0f, fz = 0.0f;
+        if (speed > 0.0f) {
+            fx = (vx / speed) * magnitude;
+            fy = (vy / speed) * magnitude;
+            fz = (vz / speed) * magnitude;
+        }
+        force[0][i] += fx;
+        force[1][i] += fy;
+        force[2][i] += fz;
+    }
+}
+
+#ifdef BU_SIMD
+void buDragForcesSIMD(buReal *const velocity[3], buReal k1, buReal k2, buReal *const force[3], size_t begin, size_t end) {
+    const buSimd zero = buSimdZero();
+    const buSimd vk1 = buSimdSet1(k1);
+    const buSimd vk2 = buSimdSet1(k2);
+
+    size_t i = begin;
+    for (; i + BU_SIMD_WIDTH <= end; i += BU_SIMD_WIDTH) {
+        buSimd v[3];
+        for (int k = 0; k < 3; k++) v[k] = buSimdLoadU(velocity[k] + i);
+        buSimd speed = buSimdSqrt(buSimdAdd(buSimdAdd(buSimdMul(v[0], v[0]), buSimdMul(v[1], v[1])), buSimdMul(v[2], v[2])));
+        buSimd magnitude = buSimdSub(zero, buSimdAdd(buSimdMul(vk1, speed), buSimdMul(vk2, speed)));
+
+        buSimd moving = buSimdCmpGt(speed, zero);
+        for (int k = 0; k < 3; k++) {
+            buSimd f = buSimdSelect(moving, buSimdMul(buSimdDiv(v[k], speed), magnitude), zero);
+            buSimdStoreU(force[k] + i, buSimdAdd(buSimdLoadU(force[k] + i), f));
+        }
+    }
+
+    // Remainder that does not fill a register
+    buDragForcesScalar(velocity, k1, k2, force, i, end);
+}
+#else
+void buDragForcesSIMD(buReal *const velocity[3], buReal k1, buReal k2, buReal *const force[3], size_t begin, size_t end) {
+    buDragForcesScalar(velocity, k1, k2, force, begin, end);
+}
+#endif
+
+void buDragForces(buReal *const velocity[3], buReal k1, buReal k2, buReal *const force[3], size_t begin, size_t end) {
+    buDragForcesSIMD(velocity, k1, k2, force, begin, end);
+}
+
+//////////////////////////////////////////////////////////////////
+// Buoyancy
+//////////////////////////////////////////////////////////////////
+void buBuoyancyForcesScalar(const buReal *height, buReal maxDepth, buReal volume, buReal waterHeight, buReal liquidDensity, buReal *forceY, size_t begin, size_t end) {
+    const buReal top = waterHeight + maxDepth;
+    const buReal bottom = waterHeight - maxDepth;
+    const buReal full = liquidDensity * volume;
+    const buReal span = 2 * maxDepth;
+
+    for (size_t i = begin; i < end; i++) {
+        buReal depth = height[i];
+        buReal f;
+        if (depth >= top) {
+            f = 0.0f; // out of the water
+        } else if (depth <= bottom) {
+            f = full; // at maximum depth
+        } else {
+            f = full * (depth - maxDepth - waterHeight) / span;
+        }
+        forceY[i] += f;
+    }
+}
+
+#ifdef BU_SIMD
+void buBuoyancyForcesSIMD(const buReal *height, buReal maxDepth, buReal volume, buReal waterHeight, buReal liquidDensity, buReal *forceY, size_t begin, size_t end) {
+    const buSimd zero = buSimdZero();
+    const buSimd top = buSimdSet1(waterHeight + maxDepth);
+    const buSimd bottom = buSimdSet1(waterHeight - maxDepth);
+    const buSimd full = buSimdSet1(liquidDensity * volume);
+    const buSimd span = buSimdSet1(2 * maxDepth);
+    const buSimd vMaxDepth = buSimdSet1(maxDepth);
+    const buSimd vWaterHeight = buSimdSet1(waterHeight);
+
+    size_t i = begin;
+    for (; i + BU_SIMD_WIDTH <= end; i += BU_SIMD_WIDTH) {
+        buSimd depth = buSimdLoadU(height + i);
+        buSimd partial = buSimdDiv(buSimdMul(full, buSimdSub(buSimdSub(depth, vMaxDepth), vWaterHeight)), span);
+        buSimd f = buSimdSelect(buSimdCmpLe(depth, bottom), full, partial);
+        f = buSimdSelect(buSimdCmpGe(depth, top), zero, f);
+        buSimdStoreU(forceY + i, buSimdAdd(buSimdLoadU(forceY + i), f));
+    }
+
+    buBuoyancyForcesScalar(height, maxDepth, volume, waterHeight, liquidDensity, forceY, i, end);
+}
+#else
+void buBuoyancyForcesSIMD(const buReal *height, buReal maxDepth, buReal volume, buReal waterHeight, buReal liquidDensity, buReal *forceY, size_t begin, size_t end) {
+    buBuoyancyForcesScalar(height, maxDepth, volume, waterHeight, liquidDensity, forceY, begin, end);
+}
+#endif
+
+void buBuoyancyForces(const buReal *height, buReal maxDepth, buReal volume, buReal waterHeight, buReal liquidDensity, buReal *forceY, size_t begin, size_t end) {
+    buBuoyancyForcesSIMD(height, maxDepth, volume, waterHeight, liquidDensity, forceY, begin, end);
+}
+
+//////////////////////////////////////////////////////////////////
+// Anchored bungee
+//////////////////////////////////////////////////////////////////
+void buAnchoredBungeeForcesScalar(buReal *const position[3], buVector3 anchor, buReal springConstant, buReal restLength, buReal *const force[3], size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        buReal dx = position[0][i] - anchor.x;
+        buReal dy = position[1][i] - anchor.y;
+        buReal dz = position[2][i] - anchor.z;
+        buReal length = buSqrt(dx*dx + dy*dy + dz*dz);
+        buReal magnitude = 0.0f - (length - restLength) * springConstant;
+
+        buReal fx = 0.0f, fy = 0.0f, fz = 0.0f;
+        if (length >= restLength && length > 0.0f) {
+            fx = (dx / length) * magnitude;
+            fy = (dy / length) * magnitude;
+            fz = (dz / length) * magnitude;
+        }
+        force[0][i] += fx;
+        force[1][i] += fy;
+        force[2][i] += fz;
+    }
+}
+
+#ifdef BU_SIMD
+void buAnchoredBungeeForcesSIMD(buReal *const position[3], buVector3 anchor, buReal springConstant, buReal restLength, buReal *const force[3], size_t begin, size_t end) {
+    const buSimd zero = buSimdZero();
+    const buSimd rest = buSimdSet1(restLength);
+    const buSimd k = buSimdSet1(springConstant);
+    buSimd a[3];
+    for (int c = 0; c < 3; c++) a[c] = buSimdSet1(anchor.v[c]);
+
+    size_t i = begin;
+    for (; i + BU_SIMD_WIDTH <= end; i += BU_SIMD_WIDTH) {
+        buSimd d[3];
+        for (int c = 0; c < 3; c++) d[c] = buSimdSub(buSimdLoadU(position[c] + i), a[c]);
+        buSimd length = buSimdSqrt(buSimdAdd(buSimdAdd(buSimdMul(d[0], d[0]), buSimdMul(d[1], d[1])), buSimdMul(d[2], d[2])));
+        buSimd magnitude = buSimdSub(zero, buSimdMul(buSimdSub(length, rest), k));
+
+        // Taut and with a direction to pull along
+        buSimd taut = buSimdAnd(buSimdCmpGe(length, rest), buSimdCmpGt(length, zero));
+        for (int c = 0; c < 3; c++) {
+            buSimd f = buSimdSelect(taut, buSimdMul(buSimdDiv(d[c], length), magnitude), zero);
+            buSimdStoreU(force[c] + i, buSimdAdd(buSimdLoadU(force[c] + i), f));
+        }
+    }
+
+    buAnchoredBungeeForcesScalar(position, anchor, springConstant, restLength, force, i, end);
+}
+#else
+void buAnchoredBungeeForcesSIMD(buReal *const position[3], buVector3 anchor, buReal springConstant, buReal restLength, buReal *const force[3], size_t begin, size_t end) {
+    buAnchoredBungeeForcesScalar(position, anchor, springConstant, restLength, force, begin, end);
+}
+#endif
+
+void buAnchoredBungeeForces(buReal *const position[3], buVector3 anchor, buReal springConstant, buReal restLength, buReal *const force[3], size_t begin, size_t end) {
+    buAnchoredBungeeForcesSIMD(position, anchor, springConstant, restLength, force, begin, end);
+}
@@ -1,4 +1,5 @@
 #include "budgie/pfgen.h"
+#include "budgie/pfbatch.h"
 #include "budgie/precision.h"
 #include <string.h>
 #include <stdlib.h>
@@ -7,6 +8,17 @@
 
 const buVector3 GRAVITY = { (buReal)0.0, (buReal)-9.81, (buReal)0.0 };
 
+// The particle state the particle-local built-in generators read
+// (gravity, drag, buoyancy and the anchored springs). Each computes
+// its force from one of these, so ParticleForcePipeline can load a
+// particle's state once for all its generators
+typedef struct PfgState {
+    buVector3 position;
+    buVector3 velocity;
+    bool finite; // hasFiniteMass
+    buReal mass; // only set when finite
+} PfgState;
+
 //////////////////////////////////////////////////////////////////
 // ParticleForceGenerator interface
 //////////////////////////////////////////////////////////////////
@@ -18,6 +30,46 @@ ParticleForceGeneratorVTable pfg_vtable;
     assert(false && "updateForce must be implemented in derived classes");  
  }
 
+static void pfg_updateForceBatch(const ParticleForceGenerator *self, Particle *const *particles, size_t count, buReal duration) {
+    for (size_t i = 0; i < count; i++) {
+        INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, self, updateForce, particles[i], duration);
+    }
+}
+
+static void pfg_updateWorldForces(const ParticleForceGenerator *self, ParticleWorld *world, size_t begin, size_t end, buReal duration) {
+    for (size_t i = begin; i < end; i++) {
+        Particle *particle = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i);
+        INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, self, updateForce, particle, duration);
+    }
+}
+
+// Block of particle state gathered for a batch kernel
+typedef struct PfgBatch {
+    buReal value[3][PFG_BATCH_SIZE];
+    buReal force[3][PFG_BATCH_SIZE];
+} PfgBatch;
+
+// Copies the velocities (or positions) of particles into the batch and
+// clears its forces
+static void pfg_gather(PfgBatch *batch, Particle *const *particles, size_t count, bool positions) {
+    for (size_t i = 0; i < count; i++) {
+        buVector3 value = positions
+            ? INSTANCE_METHOD_AS(ParticleVTable, particles[i], getPosition)
+            : INSTANCE_METHOD_AS(ParticleVTable, particles[i], getVelocity);
+        for (int k = 0; k < 3; k++) {
+            batch->value[k][i] = value.v[k];
+            batch->force[k][i] = 0.0f;
+        }
+    }
+}
+
+static void pfg_scatter(const PfgBatch *batch, Particle *const *particles, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        buVector3 force = {batch->force[0][i], batch->force[1][i], batch->force[2][i]};
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], addForce, force);
+    }
+}
+
 // free object
 static void pfg_free_instance(const Class *cls, Object *self) {
     // This is an abstract method, should be overridden in derived classes
@@ -44,6 +96,8 @@ void ParticleForceGeneratorCreateClass() {
 
         // methods
         pfg_vtable.updateForce = pfg_updateForce;
+        pfg_vtable.updateForceBatch = pfg_updateForceBatch;
+        pfg_vtable.updateWorldForces = pfg_updateWorldForces;
 
         // init the particle class
         particleForceGeneratorClass.base = class; // inherit from Class
@@ -78,15 +132,33 @@ void pg_free_instance(const ParticleGravityClass *cls, ParticleGravity *self) {
     free(self);
 }
 
-void pg_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+// Each built-in generator computes its force separately from applying
+// it, so the registry's threaded path can sum forces into its own
+// buffers instead of calling addForce
+static inline bool pg_stateForce(const ParticleForceGenerator *self, const PfgState *state, buVector3 *out) {
     // Check that we do not have infinite mass
-    if (!INSTANCE_METHOD_AS(ParticleVTable, particle, hasFiniteMass)) return;
+    if (!state->finite) return false;
 
     // Apply the mass-scaled force to the particle
-    buReal mass = INSTANCE_METHOD_AS(ParticleVTable, particle, getMass);
-    assert(mass > 0.0); // Ensure mass is positive
-    buVector3 force = buVector3Scalar(((ParticleGravity *)self)->_gravity, mass);
-    INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    assert(state->mass > 0.0); // Ensure mass is positive
+    buVector3 force = buVector3Scalar(((ParticleGravity *)self)->_gravity, state->mass);
+    *out = force;
+    return true;
+}
+
+static inline bool pg_computeForce(const ParticleForceGenerator *self, Particle *particle, buReal duration, buVector3 *out) {
+    PfgState state;
+    state.finite = INSTANCE_METHOD_AS(ParticleVTable, particle, hasFiniteMass);
+    if (!state.finite) return false;
+    state.mass = INSTANCE_METHOD_AS(ParticleVTable, particle, getMass);
+    return pg_stateForce(self, &state, out);
+}
+
+void pg_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+    buVector3 force;
+    if (pg_computeForce(self, particle, duration, &force)) {
+        INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    }
 }
 
 
@@ -140,8 +212,8 @@ void pd_free_instance(const ParticleDragClass *cls, ParticleDrag *self) {
     free(self);
 }
 
-void pd_updateForce(const ParticleForceGenerator *self, Particle* particle, buReal duration) {
-    buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, particle, getVelocity);
+static inline bool pd_stateForce(const ParticleForceGenerator *self, const PfgState *state, buVector3 *out) {
+    buVector3 force = state->velocity;
 
     // Calculate the total drag coefficient
     buReal dragCoeff = buVector3Norm(force);
@@ -150,7 +222,37 @@ void pd_updateForce(const ParticleForceGenerator *self, Particle* particle, buRe
     // Calculate the final force and apply it
     force = buVector3Normalise(force);
     force = buVector3Scalar(force, -dragCoeff);
-    INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    *out = force;
+    return true;
+}
+
+static inline bool pd_computeForce(const ParticleForceGenerator *self, Particle *particle, buReal duration, buVector3 *out) {
+    PfgState state;
+    state.velocity = INSTANCE_METHOD_AS(ParticleVTable, particle, getVelocity);
+    return pd_stateForce(self, &state, out);
+}
+
+void pd_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+    buVector3 force;
+    if (pd_computeForce(self, particle, duration, &force)) {
+        INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    }
+}
+
+// Drag is cheap enough that gathering velocities through the Particle
+// getters for the kernel costs more than it saves (see bench_batch),
+// so separate particles keep the direct per-particle path; worlds get
+// the kernel
+static void pd_updateForceBatch(const ParticleForceGenerator *self, Particle *const *particles, size_t count, buReal duration) {
+    for (size_t i = 0; i < count; i++) {
+        pd_updateForce(self, particles[i], duration);
+    }
+}
+
+static void pd_updateWorldForces(const ParticleForceGenerator *self, ParticleWorld *world, size_t begin, size_t end, buReal duration) {
+    const ParticleDrag *drag = (const ParticleDrag *)self;
+    assert(end <= world->_count);
+    buDragForces(world->_arrays.velocity, drag->_k1, drag->_k2, world->_arrays.forceAccum, begin, end);
 }
 
 static const char *pd_get_name(const ParticleDragClass *cls) {
@@ -167,6 +269,8 @@ void ParticleDragCreateClass() {
 
         // methods
         pd_vtable.base.updateForce = pd_updateForce;
+        pd_vtable.base.updateForceBatch = pd_updateForceBatch;
+        pd_vtable.base.updateWorldForces = pd_updateWorldForces;
 
         // init the particle class
         particleDragClass.base = particleForceGeneratorClass; // inherit from Class
@@ -207,9 +311,9 @@ void pas_free_instance(const ParticleAnchoredSpringClass *cls, ParticleAnchoredS
     free(self);
 }
 
-void pas_updateForce(const ParticleForceGenerator *self, Particle* particle, buReal duration) {
+static inline bool pas_stateForce(const ParticleForceGenerator *self, const PfgState *state, buVector3 *out) {
     // Calculate the vector of the spring
-    buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
+    buVector3 force = state->position;
     force = buVector3Difference(force, ((ParticleAnchoredSpring *)self)->_anchor);
 
     // Calculate the magnitude of the force
@@ -219,7 +323,21 @@ void pas_updateForce(const ParticleForceGenerator *self, Particle* particle, buR
     // Calculate the final force and apply it
     force = buVector3Normalise(force);
     force = buVector3Scalar(force, magnitude);
-    INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    *out = force;
+    return true;
+}
+
+static inline bool pas_computeForce(const ParticleForceGenerator *self, Particle *particle, buReal duration, buVector3 *out) {
+    PfgState state;
+    state.position = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
+    return pas_stateForce(self, &state, out);
+}
+
+void pas_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+    buVector3 force;
+    if (pas_computeForce(self, particle, duration, &force)) {
+        INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    }
 }
 
 static const char *pas_get_name(const ParticleAnchoredSpringClass *cls) {
@@ -276,8 +394,7 @@ void ps_free_instance(const ParticleSpringClass *cls, ParticleSpring *self) {
     free(self);
 }
 
-void ps_updateForce(const ParticleForceGenerator *self, Particle* particle, buReal duration)
-{
+static inline bool ps_computeForce(const ParticleForceGenerator *self, Particle *particle, buReal duration, buVector3 *out) {
     // Calculate the vector of the spring
     buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
     buVector3 other = INSTANCE_METHOD_AS(ParticleVTable, ((ParticleSpring *)self)->_other, getPosition);
@@ -291,7 +408,15 @@ void ps_updateForce(const ParticleForceGenerator *self, Particle* particle, buRe
     // Calculate the final force and apply it
     force = buVector3Normalise(force);
     force = buVector3Scalar(force, -magnitude);
-    INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    *out = force;
+    return true;
+}
+
+void ps_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+    buVector3 force;
+    if (ps_computeForce(self, particle, duration, &force)) {
+        INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    }
 }
 
 static const char *ps_get_name(const ParticleSpringClass *cls) {
@@ -351,26 +476,56 @@ void pb_free_instance(const ParticleBuoyancyClass *cls, ParticleBuoyancy *self)
 }
 
 
-void pb_updateForce(const ParticleForceGenerator *self, Particle* particle, buReal duration)
-{
+static inline bool pb_stateForce(const ParticleForceGenerator *self, const PfgState *state, buVector3 *out) {
     // Calculate the submersion depth
-    buReal depth = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition).y;
+    buReal depth = state->position.y;
 
     // Check if we're out of the water
-    if (depth >= ((ParticleBuoyancy *)self)->_waterHeight + ((ParticleBuoyancy *)self)->_maxDepth) return;
+    if (depth >= ((ParticleBuoyancy *)self)->_waterHeight + ((ParticleBuoyancy *)self)->_maxDepth) return false;
     buVector3 force = (buVector3){0.0, 0.0 , 0.0};
 
     // Check if we're at maximum depth
     if (depth <= ((ParticleBuoyancy *)self)->_waterHeight - ((ParticleBuoyancy *)self)->_maxDepth) {
         force.y = ((ParticleBuoyancy *)self)->_liquidDensity * ((ParticleBuoyancy *)self)->_volume;
-        INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
-        return;
+        *out = force;
+        return true;
     }
 
     // Otherwise we are partly submerged
     force.y = ((ParticleBuoyancy *)self)->_liquidDensity * ((ParticleBuoyancy *)self)->_volume *
         (depth - ((ParticleBuoyancy *)self)->_maxDepth - ((ParticleBuoyancy *)self)->_waterHeight) / (2 * ((ParticleBuoyancy *)self)->_maxDepth);
-    INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    *out = force;
+    return true;
+}
+
+static inline bool pb_computeForce(const ParticleForceGenerator *self, Particle *particle, buReal duration, buVector3 *out) {
+    PfgState state;
+    state.position = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
+    return pb_stateForce(self, &state, out);
+}
+
+void pb_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+    buVector3 force;
+    if (pb_computeForce(self, particle, duration, &force)) {
+        INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    }
+}
+
+static void pb_updateForceBatch(const ParticleForceGenerator *self, Particle *const *particles, size_t count, buReal duration) {
+    const ParticleBuoyancy *buoyancy = (const ParticleBuoyancy *)self;
+    PfgBatch batch;
+    for (size_t first = 0; first < count; first += PFG_BATCH_SIZE) {
+        size_t n = count - first < PFG_BATCH_SIZE ? count - first : PFG_BATCH_SIZE;
+        pfg_gather(&batch, particles + first, n, true);
+        buBuoyancyForces(batch.value[1], buoyancy->_maxDepth, buoyancy->_volume, buoyancy->_waterHeight, buoyancy->_liquidDensity, batch.force[1], 0, n);
+        pfg_scatter(&batch, particles + first, n);
+    }
+}
+
+static void pb_updateWorldForces(const ParticleForceGenerator *self, ParticleWorld *world, size_t begin, size_t end, buReal duration) {
+    const ParticleBuoyancy *buoyancy = (const ParticleBuoyancy *)self;
+    assert(end <= world->_count);
+    buBuoyancyForces(world->_arrays.position[1], buoyancy->_maxDepth, buoyancy->_volume, buoyancy->_waterHeight, buoyancy->_liquidDensity, world->_arrays.forceAccum[1], begin, end);
 }
 
 static const char *pb_get_name(const ParticleBuoyancyClass *cls) {
@@ -387,6 +542,8 @@ void ParticleBuoyancyCreateClass() {
 
         // methods
         pb_vtable.base.updateForce = pb_updateForce;
+        pb_vtable.base.updateForceBatch = pb_updateForceBatch;
+        pb_vtable.base.updateWorldForces = pb_updateWorldForces;
 
         // init the particle class
         particleBuoyancyClass.base = particleForceGeneratorClass; // inherit from Class
@@ -425,14 +582,14 @@ void pab_free_instance(const ParticleAnchoredBungeeClass *cls, ParticleAnchoredB
     free(self);
 }
 
-void pab_updateForce(const ParticleForceGenerator *self, Particle* particle, buReal duration) {
+static inline bool pab_stateForce(const ParticleForceGenerator *self, const PfgState *state, buVector3 *out) {
     // Calculate the vector of the spring
-    buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
+    buVector3 force = state->position;
     force = buVector3Difference(force, ((ParticleAnchoredBungee *)self)->_anchor);
 
     // Calculate the magnitude of the force
     buReal magnitude = buVector3Norm(force);
-    if (magnitude < ((ParticleAnchoredBungee *)self)->_restLength) return;
+    if (magnitude < ((ParticleAnchoredBungee *)self)->_restLength) return false;
 
     magnitude = magnitude - ((ParticleAnchoredBungee *)self)->_restLength;
     magnitude *= ((ParticleAnchoredBungee *)self)->_springConstant;
@@ -440,7 +597,40 @@ void pab_updateForce(const ParticleForceGenerator *self, Particle* particle, buR
     // Calculate the final force and apply it
     force = buVector3Normalise(force);
     force = buVector3Scalar(force, -magnitude);
-    INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    *out = force;
+    return true;
+}
+
+static inline bool pab_computeForce(const ParticleForceGenerator *self, Particle *particle, buReal duration, buVector3 *out) {
+    PfgState state;
+    state.position = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
+    return pab_stateForce(self, &state, out);
+}
+
+void pab_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+    buVector3 force;
+    if (pab_computeForce(self, particle, duration, &force)) {
+        INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    }
+}
+
+static void pab_updateForceBatch(const ParticleForceGenerator *self, Particle *const *particles, size_t count, buReal duration) {
+    const ParticleAnchoredBungee *bungee = (const ParticleAnchoredBungee *)self;
+    PfgBatch batch;
+    buReal *const position[3] = {batch.value[0], batch.value[1], batch.value[2]};
+    buReal *const force[3] = {batch.force[0], batch.force[1], batch.force[2]};
+    for (size_t first = 0; first < count; first += PFG_BATCH_SIZE) {
+        size_t n = count - first < PFG_BATCH_SIZE ? count - first : PFG_BATCH_SIZE;
+        pfg_gather(&batch, particles + first, n, true);
+        buAnchoredBungeeForces(position, bungee->_anchor, bungee->_springConstant, bungee->_restLength, force, 0, n);
+        pfg_scatter(&batch, particles + first, n);
+    }
+}
+
+static void pab_updateWorldForces(const ParticleForceGenerator *self, ParticleWorld *world, size_t begin, size_t end, buReal duration) {
+    const ParticleAnchoredBungee *bungee = (const ParticleAnchoredBungee *)self;
+    assert(end <= world->_count);
+    buAnchoredBungeeForces(world->_arrays.position, bungee->_anchor, bungee->_springConstant, bungee->_restLength, world->_arrays.forceAccum, begin, end);
 }
 
 static const char *pab_get_name(const ParticleAnchoredBungeeClass *cls) {
@@ -457,6 +647,8 @@ void ParticleAnchoredBungeeCreateClass() {
 
         // methods
         pab_vtable.base.updateForce = pab_updateForce;
+        pab_vtable.base.updateForceBatch = pab_updateForceBatch;
+        pab_vtable.base.updateWorldForces = pab_updateWorldForces;
 
         // init the particle class
         particleAnchoredBungeeClass.base = particleForceGeneratorClass; // inherit from Class
@@ -496,7 +688,7 @@ void pbu_free_instance(const ParticleBungeeClass *cls, ParticleBungee *self) {
     free(self);
 }
 
-void pbu_updateForce(const ParticleForceGenerator *self, Particle* particle, buReal duration) {
+static inline bool pbu_computeForce(const ParticleForceGenerator *self, Particle *particle, buReal duration, buVector3 *out) {
     // Calculate the vector of the spring
     buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
     buVector3 otherPosition = INSTANCE_METHOD_AS(ParticleVTable, ((ParticleBungee *)self)->_other, getPosition);
@@ -504,7 +696,7 @@ void pbu_updateForce(const ParticleForceGenerator *self, Particle* particle, buR
 
     // Check if the bungee is compressed
     buReal magnitude = buVector3Norm(force);
-    if (magnitude <= ((ParticleBungee *)self)->_restLength) return;
+    if (magnitude <= ((ParticleBungee *)self)->_restLength) return false;
 
     // Calculate the magnitude of the force
     magnitude = ((ParticleBungee *)self)->_springConstant * (((ParticleBungee *)self)->_restLength - magnitude);
@@ -512,7 +704,15 @@ void pbu_updateForce(const ParticleForceGenerator *self, Particle* particle, buR
     // Calculate the final force and apply it
     force = buVector3Normalise(force);
     force = buVector3Scalar(force, -magnitude);
-    INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    *out = force;
+    return true;
+}
+
+void pbu_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+    buVector3 force;
+    if (pbu_computeForce(self, particle, duration, &force)) {
+        INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    }
 }
 
 static const char *pbu_get_name(const ParticleBungeeClass *cls) {
@@ -568,9 +768,9 @@ void pfs_free_instance(const ParticleFakeSpringClass *cls, ParticleFakeSpring *s
     free(self);
 }
 
-void pfs_updateForce(const ParticleForceGenerator *self, Particle* particle, buReal duration) {
+static inline bool pfs_computeForce(const ParticleForceGenerator *self, Particle *particle, buReal duration, buVector3 *out) {
     // Check that we do not have infinite mass
-    if(!INSTANCE_METHOD_AS(ParticleVTable, particle, hasFiniteMass)) return;
+    if(!INSTANCE_METHOD_AS(ParticleVTable, particle, hasFiniteMass)) return false;
 
     // Calculate the relative position of the particle to the anchor
     buVector3 position = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
@@ -578,7 +778,7 @@ void pfs_updateForce(const ParticleForceGenerator *self, Particle* particle, buR
 
     // Calculate the constants and check they are in bounds.
     buReal gamma = 0.5f * buSqrt(4 * ((ParticleFakeSpring *)self)->_springConstant - ((ParticleFakeSpring *)self)->_damping * ((ParticleFakeSpring *)self)->_damping);
-    if (gamma == 0.0f) return;
+    if (gamma == 0.0f) return false;
     buVector3 c = buVector3Add(
         buVector3Scalar(position, ((ParticleFakeSpring *)self)->_damping / (2.0 * gamma)),
         buVector3Scalar(INSTANCE_METHOD_AS(ParticleVTable, particle, getVelocity), 1.0 / gamma));
@@ -595,8 +795,15 @@ void pfs_updateForce(const ParticleForceGenerator *self, Particle* particle, buR
             buVector3Scalar(INSTANCE_METHOD_AS(ParticleVTable, particle, getVelocity), ((buReal)1.0/duration)));
 
     buVector3 force = buVector3Scalar(accel, INSTANCE_METHOD_AS(ParticleVTable, particle, getMass));
-    INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    *out = force;
+    return true;
+}
 
+void pfs_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+    buVector3 force;
+    if (pfs_computeForce(self, particle, duration, &force)) {
+        INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, force);
+    }
 }
 
 static const char *pfs_get_name(const ParticleFakeSpringClass *cls) {
@@ -627,53 +834,862 @@ void ParticleFakeSpringCreateClass() {
     printf("ParticleFakeSpringCreateClass:leave\n");
 }
 
+///////////////////////////////////////////////////////////////////
+// ParticlePairSpring - applies a spring force to both ends of a link
+///////////////////////////////////////////////////////////////////
+ParticlePairSpringClass particlePairSpringClass;
+ParticlePairSpringVTable pps_vtable;
+
+// new object
+static ParticlePairSpring *pps_new_instance(
+                                    const ParticlePairSpringClass *cls,
+                                    Particle *first, Particle *second, buReal sc, buReal rl) {
+    ParticlePairSpring *p = malloc(sizeof(ParticlePairSpring));
+    assert(p);  // Check for allocation failure
+    p->_particle[0] = first;
+    p->_particle[1] = second;
+    p->_springConstant = sc;
+    p->_restLength = rl;
+    ((Object *)p)->klass = (Class *)cls;
+    return p;
+}
+
+// free object
+void pps_free_instance(const ParticlePairSpringClass *cls, ParticlePairSpring *self) {
+    free(self);
+}
+
+// Computes the force on _particle[0]; _particle[1] gets its opposite
+static inline bool pps_computeForce(const ParticleForceGenerator *self, Particle *particle, buReal duration, buVector3 *out) {
+    const ParticlePairSpring *spring = (const ParticlePairSpring *)self;
+
+    // Calculate the vector of the spring
+    buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, spring->_particle[0], getPosition);
+    buVector3 other = INSTANCE_METHOD_AS(ParticleVTable, spring->_particle[1], getPosition);
+    force = buVector3Difference(force, other);
+
+    // Calculate the magnitude of the force
+    buReal magnitude = buVector3Norm(force);
+    magnitude = magnitude - spring->_restLength;
+    magnitude *= spring->_springConstant;
+
+    // Calculate the final force
+    force = buVector3Normalise(force);
+    *out = buVector3Scalar(force, -magnitude);
+    return true;
+}
+
+void pps_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+    const ParticlePairSpring *spring = (const ParticlePairSpring *)self;
+    assert(particle == spring->_particle[0] || particle == spring->_particle[1]);
+
+    buVector3 force;
+    if (pps_computeForce(self, particle, duration, &force)) {
+        INSTANCE_METHOD_AS(ParticleVTable, spring->_particle[0], addForce, force);
+        INSTANCE_METHOD_AS(ParticleVTable, spring->_particle[1], addForce, buVector3Scalar(force, -1.0));
+    }
+}
+
+static const char *pps_get_name(const ParticlePairSpringClass *cls) {
+    return cls->class_name;
+}
+
+static bool pps_initialized = false;
+void ParticlePairSpringCreateClass() {
+    printf("ParticlePairSpringCreateClass:enter\n");
+    if (!pps_initialized) {
+        printf("ParticlePairSpringCreateClass:initializing\n");
+        ParticleForceGeneratorCreateClass();
+        pps_vtable.base = pfg_vtable; // inherit from VTable
+
+        // methods
+        pps_vtable.base.updateForce = pps_updateForce;
+
+        // init the particle class
+        particlePairSpringClass.base = particleForceGeneratorClass; // inherit from Class
+        particlePairSpringClass.base.base.vtable = (VTable *)&pps_vtable;
+        particlePairSpringClass.new_instance = pps_new_instance;
+        particlePairSpringClass.free = pps_free_instance;
+        particlePairSpringClass.class_name = strdup("ParticlePairSpring");
+        particlePairSpringClass.get_name = pps_get_name;
+
+        pps_initialized = true;
+    }
+    printf("ParticlePairSpringCreateClass:leave\n");
+}
+
+///////////////////////////////////////////////////////////////////
+// ParticlePairBungee - applies a bungee force to both ends of a link
+///////////////////////////////////////////////////////////////////
+ParticlePairBungeeClass particlePairBungeeClass;
+ParticlePairBungeeVTable ppb_vtable;
+
+// new object
+static ParticlePairBungee *ppb_new_instance(
+                                    const ParticlePairBungeeClass *cls,
+                                    Particle *first, Particle *second, buReal sc, buReal rl) {
+    ParticlePairBungee *p = malloc(sizeof(ParticlePairBungee));
+    assert(p);  // Check for allocation failure
+    p->_particle[0] = first;
+    p->_particle[1] = second;
+    p->_springConstant = sc;
+    p->_restLength = rl;
+    ((Object *)p)->klass = (Class *)cls;
+    return p;
+}
+
+// free object
+void ppb_free_instance(const ParticlePairBungeeClass *cls, ParticlePairBungee *self) {
+    free(self);
+}
+
+// Computes the force on _particle[0]; _particle[1] gets its opposite
+static inline bool ppb_computeForce(const ParticleForceGenerator *self, Particle *particle, buReal duration, buVector3 *out) {
+    const ParticlePairBungee *bungee = (const ParticlePairBungee *)self;
+
+    // Calculate the vector of the bungee
+    buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, bungee->_particle[0], getPosition);
+    buVector3 other = INSTANCE_METHOD_AS(ParticleVTable, bungee->_particle[1], getPosition);
+    force = buVector3Difference(force, other);
+
+    // Calculate the magnitude of the force
+    buReal magnitude = buVector3Norm(force);
+
+    // Check if the bungee is compressed
+    if (magnitude <= bungee->_restLength) return false;
+
+    magnitude = magnitude - bungee->_restLength;
+    magnitude *= bungee->_springConstant;
+
+    // Calculate the final force
+    force = buVector3Normalise(force);
+    *out = buVector3Scalar(force, -magnitude);
+    return true;
+}
+
+void ppb_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+    const ParticlePairBungee *bungee = (const ParticlePairBungee *)self;
+    assert(particle == bungee->_particle[0] || particle == bungee->_particle[1]);
+
+    buVector3 force;
+    if (ppb_computeForce(self, particle, duration, &force)) {
+        INSTANCE_METHOD_AS(ParticleVTable, bungee->_particle[0], addForce, force);
+        INSTANCE_METHOD_AS(ParticleVTable, bungee->_particle[1], addForce, buVector3Scalar(force, -1.0));
+    }
+}
+
+static const char *ppb_get_name(const ParticlePairBungeeClass *cls) {
+    return cls->class_name;
+}
+
+static bool ppb_initialized = false;
+void ParticlePairBungeeCreateClass() {
+    printf("ParticlePairBungeeCreateClass:enter\n");
+    if (!ppb_initialized) {
+        printf("ParticlePairBungeeCreateClass:initializing\n");
+        ParticleForceGeneratorCreateClass();
+        ppb_vtable.base = pfg_vtable; // inherit from VTable
+
+        // methods
+        ppb_vtable.base.updateForce = ppb_updateForce;
+
+        // init the particle class
+        particlePairBungeeClass.base = particleForceGeneratorClass; // inherit from Class
+        particlePairBungeeClass.base.base.vtable = (VTable *)&ppb_vtable;
+        particlePairBungeeClass.new_instance = ppb_new_instance;
+        particlePairBungeeClass.free = ppb_free_instance;
+        particlePairBungeeClass.class_name = strdup("ParticlePairBungee");
+        particlePairBungeeClass.get_name = ppb_get_name;
+
+        ppb_initialized = true;
+    }
+    printf("ParticlePairBungeeCreateClass:leave\n");
+}
+
 //////////////////////////////////////////////////////////////////
 // ParticleForceRegistry
 //////////////////////////////////////////////////////////////////
 ParticleForceRegistryClass particleForceRegistryClass;
 ParticleForceRegistryVTable pfr_vtable;
 
-void pfr_add(ParticleForceRegistry *self, Particle* particle, ParticleForceGenerator *fg) {
-    ParticleForceRegistration *registration = malloc(sizeof(ParticleForceRegistration));
-    registration->particle = particle;
-    registration->fg = fg;
-    INSTANCE_METHOD_AS(VectorVTable, self->_registrations, push, registration);
+ParticleForceKind buParticleForceKind(const ParticleForceGenerator *fg) {
+    void (*updateForce)(const ParticleForceGenerator *, Particle *, buReal) =
+        ((ParticleForceGeneratorVTable *)((Object *)fg)->klass->vtable)->updateForce;
+    if (updateForce == pg_updateForce) return PFK_GRAVITY;
+    if (updateForce == pd_updateForce) return PFK_DRAG;
+    if (updateForce == pas_updateForce) return PFK_ANCHORED_SPRING;
+    if (updateForce == pab_updateForce) return PFK_ANCHORED_BUNGEE;
+    if (updateForce == pfs_updateForce) return PFK_FAKE_SPRING;
+    if (updateForce == ps_updateForce) return PFK_SPRING;
+    if (updateForce == pbu_updateForce) return PFK_BUNGEE;
+    if (updateForce == pb_updateForce) return PFK_BUOYANCY;
+    if (updateForce == pps_updateForce) return PFK_PAIR_SPRING;
+    if (updateForce == ppb_updateForce) return PFK_PAIR_BUNGEE;
+    return PFK_GENERIC;
+}
+
+static void pfr_reserveBucket(ParticleForceRegistrationArray *bucket, size_t count) {
+    size_t needed = bucket->count + count;
+    if (needed <= bucket->capacity) return;
+
+    size_t capacity = bucket->capacity ? bucket->capacity : 16;
+    while (capacity < needed) capacity *= 2;
+    bucket->items = realloc(bucket->items, capacity * sizeof(ParticleForceRegistration));
+    assert(bucket->items);  // Check for allocation failure
+    bucket->capacity = capacity;
+}
+
+static void pfr_reserveSlots(ParticleForceRegistry *self, size_t count) {
+    size_t needed = (size_t)self->_slotCount + count;
+    if (needed <= self->_slotCapacity) return;
+    assert(needed < PFR_NONE);
+
+    size_t capacity = self->_slotCapacity ? self->_slotCapacity : 16;
+    while (capacity < needed) capacity *= 2;
+    self->_slots = realloc(self->_slots, capacity * sizeof(ParticleForceSlot));
+    assert(self->_slots);  // Check for allocation failure
+    self->_slotCapacity = (uint32_t)capacity;
+}
+
+// Fibonacci hashing of the particle address; the low bits are always
+// zero because of alignment, so they are shifted out first
+static uint32_t pfr_hashParticle(const Particle *particle, uint32_t mask) {
+    uint64_t key = (uint64_t)(uintptr_t)particle >> 4;
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+// Builds the particle table again at the given size from the live ids
+static void pfr_rehashParticles(ParticleForceRegistry *self, uint32_t size) {
+    free(self->_particleTable);
+    self->_particleTable = malloc(size * sizeof(uint32_t));
+    assert(self->_particleTable);  // Check for allocation failure
+    memset(self->_particleTable, 0xff, size * sizeof(uint32_t));
+    self->_particleTableSize = size;
+
+    for (uint32_t id = 0; id < self->_particleCount; id++) {
+        if (!self->_particles[id]) continue; // dead id
+        uint32_t h = pfr_hashParticle(self->_particles[id], size - 1);
+        while (self->_particleTable[h] != PFR_NONE) h = (h + 1) & (size - 1);
+        self->_particleTable[h] = id;
+    }
+}
+
+// Returns the dense id of the particle, giving it one if create is
+// set, or PFR_NONE if the registry has never seen it
+static uint32_t pfr_particleId(ParticleForceRegistry *self, Particle *particle, bool create) {
+    if (self->_particleTableSize) {
+        uint32_t mask = self->_particleTableSize - 1;
+        uint32_t h = pfr_hashParticle(particle, mask);
+        for (uint32_t id; (id = self->_particleTable[h]) != PFR_NONE; h = (h + 1) & mask) {
+            if (self->_particles[id] == particle) return id;
+        }
+    }
+    if (!create) return PFR_NONE;
+
+    // Keep the table at most half full
+    if ((self->_particleCount - self->_freeParticleCount + 1) * 2 > self->_particleTableSize) {
+        pfr_rehashParticles(self, self->_particleTableSize ? self->_particleTableSize * 2 : 64);
+    }
+
+    // Dead ids are reused before new ones are handed out
+    uint32_t id;
+    if (self->_freeParticle != PFR_NONE) {
+        id = self->_freeParticle;
+        self->_freeParticle = self->_particleHeads[id];
+        self->_freeParticleCount--;
+    } else {
+        if (self->_particleCount == self->_particleCapacity) {
+            uint32_t capacity = self->_particleCapacity ? self->_particleCapacity * 2 : 16;
+            self->_particles = realloc(self->_particles, capacity * sizeof(Particle *));
+            self->_particleHeads = realloc(self->_particleHeads, capacity * sizeof(uint32_t));
+            self->_particleRefs = realloc(self->_particleRefs, capacity * sizeof(uint32_t));
+            assert(self->_particles && self->_particleHeads && self->_particleRefs);  // Check for allocation failure
+            self->_particleCapacity = capacity;
+        }
+        id = self->_particleCount++;
+    }
+    self->_particles[id] = particle;
+    self->_particleHeads[id] = PFR_NONE;
+    self->_particleRefs[id] = 0;
+
+    uint32_t mask = self->_particleTableSize - 1;
+    uint32_t h = pfr_hashParticle(particle, mask);
+    while (self->_particleTable[h] != PFR_NONE) h = (h + 1) & mask;
+    self->_particleTable[h] = id;
+    return id;
+}
+
+// Forgets a particle no registration touches any more, and puts its id
+// on the free list
+static void pfr_freeParticleId(ParticleForceRegistry *self, uint32_t id) {
+    uint32_t mask = self->_particleTableSize - 1;
+    uint32_t h = pfr_hashParticle(self->_particles[id], mask);
+    while (self->_particleTable[h] != id) h = (h + 1) & mask;
+
+    // Backward-shift deletion keeps every probe sequence unbroken
+    for (uint32_t next = (h + 1) & mask; self->_particleTable[next] != PFR_NONE; next = (next + 1) & mask) {
+        uint32_t home = pfr_hashParticle(self->_particles[self->_particleTable[next]], mask);
+        // Move the entry back if h lies cyclically in [home, next)
+        if (((next - home) & mask) >= ((next - h) & mask)) {
+            self->_particleTable[h] = self->_particleTable[next];
+            h = next;
+        }
+    }
+    self->_particleTable[h] = PFR_NONE;
+
+    self->_particles[id] = NULL;
+    self->_particleHeads[id] = self->_freeParticle;
+    self->_freeParticle = id;
+    self->_freeParticleCount++;
+}
+
+// Renumbers the live ids 0.._particleCount - 1, keeping their order, so
+// arrays indexed by id can be sized by the live particles alone
+static void pfr_compactParticles(ParticleForceRegistry *self) {
+    if (self->_freeParticleCount == 0) return;
+
+    uint32_t *newId = malloc(self->_particleCount * sizeof(uint32_t));
+    assert(newId);  // Check for allocation failure
+    uint32_t live = 0;
+    for (uint32_t id = 0; id < self->_particleCount; id++) {
+        if (!self->_particles[id]) continue; // dead id
+        newId[id] = live;
+        self->_particles[live] = self->_particles[id];
+        self->_particleHeads[live] = self->_particleHeads[id];
+        self->_particleRefs[live] = self->_particleRefs[id];
+        live++;
+    }
+    for (uint32_t index = 0; index < self->_slotCount; index++) {
+        ParticleForceSlot *slot = &self->_slots[index];
+        if (slot->kind == PFK_COUNT) continue;
+        slot->particle = newId[slot->particle];
+        if (slot->other != PFR_NONE) slot->other = newId[slot->other];
+    }
+    free(newId);
+
+    self->_particleCount = live;
+    self->_freeParticle = PFR_NONE;
+    self->_freeParticleCount = 0;
+    pfr_rehashParticles(self, self->_particleTableSize);
+}
+
+// The end of a pair generator that the registration is not for, or
+// NULL for every other kind
+static Particle *pfr_otherEnd(const ParticleForceGenerator *fg, ParticleForceKind kind, const Particle *particle) {
+    Particle *const *ends;
+    switch (kind) {
+        case PFK_PAIR_SPRING: ends = ((const ParticlePairSpring *)fg)->_particle; break;
+        case PFK_PAIR_BUNGEE: ends = ((const ParticlePairBungee *)fg)->_particle; break;
+        default: return NULL;
+    }
+    assert(particle == ends[0] || particle == ends[1]);
+    return (particle == ends[0]) ? ends[1] : ends[0];
+}
+
+// Appends a registration to its bucket and gives it a slot; the
+// bucket and slot table must already have room
+static ParticleForceHandle pfr_insert(ParticleForceRegistry *self, ParticleForceRegistrationArray *bucket, ParticleForceKind kind, Particle *particle, ParticleForceGenerator *fg) {
+    uint32_t index;
+    if (self->_freeSlot != PFR_NONE) {
+        index = self->_freeSlot;
+        self->_freeSlot = self->_slots[index].index;
+    } else {
+        index = self->_slotCount++;
+        self->_slots[index].generation = 1;
+    }
+
+    uint32_t id = pfr_particleId(self, particle, true);
+    Particle *otherEnd = pfr_otherEnd(fg, kind, particle);
+    uint32_t other = otherEnd ? pfr_particleId(self, otherEnd, true) : PFR_NONE;
+    self->_particleRefs[id]++;
+    if (other != PFR_NONE) self->_particleRefs[other]++;
+
+    ParticleForceSlot *slot = &self->_slots[index];
+    slot->kind = (uint32_t)kind;
+    slot->index = (uint32_t)bucket->count;
+    slot->particle = id;
+    slot->other = other;
+    slot->prev = PFR_NONE;
+    slot->next = self->_particleHeads[id];
+    if (slot->next != PFR_NONE) self->_slots[slot->next].prev = index;
+    self->_particleHeads[id] = index;
+
+    bucket->items[bucket->count++] = (ParticleForceRegistration){particle, fg, index};
+    self->_version++;
+    return (ParticleForceHandle){index, slot->generation};
+}
+
+// Removes the registration owned by a live slot: the last entry of the
+// bucket fills the gap, and the slot goes back on the free list
+static void pfr_release(ParticleForceRegistry *self, uint32_t index) {
+    ParticleForceSlot *slot = &self->_slots[index];
+    ParticleForceRegistrationArray *bucket = &self->_registrations[slot->kind];
+
+    size_t last = --bucket->count;
+    if (slot->index != last) {
+        bucket->items[slot->index] = bucket->items[last];
+        self->_slots[bucket->items[slot->index].slot].index = slot->index;
+    }
+
+    if (slot->prev != PFR_NONE) self->_slots[slot->prev].next = slot->next;
+    else self->_particleHeads[slot->particle] = slot->next;
+    if (slot->next != PFR_NONE) self->_slots[slot->next].prev = slot->prev;
+    self->_particleRefs[slot->particle]--;
+    if (slot->other != PFR_NONE) self->_particleRefs[slot->other]--;
+    if (self->_particleRefs[slot->particle] == 0) pfr_freeParticleId(self, slot->particle);
+    if (slot->other != PFR_NONE && slot->other != slot->particle && self->_particleRefs[slot->other] == 0) {
+        pfr_freeParticleId(self, slot->other);
+    }
+
+    if (++slot->generation == 0) slot->generation = 1;
+    slot->kind = PFK_COUNT;
+    slot->index = self->_freeSlot;
+    self->_freeSlot = index;
+    self->_version++;
+}
+
+void pfr_reserve(ParticleForceRegistry *self, ParticleForceGenerator *fg, size_t count) {
+    pfr_reserveBucket(&self->_registrations[buParticleForceKind(fg)], count);
+    pfr_reserveSlots(self, count);
+}
+
+ParticleForceHandle pfr_add(ParticleForceRegistry *self, Particle* particle, ParticleForceGenerator *fg) {
+    ParticleForceKind kind = buParticleForceKind(fg);
+    ParticleForceRegistrationArray *bucket = &self->_registrations[kind];
+    pfr_reserveBucket(bucket, 1);
+    pfr_reserveSlots(self, 1);
+    return pfr_insert(self, bucket, kind, particle, fg);
+}
+
+void pfr_addMany(ParticleForceRegistry *self, Particle **particles, size_t count, ParticleForceGenerator *fg) {
+    ParticleForceKind kind = buParticleForceKind(fg);
+    ParticleForceRegistrationArray *bucket = &self->_registrations[kind];
+    pfr_reserveBucket(bucket, count);
+    pfr_reserveSlots(self, count);
+    for (size_t i = 0; i < count; i++) {
+        pfr_insert(self, bucket, kind, particles[i], fg);
+    }
 }
 
 void pfr_remove(ParticleForceRegistry *self, Particle* particle, ParticleForceGenerator *fg) {
-    size_t size = INSTANCE_METHOD_AS(VectorVTable, self->_registrations, getLength);
-    for (size_t i = 0; i < size; i++) {
-        ParticleForceRegistration *registration = INSTANCE_METHOD_AS(VectorVTable, self->_registrations, get, i);
-        if (registration->particle == particle && registration->fg == fg) {
-            INSTANCE_METHOD_AS(VectorVTable, self->_registrations, remove, registration);
-            free(registration);
+    uint32_t id = pfr_particleId(self, particle, false);
+    if (id == PFR_NONE) return;
+    for (uint32_t index = self->_particleHeads[id]; index != PFR_NONE; index = self->_slots[index].next) {
+        const ParticleForceSlot *slot = &self->_slots[index];
+        if (self->_registrations[slot->kind].items[slot->index].fg == fg) {
+            pfr_release(self, index);
             return;
         }
     }
 }
 
+bool pfr_removeByHandle(ParticleForceRegistry *self, ParticleForceHandle handle) {
+    if (handle.slot >= self->_slotCount) return false;
+    const ParticleForceSlot *slot = &self->_slots[handle.slot];
+    if (slot->kind == PFK_COUNT || slot->generation != handle.generation) return false;
+    pfr_release(self, handle.slot);
+    return true;
+}
+
+void pfr_removeAllForParticle(ParticleForceRegistry *self, Particle *particle) {
+    uint32_t id = pfr_particleId(self, particle, false);
+    if (id == PFR_NONE) return;
+    // The id goes on the free list once its last registration is gone
+    while (self->_particles[id] == particle && self->_particleHeads[id] != PFR_NONE) {
+        pfr_release(self, self->_particleHeads[id]);
+    }
+}
+
 void pfr_clear(ParticleForceRegistry *self) {
-    size_t size = INSTANCE_METHOD_AS(VectorVTable, self->_registrations, getLength);
-    for (size_t i = 0; i < size; i++) {
-        ParticleForceRegistration *registration = INSTANCE_METHOD_AS(VectorVTable, self->_registrations, get, i);
-        free(registration);
+    self->_version++;
+    self->_groupRegistrationCount = 0;
+    for (int kind = 0; kind < PFK_COUNT; kind++) {
+        self->_registrations[kind].count = 0;
+    }
+
+    // Invalidate every outstanding handle
+    for (uint32_t index = 0; index < self->_slotCount; index++) {
+        ParticleForceSlot *slot = &self->_slots[index];
+        if (slot->kind == PFK_COUNT) continue;
+        if (++slot->generation == 0) slot->generation = 1;
+        slot->kind = PFK_COUNT;
+        slot->index = self->_freeSlot;
+        self->_freeSlot = index;
+    }
+
+    // No particle has registrations left, so forget them all
+    self->_particleCount = 0;
+    self->_freeParticle = PFR_NONE;
+    self->_freeParticleCount = 0;
+    if (self->_particleTableSize) {
+        memset(self->_particleTable, 0xff, self->_particleTableSize * sizeof(uint32_t));
+    }
+}
+
+static ParticleForceGroup *pfr_group(const ParticleForceRegistry *self, uint32_t group) {
+    assert(group < self->_groupCount && self->_groups[group].live);
+    return &self->_groups[group];
+}
+
+// Returns a free group, reusing the first removed one if there is any
+static uint32_t pfr_newGroup(ParticleForceRegistry *self) {
+    uint32_t group = 0;
+    while (group < self->_groupCount && self->_groups[group].live) group++;
+    if (group == self->_groupCount) {
+        if (self->_groupCount == self->_groupCapacity) {
+            uint32_t capacity = self->_groupCapacity ? self->_groupCapacity * 2 : 8;
+            self->_groups = realloc(self->_groups, capacity * sizeof(ParticleForceGroup));
+            assert(self->_groups);  // Check for allocation failure
+            self->_groupCapacity = capacity;
+        }
+        self->_groupCount++;
+    }
+    self->_groups[group] = (ParticleForceGroup){NULL, 0, 0, NULL, 0, 0, NULL, 0, true};
+    return group;
+}
+
+// Returns the slot of the member table holding the particle, or the
+// empty slot where it would go
+static uint32_t pfr_findMember(const ParticleForceGroup *g, const Particle *particle) {
+    uint32_t mask = g->tableSize - 1;
+    uint32_t h = pfr_hashParticle(particle, mask);
+    for (uint32_t position; (position = g->table[h]) != PFR_NONE; h = (h + 1) & mask) {
+        if (g->members[position] == particle) break;
+    }
+    return h;
+}
+
+static void pfr_growMemberTable(ParticleForceGroup *g) {
+    uint32_t size = g->tableSize ? g->tableSize * 2 : 16;
+    free(g->table);
+    g->table = malloc(size * sizeof(uint32_t));
+    assert(g->table);  // Check for allocation failure
+    memset(g->table, 0xff, size * sizeof(uint32_t));
+    g->tableSize = size;
+    for (uint32_t position = 0; position < g->memberCount; position++) {
+        g->table[pfr_findMember(g, g->members[position])] = position;
+    }
+}
+
+void pfr_addToGroup(ParticleForceRegistry *self, uint32_t group, Particle *particle) {
+    ParticleForceGroup *g = pfr_group(self, group);
+    assert(!g->world);  // range groups have no member list
+
+    // Keep the table at most half full
+    if ((g->memberCount + 1) * 2 > g->tableSize) {
+        pfr_growMemberTable(g);
+    }
+    uint32_t h = pfr_findMember(g, particle);
+    if (g->table[h] != PFR_NONE) return;
+
+    if (g->memberCount == g->memberCapacity) {
+        uint32_t capacity = g->memberCapacity ? g->memberCapacity * 2 : 16;
+        g->members = realloc(g->members, capacity * sizeof(Particle *));
+        assert(g->members);  // Check for allocation failure
+        g->memberCapacity = capacity;
+    }
+    g->table[h] = g->memberCount;
+    g->members[g->memberCount++] = particle;
+}
+
+bool pfr_removeFromGroup(ParticleForceRegistry *self, uint32_t group, Particle *particle) {
+    ParticleForceGroup *g = pfr_group(self, group);
+    if (!g->tableSize) return false;
+    uint32_t h = pfr_findMember(g, particle);
+    uint32_t position = g->table[h];
+    if (position == PFR_NONE) return false;
+
+    // Backward-shift deletion keeps every probe sequence unbroken
+    uint32_t mask = g->tableSize - 1;
+    for (uint32_t next = (h + 1) & mask; g->table[next] != PFR_NONE; next = (next + 1) & mask) {
+        uint32_t home = pfr_hashParticle(g->members[g->table[next]], mask);
+        // Move the entry back if h lies cyclically in [home, next)
+        if (((next - home) & mask) >= ((next - h) & mask)) {
+            g->table[h] = g->table[next];
+            h = next;
+        }
+    }
+    g->table[h] = PFR_NONE;
+
+    // The last member fills the gap
+    uint32_t last = --g->memberCount;
+    if (position != last) {
+        g->table[pfr_findMember(g, g->members[last])] = position;
+        g->members[position] = g->members[last];
+    }
+    return true;
+}
+
+uint32_t pfr_addGroup(ParticleForceRegistry *self, Particle **particles, size_t count) {
+    uint32_t group = pfr_newGroup(self);
+    for (size_t i = 0; i < count; i++) {
+        pfr_addToGroup(self, group, particles[i]);
+    }
+    return group;
+}
+
+uint32_t pfr_addRangeGroup(ParticleForceRegistry *self, ParticleWorld *world, size_t begin, size_t end) {
+    assert(world && begin <= end);
+    uint32_t group = pfr_newGroup(self);
+    ParticleForceGroup *g = &self->_groups[group];
+    g->world = world;
+    g->begin = begin;
+    g->end = end;
+    return group;
+}
+
+void pfr_setGroupRange(ParticleForceRegistry *self, uint32_t group, size_t begin, size_t end) {
+    ParticleForceGroup *g = pfr_group(self, group);
+    assert(g->world && begin <= end);
+    g->begin = begin;
+    g->end = end;
+}
+
+size_t pfr_getGroupSize(const ParticleForceRegistry *self, uint32_t group) {
+    const ParticleForceGroup *g = pfr_group(self, group);
+    return g->world ? g->end - g->begin : g->memberCount;
+}
+
+void pfr_addGroupForce(ParticleForceRegistry *self, uint32_t group, ParticleForceGenerator *fg) {
+    pfr_group(self, group);
+    if (self->_groupRegistrationCount == self->_groupRegistrationCapacity) {
+        size_t capacity = self->_groupRegistrationCapacity ? self->_groupRegistrationCapacity * 2 : 8;
+        self->_groupRegistrations = realloc(self->_groupRegistrations, capacity * sizeof(ParticleForceGroupRegistration));
+        assert(self->_groupRegistrations);  // Check for allocation failure
+        self->_groupRegistrationCapacity = capacity;
+    }
+    self->_groupRegistrations[self->_groupRegistrationCount++] = (ParticleForceGroupRegistration){group, fg};
+}
+
+// Removes group registrations that match, keeping the rest in order;
+// fg NULL matches any generator
+static void pfr_dropGroupForces(ParticleForceRegistry *self, uint32_t group, const ParticleForceGenerator *fg, bool firstOnly) {
+    size_t kept = 0;
+    bool dropped = false;
+    for (size_t i = 0; i < self->_groupRegistrationCount; i++) {
+        const ParticleForceGroupRegistration *registration = &self->_groupRegistrations[i];
+        bool match = registration->group == group && (!fg || registration->fg == fg);
+        if (match && !(firstOnly && dropped)) {
+            dropped = true;
+            continue;
+        }
+        self->_groupRegistrations[kept++] = *registration;
+    }
+    self->_groupRegistrationCount = kept;
+}
+
+void pfr_removeGroupForce(ParticleForceRegistry *self, uint32_t group, ParticleForceGenerator *fg) {
+    pfr_dropGroupForces(self, group, fg, true);
+}
+
+void pfr_removeGroup(ParticleForceRegistry *self, uint32_t group) {
+    ParticleForceGroup *g = pfr_group(self, group);
+    pfr_dropGroupForces(self, group, NULL, false);
+    free(g->members);
+    free(g->table);
+    g->live = false;
+}
+
+// Runs the group registrations in the order they were added
+static void pfr_runGroups(const ParticleForceRegistry *self, buReal duration) {
+    for (size_t i = 0; i < self->_groupRegistrationCount; i++) {
+        const ParticleForceGroupRegistration *registration = &self->_groupRegistrations[i];
+        const ParticleForceGroup *g = &self->_groups[registration->group];
+        if (g->world) {
+            INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, registration->fg, updateWorldForces, g->world, g->begin, g->end, duration);
+        } else if (g->memberCount) {
+            INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, registration->fg, updateForceBatch, g->members, g->memberCount, duration);
+        }
+    }
+}
+
+// Runs one bucket with a direct call to the kind's updateForce, which
+// the compiler can inline since it is defined in this file
+#define PFR_RUN_BATCH(buckets, kind, updateForce, duration) \
+    do { \
+        const ParticleForceRegistrationArray *bucket = &(buckets)[kind]; \
+        for (size_t i = 0; i < bucket->count; i++) { \
+            updateForce(bucket->items[i].fg, bucket->items[i].particle, (duration)); \
+        } \
+    } while (0)
+
+// Runs one bucket with a batch kernel: consecutive registrations of
+// the same generator are handed to its updateForceBatch in blocks
+#define PFR_RUN_KERNEL_BATCH(buckets, kind, updateForceBatch, duration) \
+    do { \
+        const ParticleForceRegistrationArray *bucket = &(buckets)[kind]; \
+        Particle *run[PFG_BATCH_SIZE]; \
+        size_t i = 0; \
+        while (i < bucket->count) { \
+            const ParticleForceGenerator *fg = bucket->items[i].fg; \
+            size_t n = 0; \
+            while (i < bucket->count && bucket->items[i].fg == fg && n < PFG_BATCH_SIZE) { \
+                run[n++] = bucket->items[i++].particle; \
+            } \
+            updateForceBatch(fg, run, n, (duration)); \
+        } \
+    } while (0)
+
+// User-defined generators keep vtable dispatch
+static void pfr_runGeneric(const ParticleForceRegistrationArray *generic, buReal duration) {
+    for (size_t i = 0; i < generic->count; i++) {
+        const ParticleForceRegistration *registration = &generic->items[i];
+        INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, registration->fg, updateForce, registration->particle, duration);
+    }
+}
+
+// Runs a full set of buckets, one kind after the other, on the calling
+// thread
+static void pfr_runBuckets(const ParticleForceRegistrationArray buckets[PFK_COUNT], buReal duration) {
+    PFR_RUN_BATCH(buckets, PFK_GRAVITY, pg_updateForce, duration);
+    PFR_RUN_BATCH(buckets, PFK_DRAG, pd_updateForce, duration);
+    PFR_RUN_BATCH(buckets, PFK_ANCHORED_SPRING, pas_updateForce, duration);
+    PFR_RUN_KERNEL_BATCH(buckets, PFK_ANCHORED_BUNGEE, pab_updateForceBatch, duration);
+    PFR_RUN_BATCH(buckets, PFK_FAKE_SPRING, pfs_updateForce, duration);
+    PFR_RUN_BATCH(buckets, PFK_SPRING, ps_updateForce, duration);
+    PFR_RUN_BATCH(buckets, PFK_BUNGEE, pbu_updateForce, duration);
+    PFR_RUN_KERNEL_BATCH(buckets, PFK_BUOYANCY, pb_updateForceBatch, duration);
+    PFR_RUN_BATCH(buckets, PFK_PAIR_SPRING, pps_updateForce, duration);
+    PFR_RUN_BATCH(buckets, PFK_PAIR_BUNGEE, ppb_updateForce, duration);
+    pfr_runGeneric(&buckets[PFK_GENERIC], duration);
+}
+
+// Sums the forces of one chunk of the built-in registrations, numbered
+// across the buckets in updateForces order, into forces[particle id]
+#define PFR_ACCUMULATE_BATCH(self, kind, computeForce, first, last, forces, duration) \
+    do { \
+        const ParticleForceRegistration *items = (self)->_registrations[kind].items; \
+        for (size_t i = (first); i < (last); i++) { \
+            buVector3 force; \
+            if (computeForce(items[i].fg, items[i].particle, (duration), &force)) { \
+                buVector3 *sum = &(forces)[(self)->_slots[items[i].slot].particle]; \
+                *sum = buVector3Add(*sum, force); \
+            } \
+        } \
+    } while (0)
+
+// Pair generators add the force to one end and subtract it from the other
+#define PFR_ACCUMULATE_PAIR_BATCH(self, kind, Type, computeForce, first, last, forces, duration) \
+    do { \
+        const ParticleForceRegistration *items = (self)->_registrations[kind].items; \
+        for (size_t i = (first); i < (last); i++) { \
+            buVector3 force; \
+            if (computeForce(items[i].fg, items[i].particle, (duration), &force)) { \
+                const ParticleForceSlot *slot = &(self)->_slots[items[i].slot]; \
+                bool registeredOnFirst = items[i].particle == ((const Type *)items[i].fg)->_particle[0]; \
+                buVector3 *sum0 = &(forces)[registeredOnFirst ? slot->particle : slot->other]; \
+                buVector3 *sum1 = &(forces)[registeredOnFirst ? slot->other : slot->particle]; \
+                *sum0 = buVector3Add(*sum0, force); \
+                *sum1 = buVector3Difference(*sum1, force); \
+            } \
+        } \
+    } while (0)
+
+static void pfr_accumulateChunk(const ParticleForceRegistry *self, size_t begin, size_t end, buVector3 *forces, buReal duration) {
+    size_t offset = 0;
+    for (int kind = 0; kind < PFK_GENERIC && begin < end; kind++) {
+        size_t count = self->_registrations[kind].count;
+        if (begin < offset + count) {
+            size_t first = begin - offset;
+            size_t last = (end < offset + count ? end : offset + count) - offset;
+            switch (kind) {
+                case PFK_GRAVITY: PFR_ACCUMULATE_BATCH(self, kind, pg_computeForce, first, last, forces, duration); break;
+                case PFK_DRAG: PFR_ACCUMULATE_BATCH(self, kind, pd_computeForce, first, last, forces, duration); break;
+                case PFK_ANCHORED_SPRING: PFR_ACCUMULATE_BATCH(self, kind, pas_computeForce, first, last, forces, duration); break;
+                case PFK_ANCHORED_BUNGEE: PFR_ACCUMULATE_BATCH(self, kind, pab_computeForce, first, last, forces, duration); break;
+                case PFK_FAKE_SPRING: PFR_ACCUMULATE_BATCH(self, kind, pfs_computeForce, first, last, forces, duration); break;
+                case PFK_SPRING: PFR_ACCUMULATE_BATCH(self, kind, ps_computeForce, first, last, forces, duration); break;
+                case PFK_BUNGEE: PFR_ACCUMULATE_BATCH(self, kind, pbu_computeForce, first, last, forces, duration); break;
+                case PFK_BUOYANCY: PFR_ACCUMULATE_BATCH(self, kind, pb_computeForce, first, last, forces, duration); break;
+                case PFK_PAIR_SPRING: PFR_ACCUMULATE_PAIR_BATCH(self, kind, ParticlePairSpring, pps_computeForce, first, last, forces, duration); break;
+                case PFK_PAIR_BUNGEE: PFR_ACCUMULATE_PAIR_BATCH(self, kind, ParticlePairBungee, ppb_computeForce, first, last, forces, duration); break;
+                default: assert(false);
+            }
+            begin = offset + last;
+        }
+        offset += count;
+    }
+}
+
+static void pfr_updateForcesThreaded(ParticleForceRegistry *self, buReal duration) {
+    // The buffers are indexed by id, so only live ids may take room
+    pfr_compactParticles(self);
+    const int threads = (int)self->_threadCount;
+    const size_t particles = self->_particleCount;
+    size_t total = 0;
+    for (int kind = 0; kind < PFK_GENERIC; kind++) {
+        total += self->_registrations[kind].count;
+    }
+
+    size_t needed = (size_t)threads * particles;
+    if (needed > self->_threadForcesCapacity) {
+        free(self->_threadForces);
+        self->_threadForces = malloc(needed * sizeof(buVector3));
+        assert(self->_threadForces);  // Check for allocation failure
+        self->_threadForcesCapacity = needed;
+    }
+    buVector3 *forces = self->_threadForces;
+
+    // Chunk boundaries depend only on the thread count, never on scheduling
+    #pragma omp parallel for num_threads(threads) schedule(static, 1)
+    for (int t = 0; t < threads; t++) {
+        buVector3 *buffer = forces + (size_t)t * particles;
+        for (size_t id = 0; id < particles; id++) {
+            buffer[id] = (buVector3){0.0, 0.0, 0.0};
+        }
+        pfr_accumulateChunk(self, total * t / threads, total * (t + 1) / threads, buffer, duration);
+    }
+
+    // Reduce in chunk order; each particle is written by one thread only
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (long id = 0; id < (long)particles; id++) {
+        buVector3 force = forces[id];
+        for (int t = 1; t < threads; t++) {
+            force = buVector3Add(force, forces[(size_t)t * particles + id]);
+        }
+        INSTANCE_METHOD_AS(ParticleVTable, self->_particles[id], addForce, force);
     }
-    INSTANCE_METHOD_AS(VectorVTable, self->_registrations, clear);
 }
 
 void pfr_updateForces(ParticleForceRegistry *self, buReal duration) {
-    size_t size = INSTANCE_METHOD_AS(VectorVTable, self->_registrations, getLength);
-    for (size_t i = 0; i < size; i++) {
-        ParticleForceRegistration *registration = INSTANCE_METHOD_AS(VectorVTable, self->_registrations, get, i);
-        Particle *particle = registration->particle;
-        ParticleForceGenerator *generator = registration->fg;
-        INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, generator, updateForce, particle, duration);
+    if (self->_threadCount > 1) {
+        pfr_updateForcesThreaded(self, duration);
+        pfr_runGeneric(&self->_registrations[PFK_GENERIC], duration);
+    } else {
+        pfr_runBuckets(self->_registrations, duration);
     }
+    pfr_runGroups(self, duration);
+}
+
+void pfr_setThreadCount(ParticleForceRegistry *self, unsigned threads) {
+    assert(threads >= 1);
+    self->_threadCount = threads;
+}
+
+unsigned pfr_getThreadCount(const ParticleForceRegistry *self) {
+    return self->_threadCount;
 }
 
 // free object
 void pfr_free_instance(const Class *cls, Object *self) {
     printf("ParticleForceRegistry::free_instance:enter\n");
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)self;
+    for (int kind = 0; kind < PFK_COUNT; kind++) {
+        free(registry->_registrations[kind].items);
+    }
+    free(registry->_slots);
+    free(registry->_particles);
+    free(registry->_particleHeads);
+    free(registry->_particleRefs);
+    free(registry->_particleTable);
+    free(registry->_threadForces);
+    for (uint32_t group = 0; group < registry->_groupCount; group++) {
+        if (!registry->_groups[group].live) continue;
+        free(registry->_groups[group].members);
+        free(registry->_groups[group].table);
+    }
+    free(registry->_groups);
+    free(registry->_groupRegistrations);
     free(self);
     printf("ParticleForceRegistry::free_instance:leave\n");
 }
@@ -683,7 +1699,32 @@ static Object *pfr_new_instance(const Class *cls) {
     ParticleForceRegistry *pfg = malloc(sizeof(ParticleForceRegistry));
     assert(pfg);  // Check for allocation failure
     ((Object *)pfg)->klass = cls;
-    pfg->_registrations = (Vector *)CLASS_METHOD(&vectorClass, new_instance);
+    for (int kind = 0; kind < PFK_COUNT; kind++) {
+        pfg->_registrations[kind] = (ParticleForceRegistrationArray){NULL, 0, 0};
+    }
+    pfg->_slots = NULL;
+    pfg->_slotCount = 0;
+    pfg->_slotCapacity = 0;
+    pfg->_freeSlot = PFR_NONE;
+    pfg->_particles = NULL;
+    pfg->_particleHeads = NULL;
+    pfg->_particleRefs = NULL;
+    pfg->_particleCount = 0;
+    pfg->_particleCapacity = 0;
+    pfg->_freeParticle = PFR_NONE;
+    pfg->_freeParticleCount = 0;
+    pfg->_particleTable = NULL;
+    pfg->_particleTableSize = 0;
+    pfg->_threadCount = 1;
+    pfg->_threadForces = NULL;
+    pfg->_threadForcesCapacity = 0;
+    pfg->_version = 0;
+    pfg->_groups = NULL;
+    pfg->_groupCount = 0;
+    pfg->_groupCapacity = 0;
+    pfg->_groupRegistrations = NULL;
+    pfg->_groupRegistrationCount = 0;
+    pfg->_groupRegistrationCapacity = 0;
     return (Object *)pfg;
 }
 
@@ -700,9 +1741,24 @@ void ParticleForceRegistryCreateClass() {
 
         // methods
         pfr_vtable.add = pfr_add;
+        pfr_vtable.addMany = pfr_addMany;
+        pfr_vtable.reserve = pfr_reserve;
         pfr_vtable.remove = pfr_remove;
+        pfr_vtable.removeByHandle = pfr_removeByHandle;
+        pfr_vtable.removeAllForParticle = pfr_removeAllForParticle;
         pfr_vtable.clear = pfr_clear;
+        pfr_vtable.addGroup = pfr_addGroup;
+        pfr_vtable.addRangeGroup = pfr_addRangeGroup;
+        pfr_vtable.setGroupRange = pfr_setGroupRange;
+        pfr_vtable.addToGroup = pfr_addToGroup;
+        pfr_vtable.removeFromGroup = pfr_removeFromGroup;
+        pfr_vtable.getGroupSize = pfr_getGroupSize;
+        pfr_vtable.removeGroup = pfr_removeGroup;
+        pfr_vtable.addGroupForce = pfr_addGroupForce;
+        pfr_vtable.removeGroupForce = pfr_removeGroupForce;
         pfr_vtable.updateForces = pfr_updateForces;
+        pfr_vtable.setThreadCount = pfr_setThreadCount;
+        pfr_vtable.getThreadCount = pfr_getThreadCount;
 
         // init the particle class
         particleForceRegistryClass.base = class; // inherit from Class
@@ -718,3 +1774,350 @@ void ParticleForceRegistryCreateClass() {
 }
 
 
+
+//////////////////////////////////////////////////////////////////
+// ParticleForcePipeline
+//////////////////////////////////////////////////////////////////
+ParticleForcePipelineClass particleForcePipelineClass;
+ParticleForcePipelineVTable pfp_vtable;
+
+// Kinds whose force depends only on the particle it is registered on
+static bool pfp_fusable(ParticleForceKind kind) {
+    return kind == PFK_GRAVITY || kind == PFK_DRAG || kind == PFK_ANCHORED_SPRING ||
+        kind == PFK_ANCHORED_BUNGEE || kind == PFK_BUOYANCY;
+}
+
+static void *pfp_grow(void *array, size_t size) {
+    void *grown = realloc(array, size ? size : 1);
+    assert(grown);  // Check for allocation failure
+    return grown;
+}
+
+// FNV-1a over the generator addresses of one list
+static uint32_t pfp_hashList(ParticleForceGenerator *const *generators, uint32_t count) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (uint32_t g = 0; g < count; g++) {
+        hash ^= (uint64_t)(uintptr_t)generators[g];
+        hash *= 1099511628211ULL;
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static void pfp_build(ParticleForcePipeline *self) {
+    // The scratch below is indexed by id, so only live ids may take room
+    pfr_compactParticles(self->_registry);
+    const ParticleForceRegistry *registry = self->_registry;
+    const uint32_t particles = registry->_particleCount;
+
+    // Every particle's single-particle registrations, in the order
+    // updateForces runs them: by kind, then by bucket position
+    uint32_t *start = calloc((size_t)particles + 1, sizeof(uint32_t));
+    bool *fusable = malloc((particles ? particles : 1) * sizeof(bool));
+    assert(start && fusable);  // Check for allocation failure
+    memset(fusable, 1, particles * sizeof(bool));
+    for (int kind = 0; kind < PFK_PAIR_SPRING; kind++) {
+        const ParticleForceRegistrationArray *bucket = &registry->_registrations[kind];
+        for (size_t i = 0; i < bucket->count; i++) {
+            uint32_t id = registry->_slots[bucket->items[i].slot].particle;
+            start[id + 1]++;
+            if (!pfp_fusable((ParticleForceKind)kind)) fusable[id] = false;
+        }
+    }
+    for (uint32_t id = 0; id < particles; id++) {
+        start[id + 1] += start[id];
+    }
+    ParticleForceGenerator **lists = malloc((start[particles] ? start[particles] : 1) * sizeof(ParticleForceGenerator *));
+    uint8_t *kinds = malloc(start[particles] ? start[particles] : 1);
+    uint32_t *cursor = malloc((particles ? particles : 1) * sizeof(uint32_t));
+    assert(lists && kinds && cursor);  // Check for allocation failure
+    memcpy(cursor, start, particles * sizeof(uint32_t));
+    for (int kind = 0; kind < PFK_PAIR_SPRING; kind++) {
+        const ParticleForceRegistrationArray *bucket = &registry->_registrations[kind];
+        for (size_t i = 0; i < bucket->count; i++) {
+            uint32_t id = registry->_slots[bucket->items[i].slot].particle;
+            lists[cursor[id]] = bucket->items[i].fg;
+            kinds[cursor[id]++] = (uint8_t)kind;
+        }
+    }
+
+    // Group the fusable particles by their list
+    uint32_t tableSize = 16;
+    while (tableSize < 2 * particles) tableSize <<= 1;
+    uint32_t *table = malloc(tableSize * sizeof(uint32_t));
+    uint32_t *stackOf = cursor; // reused: id -> stack, PFR_NONE if not fused
+    assert(table);  // Check for allocation failure
+    memset(table, 0xff, tableSize * sizeof(uint32_t));
+
+    self->_stackCount = 0;
+    self->_stackGeneratorCount = 0;
+    self->_memberCount = 0;
+    size_t stackCapacity = 0;
+    size_t generatorCapacity = 0;
+    for (uint32_t id = 0; id < particles; id++) {
+        uint32_t count = start[id + 1] - start[id];
+        stackOf[id] = PFR_NONE;
+        if (count == 0 || !fusable[id]) continue;
+
+        ParticleForceGenerator *const *list = lists + start[id];
+        uint32_t slot = pfp_hashList(list, count) & (tableSize - 1);
+        while (table[slot] != PFR_NONE) {
+            const ParticleForceStack *stack = &self->_stacks[table[slot]];
+            if (stack->generatorCount == count &&
+                memcmp(self->_stackGenerators + stack->generatorBegin, list, count * sizeof(ParticleForceGenerator *)) == 0) {
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if (table[slot] == PFR_NONE) {
+            if (self->_stackCount == stackCapacity) {
+                stackCapacity = stackCapacity ? 2 * stackCapacity : 16;
+                self->_stacks = pfp_grow(self->_stacks, stackCapacity * sizeof(ParticleForceStack));
+            }
+            if (self->_stackGeneratorCount + count > generatorCapacity) {
+                while (self->_stackGeneratorCount + count > generatorCapacity) {
+                    generatorCapacity = generatorCapacity ? 2 * generatorCapacity : 64;
+                }
+                self->_stackGenerators = pfp_grow(self->_stackGenerators, generatorCapacity * sizeof(ParticleForceGenerator *));
+                self->_stackKinds = pfp_grow(self->_stackKinds, generatorCapacity);
+            }
+            memcpy(self->_stackGenerators + self->_stackGeneratorCount, list, count * sizeof(ParticleForceGenerator *));
+            memcpy(self->_stackKinds + self->_stackGeneratorCount, kinds + start[id], count);
+            self->_stacks[self->_stackCount] = (ParticleForceStack){(uint32_t)self->_stackGeneratorCount, count, 0, 0};
+            self->_stackGeneratorCount += count;
+            table[slot] = (uint32_t)self->_stackCount++;
+        }
+        stackOf[id] = table[slot];
+        self->_stacks[table[slot]].memberCount++;
+        self->_memberCount++;
+    }
+
+    // Members of each stack, in particle id order
+    uint32_t memberBegin = 0;
+    for (size_t s = 0; s < self->_stackCount; s++) {
+        self->_stacks[s].memberBegin = memberBegin;
+        memberBegin += self->_stacks[s].memberCount;
+        self->_stacks[s].memberCount = 0;
+    }
+    self->_members = pfp_grow(self->_members, self->_memberCount * sizeof(Particle *));
+    for (uint32_t id = 0; id < particles; id++) {
+        if (stackOf[id] == PFR_NONE) continue;
+        ParticleForceStack *stack = &self->_stacks[stackOf[id]];
+        self->_members[stack->memberBegin + stack->memberCount++] = registry->_particles[id];
+    }
+
+    // Everything else keeps the registry's order
+    for (int kind = 0; kind < PFK_COUNT; kind++) {
+        const ParticleForceRegistrationArray *bucket = &registry->_registrations[kind];
+        ParticleForceRegistrationArray *rest = &self->_rest[kind];
+        rest->count = 0;
+        if (bucket->count > rest->capacity) {
+            rest->items = pfp_grow(rest->items, bucket->count * sizeof(ParticleForceRegistration));
+            rest->capacity = bucket->count;
+        }
+        for (size_t i = 0; i < bucket->count; i++) {
+            uint32_t id = registry->_slots[bucket->items[i].slot].particle;
+            if (kind < PFK_PAIR_SPRING && stackOf[id] != PFR_NONE) continue;
+            rest->items[rest->count++] = bucket->items[i];
+        }
+    }
+
+    free(table);
+    free(cursor);
+    free(kinds);
+    free(lists);
+    free(fusable);
+    free(start);
+    self->_version = registry->_version;
+    self->_built = true;
+}
+
+// One block of a stack's members, gathered as arrays for the batch
+// kernels
+typedef struct PfpBlock {
+    buReal position[3][PFG_BATCH_SIZE];
+    buReal velocity[3][PFG_BATCH_SIZE];
+    buReal mass[PFG_BATCH_SIZE]; // 0 for infinite mass, which gravity skips
+    buReal sum[3][PFG_BATCH_SIZE];
+} PfpBlock;
+
+static void pfp_gather(PfpBlock *block, Particle *const *members, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        Particle *particle = members[i];
+        buVector3 position, velocity, sum;
+        buReal mass = 0.0f;
+        // Plain particles are read in place; anything else, such as a
+        // WorldParticle view, goes through its methods
+        if (((Object *)particle)->klass == (Class *)&particleClass) {
+            position = particle->_position;
+            velocity = particle->_velocity;
+            if (particle->_inverseMass > 0.0f) mass = ((buReal)1.0)/particle->_inverseMass;
+            sum = particle->_forceAccum;
+        } else {
+            position = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
+            velocity = INSTANCE_METHOD_AS(ParticleVTable, particle, getVelocity);
+            if (INSTANCE_METHOD_AS(ParticleVTable, particle, hasFiniteMass)) {
+                mass = INSTANCE_METHOD_AS(ParticleVTable, particle, getMass);
+            }
+            sum = INSTANCE_METHOD_AS(ParticleVTable, particle, getForceAccum);
+        }
+        for (int k = 0; k < 3; k++) {
+            block->position[k][i] = position.v[k];
+            block->velocity[k][i] = velocity.v[k];
+            block->sum[k][i] = sum.v[k];
+        }
+        block->mass[i] = mass;
+    }
+}
+
+static void pfp_scatter(const PfpBlock *block, Particle *const *members, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        Particle *particle = members[i];
+        buVector3 sum = {block->sum[0][i], block->sum[1][i], block->sum[2][i]};
+        if (((Object *)particle)->klass == (Class *)&particleClass) {
+            particle->_forceAccum = sum;
+        } else {
+            INSTANCE_METHOD_AS(ParticleVTable, particle, clearAccumulator);
+            INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, sum);
+        }
+    }
+}
+
+// Adds one generator's force to every particle of a block
+static void pfp_runGenerator(ParticleForceKind kind, const ParticleForceGenerator *fg, PfpBlock *block, size_t count) {
+    buReal *const position[3] = {block->position[0], block->position[1], block->position[2]};
+    buReal *const velocity[3] = {block->velocity[0], block->velocity[1], block->velocity[2]};
+    buReal *const sum[3] = {block->sum[0], block->sum[1], block->sum[2]};
+    switch (kind) {
+        case PFK_GRAVITY: {
+            const buVector3 gravity = ((const ParticleGravity *)fg)->_gravity;
+            for (int k = 0; k < 3; k++) {
+                for (size_t i = 0; i < count; i++) {
+                    sum[k][i] += gravity.v[k] * block->mass[i];
+                }
+            }
+            break;
+        }
+        case PFK_DRAG: {
+            const ParticleDrag *drag = (const ParticleDrag *)fg;
+            buDragForces(velocity, drag->_k1, drag->_k2, sum, 0, count);
+            break;
+        }
+        case PFK_ANCHORED_BUNGEE: {
+            const ParticleAnchoredBungee *bungee = (const ParticleAnchoredBungee *)fg;
+            buAnchoredBungeeForces(position, bungee->_anchor, bungee->_springConstant, bungee->_restLength, sum, 0, count);
+            break;
+        }
+        case PFK_BUOYANCY: {
+            const ParticleBuoyancy *buoyancy = (const ParticleBuoyancy *)fg;
+            buBuoyancyForces(block->position[1], buoyancy->_maxDepth, buoyancy->_volume, buoyancy->_waterHeight, buoyancy->_liquidDensity, block->sum[1], 0, count);
+            break;
+        }
+        case PFK_ANCHORED_SPRING:
+            for (size_t i = 0; i < count; i++) {
+                PfgState state;
+                buVector3 force;
+                state.position = (buVector3){block->position[0][i], block->position[1][i], block->position[2][i]};
+                if (pas_stateForce(fg, &state, &force)) {
+                    for (int k = 0; k < 3; k++) sum[k][i] += force.v[k];
+                }
+            }
+            break;
+        default:
+            assert(false);
+    }
+}
+
+// Sums one stack's forces for its members a block at a time. The sums
+// start from the force already accumulated and add the generators in
+// the registry's order, so every particle sees the same additions as
+// with the registry
+static void pfp_runStack(const ParticleForcePipeline *self, const ParticleForceStack *stack) {
+    ParticleForceGenerator *const *generators = self->_stackGenerators + stack->generatorBegin;
+    const uint8_t *kinds = self->_stackKinds + stack->generatorBegin;
+    Particle *const *members = self->_members + stack->memberBegin;
+    PfpBlock block;
+
+    for (size_t first = 0; first < stack->memberCount; first += PFG_BATCH_SIZE) {
+        size_t n = stack->memberCount - first < PFG_BATCH_SIZE ? stack->memberCount - first : PFG_BATCH_SIZE;
+        pfp_gather(&block, members + first, n);
+        for (uint32_t g = 0; g < stack->generatorCount; g++) {
+            pfp_runGenerator((ParticleForceKind)kinds[g], generators[g], &block, n);
+        }
+        pfp_scatter(&block, members + first, n);
+    }
+}
+
+static void pfp_updateForces(ParticleForcePipeline *self, buReal duration) {
+    if (!self->_built || self->_version != self->_registry->_version) {
+        pfp_build(self);
+    }
+
+    // Fused particles only receive pair and user-defined forces, which
+    // the registry also runs after every single-particle kind
+    for (size_t s = 0; s < self->_stackCount; s++) {
+        pfp_runStack(self, &self->_stacks[s]);
+    }
+    pfr_runBuckets(self->_rest, duration);
+    pfr_runGroups(self->_registry, duration);
+}
+
+static size_t pfp_getStackCount(const ParticleForcePipeline *self) {
+    return self->_stackCount;
+}
+
+static size_t pfp_getFusedCount(const ParticleForcePipeline *self) {
+    return self->_memberCount;
+}
+
+// new object
+static ParticleForcePipeline *pfp_new_instance(const ParticleForcePipelineClass *cls, ParticleForceRegistry *registry) {
+    ParticleForcePipeline *pipeline = calloc(1, sizeof(ParticleForcePipeline));
+    assert(pipeline);  // Check for allocation failure
+    ((Object *)pipeline)->klass = (Class *)cls;
+    pipeline->_registry = registry;
+    return pipeline;
+}
+
+// free object
+static void pfp_free_instance(const ParticleForcePipelineClass *cls, ParticleForcePipeline *self) {
+    printf("ParticleForcePipeline::free_instance:enter\n");
+    for (int kind = 0; kind < PFK_COUNT; kind++) {
+        free(self->_rest[kind].items);
+    }
+    free(self->_stacks);
+    free(self->_stackGenerators);
+    free(self->_stackKinds);
+    free(self->_members);
+    free(self);
+    printf("ParticleForcePipeline::free_instance:leave\n");
+}
+
+static const char *pfp_get_name(const ParticleForcePipelineClass *cls) {
+    return cls->class_name;
+}
+
+static bool pfp_initialized = false;
+void ParticleForcePipelineCreateClass() {
+    printf("ParticleForcePipelineCreateClass:enter\n");
+    if (!pfp_initialized) {
+        printf("ParticleForcePipelineCreateClass:initializing\n");
+        pfp_vtable.base = vTable; // inherit from VTable
+
+        // methods
+        pfp_vtable.build = pfp_build;
+        pfp_vtable.updateForces = pfp_updateForces;
+        pfp_vtable.getStackCount = pfp_getStackCount;
+        pfp_vtable.getFusedCount = pfp_getFusedCount;
+
+        // init the pipeline class
+        particleForcePipelineClass.base = class; // inherit from Class
+        particleForcePipelineClass.base.vtable = (VTable *)&pfp_vtable;
+        particleForcePipelineClass.new_instance = pfp_new_instance;
+        particleForcePipelineClass.free = pfp_free_instance;
+        particleForcePipelineClass.class_name = strdup("ParticleForcePipeline");
+        particleForcePipelineClass.get_name = pfp_get_name;
+
+        pfp_initialized = true;
+    }
+    printf("ParticleForcePipelineCreateClass:leave\n");
+}
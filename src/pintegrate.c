@@ -0,0 +1,118 @@
+#include "budgie/pintegrate.h"
+#include "budgie/simd.h"
+#include <assert.h>
+
+void buDampingFactors(const buReal *damping, buReal *dampingFactor, size_t begin, size_t end, buReal duration) {
+    for (size_t i = begin; i < end; i++) {
+        dampingFactor[i] = buPow(damping[i], duration);
+    }
+}
+
+void buIntegrateArraysScalar(const ParticleArrays *arrays, const buReal *dampingFactor, size_t begin, size_t end, buReal duration) {
+    const buReal *inverseMass = arrays->inverseMass;
+    for (size_t i = begin; i < end; i++) {
+        // Skip particles with infinite mass, exactly as integrate() does
+        if (inverseMass[i] <= 0.0f) continue;
+
+        for (int k = 0; k < 3; k++) {
+            buReal velocity = arrays->velocity[k][i];
+            arrays->position[k][i] = arrays->position[k][i] + velocity * duration;
+            arrays->velocity[k][i] = (velocity + arrays->acceleration[k][i] * duration) * dampingFactor[i];
+        }
+    }
+}
+
+#ifdef BU_SIMD
+void buIntegrateArraysSIMD(const ParticleArrays *arrays, const buReal *dampingFactor, size_t begin, size_t end, buReal duration) {
+    const buSimd dt = buSimdSet1(duration);
+    const buSimd zero = buSimdZero();
+
+    size_t i = begin;
+    for (; i + BU_SIMD_WIDTH <= end; i += BU_SIMD_WIDTH) {
+        // Lanes with infinite mass keep their old state
+        buSimd finite = buSimdCmpGt(buSimdLoadU(arrays->inverseMass + i), zero);
+        buSimd factor = buSimdLoadU(dampingFactor + i);
+
+        for (int k = 0; k < 3; k++) {
+            buSimd position = buSimdLoadU(arrays->position[k] + i);
+            buSimd velocity = buSimdLoadU(arrays->velocity[k] + i);
+            buSimd acceleration = buSimdLoadU(arrays->acceleration[k] + i);
+
+            buSimd newPosition = buSimdAdd(position, buSimdMul(velocity, dt));
+            buSimd newVelocity = buSimdMul(buSimdAdd(velocity, buSimdMul(acceleration, dt)), factor);
+
+            buSimdStoreU(arrays->position[k] + i, buSimdSelect(finite, newPosition, position));
+            buSimdStoreU(arrays->velocity[k] + i, buSimdSelect(finite, newVelocity, velocity));
+        }
+    }
+
+    // Remainder that does not fill a register
+    buIntegrateArraysScalar(arrays, dampingFactor, i, end, duration);
+}
+#else
+void buIntegrateArraysSIMD(const ParticleArrays *arrays, const buReal *dampingFactor, size_t begin, size_t end, buReal duration) {
+    buIntegrateArraysScalar(arrays, dampingFactor, begin, end, duration);
+}
+#endif
+
+void buIntegrateArrays(const ParticleArrays *arrays, const buReal *dampingFactor, size_t begin, size_t end, buReal duration) {
+    assert(duration > 0.0);
+    buIntegrateArraysSIMD(arrays, dampingFactor, begin, end, duration);
+}
+
+void buIntegrateArraysFieldScalar(const ParticleArrays *arrays, const buReal *dampingFactor, const buFieldTerms *terms, size_t begin, size_t end, buReal duration) {
+    const buReal *inverseMass = arrays->inverseMass;
+    for (size_t i = begin; i < end; i++) {
+        if (inverseMass[i] <= 0.0f) continue;
+
+        for (int k = 0; k < 3; k++) {
+            buReal velocity = arrays->velocity[k][i];
+            buReal acceleration = arrays->acceleration[k][i] + (terms->acceleration.v[k] + inverseMass[i] * terms->force.v[k]);
+            arrays->position[k][i] = arrays->position[k][i] + velocity * duration;
+            arrays->velocity[k][i] = (velocity + acceleration * duration) * dampingFactor[i];
+        }
+    }
+}
+
+#ifdef BU_SIMD
+void buIntegrateArraysFieldSIMD(const ParticleArrays *arrays, const buReal *dampingFactor, const buFieldTerms *terms, size_t begin, size_t end, buReal duration) {
+    const buSimd dt = buSimdSet1(duration);
+    const buSimd zero = buSimdZero();
+    buSimd fieldAcceleration[3], fieldForce[3];
+    for (int k = 0; k < 3; k++) {
+        fieldAcceleration[k] = buSimdSet1(terms->acceleration.v[k]);
+        fieldForce[k] = buSimdSet1(terms->force.v[k]);
+    }
+
+    size_t i = begin;
+    for (; i + BU_SIMD_WIDTH <= end; i += BU_SIMD_WIDTH) {
+        buSimd inverseMass = buSimdLoadU(arrays->inverseMass + i);
+        buSimd finite = buSimdCmpGt(inverseMass, zero);
+        buSimd factor = buSimdLoadU(dampingFactor + i);
+
+        for (int k = 0; k < 3; k++) {
+            buSimd position = buSimdLoadU(arrays->position[k] + i);
+            buSimd velocity = buSimdLoadU(arrays->velocity[k] + i);
+            buSimd field = buSimdAdd(fieldAcceleration[k], buSimdMul(inverseMass, fieldForce[k]));
+            buSimd acceleration = buSimdAdd(buSimdLoadU(arrays->acceleration[k] + i), field);
+
+            buSimd newPosition = buSimdAdd(position, buSimdMul(velocity, dt));
+            buSimd newVelocity = buSimdMul(buSimdAdd(velocity, buSimdMul(acceleration, dt)), factor);
+
+            buSimdStoreU(arrays->position[k] + i, buSimdSelect(finite, newPosition, position));
+            buSimdStoreU(arrays->velocity[k] + i, buSimdSelect(finite, newVelocity, velocity));
+        }
+    }
+
+    buIntegrateArraysFieldScalar(arrays, dampingFactor, terms, i, end, duration);
+}
+#else
+void buIntegrateArraysFieldSIMD(const ParticleArrays *arrays, const buReal *dampingFactor, const buFieldTerms *terms, size_t begin, size_t end, buReal duration) {
+    buIntegrateArraysFieldScalar(arrays, dampingFactor, terms, begin, end, duration);
+}
+#endif
+
+void buIntegrateArraysField(const ParticleArrays *arrays, const buReal *dampingFactor, const buFieldTerms *terms, size_t begin, size_t end, buReal duration) {
+    assert(duration > 0.0);
+    buIntegrateArraysFieldSIMD(arrays, dampingFactor, terms, begin, end, duration);
+}
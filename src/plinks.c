@@ -1,12 +1,18 @@
 
 #include "budgie/plinks.h"
+#include "budgie/alloc.h"
+#include "budgie/simd.h"
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
 
 //////////////////////////////////////////////////////////////////
 // ParticleLink
 //////////////////////////////////////////////////////////////////
 
-buReal pl_currentLength(ParticleLink *self) {
+static buReal pl_currentLength(ParticleLink *self) {
     buVector3 relativePos = buVector3Difference(
         INSTANCE_METHOD_AS(ParticleVTable, self->_particle[0], getPosition),
         INSTANCE_METHOD_AS(ParticleVTable, self->_particle[1], getPosition)
@@ -16,10 +22,10 @@ buReal pl_currentLength(ParticleLink *self) {
 }
 
 ParticleLinkClass particleLinkClass;
-ParticleLinkVTable pl_vtable;
+static ParticleLinkVTable pl_vtable;
 
 // free object
-void pl_free_instance(const Class *cls, Object *self) {
+static void pl_free_instance(const Class *cls, Object *self) {
     printf("ParticleLink::free_instance:enter\n");
     free(self);
     printf("ParticleLink::free_instance:leave\n");
@@ -46,7 +52,7 @@ void ParticleLinkCreateClass() {
         pl_vtable.base = pcg_vtable; // inherit from VTable
 
         // methods
-        pl_vtable.currentLength = pl_currentLength,
+        pl_vtable.currentLength = pl_currentLength;
 
         // init the particle class
         particleLinkClass.base = particleContactGeneratorClass; // inherit from Class
@@ -66,8 +72,10 @@ void ParticleLinkCreateClass() {
 //////////////////////////////////////////////////////////////////
 // ParticleCable
 //////////////////////////////////////////////////////////////////
-unsigned pc_addContact(ParticleContactGenerator *self, ParticleContact *contact,
+static unsigned pc_addContact(ParticleContactGenerator *self, ParticleContact *contact,
                                     unsigned limit){
+    if (limit == 0) return 0;
+
     // Find the length of the cable
     buReal length = pl_currentLength((ParticleLink *)self);
 
@@ -96,10 +104,10 @@ unsigned pc_addContact(ParticleContactGenerator *self, ParticleContact *contact,
 }
 
 ParticleCableClass particleCableClass;
-ParticleCableVTable pc_vtable;
+static ParticleCableVTable pc_vtable;
 
 // free object
-void pc_free_instance(const Class *cls, Object *self) {
+static void pc_free_instance(const Class *cls, Object *self) {
     printf("ParticleCable::free_instance:enter\n");
     free(self);
     printf("ParticleCable::free_instance:leave\n");
@@ -148,8 +156,10 @@ void ParticleCableCreateClass() {
 //////////////////////////////////////////////////////////////////
 // ParticleRod
 //////////////////////////////////////////////////////////////////
-unsigned pr_addContact(ParticleContactGenerator *self, ParticleContact *contact,
+static unsigned pr_addContact(ParticleContactGenerator *self, ParticleContact *contact,
                                   unsigned limit) {
+    if (limit == 0) return 0;
+
     // Find the length of the rod
     buReal currentLen = pl_currentLength((ParticleLink *)self);
 
@@ -185,10 +195,10 @@ unsigned pr_addContact(ParticleContactGenerator *self, ParticleContact *contact,
 }
 
 ParticleRodClass particleRodClass;
-ParticleRodVTable pr_vtable;
+static ParticleRodVTable pr_vtable;
 
 // free object
-void pr_free_instance(const Class *cls, Object *self) {
+static void pr_free_instance(const Class *cls, Object *self) {
     printf("ParticleRod::free_instance:enter\n");
     free(self);
     printf("ParticleRod::free_instance:leave\n");
@@ -237,7 +247,7 @@ void ParticleRodCreateClass() {
 //////////////////////////////////////////////////////////////////
 // ParticleConstraint
 //////////////////////////////////////////////////////////////////
-buReal pcc_currentLength(ParticleConstraint *self) {
+static buReal pcc_currentLength(ParticleConstraint *self) {
     buVector3 relativePos = buVector3Difference(
         INSTANCE_METHOD_AS(ParticleVTable, self->_particle, getPosition),
         self->_anchor
@@ -246,10 +256,10 @@ buReal pcc_currentLength(ParticleConstraint *self) {
 }
 
 ParticleConstraintClass particleConstraintClass;
-ParticleConstraintVTable pcc_vtable;
+static ParticleConstraintVTable pcc_vtable;
 
 // free object
-void pcc_free_instance(const Class *cls, Object *self) {
+static void pcc_free_instance(const Class *cls, Object *self) {
     printf("ParticleConstraint::free_instance:enter\n");
     free(self);
     printf("ParticleConstraint::free_instance:leave\n");
@@ -276,7 +286,7 @@ void ParticleConstraintCreateClass() {
         pcc_vtable.base = pcg_vtable; // inherit from VTable
 
         // methods
-        pcc_vtable.currentLength = pcc_currentLength,
+        pcc_vtable.currentLength = pcc_currentLength;
 
         // init the particle class
         particleConstraintClass.base = particleContactGeneratorClass; // inherit from Class
@@ -298,8 +308,10 @@ void ParticleConstraintCreateClass() {
 //////////////////////////////////////////////////////////////////
 // ParticleCableConstraint
 //////////////////////////////////////////////////////////////////
-unsigned pccc_addContact(ParticleContactGenerator *self, ParticleContact *contact,
+static unsigned pccc_addContact(ParticleContactGenerator *self, ParticleContact *contact,
                                    unsigned limit) {
+    if (limit == 0) return 0;
+
     // Find the length of the cable
     buReal length = pcc_currentLength((ParticleConstraint *)self);
 
@@ -328,10 +340,10 @@ unsigned pccc_addContact(ParticleContactGenerator *self, ParticleContact *contac
 
 
 ParticleCableConstraintClass particleCableConstraintClass;
-ParticleCableConstraintVTable pccc_vtable;
+static ParticleCableConstraintVTable pccc_vtable;
 
 // free object
-void pccc_free_instance(const Class *cls, Object *self) {
+static void pccc_free_instance(const Class *cls, Object *self) {
     printf("ParticleCableConstraint::free_instance:enter\n");
     free(self);
     printf("ParticleCableConstraint::free_instance:leave\n");
@@ -378,8 +390,10 @@ void ParticleCableConstraintCreateClass() {
 //////////////////////////////////////////////////////////////////
 // ParticleRodConstraint
 //////////////////////////////////////////////////////////////////
-unsigned prc_addContact(ParticleContactGenerator *self, ParticleContact *contact,
+static unsigned prc_addContact(ParticleContactGenerator *self, ParticleContact *contact,
                                  unsigned limit){
+    if (limit == 0) return 0;
+
     // Find the length of the rod
     buReal currentLen = pcc_currentLength((ParticleConstraint *)self);
 
@@ -415,10 +429,10 @@ unsigned prc_addContact(ParticleContactGenerator *self, ParticleContact *contact
 }
 
 ParticleRodConstraintClass particleRodConstraintClass;
-ParticleRodConstraintVTable pcr_vtable;
+static ParticleRodConstraintVTable pcr_vtable;
 
 // free object
-void pcr_free_instance(const Class *cls, Object *self) {
+static void pcr_free_instance(const Class *cls, Object *self) {
     printf("ParticleRodConstraint::free_instance:enter\n");
     free(self);
     printf("ParticleRodConstraint::free_instance:leave\n");
@@ -459,4 +473,276 @@ void ParticleRodConstraintCreateClass() {
         particleRodConstraint_initialized = true;
     }
     printf("ParticleRodConstraintCreateClass:leave\n");
-}
\ No newline at end of file
+}
+
+//////////////////////////////////////////////////////////////////
+// Link stretch kernels
+//////////////////////////////////////////////////////////////////
+void buLinkStretchScalar(buReal *const difference[3], const buReal *restLength, buReal *length, buReal *stretch, size_t begin, size_t end) {
+    for (size_t l = begin; l < end; l++) {
+        buReal dx = difference[0][l], dy = difference[1][l], dz = difference[2][l];
+        length[l] = buSqrt(dx*dx + dy*dy + dz*dz);
+        stretch[l] = length[l] - restLength[l];
+    }
+}
+
+#ifdef BU_SIMD
+void buLinkStretchSIMD(buReal *const difference[3], const buReal *restLength, buReal *length, buReal *stretch, size_t begin, size_t end) {
+    size_t l = begin;
+    for (; l + BU_SIMD_WIDTH <= end; l += BU_SIMD_WIDTH) {
+        buSimd dx = buSimdLoadU(difference[0] + l);
+        buSimd dy = buSimdLoadU(difference[1] + l);
+        buSimd dz = buSimdLoadU(difference[2] + l);
+        buSimd current = buSimdSqrt(buSimdAdd(buSimdAdd(buSimdMul(dx, dx), buSimdMul(dy, dy)), buSimdMul(dz, dz)));
+        buSimdStoreU(length + l, current);
+        buSimdStoreU(stretch + l, buSimdSub(current, buSimdLoadU(restLength + l)));
+    }
+
+    // Remainder that does not fill a register
+    buLinkStretchScalar(difference, restLength, length, stretch, l, end);
+}
+#else
+void buLinkStretchSIMD(buReal *const difference[3], const buReal *restLength, buReal *length, buReal *stretch, size_t begin, size_t end) {
+    buLinkStretchScalar(difference, restLength, length, stretch, begin, end);
+}
+#endif
+
+void buLinkStretch(buReal *const difference[3], const buReal *restLength, buReal *length, buReal *stretch, size_t begin, size_t end) {
+    buLinkStretchSIMD(difference, restLength, length, stretch, begin, end);
+}
+
+
+//////////////////////////////////////////////////////////////////
+// ParticleLinkSet
+//////////////////////////////////////////////////////////////////
+#define PLS_DEFAULT_CAPACITY 64
+
+ParticleLinkSetClass particleLinkSetClass;
+ParticleLinkSetVTable pls_vtable;
+
+static void *pls_grow(void *array, size_t elementSize, size_t count, size_t capacity) {
+    return buAlignedRealloc(array, count * elementSize, capacity * elementSize);
+}
+
+static void pls_reserve(ParticleLinkSet *self, size_t capacity) {
+    if (capacity <= self->_capacity) return;
+    assert(capacity < PLS_ANCHOR);
+
+    size_t count = self->_count;
+    self->_first = pls_grow(self->_first, sizeof(uint32_t), count, capacity);
+    self->_second = pls_grow(self->_second, sizeof(uint32_t), count, capacity);
+    self->_length = pls_grow(self->_length, sizeof(buReal), count, capacity);
+    self->_restitution = pls_grow(self->_restitution, sizeof(buReal), count, capacity);
+    self->_kind = pls_grow(self->_kind, sizeof(uint8_t), count, capacity);
+    self->_anchor = pls_grow(self->_anchor, sizeof(buVector3), count, capacity);
+    // Scratch is rewritten every sweep, so nothing to keep
+    for (int k = 0; k < 3; k++) {
+        buAlignedFree(self->_scratch[k]);
+        self->_scratch[k] = buAlignedAlloc(capacity * sizeof(buReal));
+    }
+    buAlignedFree(self->_currentLength);
+    self->_currentLength = buAlignedAlloc(capacity * sizeof(buReal));
+    buAlignedFree(self->_stretch);
+    self->_stretch = buAlignedAlloc(capacity * sizeof(buReal));
+    self->_capacity = capacity;
+}
+
+static void pls_append(ParticleLinkSet *self, ParticleLinkKind kind, uint32_t first, uint32_t second, buVector3 anchor, buReal length, buReal restitution) {
+    assert(first != second);
+    if (self->_count == self->_capacity) {
+        pls_reserve(self, self->_capacity ? 2 * self->_capacity : PLS_DEFAULT_CAPACITY);
+    }
+
+    size_t l = self->_count++;
+    self->_first[l] = first;
+    self->_second[l] = second;
+    self->_length[l] = length;
+    self->_restitution[l] = restitution;
+    self->_kind[l] = (uint8_t)kind;
+    self->_anchor[l] = anchor;
+}
+
+static void pls_addCable(ParticleLinkSet *self, uint32_t first, uint32_t second, buReal maxLength, buReal restitution) {
+    pls_append(self, PLK_CABLE, first, second, (buVector3){0.0, 0.0, 0.0}, maxLength, restitution);
+}
+
+static void pls_addRod(ParticleLinkSet *self, uint32_t first, uint32_t second, buReal length) {
+    // Always use zero restitution (no bounciness)
+    pls_append(self, PLK_ROD, first, second, (buVector3){0.0, 0.0, 0.0}, length, 0);
+}
+
+static void pls_addCableConstraint(ParticleLinkSet *self, uint32_t particle, buVector3 anchor, buReal maxLength, buReal restitution) {
+    pls_append(self, PLK_CABLE, particle, PLS_ANCHOR, anchor, maxLength, restitution);
+}
+
+static void pls_addRodConstraint(ParticleLinkSet *self, uint32_t particle, buVector3 anchor, buReal length) {
+    pls_append(self, PLK_ROD, particle, PLS_ANCHOR, anchor, length, 0);
+}
+
+static size_t pls_getCount(const ParticleLinkSet *self) {
+    return self->_count;
+}
+
+static void pls_setTolerance(ParticleLinkSet *self, buReal tolerance) {
+    assert(tolerance >= 0);
+    self->_tolerance = tolerance;
+}
+
+// Separation of every link's ends, from the first end to the second,
+// then the length and stretch of every link in one pass
+static void pls_sweep(ParticleLinkSet *self) {
+    const ParticleArrays *arrays = &self->_world->_arrays;
+    const size_t count = self->_count;
+    for (int k = 0; k < 3; k++) {
+        const buReal *position = arrays->position[k];
+        buReal *difference = self->_scratch[k];
+        for (size_t l = 0; l < count; l++) {
+            uint32_t second = self->_second[l];
+            buReal other = second == PLS_ANCHOR ? self->_anchor[l].v[k] : position[second];
+            difference[l] = other - position[self->_first[l]];
+        }
+    }
+    buLinkStretch(self->_scratch, self->_length, self->_currentLength, self->_stretch, 0, count);
+}
+
+// The contact of a link after a sweep, as the link classes make it, if
+// the link is violated
+static inline bool pls_violation(const ParticleLinkSet *self, size_t l, buVector3 *normal, buReal *penetration) {
+    buReal length = self->_currentLength[l];
+    buReal stretch = self->_stretch[l];
+    bool extended;
+    if (self->_kind[l] == PLK_CABLE) {
+        if (stretch < self->_tolerance) return false;
+        extended = true;
+    } else if (stretch > self->_tolerance) {
+        extended = true;
+    } else if (-stretch > self->_tolerance) {
+        extended = false;
+    } else {
+        return false;
+    }
+    if (!(length > 0)) return false;
+
+    buVector3 unit = {self->_scratch[0][l] / length, self->_scratch[1][l] / length, self->_scratch[2][l] / length};
+    // The contact normal depends on whether we're extending or compressing
+    if (extended) {
+        *normal = unit;
+        *penetration = stretch;
+    } else {
+        *normal = buVector3Scalar(unit, -1.0);
+        *penetration = self->_length[l] - length;
+    }
+    return true;
+}
+
+static inline Particle *pls_particle(ParticleLinkSet *self, uint32_t index) {
+    return index == PLS_ANCHOR ? NULL : INSTANCE_METHOD_AS(ParticleWorldVTable, self->_world, getParticle, index);
+}
+
+static unsigned pls_addContact(ParticleContactGenerator *generator, ParticleContact *contact, unsigned limit) {
+    ParticleLinkSet *self = (ParticleLinkSet *)generator;
+    if (limit == 0) return 0;
+    pls_sweep(self);
+
+    unsigned used = 0;
+    buVector3 normal;
+    buReal penetration;
+    for (size_t l = 0; l < self->_count && used < limit; l++) {
+        if (!pls_violation(self, l, &normal, &penetration)) continue;
+        ParticleContact *c = &contact[used++];
+        c->_particle[0] = pls_particle(self, self->_first[l]);
+        c->_particle[1] = pls_particle(self, self->_second[l]);
+        c->_contactNormal = normal;
+        c->_penetration = penetration;
+        c->_restitution = self->_restitution[l];
+        c->_feature = (unsigned)l;
+    }
+    return used;
+}
+
+static unsigned pls_addContactsToBuffer(ParticleContactGenerator *generator, ParticleContactBuffer *buffer, unsigned limit) {
+    ParticleLinkSet *self = (ParticleLinkSet *)generator;
+    if (limit == 0) return 0;
+    pls_sweep(self);
+
+    unsigned used = 0;
+    buVector3 normal;
+    buReal penetration;
+    for (size_t l = 0; l < self->_count && used < limit; l++) {
+        if (!pls_violation(self, l, &normal, &penetration)) continue;
+        ParticleContactRecord *record = INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, append);
+        record->particle[0] = pls_particle(self, self->_first[l]);
+        record->particle[1] = pls_particle(self, self->_second[l]);
+        record->contactNormal = normal;
+        record->penetration = penetration;
+        record->restitution = self->_restitution[l];
+        record->feature = (unsigned)l;
+        used++;
+    }
+    return used;
+}
+
+// new object
+static ParticleLinkSet *pls_new_instance(const ParticleLinkSetClass *cls, ParticleWorld *world) {
+    ParticleLinkSet *set = calloc(1, sizeof(ParticleLinkSet));
+    assert(set);  // Check for allocation failure
+    ((Object *)set)->klass = (Class *)cls;
+    set->_world = world;
+    pls_reserve(set, PLS_DEFAULT_CAPACITY);
+    return set;
+}
+
+// free object
+static void pls_free_instance(const ParticleLinkSetClass *cls, ParticleLinkSet *self) {
+    printf("ParticleLinkSet::free_instance:enter\n");
+    buAlignedFree(self->_first);
+    buAlignedFree(self->_second);
+    buAlignedFree(self->_length);
+    buAlignedFree(self->_restitution);
+    buAlignedFree(self->_kind);
+    buAlignedFree(self->_anchor);
+    for (int k = 0; k < 3; k++) {
+        buAlignedFree(self->_scratch[k]);
+    }
+    buAlignedFree(self->_currentLength);
+    buAlignedFree(self->_stretch);
+    free(self);
+    printf("ParticleLinkSet::free_instance:leave\n");
+}
+
+static const char *pls_get_name(const ParticleLinkSetClass *cls) {
+    return cls->class_name;
+}
+
+static bool particleLinkSet_initialized = false;
+void ParticleLinkSetCreateClass() {
+    printf("ParticleLinkSetCreateClass:enter\n");
+    if (!particleLinkSet_initialized) {
+        printf("ParticleLinkSetCreateClass:initializing\n");
+        ParticleContactGeneratorCreateClass();
+        ParticleWorldCreateClass();
+        pls_vtable.base = pcg_vtable; // inherit from ParticleContactGeneratorVTable
+
+        // methods
+        pls_vtable.base.addContact = pls_addContact;
+        pls_vtable.base.addContactsToBuffer = pls_addContactsToBuffer;
+        pls_vtable.addCable = pls_addCable;
+        pls_vtable.addRod = pls_addRod;
+        pls_vtable.addCableConstraint = pls_addCableConstraint;
+        pls_vtable.addRodConstraint = pls_addRodConstraint;
+        pls_vtable.reserve = pls_reserve;
+        pls_vtable.getCount = pls_getCount;
+        pls_vtable.setTolerance = pls_setTolerance;
+
+        // init the link set class
+        particleLinkSetClass.base = particleContactGeneratorClass; // inherit from ParticleContactGeneratorClass
+        particleLinkSetClass.base.base.vtable = (VTable *)&pls_vtable;
+        particleLinkSetClass.new_instance = pls_new_instance;
+        particleLinkSetClass.free = pls_free_instance;
+        particleLinkSetClass.class_name = strdup("ParticleLinkSet");
+        particleLinkSetClass.get_name = pls_get_name;
+
+        particleLinkSet_initialized = true;
+    }
+    printf("ParticleLinkSetCreateClass:leave\n");
+}
@@ -0,0 +1,179 @@
+#include "budgie/psim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//////////////////////////////////////////////////////////////////
+// ParticleSimulation
+//////////////////////////////////////////////////////////////////
+ParticleSimulationClass particleSimulationClass;
+ParticleSimulationVTable psim_vtable;
+
+static double psim_now(void) {
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static ParticleWorld *psim_getWorld(ParticleSimulation *self) {
+    return self->_world;
+}
+
+static ParticleForceRegistry *psim_getRegistry(ParticleSimulation *self) {
+    return self->_registry;
+}
+
+static ParticleContactResolver *psim_getResolver(ParticleSimulation *self) {
+    return self->_resolver;
+}
+
+static void psim_addContactGenerator(ParticleSimulation *self, ParticleContactGenerator *generator) {
+    if (self->_generatorCount == self->_generatorCapacity) {
+        unsigned capacity = self->_generatorCapacity ? 2 * self->_generatorCapacity : 4;
+        ParticleContactGenerator **generators = realloc(self->_generators, capacity * sizeof(ParticleContactGenerator *));
+        assert(generators);  // Check for allocation failure
+        self->_generators = generators;
+        self->_generatorCapacity = capacity;
+    }
+    self->_generators[self->_generatorCount++] = generator;
+}
+
+static void psim_setThreadCount(ParticleSimulation *self, unsigned threads) {
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, self->_registry, setThreadCount, threads);
+}
+
+static void psim_startFrame(ParticleSimulation *self) {
+    INSTANCE_METHOD_AS(ParticleWorldVTable, self->_world, clearAccumulators);
+}
+
+// acceleration = force * inverseMass for every particle, in one pass
+// over the world arrays
+static void psim_applyForces(ParticleWorld *world) {
+    ParticleArrays *arrays = &world->_arrays;
+    const size_t count = world->_count;
+    for (int k = 0; k < 3; k++) {
+        buReal *acceleration = arrays->acceleration[k];
+        const buReal *force = arrays->forceAccum[k];
+        for (size_t i = 0; i < count; i++) {
+            acceleration[i] = force[i] * arrays->inverseMass[i];
+        }
+    }
+}
+
+static unsigned psim_generateContacts(ParticleSimulation *self) {
+    INSTANCE_METHOD_AS(ParticleContactBufferVTable, self->_contacts, clear);
+    unsigned limit = self->_maxContacts;
+    for (unsigned g = 0; g < self->_generatorCount && limit > 0; g++) {
+        limit -= INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, self->_generators[g], addContactsToBuffer, self->_contacts, limit);
+    }
+    return self->_maxContacts - limit;
+}
+
+static void psim_runPhysics(ParticleSimulation *self, buReal duration) {
+    double start = psim_now();
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, self->_registry, updateForces, duration);
+    psim_applyForces(self->_world);
+    double forced = psim_now();
+
+    INSTANCE_METHOD_AS(ParticleWorldVTable, self->_world, integrateAll, duration);
+    double integrated = psim_now();
+
+    unsigned usedContacts = psim_generateContacts(self);
+    double generated = psim_now();
+
+    if (usedContacts > 0) {
+        if (self->_calculateIterations) {
+            INSTANCE_METHOD_AS(ParticleContactResolverVTable, self->_resolver, setIterations, 2 * usedContacts);
+        }
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, self->_resolver, resolveBuffer, self->_contacts, duration);
+    }
+    double resolved = psim_now();
+
+    self->_timings.forces = forced - start;
+    self->_timings.integration = integrated - forced;
+    self->_timings.contactGeneration = generated - integrated;
+    self->_timings.contactResolution = resolved - generated;
+}
+
+static unsigned psim_getContactCount(ParticleSimulation *self) {
+    return INSTANCE_METHOD_AS(ParticleContactBufferVTable, self->_contacts, getCount);
+}
+
+static ParticleSimulationTimings psim_getTimings(ParticleSimulation *self) {
+    return self->_timings;
+}
+
+// new object
+static ParticleSimulation *psim_new_instance(const ParticleSimulationClass *cls, unsigned maxContacts, unsigned iterations) {
+    assert(maxContacts > 0);
+    ParticleSimulation *simulation = calloc(1, sizeof(ParticleSimulation));
+    assert(simulation);  // Check for allocation failure
+    ((Object *)simulation)->klass = (Class *)cls;
+    simulation->_world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, 0);
+    simulation->_registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    simulation->_contacts = (ParticleContactBuffer *)CLASS_METHOD(&particleContactBufferClass, new_instance);
+    simulation->_resolver = (ParticleContactResolver *)CLASS_METHOD(&particleContactResolverClass, new_instance);
+    INSTANCE_METHOD_AS(ParticleContactBufferVTable, simulation->_contacts, reserve, maxContacts);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, simulation->_resolver, setIterations, iterations);
+    simulation->_maxContacts = maxContacts;
+    simulation->_calculateIterations = iterations == 0;
+    return simulation;
+}
+
+// free object
+static void psim_free_instance(const ParticleSimulationClass *cls, ParticleSimulation *self) {
+    printf("ParticleSimulation::free_instance:enter\n");
+    CLASS_METHOD(&particleContactResolverClass, free, (Object *)self->_resolver);
+    CLASS_METHOD(&particleContactBufferClass, free, (Object *)self->_contacts);
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)self->_registry);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, self->_world);
+    free(self->_generators);
+    free(self);
+    printf("ParticleSimulation::free_instance:leave\n");
+}
+
+static const char *psim_get_name(const ParticleSimulationClass *cls) {
+    return cls->class_name;
+}
+
+static bool psim_initialized = false;
+void ParticleSimulationCreateClass() {
+    printf("ParticleSimulationCreateClass:enter\n");
+    if (!psim_initialized) {
+        printf("ParticleSimulationCreateClass:initializing\n");
+        ParticleWorldCreateClass();
+        ParticleForceRegistryCreateClass();
+        ParticleContactResolverCreateClass();
+        ParticleContactGeneratorCreateClass();
+        psim_vtable.base = vTable; // inherit from VTable
+
+        // methods
+        psim_vtable.getWorld = psim_getWorld;
+        psim_vtable.getRegistry = psim_getRegistry;
+        psim_vtable.getResolver = psim_getResolver;
+        psim_vtable.addContactGenerator = psim_addContactGenerator;
+        psim_vtable.setThreadCount = psim_setThreadCount;
+        psim_vtable.startFrame = psim_startFrame;
+        psim_vtable.runPhysics = psim_runPhysics;
+        psim_vtable.getContactCount = psim_getContactCount;
+        psim_vtable.getTimings = psim_getTimings;
+
+        // init the simulation class
+        particleSimulationClass.base = class; // inherit from Class
+        particleSimulationClass.base.vtable = (VTable *)&psim_vtable;
+        particleSimulationClass.new_instance = psim_new_instance;
+        particleSimulationClass.free = psim_free_instance;
+        particleSimulationClass.class_name = strdup("ParticleSimulation");
+        particleSimulationClass.get_name = psim_get_name;
+
+        psim_initialized = true;
+    }
+    printf("ParticleSimulationCreateClass:leave\n");
+}
@@ -0,0 +1,323 @@
+#include "budgie/pspringnet.h"
+#include "budgie/alloc.h"
+#include "budgie/simd.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define PSN_DEFAULT_CAPACITY 64
+
+//////////////////////////////////////////////////////////////////
+// Spring force kernels
+//////////////////////////////////////////////////////////////////
+void buSpringForcesScalar(buReal *const difference[3], const buReal *restLength, const buReal *springConstant, const buReal *minStretch, buReal *const force[3], size_t begin, size_t end) {
+    for (size_t s = begin; s < end; s++) {
+        buReal dx = difference[0][s], dy = difference[1][s], dz = difference[2][s];
+        buReal length = buSqrt(dx*dx + dy*dy + dz*dz);
+
+        buReal stretch = length - restLength[s];
+        if (!(stretch > minStretch[s])) stretch = minStretch[s];
+        // Written as a subtraction so that zero forces get the same sign
+        // in both kernels
+        buReal magnitude = 0.0f - stretch * springConstant[s];
+
+        // A zero-length spring has no direction to push along
+        if (length > 0.0f) {
+            force[0][s] = (dx / length) * magnitude;
+            force[1][s] = (dy / length) * magnitude;
+            force[2][s] = (dz / length) * magnitude;
+        } else {
+            force[0][s] = force[1][s] = force[2][s] = 0.0f;
+        }
+    }
+}
+
+#ifdef BU_SIMD
+void buSpringForcesSIMD(buReal *const difference[3], const buReal *restLength, const buReal *springConstant, const buReal *minStretch, buReal *const force[3], size_t begin, size_t end) {
+    const buSimd zero = buSimdZero();
+
+    size_t s = begin;
+    for (; s + BU_SIMD_WIDTH <= end; s += BU_SIMD_WIDTH) {
+        buSimd dx = buSimdLoadU(difference[0] + s);
+        buSimd dy = buSimdLoadU(difference[1] + s);
+        buSimd dz = buSimdLoadU(difference[2] + s);
+        buSimd length = buSimdSqrt(buSimdAdd(buSimdAdd(buSimdMul(dx, dx), buSimdMul(dy, dy)), buSimdMul(dz, dz)));
+
+        // max(a, b) returns b unless a > b, as the scalar clamp does
+        buSimd stretch = buSimdMax(buSimdSub(length, buSimdLoadU(restLength + s)), buSimdLoadU(minStretch + s));
+        buSimd magnitude = buSimdSub(zero, buSimdMul(stretch, buSimdLoadU(springConstant + s)));
+
+        buSimd nonZero = buSimdCmpGt(length, zero);
+        buSimdStoreU(force[0] + s, buSimdSelect(nonZero, buSimdMul(buSimdDiv(dx, length), magnitude), zero));
+        buSimdStoreU(force[1] + s, buSimdSelect(nonZero, buSimdMul(buSimdDiv(dy, length), magnitude), zero));
+        buSimdStoreU(force[2] + s, buSimdSelect(nonZero, buSimdMul(buSimdDiv(dz, length), magnitude), zero));
+    }
+
+    // Remainder that does not fill a register
+    buSpringForcesScalar(difference, restLength, springConstant, minStretch, force, s, end);
+}
+#else
+void buSpringForcesSIMD(buReal *const difference[3], const buReal *restLength, const buReal *springConstant, const buReal *minStretch, buReal *const force[3], size_t begin, size_t end) {
+    buSpringForcesScalar(difference, restLength, springConstant, minStretch, force, begin, end);
+}
+#endif
+
+void buSpringForces(buReal *const difference[3], const buReal *restLength, const buReal *springConstant, const buReal *minStretch, buReal *const force[3], size_t begin, size_t end) {
+    buSpringForcesSIMD(difference, restLength, springConstant, minStretch, force, begin, end);
+}
+
+//////////////////////////////////////////////////////////////////
+// ParticleSpringNetwork
+//////////////////////////////////////////////////////////////////
+ParticleSpringNetworkClass particleSpringNetworkClass;
+ParticleSpringNetworkVTable psn_vtable;
+
+static void *psn_grow(void *array, size_t elementSize, size_t count, size_t capacity) {
+    return buAlignedRealloc(array, count * elementSize, capacity * elementSize);
+}
+
+static void psn_reserve(ParticleSpringNetwork *self, size_t capacity) {
+    if (capacity <= self->_capacity) return;
+    assert(capacity <= UINT32_MAX);
+
+    size_t count = self->_count;
+    self->_first = psn_grow(self->_first, sizeof(uint32_t), count, capacity);
+    self->_second = psn_grow(self->_second, sizeof(uint32_t), count, capacity);
+    self->_restLength = psn_grow(self->_restLength, sizeof(buReal), count, capacity);
+    self->_springConstant = psn_grow(self->_springConstant, sizeof(buReal), count, capacity);
+    self->_minStretch = psn_grow(self->_minStretch, sizeof(buReal), count, capacity);
+    for (int k = 0; k < 3; k++) {
+        // Scratch is rewritten every step, so nothing to keep
+        buAlignedFree(self->_scratch[k]);
+        self->_scratch[k] = buAlignedAlloc(capacity * sizeof(buReal));
+    }
+    self->_capacity = capacity;
+}
+
+static void psn_append(ParticleSpringNetwork *self, uint32_t first, uint32_t second, buReal springConstant, buReal restLength, buReal minStretch) {
+    assert(first != second);
+    if (self->_count == self->_capacity) {
+        psn_reserve(self, self->_capacity ? 2 * self->_capacity : PSN_DEFAULT_CAPACITY);
+    }
+
+    size_t s = self->_count++;
+    self->_first[s] = first;
+    self->_second[s] = second;
+    self->_springConstant[s] = springConstant;
+    self->_restLength[s] = restLength;
+    self->_minStretch[s] = minStretch;
+    self->_built = false;
+}
+
+static void psn_addSpring(ParticleSpringNetwork *self, uint32_t first, uint32_t second, buReal springConstant, buReal restLength) {
+    psn_append(self, first, second, springConstant, restLength, -INFINITY);
+}
+
+static void psn_addBungee(ParticleSpringNetwork *self, uint32_t first, uint32_t second, buReal springConstant, buReal restLength) {
+    psn_append(self, first, second, springConstant, restLength, 0.0f);
+}
+
+static size_t psn_getCount(const ParticleSpringNetwork *self) {
+    return self->_count;
+}
+
+// Greedy edge colouring: each spring, in insertion order, takes the
+// lowest colour neither of its particles uses yet. A mesh where every
+// particle has at most n springs needs at most 2n - 1 colours.
+static void psn_build(ParticleSpringNetwork *self) {
+    size_t count = self->_count;
+    size_t particles = 0;
+    for (size_t s = 0; s < count; s++) {
+        if (self->_first[s] >= particles) particles = self->_first[s] + 1;
+        if (self->_second[s] >= particles) particles = self->_second[s] + 1;
+    }
+    assert(particles <= self->_world->_count);
+
+    uint64_t *used = calloc(particles ? particles : 1, sizeof(uint64_t));
+    uint8_t *color = malloc(count ? count : 1);
+    assert(used && color);  // Check for allocation failure
+
+    size_t colorSize[PSN_MAX_COLORS + 1] = {0};
+    for (size_t s = 0; s < count; s++) {
+        uint64_t taken = used[self->_first[s]] | used[self->_second[s]];
+        unsigned c = 0;
+        while (c < PSN_MAX_COLORS && (taken & ((uint64_t)1 << c))) c++;
+        if (c < PSN_MAX_COLORS) {
+            used[self->_first[s]] |= (uint64_t)1 << c;
+            used[self->_second[s]] |= (uint64_t)1 << c;
+        }
+        color[s] = (uint8_t)c; // PSN_MAX_COLORS is the overflow range
+        colorSize[c]++;
+    }
+
+    // Colour ranges, skipping empty ones
+    size_t colors = 0;
+    size_t offset[PSN_MAX_COLORS + 1];
+    self->_colorStart[0] = 0;
+    for (unsigned c = 0; c <= PSN_MAX_COLORS; c++) {
+        offset[c] = self->_colorStart[colors];
+        if (colorSize[c] == 0) continue;
+        self->_colorStart[colors + 1] = self->_colorStart[colors] + colorSize[c];
+        colors++;
+    }
+    self->_colorCount = colors;
+    self->_overflow = colorSize[PSN_MAX_COLORS] > 0;
+
+    // Stable counting sort by colour, using the scratch arrays as staging
+    uint32_t *first = buAlignedAlloc((count ? count : 1) * sizeof(uint32_t));
+    uint32_t *second = buAlignedAlloc((count ? count : 1) * sizeof(uint32_t));
+    buReal *restLength = self->_scratch[0];
+    buReal *springConstant = self->_scratch[1];
+    buReal *minStretch = self->_scratch[2];
+    for (size_t s = 0; s < count; s++) {
+        size_t to = offset[color[s]]++;
+        first[to] = self->_first[s];
+        second[to] = self->_second[s];
+        restLength[to] = self->_restLength[s];
+        springConstant[to] = self->_springConstant[s];
+        minStretch[to] = self->_minStretch[s];
+    }
+    memcpy(self->_first, first, count * sizeof(uint32_t));
+    memcpy(self->_second, second, count * sizeof(uint32_t));
+    memcpy(self->_restLength, restLength, count * sizeof(buReal));
+    memcpy(self->_springConstant, springConstant, count * sizeof(buReal));
+    memcpy(self->_minStretch, minStretch, count * sizeof(buReal));
+
+    buAlignedFree(first);
+    buAlignedFree(second);
+    free(color);
+    free(used);
+    self->_built = true;
+}
+
+static size_t psn_getColorCount(ParticleSpringNetwork *self) {
+    if (!self->_built) psn_build(self);
+    return self->_colorCount;
+}
+
+// Adds the force of springs [begin, end) to both ends
+static inline void psn_scatter(const uint32_t *first, const uint32_t *second, buReal *const force[3], buReal *const forceAccum[3], size_t begin, size_t end) {
+    for (int k = 0; k < 3; k++) {
+        const buReal *f = force[k];
+        buReal *accum = forceAccum[k];
+        for (size_t s = begin; s < end; s++) {
+            accum[first[s]] += f[s];
+            accum[second[s]] -= f[s];
+        }
+    }
+}
+
+static void psn_updateForces(ParticleSpringNetwork *self, buReal duration) {
+    if (!self->_built) psn_build(self);
+
+    buReal *const *position = self->_world->_arrays.position;
+    buReal *const *forceAccum = self->_world->_arrays.forceAccum;
+    buReal *const *scratch = self->_scratch;
+    const uint32_t *first = self->_first;
+    const uint32_t *second = self->_second;
+    const size_t count = self->_count;
+    const int threads = (int)self->_threadCount;
+    const size_t parallelColors = self->_colorCount - (self->_overflow ? 1 : 0);
+
+    #pragma omp parallel num_threads(threads)
+    {
+        // Gather and evaluate in one contiguous chunk per thread
+        #pragma omp for schedule(static)
+        for (int t = 0; t < threads; t++) {
+            size_t begin = count * t / threads;
+            size_t end = count * (t + 1) / threads;
+            for (int k = 0; k < 3; k++) {
+                const buReal *p = position[k];
+                buReal *d = scratch[k];
+                for (size_t s = begin; s < end; s++) {
+                    d[s] = p[first[s]] - p[second[s]];
+                }
+            }
+            buSpringForces(scratch, self->_restLength, self->_springConstant, self->_minStretch, scratch, begin, end);
+        }
+
+        // No two springs of a colour share a particle, so a colour can be
+        // split across threads; colours run one after the other
+        for (size_t c = 0; c < parallelColors; c++) {
+            const size_t colorBegin = self->_colorStart[c];
+            const size_t colorSize = self->_colorStart[c + 1] - colorBegin;
+            #pragma omp for schedule(static)
+            for (int t = 0; t < threads; t++) {
+                psn_scatter(first, second, scratch, forceAccum,
+                    colorBegin + colorSize * t / threads, colorBegin + colorSize * (t + 1) / threads);
+            }
+        }
+
+        #pragma omp single
+        if (self->_overflow) {
+            psn_scatter(first, second, scratch, forceAccum, self->_colorStart[self->_colorCount - 1], count);
+        }
+    }
+}
+
+static void psn_setThreadCount(ParticleSpringNetwork *self, unsigned threads) {
+    assert(threads >= 1);
+    self->_threadCount = threads;
+}
+
+// new object
+static ParticleSpringNetwork *psn_new_instance(const ParticleSpringNetworkClass *cls, ParticleWorld *world) {
+    ParticleSpringNetwork *network = calloc(1, sizeof(ParticleSpringNetwork));
+    assert(network);  // Check for allocation failure
+    ((Object *)network)->klass = (Class *)cls;
+    network->_world = world;
+    network->_threadCount = 1;
+    psn_reserve(network, PSN_DEFAULT_CAPACITY);
+    return network;
+}
+
+// free object
+static void psn_free_instance(const ParticleSpringNetworkClass *cls, ParticleSpringNetwork *self) {
+    printf("ParticleSpringNetwork::free_instance:enter\n");
+    buAlignedFree(self->_first);
+    buAlignedFree(self->_second);
+    buAlignedFree(self->_restLength);
+    buAlignedFree(self->_springConstant);
+    buAlignedFree(self->_minStretch);
+    for (int k = 0; k < 3; k++) {
+        buAlignedFree(self->_scratch[k]);
+    }
+    free(self);
+    printf("ParticleSpringNetwork::free_instance:leave\n");
+}
+
+static const char *psn_get_name(const ParticleSpringNetworkClass *cls) {
+    return cls->class_name;
+}
+
+static bool psn_initialized = false;
+void ParticleSpringNetworkCreateClass() {
+    printf("ParticleSpringNetworkCreateClass:enter\n");
+    if (!psn_initialized) {
+        printf("ParticleSpringNetworkCreateClass:initializing\n");
+        psn_vtable.base = vTable; // inherit from VTable
+
+        // methods
+        psn_vtable.addSpring = psn_addSpring;
+        psn_vtable.addBungee = psn_addBungee;
+        psn_vtable.reserve = psn_reserve;
+        psn_vtable.getCount = psn_getCount;
+        psn_vtable.build = psn_build;
+        psn_vtable.getColorCount = psn_getColorCount;
+        psn_vtable.updateForces = psn_updateForces;
+        psn_vtable.setThreadCount = psn_setThreadCount;
+
+        // init the network class
+        particleSpringNetworkClass.base = class; // inherit from Class
+        particleSpringNetworkClass.base.vtable = (VTable *)&psn_vtable;
+        particleSpringNetworkClass.new_instance = psn_new_instance;
+        particleSpringNetworkClass.free = psn_free_instance;
+        particleSpringNetworkClass.class_name = strdup("ParticleSpringNetwork");
+        particleSpringNetworkClass.get_name = psn_get_name;
+
+        psn_initialized = true;
+    }
+    printf("ParticleSpringNetworkCreateClass:leave\n");
+}
@@ -0,0 +1,457 @@
+#include "budgie/pworld.h"
+#include "budgie/alloc.h"
+#include "budgie/pintegrate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define PW_DEFAULT_CAPACITY 64
+
+static inline buVector3 pw_load(buReal *const a[3], size_t i) {
+    return (buVector3){a[0][i], a[1][i], a[2][i]};
+}
+
+static inline void pw_store(buReal *const a[3], size_t i, buVector3 v) {
+    a[0][i] = v.x;
+    a[1][i] = v.y;
+    a[2][i] = v.z;
+}
+
+//////////////////////////////////////////////////////////////////
+// ParticleWorld
+//////////////////////////////////////////////////////////////////
+ParticleWorldClass particleWorldClass;
+ParticleWorldVTable pw_vtable;
+
+static buReal *pw_grow(buReal *array, size_t count, size_t capacity) {
+    return buAlignedRealloc(array, count * sizeof(buReal), capacity * sizeof(buReal));
+}
+
+static void pw_reserve(ParticleWorld *self, size_t capacity) {
+    if (capacity <= self->_capacity) return;
+
+    ParticleArrays *arrays = &self->_arrays;
+    size_t count = self->_count;
+    for (int k = 0; k < 3; k++) {
+        arrays->position[k] = pw_grow(arrays->position[k], count, capacity);
+        arrays->velocity[k] = pw_grow(arrays->velocity[k], count, capacity);
+        arrays->acceleration[k] = pw_grow(arrays->acceleration[k], count, capacity);
+        arrays->forceAccum[k] = pw_grow(arrays->forceAccum[k], count, capacity);
+    }
+    arrays->damping = pw_grow(arrays->damping, count, capacity);
+    arrays->inverseMass = pw_grow(arrays->inverseMass, count, capacity);
+    self->_dampingFactor = pw_grow(self->_dampingFactor, count, capacity);
+
+    buVector3 *initialPosition = realloc(self->_initialPosition, capacity * sizeof(buVector3));
+    assert(initialPosition);  // Check for allocation failure
+    self->_initialPosition = initialPosition;
+
+    uint8_t *group = realloc(self->_group, capacity * sizeof(uint8_t));
+    assert(group);  // Check for allocation failure
+    self->_group = group;
+
+    WorldParticle **views = realloc(self->_views, capacity * sizeof(WorldParticle *));
+    assert(views);  // Check for allocation failure
+    memset(views + self->_capacity, 0, (capacity - self->_capacity) * sizeof(WorldParticle *));
+    self->_views = views;
+
+    self->_capacity = capacity;
+}
+
+// Keeps the cached damping factor of one particle in step with its damping
+static void pw_updateDampingFactor(ParticleWorld *self, size_t i) {
+    if (self->_dampingFactorDuration > 0.0) {
+        buDampingFactors(self->_arrays.damping, self->_dampingFactor, i, i + 1, self->_dampingFactorDuration);
+    }
+}
+
+static size_t pw_add(ParticleWorld *self, buVector3 position, buVector3 velocity, buVector3 acceleration, buReal damping, buReal inverseMass) {
+    if (self->_count == self->_capacity) {
+        pw_reserve(self, self->_capacity ? 2 * self->_capacity : PW_DEFAULT_CAPACITY);
+    }
+
+    size_t i = self->_count++;
+    ParticleArrays *arrays = &self->_arrays;
+    pw_store(arrays->position, i, position);
+    pw_store(arrays->velocity, i, velocity);
+    pw_store(arrays->acceleration, i, acceleration);
+    pw_store(arrays->forceAccum, i, (buVector3){0.0, 0.0, 0.0});
+    arrays->damping[i] = damping;
+    arrays->inverseMass[i] = inverseMass;
+    self->_initialPosition[i] = position;
+    self->_group[i] = 0;
+    pw_updateDampingFactor(self, i);
+    return i;
+}
+
+static size_t pw_getCount(ParticleWorld *self) {
+    return self->_count;
+}
+
+static Particle *pw_getParticle(ParticleWorld *self, size_t index) {
+    assert(index < self->_count);
+    if (!self->_views[index]) {
+        WorldParticle *view = (WorldParticle *)CLASS_METHOD(&worldParticleClass, new_instance);
+        view->_world = self;
+        view->_index = index;
+        self->_views[index] = view;
+    }
+    return (Particle *)self->_views[index];
+}
+
+static void pw_clearAccumulators(ParticleWorld *self) {
+    for (int k = 0; k < 3; k++) {
+        memset(self->_arrays.forceAccum[k], 0, self->_count * sizeof(buReal));
+    }
+}
+
+// Sums the fields that apply to the particles of one group
+static buFieldTerms pw_fieldTerms(const ParticleWorld *self, uint8_t group) {
+    buFieldTerms terms = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+    for (size_t f = 0; f < self->_fieldCount; f++) {
+        const ParticleField *field = &self->_fields[f];
+        if (field->excludedGroups & (UINT32_C(1) << group)) continue;
+        buVector3 *term = field->kind == PW_FIELD_ACCELERATION ? &terms.acceleration : &terms.force;
+        *term = buVector3Add(*term, field->value);
+    }
+    return terms;
+}
+
+static void pw_integrateAll(ParticleWorld *self, buReal duration) {
+    // Ensure duration is positive and meaningful
+    assert(duration > 0.0);
+
+    // buPow(damping, duration) is the expensive part of the step and only
+    // changes with the duration, which is normally fixed, so cache it
+    if (duration != self->_dampingFactorDuration) {
+        buDampingFactors(self->_arrays.damping, self->_dampingFactor, 0, self->_count, duration);
+        self->_dampingFactorDuration = duration;
+    }
+
+    if (self->_fieldCount == 0) {
+        buIntegrateArrays(&self->_arrays, self->_dampingFactor, 0, self->_count, duration);
+        return;
+    }
+
+    uint32_t excluded = 0;
+    for (size_t f = 0; f < self->_fieldCount; f++) {
+        excluded |= self->_fields[f].excludedGroups;
+    }
+    if (!excluded) {
+        // Every particle feels every field
+        buFieldTerms terms = pw_fieldTerms(self, 0);
+        buIntegrateArraysField(&self->_arrays, self->_dampingFactor, &terms, 0, self->_count, duration);
+        return;
+    }
+
+    // One batch per run of particles in the same group
+    size_t begin = 0;
+    while (begin < self->_count) {
+        uint8_t group = self->_group[begin];
+        size_t end = begin + 1;
+        while (end < self->_count && self->_group[end] == group) end++;
+        buFieldTerms terms = pw_fieldTerms(self, group);
+        buIntegrateArraysField(&self->_arrays, self->_dampingFactor, &terms, begin, end, duration);
+        begin = end;
+    }
+}
+
+static size_t pw_addField(ParticleWorld *self, ParticleFieldKind kind, buVector3 value) {
+    assert(self->_fieldCount < PW_MAX_FIELDS);
+    size_t field = self->_fieldCount++;
+    self->_fields[field] = (ParticleField){kind, value, 0};
+    return field;
+}
+
+static void pw_setField(ParticleWorld *self, size_t field, buVector3 value) {
+    assert(field < self->_fieldCount);
+    self->_fields[field].value = value;
+}
+
+static void pw_setGroupExcluded(ParticleWorld *self, size_t field, uint8_t group, bool excluded) {
+    assert(field < self->_fieldCount);
+    assert(group < PW_MAX_GROUPS);
+    if (excluded) {
+        self->_fields[field].excludedGroups |= UINT32_C(1) << group;
+    } else {
+        self->_fields[field].excludedGroups &= ~(UINT32_C(1) << group);
+    }
+}
+
+static void pw_setGroup(ParticleWorld *self, size_t index, uint8_t group) {
+    assert(index < self->_count);
+    assert(group < PW_MAX_GROUPS);
+    self->_group[index] = group;
+}
+
+static uint8_t pw_getGroup(ParticleWorld *self, size_t index) {
+    assert(index < self->_count);
+    return self->_group[index];
+}
+
+// new object
+static ParticleWorld *pw_new_instance(const ParticleWorldClass *cls, size_t capacity) {
+    ParticleWorld *world = calloc(1, sizeof(ParticleWorld));
+    assert(world);  // Check for allocation failure
+    ((Object *)world)->klass = (Class *)cls;
+    pw_reserve(world, capacity ? capacity : PW_DEFAULT_CAPACITY);
+    return world;
+}
+
+// free object
+static void pw_free_instance(const ParticleWorldClass *cls, ParticleWorld *self) {
+    printf("ParticleWorld::free_instance:enter\n");
+    ParticleArrays *arrays = &self->_arrays;
+    for (int k = 0; k < 3; k++) {
+        buAlignedFree(arrays->position[k]);
+        buAlignedFree(arrays->velocity[k]);
+        buAlignedFree(arrays->acceleration[k]);
+        buAlignedFree(arrays->forceAccum[k]);
+    }
+    buAlignedFree(arrays->damping);
+    buAlignedFree(arrays->inverseMass);
+    buAlignedFree(self->_dampingFactor);
+    for (size_t i = 0; i < self->_count; i++) {
+        free(self->_views[i]);
+    }
+    free(self->_views);
+    free(self->_group);
+    free(self->_initialPosition);
+    free(self);
+    printf("ParticleWorld::free_instance:leave\n");
+}
+
+static const char *pw_get_name(const ParticleWorldClass *cls) {
+    return cls->class_name;
+}
+
+static bool pw_initialized = false;
+void ParticleWorldCreateClass() {
+    printf("ParticleWorldCreateClass:enter\n");
+    if (!pw_initialized) {
+        printf("ParticleWorldCreateClass:initializing\n");
+        WorldParticleCreateClass();
+        pw_vtable.base = vTable; // inherit from VTable
+
+        // methods
+        pw_vtable.add = pw_add;
+        pw_vtable.reserve = pw_reserve;
+        pw_vtable.getCount = pw_getCount;
+        pw_vtable.getParticle = pw_getParticle;
+        pw_vtable.clearAccumulators = pw_clearAccumulators;
+        pw_vtable.integrateAll = pw_integrateAll;
+        pw_vtable.addField = pw_addField;
+        pw_vtable.setField = pw_setField;
+        pw_vtable.setGroupExcluded = pw_setGroupExcluded;
+        pw_vtable.setGroup = pw_setGroup;
+        pw_vtable.getGroup = pw_getGroup;
+
+        // init the world class
+        particleWorldClass.base = class; // inherit from Class
+        particleWorldClass.base.vtable = (VTable *)&pw_vtable;
+        particleWorldClass.new_instance = pw_new_instance;
+        particleWorldClass.free = pw_free_instance;
+        particleWorldClass.class_name = strdup("ParticleWorld");
+        particleWorldClass.get_name = pw_get_name;
+
+        pw_initialized = true;
+    }
+    printf("ParticleWorldCreateClass:leave\n");
+}
+
+//////////////////////////////////////////////////////////////////
+// WorldParticle - a Particle view onto one slot of a ParticleWorld
+//////////////////////////////////////////////////////////////////
+WorldParticleClass worldParticleClass;
+WorldParticleVTable wp_vtable;
+
+#define WP_WORLD(particle) (((WorldParticle *)(particle))->_world)
+#define WP_INDEX(particle) (((WorldParticle *)(particle))->_index)
+#define WP_ARRAYS(particle) (&WP_WORLD(particle)->_arrays)
+
+static void wp_integrate(Particle *particle, buReal duration) {
+    ParticleArrays *arrays = WP_ARRAYS(particle);
+    size_t i = WP_INDEX(particle);
+    if (arrays->inverseMass[i] <= 0.0f) return;
+
+    assert(duration > 0.0);
+
+    ParticleWorld *world = WP_WORLD(particle);
+    buFieldTerms terms = pw_fieldTerms(world, world->_group[i]);
+    buReal drag = buPow(arrays->damping[i], duration);
+    for (int k = 0; k < 3; k++) {
+        buReal acceleration = arrays->acceleration[k][i] + (terms.acceleration.v[k] + arrays->inverseMass[i] * terms.force.v[k]);
+        arrays->position[k][i] += arrays->velocity[k][i] * duration;
+        arrays->velocity[k][i] = (arrays->velocity[k][i] + acceleration * duration) * drag;
+    }
+}
+
+static void wp_set(Particle *particle, buVector3 position, buVector3 velocity, buVector3 acceleration, buReal damping, buReal inverseMass) {
+    ParticleArrays *arrays = WP_ARRAYS(particle);
+    size_t i = WP_INDEX(particle);
+    pw_store(arrays->position, i, position);
+    pw_store(arrays->velocity, i, velocity);
+    pw_store(arrays->acceleration, i, acceleration);
+    arrays->damping[i] = damping;
+    arrays->inverseMass[i] = inverseMass;
+    WP_WORLD(particle)->_initialPosition[i] = position;
+    pw_updateDampingFactor(WP_WORLD(particle), i);
+}
+
+static void wp_setMass(Particle *particle, const buReal mass) {
+    assert(mass != 0);
+    WP_ARRAYS(particle)->inverseMass[WP_INDEX(particle)] = ((buReal)1.0)/mass;
+}
+
+static buReal wp_getMass(Particle *particle) {
+    buReal inverseMass = WP_ARRAYS(particle)->inverseMass[WP_INDEX(particle)];
+    if (inverseMass == 0) {
+        return REAL_MAX;
+    } else {
+        return ((buReal)1.0)/inverseMass;
+    }
+}
+
+static void wp_setInverseMass(Particle *particle, const buReal inverseMass) {
+    WP_ARRAYS(particle)->inverseMass[WP_INDEX(particle)] = inverseMass;
+}
+
+static buReal wp_getInverseMass(Particle *particle) {
+    return WP_ARRAYS(particle)->inverseMass[WP_INDEX(particle)];
+}
+
+static bool wp_hasFiniteMass(Particle *particle) {
+    return WP_ARRAYS(particle)->inverseMass[WP_INDEX(particle)] > 0.0f;
+}
+
+static void wp_setDamping(Particle *particle, const buReal damping) {
+    WP_ARRAYS(particle)->damping[WP_INDEX(particle)] = damping;
+    pw_updateDampingFactor(WP_WORLD(particle), WP_INDEX(particle));
+}
+
+static buReal wp_getDamping(Particle *particle) {
+    return WP_ARRAYS(particle)->damping[WP_INDEX(particle)];
+}
+
+static void wp_setPosition(Particle *particle, const buVector3 position) {
+    pw_store(WP_ARRAYS(particle)->position, WP_INDEX(particle), position);
+}
+
+static buVector3 wp_getPosition(Particle *particle) {
+    return pw_load(WP_ARRAYS(particle)->position, WP_INDEX(particle));
+}
+
+static void wp_setVelocity(Particle *particle, const buVector3 velocity) {
+    pw_store(WP_ARRAYS(particle)->velocity, WP_INDEX(particle), velocity);
+}
+
+static buVector3 wp_getVelocity(Particle *particle) {
+    return pw_load(WP_ARRAYS(particle)->velocity, WP_INDEX(particle));
+}
+
+static void wp_setAcceleration(Particle *particle, const buVector3 acceleration) {
+    pw_store(WP_ARRAYS(particle)->acceleration, WP_INDEX(particle), acceleration);
+}
+
+static buVector3 wp_getAcceleration(Particle *particle) {
+    return pw_load(WP_ARRAYS(particle)->acceleration, WP_INDEX(particle));
+}
+
+static void wp_clearAccumulator(Particle *particle) {
+    pw_store(WP_ARRAYS(particle)->forceAccum, WP_INDEX(particle), (buVector3){0.0, 0.0, 0.0});
+}
+
+static void wp_addForce(Particle *particle, const buVector3 force) {
+    ParticleArrays *arrays = WP_ARRAYS(particle);
+    size_t i = WP_INDEX(particle);
+    arrays->forceAccum[0][i] += force.x;
+    arrays->forceAccum[1][i] += force.y;
+    arrays->forceAccum[2][i] += force.z;
+}
+
+static buVector3 wp_getForceAccum(Particle *particle) {
+    return pw_load(WP_ARRAYS(particle)->forceAccum, WP_INDEX(particle));
+}
+
+static buReal wp_getKE(Particle *particle) {
+    buReal inverseMass = wp_getInverseMass(particle);
+    assert(inverseMass > 0.0f); // Ensure inverse mass is positive
+    buVector3 velocity = wp_getVelocity(particle);
+    return 0.5 * (1.0 / inverseMass) * buVector3Dot(velocity, velocity);
+}
+
+static buReal wp_getPE(Particle *particle, buReal y) {
+    buReal inverseMass = wp_getInverseMass(particle);
+    assert(inverseMass > 0.0); // Ensure inverse mass is positive
+    const buReal g = 9.81;
+    buReal height = wp_getPosition(particle).y - y; // Height relative to y
+    return (1.0 / inverseMass) * g * height;
+}
+
+static buReal wp_getEnergy(Particle *particle) {
+    buReal initialY = WP_WORLD(particle)->_initialPosition[WP_INDEX(particle)].y;
+    return wp_getKE(particle) + wp_getPE(particle, initialY);
+}
+
+// new object
+static Object *wp_new_instance(const Class *cls) {
+    WorldParticle *p = calloc(1, sizeof(WorldParticle));
+    assert(p);  // Check for allocation failure
+    ((Object *)p)->klass = cls;
+    return (Object *)p;
+}
+
+// free object
+static void wp_free_instance(const Class *cls, Object *self) {
+    // Views belong to their world and are released with it
+    assert(false && "WorldParticle views are freed by their ParticleWorld");
+}
+
+static const char *wp_get_name(WorldParticleClass *cls) {
+    return cls->class_name;
+}
+
+static bool wp_initialized = false;
+void WorldParticleCreateClass() {
+    printf("WorldParticleCreateClass:enter\n");
+    if (!wp_initialized) {
+        printf("WorldParticleCreateClass:initializing\n");
+        ParticleCreateClass();
+        wp_vtable.base = particle_vtable; // inherit from ParticleVTable
+
+        // methods
+        wp_vtable.base.integrate = wp_integrate;
+        wp_vtable.base.set = wp_set;
+        wp_vtable.base.setMass = wp_setMass;
+        wp_vtable.base.getMass = wp_getMass;
+        wp_vtable.base.setInverseMass = wp_setInverseMass;
+        wp_vtable.base.getInverseMass = wp_getInverseMass;
+        wp_vtable.base.hasFiniteMass = wp_hasFiniteMass;
+        wp_vtable.base.setDamping = wp_setDamping;
+        wp_vtable.base.getDamping = wp_getDamping;
+        wp_vtable.base.setPosition = wp_setPosition;
+        wp_vtable.base.getPosition = wp_getPosition;
+        wp_vtable.base.setVelocity = wp_setVelocity;
+        wp_vtable.base.getVelocity = wp_getVelocity;
+        wp_vtable.base.setAcceleration = wp_setAcceleration;
+        wp_vtable.base.getAcceleration = wp_getAcceleration;
+        wp_vtable.base.clearAccumulator = wp_clearAccumulator;
+        wp_vtable.base.addForce = wp_addForce;
+        wp_vtable.base.getForceAccum = wp_getForceAccum;
+        wp_vtable.base.getKE = wp_getKE;
+        wp_vtable.base.getPE = wp_getPE;
+        wp_vtable.base.getEnergy = wp_getEnergy;
+
+        // init the view class
+        worldParticleClass.base = particleClass; // inherit from ParticleClass
+        worldParticleClass.base.base.vtable = (VTable *)&wp_vtable;
+        worldParticleClass.base.base.new_instance = wp_new_instance;
+        worldParticleClass.base.base.free = wp_free_instance;
+        worldParticleClass.class_name = strdup("WorldParticle");
+        worldParticleClass.get_name = wp_get_name;
+
+        wp_initialized = true;
+    }
+    printf("WorldParticleCreateClass:leave\n");
+}
@@ -0,0 +1,223 @@
+#include "budgie/vec3array.h"
+#include "budgie/simd.h"
+#include <assert.h>
+
+/////////////////////////////////////////////////////////////
+// Flat kernels over reals, shared by both layouts
+/////////////////////////////////////////////////////////////
+
+// y[i] = y[i] + a * x[i] for n reals
+static void axpyReals(buReal *y, buReal a, const buReal *x, size_t n) {
+    size_t i = 0;
+#ifdef BU_SIMD
+    for (; i < n && !buSimdIsAligned(y + i); i++) {
+        y[i] = y[i] + x[i] * a;
+    }
+    const buSimd va = buSimdSet1(a);
+    for (; i + BU_SIMD_WIDTH <= n; i += BU_SIMD_WIDTH) {
+        buSimdStore(y + i, buSimdAdd(buSimdLoad(y + i), buSimdMul(buSimdLoadU(x + i), va)));
+    }
+#endif
+    for (; i < n; i++) {
+        y[i] = y[i] + x[i] * a;
+    }
+}
+
+// v[i] = v[i] * scalar for n reals
+static void scaleReals(buReal *v, buReal scalar, size_t n) {
+    size_t i = 0;
+#ifdef BU_SIMD
+    for (; i < n && !buSimdIsAligned(v + i); i++) {
+        v[i] = v[i] * scalar;
+    }
+    const buSimd vs = buSimdSet1(scalar);
+    for (; i + BU_SIMD_WIDTH <= n; i += BU_SIMD_WIDTH) {
+        buSimdStore(v + i, buSimdMul(buSimdLoad(v + i), vs));
+    }
+#endif
+    for (; i < n; i++) {
+        v[i] = v[i] * scalar;
+    }
+}
+
+// The packed layout is treated as 3 * count consecutive reals
+static inline buReal *reals(const buVector3 *v) {
+    assert(sizeof(buVector3) == 3 * sizeof(buReal));
+    return (buReal *)v;
+}
+
+/////////////////////////////////////////////////////////////
+// Axpy / Scale
+/////////////////////////////////////////////////////////////
+
+void buVec3ArrayAxpy(buVector3 *y, buReal a, const buVector3 *x, size_t count) {
+    axpyReals(reals(y), a, reals(x), 3 * count);
+}
+
+void buVec3ArrayAxpySoA(buReal *const y[3], buReal a, buReal *const x[3], size_t count) {
+    for (int k = 0; k < 3; k++) {
+        axpyReals(y[k], a, x[k], count);
+    }
+}
+
+void buVec3ArrayScale(buVector3 *v, buReal scalar, size_t count) {
+    scaleReals(reals(v), scalar, 3 * count);
+}
+
+void buVec3ArrayScaleSoA(buReal *const v[3], buReal scalar, size_t count) {
+    for (int k = 0; k < 3; k++) {
+        scaleReals(v[k], scalar, count);
+    }
+}
+
+/////////////////////////////////////////////////////////////
+// Dot / Norm / Normalize, structure-of-arrays
+/////////////////////////////////////////////////////////////
+
+void buVec3ArrayDotSoA(buReal *out, buReal *const a[3], buReal *const b[3], size_t count) {
+    size_t i = 0;
+#ifdef BU_SIMD
+    for (; i < count && !buSimdIsAligned(out + i); i++) {
+        out[i] = a[0][i]*b[0][i] + a[1][i]*b[1][i] + a[2][i]*b[2][i];
+    }
+    for (; i + BU_SIMD_WIDTH <= count; i += BU_SIMD_WIDTH) {
+        buSimd dot = buSimdMul(buSimdLoadU(a[0] + i), buSimdLoadU(b[0] + i));
+        dot = buSimdAdd(dot, buSimdMul(buSimdLoadU(a[1] + i), buSimdLoadU(b[1] + i)));
+        dot = buSimdAdd(dot, buSimdMul(buSimdLoadU(a[2] + i), buSimdLoadU(b[2] + i)));
+        buSimdStore(out + i, dot);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = a[0][i]*b[0][i] + a[1][i]*b[1][i] + a[2][i]*b[2][i];
+    }
+}
+
+void buVec3ArrayNormSoA(buReal *out, buReal *const v[3], size_t count) {
+    size_t i = 0;
+#ifdef BU_SIMD
+    for (; i < count && !buSimdIsAligned(out + i); i++) {
+        out[i] = buSqrt(v[0][i]*v[0][i] + v[1][i]*v[1][i] + v[2][i]*v[2][i]);
+    }
+    for (; i + BU_SIMD_WIDTH <= count; i += BU_SIMD_WIDTH) {
+        buSimd x = buSimdLoadU(v[0] + i), y = buSimdLoadU(v[1] + i), z = buSimdLoadU(v[2] + i);
+        buSimd squareNorm = buSimdAdd(buSimdAdd(buSimdMul(x, x), buSimdMul(y, y)), buSimdMul(z, z));
+        buSimdStore(out + i, buSimdSqrt(squareNorm));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = buSqrt(v[0][i]*v[0][i] + v[1][i]*v[1][i] + v[2][i]*v[2][i]);
+    }
+}
+
+static inline void normalizeOne(buReal *x, buReal *y, buReal *z) {
+    buReal length = buSqrt((*x)*(*x) + (*y)*(*y) + (*z)*(*z));
+    if (length == 0.0) return;
+    *x = *x / length;
+    *y = *y / length;
+    *z = *z / length;
+}
+
+void buVec3ArrayNormalizeSoA(buReal *const v[3], size_t count) {
+    size_t i = 0;
+#ifdef BU_SIMD
+    for (; i < count && !buSimdIsAligned(v[0] + i); i++) {
+        normalizeOne(v[0] + i, v[1] + i, v[2] + i);
+    }
+    const buSimd zero = buSimdZero();
+    const buSimd one = buSimdSet1((buReal)1.0);
+    for (; i + BU_SIMD_WIDTH <= count; i += BU_SIMD_WIDTH) {
+        buSimd x = buSimdLoad(v[0] + i), y = buSimdLoadU(v[1] + i), z = buSimdLoadU(v[2] + i);
+        buSimd length = buSimdSqrt(buSimdAdd(buSimdAdd(buSimdMul(x, x), buSimdMul(y, y)), buSimdMul(z, z)));
+        // Zero-length lanes divide by one, leaving them unchanged
+        buSimd divisor = buSimdSelect(buSimdCmpNeq(length, zero), length, one);
+        buSimdStore(v[0] + i, buSimdDiv(x, divisor));
+        buSimdStoreU(v[1] + i, buSimdDiv(y, divisor));
+        buSimdStoreU(v[2] + i, buSimdDiv(z, divisor));
+    }
+#endif
+    for (; i < count; i++) {
+        normalizeOne(v[0] + i, v[1] + i, v[2] + i);
+    }
+}
+
+/////////////////////////////////////////////////////////////
+// Dot / Norm / Normalize, packed buVector3
+/////////////////////////////////////////////////////////////
+
+#if defined(BU_SIMD) && defined(USE_FLOAT)
+    #define BU_VEC3ARRAY_TRANSPOSE 1
+
+// Four packed vectors are three registers:
+//     r0 = x0 y0 z0 x1, r1 = y1 z1 x2 y2, r2 = z2 x3 y3 z3
+static inline void loadTransposed(const buVector3 *v, __m128 *x, __m128 *y, __m128 *z) {
+    const float *p = (const float *)v;
+    __m128 r0 = _mm_loadu_ps(p), r1 = _mm_loadu_ps(p + 4), r2 = _mm_loadu_ps(p + 8);
+    __m128 t;
+    t = _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(1, 1, 2, 2));               // x2 x2 x3 x3
+    *x = _mm_shuffle_ps(r0, t, _MM_SHUFFLE(2, 0, 3, 0));
+    *y = _mm_shuffle_ps(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(0, 0, 1, 1)),  // y0 y0 y1 y1
+                        _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(2, 2, 3, 3)),  // y2 y2 y3 y3
+                        _MM_SHUFFLE(2, 0, 2, 0));
+    *z = _mm_shuffle_ps(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(1, 1, 2, 2)),  // z0 z0 z1 z1
+                        _mm_shuffle_ps(r2, r2, _MM_SHUFFLE(3, 3, 0, 0)),  // z2 z2 z3 z3
+                        _MM_SHUFFLE(2, 0, 2, 0));
+}
+#endif
+
+void buVec3ArrayDot(buReal *out, const buVector3 *a, const buVector3 *b, size_t count) {
+    size_t i = 0;
+#ifdef BU_VEC3ARRAY_TRANSPOSE
+    for (; i + 4 <= count; i += 4) {
+        __m128 ax, ay, az, bx, by, bz;
+        loadTransposed(a + i, &ax, &ay, &az);
+        loadTransposed(b + i, &bx, &by, &bz);
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+        _mm_storeu_ps(out + i, dot);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = a[i].x*b[i].x + a[i].y*b[i].y + a[i].z*b[i].z;
+    }
+}
+
+void buVec3ArrayNorm(buReal *out, const buVector3 *v, size_t count) {
+    size_t i = 0;
+#ifdef BU_VEC3ARRAY_TRANSPOSE
+    for (; i + 4 <= count; i += 4) {
+        __m128 x, y, z;
+        loadTransposed(v + i, &x, &y, &z);
+        __m128 squareNorm = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        _mm_storeu_ps(out + i, _mm_sqrt_ps(squareNorm));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = buSqrt(v[i].x*v[i].x + v[i].y*v[i].y + v[i].z*v[i].z);
+    }
+}
+
+void buVec3ArrayNormalize(buVector3 *v, size_t count) {
+    size_t i = 0;
+#ifdef BU_VEC3ARRAY_TRANSPOSE
+    // Every fourth vector starts on a 16 byte boundary once one does
+    for (; i < count && ((size_t)(v + i) % 16) != 0; i++) {
+        normalizeOne(&v[i].x, &v[i].y, &v[i].z);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4) {
+        float *p = (float *)(v + i);
+        __m128 x, y, z;
+        loadTransposed(v + i, &x, &y, &z);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+        __m128 nonZero = _mm_cmpneq_ps(length, zero);
+        __m128 d = _mm_or_ps(_mm_and_ps(nonZero, length), _mm_andnot_ps(nonZero, one));
+        // Spread the four divisors back over the packed layout
+        _mm_store_ps(p, _mm_div_ps(_mm_load_ps(p), _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 0, 0))));
+        _mm_store_ps(p + 4, _mm_div_ps(_mm_load_ps(p + 4), _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 2, 1, 1))));
+        _mm_store_ps(p + 8, _mm_div_ps(_mm_load_ps(p + 8), _mm_shuffle_ps(d, d, _MM_SHUFFLE(3, 3, 3, 2))));
+    }
+#endif
+    for (; i < count; i++) {
+        normalizeOne(&v[i].x, &v[i].y, &v[i].z);
+    }
+}
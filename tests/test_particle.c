@@ -65,7 +65,25 @@ void test_integrate_with_damping(void) {
     CLASS_METHOD(&particleClass, free, (Object *)p);
 }
 
+void test_direct_calls_match_dispatch(void) {
+    Particle *p = (Particle *)CLASS_METHOD(&particleClass,new_instance);
+    Particle *q = (Particle *)CLASS_METHOD(&particleClass,new_instance);
+    INSTANCE_METHOD_AS(ParticleVTable, p, set, (buVector3){1.0, 2.0, 3.0}, (buVector3){1.0, 0.0, -1.0}, (buVector3){0.0, -9.81, 0.0}, 0.9, 0.5);
+    Particle_set(q, (buVector3){1.0, 2.0, 3.0}, (buVector3){1.0, 0.0, -1.0}, (buVector3){0.0, -9.81, 0.0}, 0.9, 0.5);
+
+    INSTANCE_METHOD_AS(ParticleVTable, p, integrate, 0.1);
+    Particle_integrate(q, 0.1);
+
+    buVector3 position = INSTANCE_METHOD_AS(ParticleVTable, p, getPosition);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, position.x, Particle_getPosition(q).x);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, position.z, Particle_getPosition(q).z);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, INSTANCE_METHOD_AS(ParticleVTable, p, getVelocity).y, Particle_getVelocity(q).y);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 2.0, Particle_getMass(q));
+    TEST_ASSERT_TRUE(Particle_hasFiniteMass(q));
 
+    CLASS_METHOD(&particleClass, free, (Object *)p);
+    CLASS_METHOD(&particleClass, free, (Object *)q);
+}
 
 int main(void) {
     ParticleCreateClass();
@@ -73,5 +91,6 @@ int main(void) {
     RUN_TEST(test_integrate_basic_motion);
     RUN_TEST(test_integrate_with_acceleration);
     RUN_TEST(test_integrate_with_damping);
+    RUN_TEST(test_direct_calls_match_dispatch);
     return UNITY_END();
 }
@@ -0,0 +1,800 @@
+#include "unity/src/unity.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pcontacts.h"
+#include "../src/budgie/pworld.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define SCENE_PARTICLES 48
+#define SCENE_CONTACTS (SCENE_PARTICLES + 2 * (SCENE_PARTICLES - 8))
+#define DURATION ((buReal)1.0 / 60.0)
+
+void setUp(void) {}
+void tearDown(void) {}
+
+/**
+ * A small particle pile: every particle rests on the ground, and is in
+ * contact with its neighbour and with the particle above it. Many
+ * contacts share particles, and the ground contacts of the first row
+ * have equal separating velocities, so ties are exercised too.
+ */
+typedef struct Scene {
+    Particle *particles[SCENE_PARTICLES];
+    ParticleContact *contacts[SCENE_CONTACTS];
+    unsigned contactCount;
+} Scene;
+
+static buReal random01(void) {
+    return (buReal)rand() / RAND_MAX;
+}
+
+static void buildScene(Scene *scene, unsigned seed) {
+    ParticleCreateClass();
+    ParticleContactResolverCreateClass();
+
+    srand(seed);
+    for (int i = 0; i < SCENE_PARTICLES; i++) {
+        Particle *particle = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        buVector3 position = {(buReal)(i % 8), (buReal)(i / 8) * 0.9f, 0.0};
+        buVector3 velocity = {0.0, -1.0, 0.0};
+        if (i >= 8) velocity = (buVector3){random01() - (buReal)0.5, -random01() * 2, random01() - (buReal)0.5};
+        buReal inverseMass = (i % 11 == 0) ? 0.0f : (buReal)1.0 / (1 + (buReal)(i % 3));
+        INSTANCE_METHOD_AS(ParticleVTable, particle, set, position, velocity, (buVector3){0.0, -9.81, 0.0}, 0.99, inverseMass);
+        scene->particles[i] = particle;
+    }
+
+    unsigned n = 0;
+    for (int i = 0; i < SCENE_PARTICLES; i++) {
+        ParticleContact *contact = (ParticleContact *)CLASS_METHOD(&particleContactClass, new_instance);
+        contact->_particle[0] = scene->particles[i];
+        contact->_particle[1] = NULL;
+        contact->_restitution = 0.3;
+        contact->_contactNormal = (buVector3){0.0, 1.0, 0.0};
+        contact->_penetration = (i < 8) ? 0.02f : 0.0f;
+        scene->contacts[n++] = contact;
+    }
+    for (int i = 8; i < SCENE_PARTICLES; i++) {
+        int others[2] = {i - 8, (i % 8) ? i - 1 : i - 7};
+        for (int o = 0; o < 2; o++) {
+            ParticleContact *contact = (ParticleContact *)CLASS_METHOD(&particleContactClass, new_instance);
+            buVector3 position = INSTANCE_METHOD_AS(ParticleVTable, scene->particles[i], getPosition);
+            buVector3 other = INSTANCE_METHOD_AS(ParticleVTable, scene->particles[others[o]], getPosition);
+            buVector3 normal = buVector3Difference(position, other);
+            buReal distance = buVector3Norm(normal);
+            contact->_particle[0] = scene->particles[i];
+            contact->_particle[1] = scene->particles[others[o]];
+            contact->_restitution = 0.5;
+            contact->_contactNormal = buVector3Scalar(normal, (buReal)1.0 / distance);
+            contact->_penetration = (buReal)1.0 - distance;
+            scene->contacts[n++] = contact;
+        }
+    }
+    scene->contactCount = n;
+    TEST_ASSERT_EQUAL_UINT(SCENE_CONTACTS, n);
+    for (unsigned c = 0; c < n; c++) {
+        scene->contacts[c]->_particleMovement[0] = (buVector3){0.0, 0.0, 0.0};
+        scene->contacts[c]->_particleMovement[1] = (buVector3){0.0, 0.0, 0.0};
+    }
+}
+
+static void freeScene(Scene *scene) {
+    for (int i = 0; i < SCENE_PARTICLES; i++) {
+        CLASS_METHOD(&particleClass, free, (Object *)scene->particles[i]);
+    }
+    for (unsigned c = 0; c < scene->contactCount; c++) {
+        CLASS_METHOD(&particleContactClass, free, (Object *)scene->contacts[c]);
+    }
+}
+
+static void assertSameScene(const Scene *expected, const Scene *actual) {
+    for (int i = 0; i < SCENE_PARTICLES; i++) {
+        buVector3 p0 = INSTANCE_METHOD_AS(ParticleVTable, expected->particles[i], getPosition);
+        buVector3 p1 = INSTANCE_METHOD_AS(ParticleVTable, actual->particles[i], getPosition);
+        buVector3 v0 = INSTANCE_METHOD_AS(ParticleVTable, expected->particles[i], getVelocity);
+        buVector3 v1 = INSTANCE_METHOD_AS(ParticleVTable, actual->particles[i], getVelocity);
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_TRUE(p0.v[k] == p1.v[k]);
+            TEST_ASSERT_TRUE(v0.v[k] == v1.v[k]);
+        }
+    }
+    for (unsigned c = 0; c < expected->contactCount; c++) {
+        TEST_ASSERT_TRUE(expected->contacts[c]->_penetration == actual->contacts[c]->_penetration);
+    }
+}
+
+static ParticleContactResolver *newResolver(ParticleContactResolverMode mode, unsigned iterations) {
+    ParticleContactResolver *resolver = (ParticleContactResolver *)CLASS_METHOD(&particleContactResolverClass, new_instance);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setIterations, iterations);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setMode, mode);
+    return resolver;
+}
+
+void test_heap_mode_matches_scan_exactly(void) {
+    // Both with enough iterations to finish and cut short
+    const unsigned budgets[3] = {SCENE_CONTACTS * 4, 25, 1};
+    for (int b = 0; b < 3; b++) {
+        for (unsigned seed = 1; seed <= 3; seed++) {
+            Scene scan, heap;
+            buildScene(&scan, seed);
+            buildScene(&heap, seed);
+            ParticleContactResolver *scanResolver = newResolver(PCR_MODE_SCAN, budgets[b]);
+            ParticleContactResolver *heapResolver = newResolver(PCR_MODE_HEAP, budgets[b]);
+
+            // Two steps, so the heap's scratch is reused
+            for (int step = 0; step < 2; step++) {
+                INSTANCE_METHOD_AS(ParticleContactResolverVTable, scanResolver, resolveContacts, scan.contacts, scan.contactCount, DURATION);
+                INSTANCE_METHOD_AS(ParticleContactResolverVTable, heapResolver, resolveContacts, heap.contacts, heap.contactCount, DURATION);
+                TEST_ASSERT_EQUAL_UINT(scanResolver->_iterationsUsed, heapResolver->_iterationsUsed);
+                assertSameScene(&scan, &heap);
+            }
+            TEST_ASSERT_TRUE(scanResolver->_iterationsUsed > 0);
+
+            CLASS_METHOD(&particleContactResolverClass, free, (Object *)scanResolver);
+            CLASS_METHOD(&particleContactResolverClass, free, (Object *)heapResolver);
+            freeScene(&scan);
+            freeScene(&heap);
+        }
+    }
+}
+
+// The resolver before it kept any per-particle index: a full scan for
+// the worst contact, then a penetration update of every contact
+static unsigned referenceResolve(ParticleContact **contacts, unsigned count, unsigned iterations) {
+    unsigned used = 0;
+    while (used < iterations) {
+        buReal max = REAL_MAX;
+        unsigned maxIndex = count;
+        for (unsigned i = 0; i < count; i++) {
+            buReal sepVel = ParticleContact_calculateSeparatingVelocity(contacts[i]);
+            if (sepVel < max && (sepVel < 0 || contacts[i]->_penetration > 0)) {
+                max = sepVel;
+                maxIndex = i;
+            }
+        }
+        if (maxIndex == count) break;
+        ParticleContact_resolve(contacts[maxIndex], DURATION);
+        buVector3 *move = contacts[maxIndex]->_particleMovement;
+        for (unsigned i = 0; i < count; i++) {
+            if (contacts[i]->_particle[0] == contacts[maxIndex]->_particle[0]) {
+                contacts[i]->_penetration -= buVector3Dot(move[0], contacts[i]->_contactNormal);
+            } else if (contacts[i]->_particle[0] == contacts[maxIndex]->_particle[1]) {
+                contacts[i]->_penetration -= buVector3Dot(move[1], contacts[i]->_contactNormal);
+            }
+            if (contacts[i]->_particle[1]) {
+                if (contacts[i]->_particle[1] == contacts[maxIndex]->_particle[0]) {
+                    contacts[i]->_penetration += buVector3Dot(move[0], contacts[i]->_contactNormal);
+                } else if (contacts[i]->_particle[1] == contacts[maxIndex]->_particle[1]) {
+                    contacts[i]->_penetration += buVector3Dot(move[1], contacts[i]->_contactNormal);
+                }
+            }
+        }
+        used++;
+    }
+    return used;
+}
+
+void test_adjacency_matches_full_penetration_update(void) {
+    const ParticleContactResolverMode modes[2] = {PCR_MODE_SCAN, PCR_MODE_HEAP};
+    for (int m = 0; m < 2; m++) {
+        Scene reference, scene;
+        buildScene(&reference, 5);
+        buildScene(&scene, 5);
+
+        // Contacts sharing both particles with another: the same pair
+        // reversed, and a duplicate
+        ParticleContact *extra[2][2];
+        Scene *scenes[2] = {&reference, &scene};
+        ParticleContact *contacts[2][SCENE_CONTACTS + 2];
+        for (int s = 0; s < 2; s++) {
+            for (int e = 0; e < 2; e++) {
+                const ParticleContact *original = scenes[s]->contacts[SCENE_PARTICLES + 2 * e];
+                extra[s][e] = (ParticleContact *)CLASS_METHOD(&particleContactClass, new_instance);
+                *extra[s][e] = *original;
+                if (e == 0) {
+                    extra[s][e]->_particle[0] = original->_particle[1];
+                    extra[s][e]->_particle[1] = original->_particle[0];
+                    extra[s][e]->_contactNormal = buVector3Scalar(original->_contactNormal, -1);
+                }
+            }
+            for (unsigned c = 0; c < SCENE_CONTACTS; c++) contacts[s][c] = scenes[s]->contacts[c];
+            contacts[s][SCENE_CONTACTS] = extra[s][0];
+            contacts[s][SCENE_CONTACTS + 1] = extra[s][1];
+        }
+
+        ParticleContactResolver *resolver = newResolver(modes[m], 40);
+        unsigned used = referenceResolve(contacts[0], SCENE_CONTACTS + 2, 40);
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveContacts, contacts[1], SCENE_CONTACTS + 2, DURATION);
+        TEST_ASSERT_EQUAL_UINT(used, resolver->_iterationsUsed);
+        assertSameScene(&reference, &scene);
+        for (int e = 0; e < 2; e++) {
+            TEST_ASSERT_TRUE(extra[0][e]->_penetration == extra[1][e]->_penetration);
+            CLASS_METHOD(&particleContactClass, free, (Object *)extra[0][e]);
+            CLASS_METHOD(&particleContactClass, free, (Object *)extra[1][e]);
+        }
+
+        CLASS_METHOD(&particleContactResolverClass, free, (Object *)resolver);
+        freeScene(&reference);
+        freeScene(&scene);
+    }
+}
+
+static void resolveColored(Scene *scene, ParticleContact **contacts, unsigned count, unsigned threads, ParticleContactResolver **out) {
+    ParticleContactResolver *resolver = newResolver(PCR_MODE_COLORED, 100 * count);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setThreadCount, threads);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setTolerance, 1e-4);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveContacts, contacts, count, DURATION);
+    *out = resolver;
+}
+
+void test_colored_mode_is_independent_of_thread_count_and_converges(void) {
+    Scene scenes[3];
+    ParticleContactResolver *resolvers[3];
+    for (int t = 0; t < 3; t++) {
+        buildScene(&scenes[t], 6);
+        // Every particle movable, so every contact can be resolved
+        for (int i = 0; i < SCENE_PARTICLES; i++) {
+            INSTANCE_METHOD_AS(ParticleVTable, scenes[t].particles[i], setInverseMass, 1.0);
+        }
+        resolveColored(&scenes[t], scenes[t].contacts, scenes[t].contactCount, (unsigned)t + 1, &resolvers[t]);
+    }
+
+    for (int t = 1; t < 3; t++) {
+        assertSameScene(&scenes[0], &scenes[t]);
+        TEST_ASSERT_EQUAL_UINT(resolvers[0]->_iterationsUsed, resolvers[t]->_iterationsUsed);
+        TEST_ASSERT_EQUAL_UINT(resolvers[0]->_sweepsUsed, resolvers[t]->_sweepsUsed);
+    }
+
+    // Stopped because a sweep found nothing left to resolve
+    TEST_ASSERT_TRUE(resolvers[0]->_sweepsUsed > 1);
+    TEST_ASSERT_TRUE(resolvers[0]->_iterationsUsed < 100 * SCENE_CONTACTS);
+    TEST_ASSERT_FALSE(resolvers[0]->_overflow);
+    for (unsigned c = 0; c < scenes[0].contactCount; c++) {
+        ParticleContact *contact = scenes[0].contacts[c];
+        TEST_ASSERT_TRUE(ParticleContact_calculateSeparatingVelocity(contact) >= -1e-4);
+        TEST_ASSERT_TRUE(contact->_penetration <= 1e-4);
+    }
+
+    for (int t = 0; t < 3; t++) {
+        CLASS_METHOD(&particleContactResolverClass, free, (Object *)resolvers[t]);
+        freeScene(&scenes[t]);
+    }
+}
+
+void test_colored_mode_overflow_colour(void) {
+    // One particle in more contacts than there are colours
+    Scene scenes[2];
+    ParticleContactResolver *resolvers[2];
+    ParticleContact *hub[2][SCENE_PARTICLES + PCR_MAX_COLORS];
+    for (int t = 0; t < 2; t++) {
+        buildScene(&scenes[t], 7);
+        unsigned count = 0;
+        for (int i = 0; i < SCENE_PARTICLES + PCR_MAX_COLORS; i++) {
+            ParticleContact *contact = (ParticleContact *)CLASS_METHOD(&particleContactClass, new_instance);
+            contact->_particle[0] = scenes[t].particles[0];
+            contact->_particle[1] = scenes[t].particles[1 + i % (SCENE_PARTICLES - 1)];
+            contact->_restitution = 0.2;
+            contact->_contactNormal = (i % 2) ? (buVector3){1.0, 0.0, 0.0} : (buVector3){0.0, 0.0, 1.0};
+            contact->_penetration = 0.001f * (buReal)(i % 4);
+            hub[t][count++] = contact;
+        }
+        resolveColored(&scenes[t], hub[t], count, (unsigned)t * 2 + 1, &resolvers[t]);
+        TEST_ASSERT_TRUE(resolvers[t]->_overflow);
+        TEST_ASSERT_EQUAL_UINT(PCR_MAX_COLORS + 1, resolvers[t]->_colorCount);
+    }
+    assertSameScene(&scenes[0], &scenes[1]);
+    TEST_ASSERT_EQUAL_UINT(resolvers[0]->_iterationsUsed, resolvers[1]->_iterationsUsed);
+
+    for (int t = 0; t < 2; t++) {
+        for (int i = 0; i < SCENE_PARTICLES + PCR_MAX_COLORS; i++) {
+            CLASS_METHOD(&particleContactClass, free, (Object *)hub[t][i]);
+        }
+        CLASS_METHOD(&particleContactResolverClass, free, (Object *)resolvers[t]);
+        freeScene(&scenes[t]);
+    }
+}
+
+void test_heap_mode_stops_when_nothing_is_resolvable(void) {
+    Scene scene;
+    buildScene(&scene, 4);
+    ParticleContactResolver *resolver = newResolver(PCR_MODE_HEAP, SCENE_CONTACTS);
+
+    // Every particle moving away from the ground, without penetration
+    for (int i = 0; i < SCENE_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleVTable, scene.particles[i], setVelocity, (buVector3){0.0, 1.0, 0.0});
+        scene.contacts[i]->_penetration = 0.0f;
+    }
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveContacts, scene.contacts, SCENE_PARTICLES, DURATION);
+    TEST_ASSERT_EQUAL_UINT(0, resolver->_iterationsUsed);
+
+    // One of them closing
+    INSTANCE_METHOD_AS(ParticleVTable, scene.particles[5], setVelocity, (buVector3){0.0, -1.0, 0.0});
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveContacts, scene.contacts, SCENE_PARTICLES, DURATION);
+    TEST_ASSERT_EQUAL_UINT(1, resolver->_iterationsUsed);
+    TEST_ASSERT_TRUE(ParticleContact_calculateSeparatingVelocity(scene.contacts[5]) >= 0);
+
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveContacts, scene.contacts, 0, DURATION);
+    TEST_ASSERT_EQUAL_UINT(0, resolver->_iterationsUsed);
+
+    CLASS_METHOD(&particleContactResolverClass, free, (Object *)resolver);
+    freeScene(&scene);
+}
+
+// Three separate piles with their contacts interleaved, the last one at rest
+static void buildIslandScenes(Scene scenes[3], ParticleContact **combined, unsigned seed) {
+    for (int s = 0; s < 3; s++) {
+        buildScene(&scenes[s], seed + (unsigned)s);
+    }
+    for (int i = 0; i < SCENE_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleVTable, scenes[2].particles[i], setVelocity, (buVector3){0.0, 0.0, 0.0});
+    }
+    for (unsigned c = 0; c < SCENE_CONTACTS; c++) {
+        scenes[2].contacts[c]->_penetration = -0.01f;
+        for (int s = 0; s < 3; s++) {
+            combined[3 * c + s] = scenes[s].contacts[c];
+        }
+    }
+}
+
+void test_islands_mode_matches_scan_of_each_island(void) {
+    // Each island gets a third of the budget, rounded up, as each pile has a third of the contacts
+    const unsigned budgets[3] = {SCENE_CONTACTS * 4, 25, 1};
+    for (int b = 0; b < 3; b++) {
+        Scene expected[3], actual[3];
+        ParticleContact *combined[3 * SCENE_CONTACTS];
+        buildIslandScenes(expected, combined, 8);
+        buildIslandScenes(actual, combined, 8);
+        const unsigned share = (budgets[b] + 2) / 3;
+        ParticleContactResolver *scanResolver = newResolver(PCR_MODE_SCAN, share);
+        ParticleContactResolver *islandResolver = newResolver(PCR_MODE_ISLANDS, budgets[b]);
+
+        unsigned scanIterations = 0;
+        for (int s = 0; s < 3; s++) {
+            INSTANCE_METHOD_AS(ParticleContactResolverVTable, scanResolver, resolveContacts, expected[s].contacts, expected[s].contactCount, DURATION);
+            scanIterations += scanResolver->_iterationsUsed;
+        }
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, islandResolver, resolveContacts, combined, 3 * SCENE_CONTACTS, DURATION);
+        TEST_ASSERT_EQUAL_UINT(scanIterations, islandResolver->_iterationsUsed);
+        for (int s = 0; s < 3; s++) {
+            assertSameScene(&expected[s], &actual[s]);
+        }
+
+        TEST_ASSERT_EQUAL_UINT(3, INSTANCE_METHOD_AS(ParticleContactResolverVTable, islandResolver, getIslandCount));
+        unsigned begin = 0;
+        for (unsigned k = 0; k < 3; k++) {
+            const ParticleContactIsland *island = INSTANCE_METHOD_AS(ParticleContactResolverVTable, islandResolver, getIsland, k);
+            TEST_ASSERT_EQUAL_UINT(begin, island->begin);
+            TEST_ASSERT_EQUAL_UINT(SCENE_CONTACTS, island->contactCount);
+            TEST_ASSERT_EQUAL_UINT(SCENE_PARTICLES, island->particleCount);
+            TEST_ASSERT_EQUAL(k == 2, island->resting);
+            TEST_ASSERT_TRUE(island->iterationsUsed <= share);
+            begin += island->contactCount;
+        }
+        TEST_ASSERT_TRUE(INSTANCE_METHOD_AS(ParticleContactResolverVTable, islandResolver, getIsland, 0)->iterationsUsed > 0);
+        TEST_ASSERT_EQUAL_UINT(0, INSTANCE_METHOD_AS(ParticleContactResolverVTable, islandResolver, getIsland, 2)->iterationsUsed);
+
+        CLASS_METHOD(&particleContactResolverClass, free, (Object *)scanResolver);
+        CLASS_METHOD(&particleContactResolverClass, free, (Object *)islandResolver);
+        for (int s = 0; s < 3; s++) {
+            freeScene(&expected[s]);
+            freeScene(&actual[s]);
+        }
+    }
+}
+
+void test_islands_mode_is_independent_of_thread_count(void) {
+    Scene scenes[2][3];
+    ParticleContact *combined[2][3 * SCENE_CONTACTS];
+    ParticleContactResolver *resolvers[2];
+    for (int t = 0; t < 2; t++) {
+        buildIslandScenes(scenes[t], combined[t], 9);
+        resolvers[t] = newResolver(PCR_MODE_ISLANDS, SCENE_CONTACTS);
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolvers[t], setThreadCount, (unsigned)t * 2 + 1);
+        // Two steps, so the scratch is reused
+        for (int step = 0; step < 2; step++) {
+            INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolvers[t], resolveContacts, combined[t], 3 * SCENE_CONTACTS, DURATION);
+        }
+    }
+    for (int s = 0; s < 3; s++) {
+        assertSameScene(&scenes[0][s], &scenes[1][s]);
+    }
+    TEST_ASSERT_EQUAL_UINT(resolvers[0]->_iterationsUsed, resolvers[1]->_iterationsUsed);
+
+    for (int t = 0; t < 2; t++) {
+        CLASS_METHOD(&particleContactResolverClass, free, (Object *)resolvers[t]);
+        for (int s = 0; s < 3; s++) {
+            freeScene(&scenes[t][s]);
+        }
+    }
+}
+
+void test_islands_mode_with_root_first_in_several_contacts(void) {
+    // The root particle of the pile is the first end of its ground
+    // contact and of every hub contact after it
+    const unsigned hubContacts = 6;
+    Scene expected, actual;
+    Scene *scenes[2] = {&expected, &actual};
+    ParticleContact *contacts[2][SCENE_CONTACTS + 6];
+    for (int s = 0; s < 2; s++) {
+        buildScene(scenes[s], 10);
+        for (unsigned c = 0; c < SCENE_CONTACTS; c++) contacts[s][c] = scenes[s]->contacts[c];
+        for (unsigned h = 0; h < hubContacts; h++) {
+            ParticleContact *contact = (ParticleContact *)CLASS_METHOD(&particleContactClass, new_instance);
+            contact->_particle[0] = scenes[s]->particles[0];
+            contact->_particle[1] = scenes[s]->particles[1 + 9 * h];
+            contact->_restitution = 0.2;
+            contact->_contactNormal = (buVector3){0.0, 0.0, 1.0};
+            contact->_penetration = 0.01f;
+            contacts[s][SCENE_CONTACTS + h] = contact;
+        }
+    }
+
+    ParticleContactResolver *scanResolver = newResolver(PCR_MODE_SCAN, SCENE_CONTACTS);
+    ParticleContactResolver *islandResolver = newResolver(PCR_MODE_ISLANDS, SCENE_CONTACTS);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, scanResolver, resolveContacts, contacts[0], SCENE_CONTACTS + hubContacts, DURATION);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, islandResolver, resolveContacts, contacts[1], SCENE_CONTACTS + hubContacts, DURATION);
+    TEST_ASSERT_EQUAL_UINT(scanResolver->_iterationsUsed, islandResolver->_iterationsUsed);
+    assertSameScene(&expected, &actual);
+
+    TEST_ASSERT_EQUAL_UINT(1, INSTANCE_METHOD_AS(ParticleContactResolverVTable, islandResolver, getIslandCount));
+    const ParticleContactIsland *island = INSTANCE_METHOD_AS(ParticleContactResolverVTable, islandResolver, getIsland, 0);
+    TEST_ASSERT_EQUAL_UINT(SCENE_CONTACTS + hubContacts, island->contactCount);
+    TEST_ASSERT_EQUAL_UINT(SCENE_PARTICLES, island->particleCount);
+
+    for (int s = 0; s < 2; s++) {
+        for (unsigned h = 0; h < hubContacts; h++) {
+            CLASS_METHOD(&particleContactClass, free, (Object *)contacts[s][SCENE_CONTACTS + h]);
+        }
+        freeScene(scenes[s]);
+    }
+    CLASS_METHOD(&particleContactResolverClass, free, (Object *)scanResolver);
+    CLASS_METHOD(&particleContactResolverClass, free, (Object *)islandResolver);
+}
+
+void test_contact_cache_warm_starts_persistent_contacts(void) {
+    ParticleCreateClass();
+    ParticleContactResolverCreateClass();
+    ParticleContactCacheCreateClass();
+    Particle *particles[2];
+    ParticleContact *contacts[3];
+    for (int i = 0; i < 2; i++) {
+        particles[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], set, (buVector3){0.0, (buReal)i, 0.0}, (buVector3){0.0, -1.0, 0.0}, (buVector3){0.0, 0.0, 0.0}, 1.0, 1.0);
+    }
+    for (int c = 0; c < 3; c++) {
+        contacts[c] = (ParticleContact *)CLASS_METHOD(&particleContactClass, new_instance);
+        TEST_ASSERT_EQUAL_UINT(0, contacts[c]->_feature);
+        contacts[c]->_restitution = 0.0;
+        contacts[c]->_penetration = 0.0;
+        contacts[c]->_contactNormal = (buVector3){0.0, 1.0, 0.0};
+    }
+    // Two ground contacts of particle 0, told apart by feature, and the pair
+    contacts[0]->_particle[0] = particles[0];
+    contacts[0]->_particle[1] = NULL;
+    contacts[1]->_particle[0] = particles[0];
+    contacts[1]->_particle[1] = NULL;
+    contacts[1]->_feature = 1;
+    contacts[2]->_particle[0] = particles[1];
+    contacts[2]->_particle[1] = particles[0];
+
+    ParticleContactCache *cache = (ParticleContactCache *)CLASS_METHOD(&particleContactCacheClass, new_instance);
+    ParticleContactResolver *resolver = newResolver(PCR_MODE_SCAN, 16);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setCache, cache);
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveContacts, contacts, 3, DURATION);
+    TEST_ASSERT_EQUAL_UINT(3, INSTANCE_METHOD_AS(ParticleContactCacheVTable, cache, getCount));
+    TEST_ASSERT_EQUAL_UINT(0, INSTANCE_METHOD_AS(ParticleContactCacheVTable, cache, getHitCount));
+    buReal impulse[3];
+    for (int c = 0; c < 3; c++) {
+        impulse[c] = contacts[c]->_impulse;
+    }
+    TEST_ASSERT_TRUE(impulse[0] + impulse[1] > 0);
+    TEST_ASSERT_TRUE(impulse[2] > 0);
+
+    // Closing again: every contact gets 0.9 of its impulse back first
+    for (int i = 0; i < 2; i++) {
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], setVelocity, (buVector3){0.0, -1.0, 0.0});
+    }
+    INSTANCE_METHOD_AS(ParticleContactCacheVTable, cache, warmStart, contacts, 3);
+    TEST_ASSERT_EQUAL_UINT(3, INSTANCE_METHOD_AS(ParticleContactCacheVTable, cache, getHitCount));
+    for (int c = 0; c < 3; c++) {
+        TEST_ASSERT_TRUE(contacts[c]->_impulse == impulse[c] * (buReal)0.9);
+    }
+    buReal expected = -1 + (impulse[0] + impulse[1] - impulse[2]) * (buReal)0.9;
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, expected, INSTANCE_METHOD_AS(ParticleVTable, particles[0], getVelocity).y);
+
+    // A reversed pair is another contact, and separating contacts are not warm started
+    contacts[2]->_particle[0] = particles[0];
+    contacts[2]->_particle[1] = particles[1];
+    contacts[2]->_contactNormal = (buVector3){0.0, -1.0, 0.0};
+    INSTANCE_METHOD_AS(ParticleVTable, particles[0], setVelocity, (buVector3){0.0, 1.0, 0.0});
+    INSTANCE_METHOD_AS(ParticleVTable, particles[1], setVelocity, (buVector3){0.0, 0.0, 0.0});
+    INSTANCE_METHOD_AS(ParticleContactCacheVTable, cache, warmStart, contacts, 3);
+    TEST_ASSERT_EQUAL_UINT(2, INSTANCE_METHOD_AS(ParticleContactCacheVTable, cache, getHitCount));
+    for (int c = 0; c < 3; c++) {
+        TEST_ASSERT_TRUE(contacts[c]->_impulse == 0);
+    }
+
+    // Contacts not passed again are forgotten
+    INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveContacts, contacts, 1, DURATION);
+    TEST_ASSERT_EQUAL_UINT(1, INSTANCE_METHOD_AS(ParticleContactCacheVTable, cache, getCount));
+    INSTANCE_METHOD_AS(ParticleContactCacheVTable, cache, clear);
+    TEST_ASSERT_EQUAL_UINT(0, INSTANCE_METHOD_AS(ParticleContactCacheVTable, cache, getCount));
+
+    CLASS_METHOD(&particleContactResolverClass, free, (Object *)resolver);
+    CLASS_METHOD(&particleContactCacheClass, free, (Object *)cache);
+    for (int c = 0; c < 3; c++) {
+        CLASS_METHOD(&particleContactClass, free, (Object *)contacts[c]);
+    }
+    for (int i = 0; i < 2; i++) {
+        CLASS_METHOD(&particleClass, free, (Object *)particles[i]);
+    }
+}
+
+#define STACK_HEIGHT 8
+
+// Steps a column of STACK_HEIGHT unit spheres resting on the ground
+// for ten seconds, regenerating the contacts every step, and returns
+// the largest speed of any sphere over the last second
+static double settleStack(unsigned iterations, bool warmStart, buReal *top) {
+    ParticleCreateClass();
+    ParticleContactResolverCreateClass();
+    ParticleContactCacheCreateClass();
+    Particle *particles[STACK_HEIGHT];
+    ParticleContact *contacts[STACK_HEIGHT];
+    for (int i = 0; i < STACK_HEIGHT; i++) {
+        particles[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], set, (buVector3){0.0, (buReal)0.5 + (buReal)i, 0.0}, (buVector3){0.0, 0.0, 0.0}, (buVector3){0.0, -9.81, 0.0}, 0.99, 1.0);
+        contacts[i] = (ParticleContact *)CLASS_METHOD(&particleContactClass, new_instance);
+    }
+    ParticleContactCache *cache = (ParticleContactCache *)CLASS_METHOD(&particleContactCacheClass, new_instance);
+    ParticleContactResolver *resolver = newResolver(PCR_MODE_SCAN, iterations);
+    if (warmStart) INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setCache, cache);
+
+    double speed = 0.0;
+    for (int step = 0; step < 600; step++) {
+        for (int i = 0; i < STACK_HEIGHT; i++) {
+            INSTANCE_METHOD_AS(ParticleVTable, particles[i], integrate, DURATION);
+        }
+        for (int i = 0; i < STACK_HEIGHT; i++) {
+            ParticleContact *contact = contacts[i];
+            buVector3 position = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getPosition);
+            contact->_restitution = 0.2;
+            contact->_particle[0] = particles[i];
+            if (i == 0) {
+                contact->_particle[1] = NULL;
+                contact->_contactNormal = (buVector3){0.0, 1.0, 0.0};
+                contact->_penetration = (buReal)0.5 - position.y;
+            } else {
+                buVector3 below = INSTANCE_METHOD_AS(ParticleVTable, particles[i - 1], getPosition);
+                buVector3 normal = buVector3Difference(position, below);
+                buReal distance = buVector3Norm(normal);
+                contact->_particle[1] = particles[i - 1];
+                contact->_contactNormal = buVector3Scalar(normal, (buReal)1.0 / distance);
+                contact->_penetration = (buReal)1.0 - distance;
+            }
+        }
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveContacts, contacts, STACK_HEIGHT, DURATION);
+        if (warmStart && step > 0) TEST_ASSERT_EQUAL_UINT(STACK_HEIGHT, INSTANCE_METHOD_AS(ParticleContactCacheVTable, cache, getHitCount));
+        for (int i = 0; step >= 540 && i < STACK_HEIGHT; i++) {
+            double v = buVector3Norm(INSTANCE_METHOD_AS(ParticleVTable, particles[i], getVelocity));
+            if (v > speed) speed = v;
+        }
+    }
+    *top = INSTANCE_METHOD_AS(ParticleVTable, particles[STACK_HEIGHT - 1], getPosition).y;
+
+    CLASS_METHOD(&particleContactResolverClass, free, (Object *)resolver);
+    CLASS_METHOD(&particleContactCacheClass, free, (Object *)cache);
+    for (int i = 0; i < STACK_HEIGHT; i++) {
+        CLASS_METHOD(&particleContactClass, free, (Object *)contacts[i]);
+        CLASS_METHOD(&particleClass, free, (Object *)particles[i]);
+    }
+    return speed;
+}
+
+void test_contact_cache_settles_stack_with_fewer_iterations(void) {
+    buReal top;
+    double cold = settleStack(8 * STACK_HEIGHT, false, &top);
+    TEST_ASSERT_FLOAT_WITHIN(0.05, STACK_HEIGHT - 0.5, top);
+    // Warm started with an eighth of the iterations, the stack holds its
+    // height and jitters less
+    double warm = settleStack(STACK_HEIGHT, true, &top);
+    TEST_ASSERT_FLOAT_WITHIN(0.2, STACK_HEIGHT - 0.5, top);
+    TEST_ASSERT_TRUE(warm < cold);
+}
+
+void test_buffer_matches_heap_mode(void) {
+    const unsigned budgets[3] = {SCENE_CONTACTS * 4, 25, 1};
+    for (int b = 0; b < 3; b++) {
+        Scene objects, records;
+        buildScene(&objects, 10);
+        buildScene(&records, 10);
+        ParticleContactResolver *objectResolver = newResolver(PCR_MODE_HEAP, budgets[b]);
+        ParticleContactResolver *bufferResolver = newResolver(PCR_MODE_HEAP, budgets[b]);
+        ParticleContactCache *caches[2];
+        for (int c = 0; c < 2; c++) {
+            caches[c] = (ParticleContactCache *)CLASS_METHOD(&particleContactCacheClass, new_instance);
+        }
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, objectResolver, setCache, caches[0]);
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, bufferResolver, setCache, caches[1]);
+        ParticleContactBuffer *buffer = (ParticleContactBuffer *)CLASS_METHOD(&particleContactBufferClass, new_instance);
+
+        // Three steps through the adapter, the later ones warm started
+        for (int step = 0; step < 3; step++) {
+            INSTANCE_METHOD_AS(ParticleContactResolverVTable, objectResolver, resolveContacts, objects.contacts, objects.contactCount, DURATION);
+            INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, clear);
+            INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, appendContacts, records.contacts, records.contactCount);
+            INSTANCE_METHOD_AS(ParticleContactResolverVTable, bufferResolver, resolveBuffer, buffer, DURATION);
+            INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, storeContacts, 0, records.contacts, records.contactCount);
+
+            TEST_ASSERT_EQUAL_UINT(objectResolver->_iterationsUsed, bufferResolver->_iterationsUsed);
+            assertSameScene(&objects, &records);
+            for (unsigned c = 0; c < objects.contactCount; c++) {
+                TEST_ASSERT_TRUE(objects.contacts[c]->_impulse == records.contacts[c]->_impulse);
+            }
+            TEST_ASSERT_EQUAL_UINT(INSTANCE_METHOD_AS(ParticleContactCacheVTable, caches[0], getHitCount),
+                INSTANCE_METHOD_AS(ParticleContactCacheVTable, caches[1], getHitCount));
+        }
+        TEST_ASSERT_EQUAL_UINT(SCENE_CONTACTS, INSTANCE_METHOD_AS(ParticleContactCacheVTable, caches[1], getHitCount));
+
+        CLASS_METHOD(&particleContactBufferClass, free, (Object *)buffer);
+        for (int c = 0; c < 2; c++) {
+            CLASS_METHOD(&particleContactCacheClass, free, (Object *)caches[c]);
+        }
+        CLASS_METHOD(&particleContactResolverClass, free, (Object *)objectResolver);
+        CLASS_METHOD(&particleContactResolverClass, free, (Object *)bufferResolver);
+        freeScene(&objects);
+        freeScene(&records);
+    }
+}
+
+// Moves the particles of a scene into a world and puts views of them
+// in their place, which the resolvers must go through the methods of
+static ParticleWorld *viewScene(Scene *scene) {
+    ParticleWorldCreateClass();
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, SCENE_PARTICLES);
+    for (int i = 0; i < SCENE_PARTICLES; i++) {
+        Particle *particle = scene->particles[i];
+        buVector3 position = INSTANCE_METHOD_AS(ParticleVTable, particle, getPosition);
+        buVector3 velocity = INSTANCE_METHOD_AS(ParticleVTable, particle, getVelocity);
+        buVector3 acceleration = INSTANCE_METHOD_AS(ParticleVTable, particle, getAcceleration);
+        buReal damping = INSTANCE_METHOD_AS(ParticleVTable, particle, getDamping);
+        buReal inverseMass = INSTANCE_METHOD_AS(ParticleVTable, particle, getInverseMass);
+        size_t index = INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, position, velocity, acceleration, damping, inverseMass);
+        scene->particles[i] = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, index);
+        for (unsigned c = 0; c < scene->contactCount; c++) {
+            for (int e = 0; e < 2; e++) {
+                if (scene->contacts[c]->_particle[e] == particle) scene->contacts[c]->_particle[e] = scene->particles[i];
+            }
+        }
+        CLASS_METHOD(&particleClass, free, (Object *)particle);
+    }
+    return world;
+}
+
+void test_buffer_matches_heap_mode_on_world_views(void) {
+    // Plain particles against the views of a world, and the object
+    // path on views against the buffer path on views
+    Scene plain, objects, records;
+    buildScene(&plain, 12);
+    buildScene(&objects, 12);
+    buildScene(&records, 12);
+    ParticleWorld *worlds[2] = {viewScene(&objects), viewScene(&records)};
+    ParticleContactResolver *plainResolver = newResolver(PCR_MODE_HEAP, SCENE_CONTACTS * 2);
+    ParticleContactResolver *objectResolver = newResolver(PCR_MODE_HEAP, SCENE_CONTACTS * 2);
+    ParticleContactResolver *bufferResolver = newResolver(PCR_MODE_HEAP, SCENE_CONTACTS * 2);
+    ParticleContactBuffer *buffer = (ParticleContactBuffer *)CLASS_METHOD(&particleContactBufferClass, new_instance);
+
+    for (int step = 0; step < 2; step++) {
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, plainResolver, resolveContacts, plain.contacts, plain.contactCount, DURATION);
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, objectResolver, resolveContacts, objects.contacts, objects.contactCount, DURATION);
+        INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, clear);
+        INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, appendContacts, records.contacts, records.contactCount);
+        INSTANCE_METHOD_AS(ParticleContactResolverVTable, bufferResolver, resolveBuffer, buffer, DURATION);
+        INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, storeContacts, 0, records.contacts, records.contactCount);
+
+        TEST_ASSERT_EQUAL_UINT(plainResolver->_iterationsUsed, objectResolver->_iterationsUsed);
+        TEST_ASSERT_EQUAL_UINT(objectResolver->_iterationsUsed, bufferResolver->_iterationsUsed);
+        assertSameScene(&plain, &objects);
+        assertSameScene(&objects, &records);
+    }
+    TEST_ASSERT_TRUE(bufferResolver->_iterationsUsed > 0);
+
+    CLASS_METHOD(&particleContactBufferClass, free, (Object *)buffer);
+    CLASS_METHOD(&particleContactResolverClass, free, (Object *)plainResolver);
+    CLASS_METHOD(&particleContactResolverClass, free, (Object *)objectResolver);
+    CLASS_METHOD(&particleContactResolverClass, free, (Object *)bufferResolver);
+    for (unsigned c = 0; c < SCENE_CONTACTS; c++) {
+        CLASS_METHOD(&particleContactClass, free, (Object *)objects.contacts[c]);
+        CLASS_METHOD(&particleContactClass, free, (Object *)records.contacts[c]);
+    }
+    for (int w = 0; w < 2; w++) {
+        CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, worlds[w]);
+    }
+    freeScene(&plain);
+}
+
+// A generator with a fixed ground contact for each of its particles
+static Particle *groundParticles[3];
+static unsigned groundContacts(ParticleContactGenerator *self, ParticleContact *contact, unsigned limit) {
+    unsigned count = 0;
+    for (; count < 3 && count < limit; count++) {
+        contact[count]._particle[0] = groundParticles[count];
+        contact[count]._particle[1] = NULL;
+        contact[count]._contactNormal = (buVector3){0.0, 1.0, 0.0};
+        contact[count]._penetration = 0.1f * (buReal)(count + 1);
+        contact[count]._restitution = 0.5;
+    }
+    return count;
+}
+
+void test_buffer_reuse_and_generator_adapter(void) {
+    ParticleCreateClass();
+    ParticleContactResolverCreateClass();
+    ParticleContactGeneratorCreateClass();
+    ParticleContactBuffer *buffer = (ParticleContactBuffer *)CLASS_METHOD(&particleContactBufferClass, new_instance);
+
+    ParticleContactRecord *record = INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, append);
+    TEST_ASSERT_NULL(record->particle[0]);
+    TEST_ASSERT_NULL(record->particle[1]);
+    TEST_ASSERT_EQUAL_UINT(0, record->feature);
+    record->feature = 7;
+    TEST_ASSERT_EQUAL_UINT(7, INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, get, 0)->feature);
+    unsigned capacity = buffer->_capacity;
+    ParticleContactRecord *records = buffer->_records;
+    INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, clear);
+    TEST_ASSERT_EQUAL_UINT(0, INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, getCount));
+
+    // Generators without addContactsToBuffer of their own go through addContact
+    ParticleContactGeneratorVTable vtable = pcg_vtable;
+    vtable.addContact = groundContacts;
+    ParticleContactGeneratorClass cls = particleContactGeneratorClass;
+    cls.base.vtable = (VTable *)&vtable;
+    ParticleContactGenerator *generator = (ParticleContactGenerator *)CLASS_METHOD(&cls, new_instance);
+    for (int i = 0; i < 3; i++) {
+        groundParticles[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+    }
+    TEST_ASSERT_EQUAL_UINT(2, INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, generator, addContactsToBuffer, buffer, 2));
+    TEST_ASSERT_EQUAL_UINT(3, INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, generator, addContactsToBuffer, buffer, 8));
+    // The adapter's scratch is kept for later calls within its size
+    ParticleContact *scratch = buffer->_contacts;
+    TEST_ASSERT_EQUAL_UINT(8, buffer->_contactCapacity);
+    TEST_ASSERT_EQUAL_UINT(0, INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, generator, addContactsToBuffer, buffer, 0));
+    TEST_ASSERT_EQUAL_PTR(scratch, buffer->_contacts);
+    TEST_ASSERT_EQUAL_UINT(5, INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, getCount));
+    const unsigned expected[5] = {0, 1, 0, 1, 2};
+    for (unsigned i = 0; i < 5; i++) {
+        record = INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, get, i);
+        TEST_ASSERT_EQUAL_PTR(groundParticles[expected[i]], record->particle[0]);
+        TEST_ASSERT_NULL(record->particle[1]);
+        TEST_ASSERT_EQUAL_FLOAT(0.1f * (buReal)(expected[i] + 1), record->penetration);
+        TEST_ASSERT_EQUAL_UINT(0, record->feature);
+    }
+    // Refilled within its capacity, the buffer did not reallocate
+    TEST_ASSERT_EQUAL_UINT(capacity, buffer->_capacity);
+    TEST_ASSERT_EQUAL_PTR(records, buffer->_records);
+
+    for (int i = 0; i < 3; i++) {
+        CLASS_METHOD(&particleClass, free, (Object *)groundParticles[i]);
+    }
+    CLASS_METHOD(&cls, free, (Object *)generator);
+    CLASS_METHOD(&particleContactBufferClass, free, (Object *)buffer);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_heap_mode_matches_scan_exactly);
+    RUN_TEST(test_adjacency_matches_full_penetration_update);
+    RUN_TEST(test_colored_mode_is_independent_of_thread_count_and_converges);
+    RUN_TEST(test_colored_mode_overflow_colour);
+    RUN_TEST(test_heap_mode_stops_when_nothing_is_resolvable);
+    RUN_TEST(test_islands_mode_matches_scan_of_each_island);
+    RUN_TEST(test_islands_mode_is_independent_of_thread_count);
+    RUN_TEST(test_islands_mode_with_root_first_in_several_contacts);
+    RUN_TEST(test_contact_cache_warm_starts_persistent_contacts);
+    RUN_TEST(test_contact_cache_settles_stack_with_fewer_iterations);
+    RUN_TEST(test_buffer_matches_heap_mode);
+    RUN_TEST(test_buffer_matches_heap_mode_on_world_views);
+    RUN_TEST(test_buffer_reuse_and_generator_adapter);
+    return UNITY_END();
+}
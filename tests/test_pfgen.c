@@ -0,0 +1,767 @@
+#include "unity/src/unity.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pfgen.h"
+#include "../src/budgie/pfbatch.h"
+#include "../src/budgie/pworld.h"
+#include <math.h>
+
+#define EPSILON 1e-5
+#define NUMBER_OF_PARTICLES 8
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// A user-defined generator, which the registry can only reach through the vtable
+static ParticleForceGeneratorVTable push_vtable;
+static ParticleForceGeneratorClass pushClass;
+static ParticleForceGenerator push;
+
+static void push_updateForce(const ParticleForceGenerator *self, Particle *particle, buReal duration) {
+    INSTANCE_METHOD_AS(ParticleVTable, particle, addForce, (buVector3){1.0, 0.0, 0.0});
+}
+
+static Particle *particles[NUMBER_OF_PARTICLES];
+static ParticleForceGenerator *generators[4];
+
+static void createScene(void) {
+    ParticleCreateClass();
+    ParticleGravityCreateClass();
+    ParticleDragCreateClass();
+    ParticleSpringCreateClass();
+    ParticleForceRegistryCreateClass();
+
+    push_vtable = pfg_vtable;
+    push_vtable.updateForce = push_updateForce;
+    pushClass = particleForceGeneratorClass;
+    pushClass.base.vtable = (VTable *)&push_vtable;
+    ((Object *)&push)->klass = (Class *)&pushClass;
+
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        particles[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], set, (buVector3){(buReal)i, (buReal)(i * i) * 0.1f, 0.0}, (buVector3){1.0, (buReal)i, -1.0}, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0 / (1 + i));
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], clearAccumulator);
+    }
+    generators[0] = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleGravityClass, &particleGravityClass, new_instance, GRAVITY);
+    generators[1] = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleDragClass, &particleDragClass, new_instance, 0.1, 0.01);
+    generators[2] = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, new_instance, particles[0], 2.0, 1.0);
+    generators[3] = &push;
+}
+
+static void freeScene(void) {
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        CLASS_METHOD(&particleClass, free, (Object *)particles[i]);
+    }
+    CLASS_METHOD_AS(ParticleGravityClass, &particleGravityClass, free, (ParticleGravity *)generators[0]);
+    CLASS_METHOD_AS(ParticleDragClass, &particleDragClass, free, (ParticleDrag *)generators[1]);
+    CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, free, (ParticleSpring *)generators[2]);
+}
+
+// Force each particle receives when every generator is applied to it once, directly
+static buVector3 expectedForce(int i, int skipGenerator) {
+    Particle *reference = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+    buVector3 position = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getPosition);
+    buVector3 velocity = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getVelocity);
+    buReal inverseMass = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getInverseMass);
+    INSTANCE_METHOD_AS(ParticleVTable, reference, set, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, inverseMass);
+    INSTANCE_METHOD_AS(ParticleVTable, reference, clearAccumulator);
+    for (int g = 0; g < 4; g++) {
+        if (g == skipGenerator) continue;
+        if (g == 2 && i == 0) continue; // no spring from particle 0 to itself
+        INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, generators[g], updateForce, reference, 0.01);
+    }
+    buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, reference, getForceAccum);
+    CLASS_METHOD(&particleClass, free, (Object *)reference);
+    return force;
+}
+
+static void assertForces(int skipGenerator) {
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 expected = expectedForce(i, skipGenerator);
+        buVector3 actual = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getForceAccum);
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_FLOAT_WITHIN(EPSILON, expected.v[k], actual.v[k]);
+        }
+    }
+}
+
+static void registerAll(ParticleForceRegistry *registry) {
+    // Interleave kinds, as a scene would
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        for (int g = 3; g >= 0; g--) {
+            if (g == 2 && i == 0) continue;
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], generators[g]);
+        }
+    }
+}
+
+void test_kinds_are_recognised(void) {
+    createScene();
+    TEST_ASSERT_EQUAL_INT(PFK_GRAVITY, buParticleForceKind(generators[0]));
+    TEST_ASSERT_EQUAL_INT(PFK_DRAG, buParticleForceKind(generators[1]));
+    TEST_ASSERT_EQUAL_INT(PFK_SPRING, buParticleForceKind(generators[2]));
+    TEST_ASSERT_EQUAL_INT(PFK_GENERIC, buParticleForceKind(generators[3]));
+    freeScene();
+}
+
+void test_updateForces_matches_direct_calls(void) {
+    createScene();
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    registerAll(registry);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+    assertForces(-1);
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    freeScene();
+}
+
+void test_remove_and_clear(void) {
+    createScene();
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    registerAll(registry);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, remove, particles[i], generators[1]);
+    }
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+    assertForces(1);
+
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, clear);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], clearAccumulator);
+    }
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.0, INSTANCE_METHOD_AS(ParticleVTable, particles[3], getForceAccum).y);
+
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    freeScene();
+}
+
+void test_addMany_matches_add(void) {
+    createScene();
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, reserve, generators[0], NUMBER_OF_PARTICLES);
+    for (int g = 0; g < 4; g++) {
+        // The spring is anchored on particle 0, so leave that one out
+        size_t first = (g == 2) ? 1 : 0;
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, addMany, particles + first, NUMBER_OF_PARTICLES - first, generators[g]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUMBER_OF_PARTICLES, registry->_registrations[PFK_GRAVITY].count);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+    assertForces(-1);
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    freeScene();
+}
+
+void test_removeByHandle(void) {
+    createScene();
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    ParticleForceHandle drag[NUMBER_OF_PARTICLES];
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        for (int g = 0; g < 4; g++) {
+            if (g == 2 && i == 0) continue;
+            ParticleForceHandle handle = INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[i], generators[g]);
+            if (g == 1) drag[i] = handle;
+        }
+    }
+
+    // Remove out of order, so entries get moved around inside the bucket
+    for (int i = NUMBER_OF_PARTICLES - 1; i >= 0; i -= 2) {
+        TEST_ASSERT_TRUE(INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeByHandle, drag[i]));
+    }
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i += 2) {
+        TEST_ASSERT_TRUE(INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeByHandle, drag[i]));
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, registry->_registrations[PFK_DRAG].count);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+    assertForces(1);
+
+    // Stale handles are ignored, even once their slot has been reused
+    TEST_ASSERT_FALSE(INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeByHandle, drag[0]));
+    ParticleForceHandle reused = INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[0], generators[1]);
+    TEST_ASSERT_FALSE(INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeByHandle, drag[0]));
+    TEST_ASSERT_FALSE(INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeByHandle, (ParticleForceHandle){0, 0}));
+    TEST_ASSERT_EQUAL_UINT32(1, registry->_registrations[PFK_DRAG].count);
+
+    // clear invalidates every handle
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, clear);
+    TEST_ASSERT_FALSE(INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeByHandle, reused));
+
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    freeScene();
+}
+
+void test_removeAllForParticle(void) {
+    createScene();
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    registerAll(registry);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeAllForParticle, particles[3]);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 expected = (i == 3) ? (buVector3){0.0, 0.0, 0.0} : expectedForce(i, -1);
+        buVector3 actual = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getForceAccum);
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_FLOAT_WITHIN(EPSILON, expected.v[k], actual.v[k]);
+        }
+    }
+
+    // The particle can be registered again afterwards
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[3], generators[0]);
+    TEST_ASSERT_EQUAL_UINT32(NUMBER_OF_PARTICLES, registry->_registrations[PFK_GRAVITY].count);
+
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    freeScene();
+}
+
+void test_mass_removal(void) {
+    createScene();
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    enum { COUNT = 4096 };
+    static ParticleForceHandle handles[COUNT];
+    for (int n = 0; n < COUNT; n++) {
+        handles[n] = INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[n % NUMBER_OF_PARTICLES], generators[3]);
+    }
+
+    // Remove all but the last registration of each particle, in a scattered order
+    for (int n = 0; n < COUNT - NUMBER_OF_PARTICLES; n++) {
+        int victim = (n * 1237) % (COUNT - NUMBER_OF_PARTICLES);
+        TEST_ASSERT_TRUE(INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeByHandle, handles[victim]));
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUMBER_OF_PARTICLES, registry->_registrations[PFK_GENERIC].count);
+
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        TEST_ASSERT_FLOAT_WITHIN(EPSILON, 1.0, INSTANCE_METHOD_AS(ParticleVTable, particles[i], getForceAccum).x);
+    }
+
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    freeScene();
+}
+
+void test_particle_ids_are_reused(void) {
+    createScene();
+    ParticlePairSpringCreateClass();
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    registerAll(registry);
+    TEST_ASSERT_EQUAL_UINT32(NUMBER_OF_PARTICLES, registry->_particleCount);
+
+    // Short-lived particles, some tied to a scene particle by a pair spring
+    for (int round = 0; round < 1000; round++) {
+        Particle *temporary[2];
+        ParticleForceHandle handles[2];
+        for (int t = 0; t < 2; t++) {
+            temporary[t] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+            handles[t] = INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, temporary[t], generators[0]);
+        }
+        ParticlePairSpring *pair = CLASS_METHOD_AS(ParticlePairSpringClass, &particlePairSpringClass, new_instance, temporary[1], particles[round % NUMBER_OF_PARTICLES], 2.0, 1.0);
+        ParticleForceHandle pairHandle = INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, temporary[1], (ParticleForceGenerator *)pair);
+        for (int t = 0; t < 2; t++) {
+            TEST_ASSERT_TRUE(INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeByHandle, handles[t]));
+        }
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeAllForParticle, temporary[1]);
+        TEST_ASSERT_FALSE(INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeByHandle, pairHandle));
+        CLASS_METHOD_AS(ParticlePairSpringClass, &particlePairSpringClass, free, pair);
+        for (int t = 0; t < 2; t++) {
+            CLASS_METHOD(&particleClass, free, (Object *)temporary[t]);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(NUMBER_OF_PARTICLES + 2, registry->_particleCount);
+    TEST_ASSERT_EQUAL_UINT32(2, registry->_freeParticleCount);
+
+    // The scene particles kept their ids and their registrations
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        TEST_ASSERT_EQUAL_PTR(particles[i], registry->_particles[i]);
+    }
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+    assertForces(-1);
+
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    freeScene();
+}
+
+void test_threaded_buffers_cover_live_particles(void) {
+    createScene();
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    registerAll(registry);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeAllForParticle, particles[2]);
+    TEST_ASSERT_EQUAL_UINT32(1, registry->_freeParticleCount);
+
+    // The dead id is compacted away before the buffers are sized
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, setThreadCount, 3);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+    TEST_ASSERT_EQUAL_UINT32(NUMBER_OF_PARTICLES - 1, registry->_particleCount);
+    TEST_ASSERT_EQUAL_UINT32(0, registry->_freeParticleCount);
+    TEST_ASSERT_EQUAL_UINT(3 * (NUMBER_OF_PARTICLES - 1), registry->_threadForcesCapacity);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 expected = (i == 2) ? (buVector3){0.0, 0.0, 0.0} : expectedForce(i, -1);
+        buVector3 actual = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getForceAccum);
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_FLOAT_WITHIN(EPSILON, expected.v[k], actual.v[k]);
+        }
+    }
+
+    // Registrations found by particle still reach the renumbered ids
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, remove, particles[i], generators[1]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, registry->_registrations[PFK_DRAG].count);
+
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    freeScene();
+}
+
+void test_threaded_updateForces(void) {
+    createScene();
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    registerAll(registry);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeAllForParticle, particles[5]);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[5], generators[0]);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[5], generators[1]);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[5], generators[2]);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particles[5], generators[3]);
+
+    // More threads than some buckets have registrations, and a count
+    // that does not divide the total
+    for (unsigned threads = 1; threads <= 5; threads++) {
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, setThreadCount, threads);
+        TEST_ASSERT_EQUAL_UINT(threads, INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, getThreadCount));
+
+        buVector3 first[NUMBER_OF_PARTICLES];
+        for (int run = 0; run < 2; run++) {
+            for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+                INSTANCE_METHOD_AS(ParticleVTable, particles[i], clearAccumulator);
+            }
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+            assertForces(-1);
+
+            // Deterministic: the same thread count gives the same bits
+            for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+                buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getForceAccum);
+                if (run == 0) {
+                    first[i] = force;
+                } else {
+                    for (int k = 0; k < 3; k++) {
+                        TEST_ASSERT_TRUE(first[i].v[k] == force.v[k]);
+                    }
+                }
+            }
+        }
+    }
+
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    freeScene();
+}
+
+void test_pair_spring_matches_two_springs(void) {
+    createScene();
+    ParticlePairSpringCreateClass();
+    ParticlePairBungeeCreateClass();
+
+    // A chain linked once with pair springs, and once with a
+    // ParticleSpring on each end of every link
+    ParticleForceRegistry *pairs = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    ParticleForceRegistry *singles = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    ParticlePairSpring *pairSprings[NUMBER_OF_PARTICLES - 1];
+    ParticleSpring *singleSprings[2 * (NUMBER_OF_PARTICLES - 1)];
+    for (int i = 0; i + 1 < NUMBER_OF_PARTICLES; i++) {
+        Particle *a = particles[i];
+        Particle *b = particles[i + 1];
+        pairSprings[i] = CLASS_METHOD_AS(ParticlePairSpringClass, &particlePairSpringClass, new_instance, a, b, 2.0, 1.0);
+        TEST_ASSERT_EQUAL_INT(PFK_PAIR_SPRING, buParticleForceKind((ParticleForceGenerator *)pairSprings[i]));
+        // Either end can be the one registered
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, pairs, add, (i % 2) ? b : a, (ParticleForceGenerator *)pairSprings[i]);
+
+        singleSprings[2 * i] = CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, new_instance, b, 2.0, 1.0);
+        singleSprings[2 * i + 1] = CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, new_instance, a, 2.0, 1.0);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, singles, add, a, (ParticleForceGenerator *)singleSprings[2 * i]);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, singles, add, b, (ParticleForceGenerator *)singleSprings[2 * i + 1]);
+    }
+
+    buVector3 expected[NUMBER_OF_PARTICLES];
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, singles, updateForces, 0.01);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        expected[i] = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getForceAccum);
+        INSTANCE_METHOD_AS(ParticleVTable, particles[i], clearAccumulator);
+    }
+
+    for (unsigned threads = 1; threads <= 3; threads++) {
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, pairs, setThreadCount, threads);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, pairs, updateForces, 0.01);
+        for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+            buVector3 actual = INSTANCE_METHOD_AS(ParticleVTable, particles[i], getForceAccum);
+            for (int k = 0; k < 3; k++) {
+                TEST_ASSERT_FLOAT_WITHIN(EPSILON, expected[i].v[k], actual.v[k]);
+            }
+            INSTANCE_METHOD_AS(ParticleVTable, particles[i], clearAccumulator);
+        }
+    }
+
+    // A bungee only pulls once stretched past its rest length
+    buReal distance = buVector3Norm(buVector3Difference(
+        INSTANCE_METHOD_AS(ParticleVTable, particles[1], getPosition),
+        INSTANCE_METHOD_AS(ParticleVTable, particles[2], getPosition)));
+    ParticlePairBungee *slack = CLASS_METHOD_AS(ParticlePairBungeeClass, &particlePairBungeeClass, new_instance, particles[1], particles[2], 2.0, distance * 2);
+    ParticlePairBungee *taut = CLASS_METHOD_AS(ParticlePairBungeeClass, &particlePairBungeeClass, new_instance, particles[1], particles[2], 2.0, distance / 2);
+    INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, (ParticleForceGenerator *)slack, updateForce, particles[1], 0.01);
+    buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, particles[1], getForceAccum);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.0, buVector3Norm(force));
+    INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, (ParticleForceGenerator *)taut, updateForce, particles[2], 0.01);
+    buVector3 toOther = buVector3Difference(
+        INSTANCE_METHOD_AS(ParticleVTable, particles[2], getPosition),
+        INSTANCE_METHOD_AS(ParticleVTable, particles[1], getPosition));
+    force = INSTANCE_METHOD_AS(ParticleVTable, particles[1], getForceAccum);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 2.0 * distance / 2, buVector3Norm(force));
+    TEST_ASSERT_TRUE(buVector3Dot(force, toOther) > 0.0);
+    buVector3 reaction = INSTANCE_METHOD_AS(ParticleVTable, particles[2], getForceAccum);
+    for (int k = 0; k < 3; k++) {
+        TEST_ASSERT_FLOAT_WITHIN(EPSILON, -force.v[k], reaction.v[k]);
+    }
+
+    CLASS_METHOD_AS(ParticlePairBungeeClass, &particlePairBungeeClass, free, slack);
+    CLASS_METHOD_AS(ParticlePairBungeeClass, &particlePairBungeeClass, free, taut);
+    for (int i = 0; i + 1 < NUMBER_OF_PARTICLES; i++) {
+        CLASS_METHOD_AS(ParticlePairSpringClass, &particlePairSpringClass, free, pairSprings[i]);
+        CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, free, singleSprings[2 * i]);
+        CLASS_METHOD_AS(ParticleSpringClass, &particleSpringClass, free, singleSprings[2 * i + 1]);
+    }
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)pairs);
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)singles);
+    freeScene();
+}
+
+#define BATCH_PARTICLES 70 // more than one PFG_BATCH_SIZE block, and not a multiple of the SIMD width
+
+// Heights from well below to well above the water and the bungee's
+// rest length, so every branch of every generator is taken
+static void batchState(int i, buVector3 *position, buVector3 *velocity) {
+    *position = (buVector3){(buReal)(i % 5) * 0.3f, (buReal)-2.0 + (buReal)i * 0.08f, (buReal)(i % 3) * 0.5f};
+    *velocity = (buVector3){(buReal)(i % 4) - 1.5f, (buReal)(i % 7) * 0.25f, (buReal)1.0 - (buReal)(i % 2)};
+}
+
+static ParticleForceGenerator *createBatchGenerators(ParticleForceGenerator *out[3]) {
+    ParticleDragCreateClass();
+    ParticleBuoyancyCreateClass();
+    ParticleAnchoredBungeeCreateClass();
+    out[0] = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleDragClass, &particleDragClass, new_instance, 0.1, 0.01);
+    out[1] = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleBuoyancyClass, &particleBuoyancyClass, new_instance, 0.5, 0.002, 0.0, 1000.0);
+    out[2] = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleAnchoredBungeeClass, &particleAnchoredBungeeClass, new_instance, (buVector3){0.0, 0.5, 0.0}, 3.0, 1.5);
+    return out[0];
+}
+
+static void freeBatchGenerators(ParticleForceGenerator *generators[3]) {
+    CLASS_METHOD_AS(ParticleDragClass, &particleDragClass, free, (ParticleDrag *)generators[0]);
+    CLASS_METHOD_AS(ParticleBuoyancyClass, &particleBuoyancyClass, free, (ParticleBuoyancy *)generators[1]);
+    CLASS_METHOD_AS(ParticleAnchoredBungeeClass, &particleAnchoredBungeeClass, free, (ParticleAnchoredBungee *)generators[2]);
+}
+
+static void assertSameForce(buVector3 expected, buVector3 actual) {
+    for (int k = 0; k < 3; k++) {
+        TEST_ASSERT_FLOAT_WITHIN(EPSILON * (1 + fabs(expected.v[k])), expected.v[k], actual.v[k]);
+    }
+}
+
+void test_updateForceBatch_matches_updateForce(void) {
+    ParticleForceGenerator *batchGenerators[3];
+    createBatchGenerators(batchGenerators);
+    Particle *batch[BATCH_PARTICLES];
+    Particle *single[BATCH_PARTICLES];
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        buVector3 position, velocity;
+        batchState(i, &position, &velocity);
+        batch[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        single[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, batch[i], set, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+        INSTANCE_METHOD_AS(ParticleVTable, single[i], set, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+    }
+
+    for (int g = 0; g < 3; g++) {
+        for (int i = 0; i < BATCH_PARTICLES; i++) {
+            INSTANCE_METHOD_AS(ParticleVTable, batch[i], clearAccumulator);
+            INSTANCE_METHOD_AS(ParticleVTable, single[i], clearAccumulator);
+            INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, batchGenerators[g], updateForce, single[i], 0.01);
+        }
+        INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, batchGenerators[g], updateForceBatch, batch, BATCH_PARTICLES, 0.01);
+        for (int i = 0; i < BATCH_PARTICLES; i++) {
+            assertSameForce(INSTANCE_METHOD_AS(ParticleVTable, single[i], getForceAccum), INSTANCE_METHOD_AS(ParticleVTable, batch[i], getForceAccum));
+        }
+    }
+
+    // The registry batches consecutive registrations of one generator
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleVTable, batch[i], clearAccumulator);
+        INSTANCE_METHOD_AS(ParticleVTable, single[i], clearAccumulator);
+        for (int g = 0; g < 3; g++) {
+            INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, batch[i], batchGenerators[g]);
+            INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, batchGenerators[g], updateForce, single[i], 0.01);
+        }
+    }
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        assertSameForce(INSTANCE_METHOD_AS(ParticleVTable, single[i], getForceAccum), INSTANCE_METHOD_AS(ParticleVTable, batch[i], getForceAccum));
+        CLASS_METHOD(&particleClass, free, (Object *)batch[i]);
+        CLASS_METHOD(&particleClass, free, (Object *)single[i]);
+    }
+
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    freeBatchGenerators(batchGenerators);
+}
+
+void test_updateWorldForces_matches_updateForce(void) {
+    ParticleForceGenerator *batchGenerators[3];
+    createBatchGenerators(batchGenerators);
+    ParticleWorldCreateClass();
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, BATCH_PARTICLES);
+    ParticleWorld *reference = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, BATCH_PARTICLES);
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        buVector3 position, velocity;
+        batchState(i, &position, &velocity);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, reference, add, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+    }
+
+    // Only part of the world, at an unaligned start
+    const size_t begin = 3, end = BATCH_PARTICLES - 2;
+    for (int g = 0; g < 3; g++) {
+        INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, batchGenerators[g], updateWorldForces, world, begin, end, 0.01);
+        for (size_t i = begin; i < end; i++) {
+            Particle *view = INSTANCE_METHOD_AS(ParticleWorldVTable, reference, getParticle, i);
+            INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, batchGenerators[g], updateForce, view, 0.01);
+        }
+    }
+
+    for (size_t i = 0; i < BATCH_PARTICLES; i++) {
+        Particle *expected = INSTANCE_METHOD_AS(ParticleWorldVTable, reference, getParticle, i);
+        Particle *actual = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i);
+        assertSameForce(INSTANCE_METHOD_AS(ParticleVTable, expected, getForceAccum), INSTANCE_METHOD_AS(ParticleVTable, actual, getForceAccum));
+    }
+
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, reference);
+    freeBatchGenerators(batchGenerators);
+}
+
+void test_group_registrations(void) {
+    ParticleForceGenerator *batchGenerators[3];
+    createBatchGenerators(batchGenerators);
+    ParticleWorldCreateClass();
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+
+    // A list group, with a third of its members removed again
+    Particle *grouped[BATCH_PARTICLES];
+    Particle *single[BATCH_PARTICLES];
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        buVector3 position, velocity;
+        batchState(i, &position, &velocity);
+        grouped[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        single[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, grouped[i], set, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+        INSTANCE_METHOD_AS(ParticleVTable, single[i], set, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+        INSTANCE_METHOD_AS(ParticleVTable, grouped[i], clearAccumulator);
+        INSTANCE_METHOD_AS(ParticleVTable, single[i], clearAccumulator);
+    }
+    uint32_t list = INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, addGroup, grouped, BATCH_PARTICLES);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, addToGroup, list, grouped[5]);
+    size_t members = BATCH_PARTICLES;
+    for (int i = 0; i < BATCH_PARTICLES; i += 3) {
+        TEST_ASSERT_TRUE(INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeFromGroup, list, grouped[i]));
+        members--;
+    }
+    TEST_ASSERT_FALSE(INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeFromGroup, list, grouped[0]));
+    TEST_ASSERT_EQUAL_UINT(members, INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, getGroupSize, list));
+
+    // A range group over part of a world
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, BATCH_PARTICLES);
+    ParticleWorld *reference = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, BATCH_PARTICLES);
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        buVector3 position, velocity;
+        batchState(i, &position, &velocity);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, reference, add, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+    }
+    uint32_t range = INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, addRangeGroup, world, 0, BATCH_PARTICLES);
+    const size_t begin = 3, end = BATCH_PARTICLES - 2;
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, setGroupRange, range, begin, end);
+    TEST_ASSERT_EQUAL_UINT(end - begin, INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, getGroupSize, range));
+
+    for (int g = 0; g < 3; g++) {
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, addGroupForce, list, batchGenerators[g]);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, addGroupForce, range, batchGenerators[g]);
+        for (int i = 0; i < BATCH_PARTICLES; i++) {
+            if (i % 3 == 0) continue;
+            INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, batchGenerators[g], updateForce, single[i], 0.01);
+        }
+        for (size_t i = begin; i < end; i++) {
+            Particle *view = INSTANCE_METHOD_AS(ParticleWorldVTable, reference, getParticle, i);
+            INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, batchGenerators[g], updateForce, view, 0.01);
+        }
+    }
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        assertSameForce(INSTANCE_METHOD_AS(ParticleVTable, single[i], getForceAccum), INSTANCE_METHOD_AS(ParticleVTable, grouped[i], getForceAccum));
+        Particle *expected = INSTANCE_METHOD_AS(ParticleWorldVTable, reference, getParticle, i);
+        Particle *actual = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i);
+        assertSameForce(INSTANCE_METHOD_AS(ParticleVTable, expected, getForceAccum), INSTANCE_METHOD_AS(ParticleVTable, actual, getForceAccum));
+    }
+
+    // Without the list group and the range group's drag, only buoyancy
+    // and the bungee reach the world
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeGroup, list);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeGroupForce, range, batchGenerators[0]);
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, clearAccumulators);
+    INSTANCE_METHOD_AS(ParticleWorldVTable, reference, clearAccumulators);
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        INSTANCE_METHOD_AS(ParticleVTable, grouped[i], clearAccumulator);
+    }
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+    for (size_t i = 0; i < BATCH_PARTICLES; i++) {
+        Particle *expected = INSTANCE_METHOD_AS(ParticleWorldVTable, reference, getParticle, i);
+        Particle *actual = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i);
+        for (int g = 1; g < 3 && i >= begin && i < end; g++) {
+            INSTANCE_METHOD_AS(ParticleForceGeneratorVTable, batchGenerators[g], updateForce, expected, 0.01);
+        }
+        assertSameForce(INSTANCE_METHOD_AS(ParticleVTable, expected, getForceAccum), INSTANCE_METHOD_AS(ParticleVTable, actual, getForceAccum));
+        buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, grouped[i], getForceAccum);
+        TEST_ASSERT_TRUE(force.x == 0.0f && force.y == 0.0f && force.z == 0.0f);
+    }
+
+    // A removed group's id is handed out again
+    TEST_ASSERT_EQUAL_UINT32(list, INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, addGroup, NULL, 0));
+
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        CLASS_METHOD(&particleClass, free, (Object *)grouped[i]);
+        CLASS_METHOD(&particleClass, free, (Object *)single[i]);
+    }
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, reference);
+    freeBatchGenerators(batchGenerators);
+}
+
+void test_simd_batch_kernels_match_scalar_kernels_exactly(void) {
+    buReal state[3][BATCH_PARTICLES];
+    buReal scalar[3][BATCH_PARTICLES] = {{0}};
+    buReal simd[3][BATCH_PARTICLES] = {{0}};
+    buReal *const in[3] = {state[0], state[1], state[2]};
+    buReal *const outScalar[3] = {scalar[0], scalar[1], scalar[2]};
+    buReal *const outSimd[3] = {simd[0], simd[1], simd[2]};
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        buVector3 position, velocity;
+        batchState(i, &position, &velocity);
+        for (int k = 0; k < 3; k++) state[k][i] = position.v[k];
+    }
+    state[0][5] = state[1][5] = state[2][5] = 0.0; // at rest, and at the anchor
+
+    buDragForcesScalar(in, 0.1, 0.01, outScalar, 1, BATCH_PARTICLES);
+    buDragForcesSIMD(in, 0.1, 0.01, outSimd, 1, BATCH_PARTICLES);
+    buBuoyancyForcesScalar(state[1], 0.5, 0.002, 0.0, 1000.0, scalar[1], 1, BATCH_PARTICLES);
+    buBuoyancyForcesSIMD(state[1], 0.5, 0.002, 0.0, 1000.0, simd[1], 1, BATCH_PARTICLES);
+    buAnchoredBungeeForcesScalar(in, (buVector3){0.0, 0.0, 0.0}, 3.0, 1.5, outScalar, 1, BATCH_PARTICLES);
+    buAnchoredBungeeForcesSIMD(in, (buVector3){0.0, 0.0, 0.0}, 3.0, 1.5, outSimd, 1, BATCH_PARTICLES);
+
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_TRUE(scalar[k][i] == simd[k][i]);
+        }
+    }
+    TEST_ASSERT_TRUE(scalar[0][5] == 0.0 && scalar[2][5] == 0.0);
+}
+
+void test_pipeline_matches_registry_exactly(void) {
+    createScene();
+    ParticleForceGenerator *batchGenerators[3];
+    createBatchGenerators(batchGenerators);
+    ParticleForcePipelineCreateClass();
+    ParticlePairSpringCreateClass();
+
+    // Fireworks with gravity + drag, some also with buoyancy, some with
+    // a bungee first (a different order), one with a spring (not
+    // fusable) and pair and user-defined generators on top
+    Particle *fireworks[BATCH_PARTICLES];
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        buVector3 position, velocity;
+        batchState(i, &position, &velocity);
+        fireworks[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, fireworks[i], set, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, (i % 9 == 0) ? 0.0 : 1.0 / (1 + i % 4));
+        if (i % 5 == 1) INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, fireworks[i], batchGenerators[2]);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, fireworks[i], generators[0]);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, fireworks[i], batchGenerators[0]);
+        if (i % 3 == 0) INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, fireworks[i], batchGenerators[1]);
+        if (i % 11 == 0) INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, fireworks[i], &push);
+    }
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, fireworks[7], generators[2]);
+    ParticlePairSpring *pair = CLASS_METHOD_AS(ParticlePairSpringClass, &particlePairSpringClass, new_instance, fireworks[3], fireworks[4], 2.0, 1.0);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, fireworks[3], (ParticleForceGenerator *)pair);
+
+    // A world view takes the generic path through the Particle methods
+    ParticleWorldCreateClass();
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, 1);
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, (buVector3){0.0, -0.2, 0.0}, (buVector3){1.0, 2.0, 3.0}, (buVector3){0.0, 0.0, 0.0}, 0.99, 0.5);
+    Particle *view = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, 0);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, view, generators[0]);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, view, batchGenerators[0]);
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, view, batchGenerators[1]);
+
+    ParticleForcePipeline *pipeline = CLASS_METHOD_AS(ParticleForcePipelineClass, &particleForcePipelineClass, new_instance, registry);
+    for (int round = 0; round < 2; round++) {
+        buVector3 expected[BATCH_PARTICLES + 1];
+        for (int i = 0; i < BATCH_PARTICLES; i++) INSTANCE_METHOD_AS(ParticleVTable, fireworks[i], clearAccumulator);
+        INSTANCE_METHOD_AS(ParticleVTable, view, clearAccumulator);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+        for (int i = 0; i < BATCH_PARTICLES; i++) {
+            expected[i] = INSTANCE_METHOD_AS(ParticleVTable, fireworks[i], getForceAccum);
+            INSTANCE_METHOD_AS(ParticleVTable, fireworks[i], clearAccumulator);
+        }
+        expected[BATCH_PARTICLES] = INSTANCE_METHOD_AS(ParticleVTable, view, getForceAccum);
+        INSTANCE_METHOD_AS(ParticleVTable, view, clearAccumulator);
+
+        INSTANCE_METHOD_AS(ParticleForcePipelineVTable, pipeline, updateForces, 0.01);
+        for (int i = 0; i <= BATCH_PARTICLES; i++) {
+            Particle *p = i < BATCH_PARTICLES ? fireworks[i] : view;
+            buVector3 actual = INSTANCE_METHOD_AS(ParticleVTable, p, getForceAccum);
+            for (int k = 0; k < 3; k++) {
+                TEST_ASSERT_TRUE(expected[i].v[k] == actual.v[k]);
+            }
+        }
+        // Everything but particle 7 and its spring is fused, and the view
+        TEST_ASSERT_EQUAL_UINT(BATCH_PARTICLES + round, INSTANCE_METHOD_AS(ParticleForcePipelineVTable, pipeline, getFusedCount));
+        TEST_ASSERT_TRUE(INSTANCE_METHOD_AS(ParticleForcePipelineVTable, pipeline, getStackCount) >= 4);
+
+        // Changing the registry makes the pipeline rebuild, fusing 7 too
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, removeAllForParticle, fireworks[7]);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, fireworks[7], generators[0]);
+    }
+
+    CLASS_METHOD_AS(ParticleForcePipelineClass, &particleForcePipelineClass, free, pipeline);
+    CLASS_METHOD_AS(ParticlePairSpringClass, &particlePairSpringClass, free, pair);
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+    for (int i = 0; i < BATCH_PARTICLES; i++) {
+        CLASS_METHOD(&particleClass, free, (Object *)fireworks[i]);
+    }
+    freeBatchGenerators(batchGenerators);
+    freeScene();
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_kinds_are_recognised);
+    RUN_TEST(test_updateForces_matches_direct_calls);
+    RUN_TEST(test_remove_and_clear);
+    RUN_TEST(test_addMany_matches_add);
+    RUN_TEST(test_removeByHandle);
+    RUN_TEST(test_removeAllForParticle);
+    RUN_TEST(test_mass_removal);
+    RUN_TEST(test_particle_ids_are_reused);
+    RUN_TEST(test_threaded_buffers_cover_live_particles);
+    RUN_TEST(test_threaded_updateForces);
+    RUN_TEST(test_pair_spring_matches_two_springs);
+    RUN_TEST(test_updateForceBatch_matches_updateForce);
+    RUN_TEST(test_updateWorldForces_matches_updateForce);
+    RUN_TEST(test_group_registrations);
+    RUN_TEST(test_simd_batch_kernels_match_scalar_kernels_exactly);
+    RUN_TEST(test_pipeline_matches_registry_exactly);
+    return UNITY_END();
+}
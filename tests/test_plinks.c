@@ -0,0 +1,205 @@
+#include "unity/src/unity.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pworld.h"
+#include "../src/budgie/pcontacts.h"
+#include "../src/budgie/plinks.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define NUMBER_OF_PARTICLES 40
+#define MAX_LINKS (4 * NUMBER_OF_PARTICLES)
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static buReal random01(void) {
+    return (buReal)rand() / RAND_MAX;
+}
+
+/**
+ * A jittered rope: cables between neighbours, rods between every
+ * second particle, and every particle hung from an anchor above it by
+ * a cable or a rod. Some links are slack, some stretched, some
+ * compressed, and the first rod is exactly its length.
+ */
+typedef struct Rope {
+    ParticleWorld *world;
+    ParticleLinkSet *set;
+    ParticleContactGenerator *links[MAX_LINKS];
+    unsigned linkCount;
+} Rope;
+
+static void buildRope(Rope *rope) {
+    ParticleWorldCreateClass();
+    ParticleCableCreateClass();
+    ParticleRodCreateClass();
+    ParticleCableConstraintCreateClass();
+    ParticleRodConstraintCreateClass();
+    ParticleLinkSetCreateClass();
+
+    srand(3);
+    rope->world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 position = {(buReal)i, 0.0, 0.0};
+        if (i >= 3) position = (buVector3){(buReal)i + random01() * 0.4f - 0.2f, random01() * 0.4f - 0.2f, random01() * 0.2f};
+        INSTANCE_METHOD_AS(ParticleWorldVTable, rope->world, add, position, (buVector3){0.0, 0.0, 0.0}, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+    }
+    rope->set = CLASS_METHOD_AS(ParticleLinkSetClass, &particleLinkSetClass, new_instance, rope->world);
+
+    unsigned n = 0;
+    for (uint32_t i = 0; i + 1 < NUMBER_OF_PARTICLES; i++) {
+        ParticleCable *cable = (ParticleCable *)CLASS_METHOD(&particleCableClass, new_instance);
+        cable->base._particle[0] = INSTANCE_METHOD_AS(ParticleWorldVTable, rope->world, getParticle, i);
+        cable->base._particle[1] = INSTANCE_METHOD_AS(ParticleWorldVTable, rope->world, getParticle, i + 1);
+        cable->_maxLength = 1.0;
+        cable->_restitution = 0.3;
+        rope->links[n++] = (ParticleContactGenerator *)cable;
+        INSTANCE_METHOD_AS(ParticleLinkSetVTable, rope->set, addCable, i, i + 1, 1.0, 0.3);
+    }
+    for (uint32_t i = 0; i + 2 < NUMBER_OF_PARTICLES; i += 2) {
+        ParticleRod *rod = (ParticleRod *)CLASS_METHOD(&particleRodClass, new_instance);
+        rod->base._particle[0] = INSTANCE_METHOD_AS(ParticleWorldVTable, rope->world, getParticle, i);
+        rod->base._particle[1] = INSTANCE_METHOD_AS(ParticleWorldVTable, rope->world, getParticle, i + 2);
+        rod->_length = 2.0;
+        rope->links[n++] = (ParticleContactGenerator *)rod;
+        INSTANCE_METHOD_AS(ParticleLinkSetVTable, rope->set, addRod, i, i + 2, 2.0);
+    }
+    for (uint32_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 anchor = {(buReal)i, 5.0, 0.0};
+        if (i % 2) {
+            ParticleCableConstraint *cable = (ParticleCableConstraint *)CLASS_METHOD(&particleCableConstraintClass, new_instance);
+            cable->base._particle = INSTANCE_METHOD_AS(ParticleWorldVTable, rope->world, getParticle, i);
+            cable->base._anchor = anchor;
+            cable->_maxLength = 5.0;
+            cable->_restitution = 0.5;
+            rope->links[n++] = (ParticleContactGenerator *)cable;
+            INSTANCE_METHOD_AS(ParticleLinkSetVTable, rope->set, addCableConstraint, i, anchor, 5.0, 0.5);
+        } else {
+            ParticleRodConstraint *rod = (ParticleRodConstraint *)CLASS_METHOD(&particleRodConstraintClass, new_instance);
+            rod->base._particle = INSTANCE_METHOD_AS(ParticleWorldVTable, rope->world, getParticle, i);
+            rod->base._anchor = anchor;
+            rod->_length = 5.0;
+            rope->links[n++] = (ParticleContactGenerator *)rod;
+            INSTANCE_METHOD_AS(ParticleLinkSetVTable, rope->set, addRodConstraint, i, anchor, 5.0);
+        }
+    }
+    rope->linkCount = n;
+    TEST_ASSERT_EQUAL_UINT(n, INSTANCE_METHOD_AS(ParticleLinkSetVTable, rope->set, getCount));
+}
+
+static void freeRope(Rope *rope) {
+    for (unsigned l = 0; l < rope->linkCount; l++) {
+        CLASS_METHOD(((Object *)rope->links[l])->klass, free, (Object *)rope->links[l]);
+    }
+    CLASS_METHOD_AS(ParticleLinkSetClass, &particleLinkSetClass, free, rope->set);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, rope->world);
+}
+
+void test_link_set_matches_link_objects(void) {
+    Rope rope;
+    buildRope(&rope);
+
+    // One contact at most from each link object, in link order
+    static ParticleContact expected[MAX_LINKS], actual[MAX_LINKS];
+    unsigned features[MAX_LINKS];
+    unsigned expectedCount = 0;
+    for (unsigned l = 0; l < rope.linkCount; l++) {
+        unsigned used = INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, rope.links[l], addContact, &expected[expectedCount], 1);
+        if (used) features[expectedCount] = l;
+        expectedCount += used;
+    }
+    TEST_ASSERT_TRUE(expectedCount > 0);
+    TEST_ASSERT_TRUE(expectedCount < rope.linkCount);
+
+    ParticleContactGenerator *set = (ParticleContactGenerator *)rope.set;
+    TEST_ASSERT_EQUAL_UINT(expectedCount, INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, set, addContact, actual, MAX_LINKS));
+    ParticleContactBuffer *buffer = (ParticleContactBuffer *)CLASS_METHOD(&particleContactBufferClass, new_instance);
+    TEST_ASSERT_EQUAL_UINT(expectedCount, INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, set, addContactsToBuffer, buffer, MAX_LINKS));
+
+    for (unsigned c = 0; c < expectedCount; c++) {
+        const ParticleContactRecord *record = INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, get, c);
+        for (int e = 0; e < 2; e++) {
+            TEST_ASSERT_EQUAL_PTR(expected[c]._particle[e], actual[c]._particle[e]);
+            TEST_ASSERT_EQUAL_PTR(expected[c]._particle[e], record->particle[e]);
+        }
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_TRUE(expected[c]._contactNormal.v[k] == actual[c]._contactNormal.v[k]);
+            TEST_ASSERT_TRUE(expected[c]._contactNormal.v[k] == record->contactNormal.v[k]);
+        }
+        TEST_ASSERT_TRUE(expected[c]._penetration == actual[c]._penetration);
+        TEST_ASSERT_TRUE(expected[c]._penetration == record->penetration);
+        TEST_ASSERT_TRUE(expected[c]._restitution == record->restitution);
+        TEST_ASSERT_EQUAL_UINT(features[c], actual[c]._feature);
+        TEST_ASSERT_EQUAL_UINT(features[c], record->feature);
+    }
+
+    CLASS_METHOD(&particleContactBufferClass, free, (Object *)buffer);
+    freeRope(&rope);
+}
+
+void test_link_set_honours_limit_and_tolerance(void) {
+    Rope rope;
+    buildRope(&rope);
+    ParticleContactGenerator *set = (ParticleContactGenerator *)rope.set;
+    ParticleContactBuffer *buffer = (ParticleContactBuffer *)CLASS_METHOD(&particleContactBufferClass, new_instance);
+    unsigned all = INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, set, addContactsToBuffer, buffer, MAX_LINKS);
+    TEST_ASSERT_TRUE(all > 4);
+
+    // The limit cuts the sweep short, keeping the first contacts
+    INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, clear);
+    TEST_ASSERT_EQUAL_UINT(0, INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, set, addContactsToBuffer, buffer, 0));
+    TEST_ASSERT_EQUAL_UINT(4, INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, set, addContactsToBuffer, buffer, 4));
+    TEST_ASSERT_EQUAL_UINT(4, INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, getCount));
+    static ParticleContact contacts[MAX_LINKS];
+    TEST_ASSERT_EQUAL_UINT(3, INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, set, addContact, contacts, 3));
+    for (unsigned c = 0; c < 3; c++) {
+        TEST_ASSERT_EQUAL_UINT(INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, get, c)->feature, contacts[c]._feature);
+    }
+
+    // Links within the tolerance make no contact; the rest still do
+    const buReal tolerance = 0.05f;
+    INSTANCE_METHOD_AS(ParticleLinkSetVTable, rope.set, setTolerance, tolerance);
+    INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, clear);
+    unsigned outside = INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, set, addContactsToBuffer, buffer, MAX_LINKS);
+    TEST_ASSERT_TRUE(outside > 0);
+    TEST_ASSERT_TRUE(outside < all);
+    for (unsigned c = 0; c < outside; c++) {
+        TEST_ASSERT_TRUE(INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, get, c)->penetration > tolerance);
+    }
+
+    CLASS_METHOD(&particleContactBufferClass, free, (Object *)buffer);
+    freeRope(&rope);
+}
+
+void test_simd_kernel_matches_scalar_kernel_exactly(void) {
+    enum { COUNT = 37 };
+    buReal difference[3][COUNT], restLength[COUNT];
+    buReal scalarLength[COUNT], scalarStretch[COUNT], simdLength[COUNT], simdStretch[COUNT];
+    srand(5);
+    for (int l = 0; l < COUNT; l++) {
+        for (int k = 0; k < 3; k++) {
+            difference[k][l] = (l == 7) ? 0.0f : (buReal)rand() / RAND_MAX * 4 - 2; // one zero-length link
+        }
+        restLength[l] = (buReal)rand() / RAND_MAX * 2;
+    }
+
+    buReal *const d[3] = {difference[0], difference[1], difference[2]};
+    buLinkStretchScalar(d, restLength, scalarLength, scalarStretch, 0, COUNT);
+    buLinkStretchSIMD(d, restLength, simdLength, simdStretch, 1, COUNT); // unaligned start
+    buLinkStretchSIMD(d, restLength, simdLength, simdStretch, 0, 1);
+    for (int l = 0; l < COUNT; l++) {
+        TEST_ASSERT_TRUE(scalarLength[l] == simdLength[l]);
+        TEST_ASSERT_TRUE(scalarStretch[l] == simdStretch[l]);
+    }
+    TEST_ASSERT_TRUE(scalarLength[7] == 0.0f);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_link_set_matches_link_objects);
+    RUN_TEST(test_link_set_honours_limit_and_tolerance);
+    RUN_TEST(test_simd_kernel_matches_scalar_kernel_exactly);
+    return UNITY_END();
+}
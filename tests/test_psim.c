@@ -0,0 +1,190 @@
+#include "unity/src/unity.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pfgen.h"
+#include "../src/budgie/pworld.h"
+#include "../src/budgie/pcontacts.h"
+#include "../src/budgie/psim.h"
+#include <stdlib.h>
+
+#define NUMBER_OF_PARTICLES 24
+#define STEPS 90
+#define DURATION ((buReal)1.0 / 60.0)
+#define RADIUS ((buReal)0.5)
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static buReal random01(void) {
+    return (buReal)rand() / RAND_MAX;
+}
+
+// The particles of a world that the ground generator keeps above y = RADIUS
+typedef struct Ground {
+    ParticleContactGenerator base;
+    ParticleWorld *world;
+} Ground;
+
+static unsigned groundContacts(ParticleContactGenerator *self, ParticleContact *contact, unsigned limit) {
+    ParticleWorld *world = ((Ground *)self)->world;
+    unsigned count = 0;
+    for (size_t i = 0; i < world->_count && count < limit; i++) {
+        buReal y = world->_arrays.position[1][i];
+        if (y >= RADIUS) continue;
+        contact[count]._particle[0] = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i);
+        contact[count]._particle[1] = NULL;
+        contact[count]._contactNormal = (buVector3){0.0, 1.0, 0.0};
+        contact[count]._penetration = RADIUS - y;
+        contact[count]._restitution = 0.4;
+        count++;
+    }
+    return count;
+}
+
+static ParticleContactGeneratorVTable groundVTable;
+static ParticleContactGeneratorClass groundClass;
+
+static Ground *newGround(ParticleWorld *world) {
+    ParticleContactGeneratorCreateClass();
+    groundVTable = pcg_vtable;
+    groundVTable.addContact = groundContacts;
+    groundClass = particleContactGeneratorClass;
+    groundClass.base.vtable = (VTable *)&groundVTable;
+    Ground *ground = calloc(1, sizeof(Ground));
+    TEST_ASSERT_NOT_NULL(ground);
+    ((Object *)ground)->klass = (Class *)&groundClass;
+    ground->world = world;
+    return ground;
+}
+
+// Falling particles with gravity from a force generator and a world
+// field, and drag on every other one
+static void fillWorld(ParticleWorld *world, ParticleForceRegistry *registry, ParticleForceGenerator *gravity, ParticleForceGenerator *drag) {
+    srand(5);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 position = {(buReal)(i % 6), (buReal)1.0 + (buReal)(i / 6) + random01(), 0.0};
+        buVector3 velocity = {random01() - (buReal)0.5, -random01(), random01() - (buReal)0.5};
+        buReal inverseMass = (buReal)1.0 / (1 + (buReal)(i % 4));
+        size_t index = INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, position, velocity, (buVector3){0.0, 0.0, 0.0}, 0.99, inverseMass);
+        Particle *particle = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, index);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particle, gravity);
+        if (i % 2) INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, particle, drag);
+    }
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, addField, PW_FIELD_FORCE, (buVector3){0.5, 0.0, 0.0});
+}
+
+void test_run_physics_matches_hand_written_step(void) {
+    ParticleSimulationCreateClass();
+    ParticleGravityCreateClass();
+    ParticleDragCreateClass();
+    ParticleForceGenerator *gravity = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleGravityClass, &particleGravityClass, new_instance, (buVector3){0.0, -9.81, 0.0});
+    ParticleForceGenerator *drag = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticleDragClass, &particleDragClass, new_instance, 0.1, 0.01);
+
+    ParticleSimulation *simulation = CLASS_METHOD_AS(ParticleSimulationClass, &particleSimulationClass, new_instance, NUMBER_OF_PARTICLES, 0);
+    ParticleWorld *world = INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, getWorld);
+    fillWorld(world, INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, getRegistry), gravity, drag);
+    Ground *ground = newGround(world);
+    INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, addContactGenerator, (ParticleContactGenerator *)ground);
+
+    // The same step spelled out, as the demos do it
+    ParticleWorld *reference = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, 0);
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    fillWorld(reference, registry, gravity, drag);
+    Ground *referenceGround = newGround(reference);
+    ParticleContactBuffer *buffer = (ParticleContactBuffer *)CLASS_METHOD(&particleContactBufferClass, new_instance);
+    ParticleContactResolver *resolver = (ParticleContactResolver *)CLASS_METHOD(&particleContactResolverClass, new_instance);
+
+    unsigned framesWithContacts = 0;
+    for (int step = 0; step < STEPS; step++) {
+        INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, startFrame);
+        INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, runPhysics, DURATION);
+
+        INSTANCE_METHOD_AS(ParticleWorldVTable, reference, clearAccumulators);
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, DURATION);
+        for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+            Particle *particle = INSTANCE_METHOD_AS(ParticleWorldVTable, reference, getParticle, i);
+            buVector3 force = INSTANCE_METHOD_AS(ParticleVTable, particle, getForceAccum);
+            buReal inverseMass = INSTANCE_METHOD_AS(ParticleVTable, particle, getInverseMass);
+            INSTANCE_METHOD_AS(ParticleVTable, particle, setAcceleration, buVector3Scalar(force, inverseMass));
+        }
+        INSTANCE_METHOD_AS(ParticleWorldVTable, reference, integrateAll, DURATION);
+        INSTANCE_METHOD_AS(ParticleContactBufferVTable, buffer, clear);
+        unsigned used = INSTANCE_METHOD_AS(ParticleContactGeneratorVTable, (ParticleContactGenerator *)referenceGround, addContactsToBuffer, buffer, NUMBER_OF_PARTICLES);
+        if (used > 0) {
+            INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, setIterations, 2 * used);
+            INSTANCE_METHOD_AS(ParticleContactResolverVTable, resolver, resolveBuffer, buffer, DURATION);
+            TEST_ASSERT_EQUAL_UINT(2 * used, simulation->_resolver->_iterations);
+            framesWithContacts++;
+        }
+
+        TEST_ASSERT_EQUAL_UINT(used, INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, getContactCount));
+        for (int k = 0; k < 3; k++) {
+            for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+                TEST_ASSERT_TRUE(reference->_arrays.position[k][i] == world->_arrays.position[k][i]);
+                TEST_ASSERT_TRUE(reference->_arrays.velocity[k][i] == world->_arrays.velocity[k][i]);
+            }
+        }
+    }
+    // The particles reached the ground and came to rest on it
+    TEST_ASSERT_TRUE(framesWithContacts > 0);
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        TEST_ASSERT_TRUE(world->_arrays.position[1][i] > (buReal)0.4);
+    }
+
+    ParticleSimulationTimings timings = INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, getTimings);
+    TEST_ASSERT_TRUE(timings.forces >= 0.0);
+    TEST_ASSERT_TRUE(timings.integration >= 0.0);
+    TEST_ASSERT_TRUE(timings.contactGeneration >= 0.0);
+    TEST_ASSERT_TRUE(timings.contactResolution >= 0.0);
+
+    CLASS_METHOD(&particleContactResolverClass, free, (Object *)resolver);
+    CLASS_METHOD(&particleContactBufferClass, free, (Object *)buffer);
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, reference);
+    CLASS_METHOD_AS(ParticleSimulationClass, &particleSimulationClass, free, simulation);
+    free(referenceGround);
+    free(ground);
+    CLASS_METHOD_AS(ParticleDragClass, &particleDragClass, free, (ParticleDrag *)drag);
+    CLASS_METHOD_AS(ParticleGravityClass, &particleGravityClass, free, (ParticleGravity *)gravity);
+}
+
+void test_contact_limit_is_shared_by_generators(void) {
+    ParticleSimulationCreateClass();
+    ParticleSimulation *simulation = CLASS_METHOD_AS(ParticleSimulationClass, &particleSimulationClass, new_instance, 5, 12);
+    ParticleWorld *world = INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, getWorld);
+    for (int i = 0; i < 3; i++) {
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, (buVector3){(buReal)i, 0.0, 0.0}, (buVector3){0.0, -1.0, 0.0}, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+    }
+    // Each generator finds all three particles below the ground
+    Ground *grounds[3];
+    for (int g = 0; g < 3; g++) {
+        grounds[g] = newGround(world);
+        INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, addContactGenerator, (ParticleContactGenerator *)grounds[g]);
+    }
+
+    // Only the forces are threaded; the buffer is resolved on one thread
+    INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, setThreadCount, 3);
+    TEST_ASSERT_EQUAL_UINT(3, simulation->_registry->_threadCount);
+    TEST_ASSERT_EQUAL_UINT(1, simulation->_resolver->_threadCount);
+
+    INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, startFrame);
+    INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, runPhysics, DURATION);
+    TEST_ASSERT_EQUAL_UINT(5,INSTANCE_METHOD_AS(ParticleSimulationVTable, simulation, getContactCount));
+    TEST_ASSERT_EQUAL_UINT(12, simulation->_resolver->_iterations);
+    for (size_t i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(world->_arrays.velocity[1][i] >= 0.0f);
+    }
+
+    CLASS_METHOD_AS(ParticleSimulationClass, &particleSimulationClass, free, simulation);
+    for (int g = 0; g < 3; g++) {
+        free(grounds[g]);
+    }
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_run_physics_matches_hand_written_step);
+    RUN_TEST(test_contact_limit_is_shared_by_generators);
+    return UNITY_END();
+}
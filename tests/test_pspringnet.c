@@ -0,0 +1,225 @@
+#include "unity/src/unity.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pfgen.h"
+#include "../src/budgie/pworld.h"
+#include "../src/budgie/pspringnet.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define EPSILON 1e-4
+#define WIDTH 7
+#define HEIGHT 5
+#define NUMBER_OF_PARTICLES (WIDTH * HEIGHT)
+#define MAX_SPRINGS (4 * NUMBER_OF_PARTICLES)
+
+void setUp(void) {}
+void tearDown(void) {}
+
+typedef struct Link {
+    uint32_t first, second;
+    buReal springConstant, restLength;
+    bool bungee;
+} Link;
+
+static Link links[MAX_SPRINGS];
+static size_t linkCount;
+
+// A jittered cloth: structural springs along the grid, bungees across
+// the diagonals, some of them slack
+static ParticleWorld *createCloth(void) {
+    ParticleWorldCreateClass();
+    ParticleSpringNetworkCreateClass();
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    srand(3);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 position = {(buReal)(i % WIDTH) + (buReal)rand() / RAND_MAX * 0.2f, (buReal)(i / WIDTH), (buReal)rand() / RAND_MAX * 0.2f};
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, position, (buVector3){0.0, 0.0, 0.0}, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+    }
+
+    linkCount = 0;
+    for (uint32_t y = 0; y < HEIGHT; y++) {
+        for (uint32_t x = 0; x < WIDTH; x++) {
+            uint32_t i = y * WIDTH + x;
+            if (x + 1 < WIDTH) links[linkCount++] = (Link){i, i + 1, 3.0, 0.9, false};
+            if (y + 1 < HEIGHT) links[linkCount++] = (Link){i, i + WIDTH, 2.0, 1.1, false};
+            if (x + 1 < WIDTH && y + 1 < HEIGHT) links[linkCount++] = (Link){i, i + WIDTH + 1, 1.0, (x % 2) ? 1.2f : 1.6f, true};
+        }
+    }
+    return world;
+}
+
+static ParticleSpringNetwork *createNetwork(ParticleWorld *world) {
+    ParticleSpringNetwork *network = CLASS_METHOD_AS(ParticleSpringNetworkClass, &particleSpringNetworkClass, new_instance, world);
+    for (size_t l = 0; l < linkCount; l++) {
+        if (links[l].bungee) {
+            INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, addBungee, links[l].first, links[l].second, links[l].springConstant, links[l].restLength);
+        } else {
+            INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, addSpring, links[l].first, links[l].second, links[l].springConstant, links[l].restLength);
+        }
+    }
+    return network;
+}
+
+void test_network_matches_pair_generators(void) {
+    ParticleWorld *world = createCloth();
+    ParticleSpringNetwork *network = createNetwork(world);
+    TEST_ASSERT_EQUAL_UINT32(linkCount, INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, getCount));
+
+    // The same links as pair generators on views of the world particles
+    ParticlePairSpringCreateClass();
+    ParticlePairBungeeCreateClass();
+    ParticleForceRegistryCreateClass();
+    ParticleForceRegistry *registry = (ParticleForceRegistry *)CLASS_METHOD(&particleForceRegistryClass, new_instance);
+    ParticleForceGenerator *generators[MAX_SPRINGS];
+    for (size_t l = 0; l < linkCount; l++) {
+        Particle *a = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, links[l].first);
+        Particle *b = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, links[l].second);
+        if (links[l].bungee) {
+            generators[l] = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticlePairBungeeClass, &particlePairBungeeClass, new_instance, a, b, links[l].springConstant, links[l].restLength);
+        } else {
+            generators[l] = (ParticleForceGenerator *)CLASS_METHOD_AS(ParticlePairSpringClass, &particlePairSpringClass, new_instance, a, b, links[l].springConstant, links[l].restLength);
+        }
+        INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, add, a, generators[l]);
+    }
+
+    INSTANCE_METHOD_AS(ParticleForceRegistryVTable, registry, updateForces, 0.01);
+    buVector3 expected[NUMBER_OF_PARTICLES];
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        expected[i] = INSTANCE_METHOD_AS(ParticleVTable, INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i), getForceAccum);
+    }
+
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, clearAccumulators);
+    INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, updateForces, 0.01);
+    for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_FLOAT_WITHIN(EPSILON, expected[i].v[k], world->_arrays.forceAccum[k][i]);
+        }
+    }
+
+    for (size_t l = 0; l < linkCount; l++) {
+        free(generators[l]);
+    }
+    CLASS_METHOD(&particleForceRegistryClass, free, (Object *)registry);
+    CLASS_METHOD_AS(ParticleSpringNetworkClass, &particleSpringNetworkClass, free, network);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+}
+
+void test_colors_do_not_share_particles(void) {
+    ParticleWorld *world = createCloth();
+    ParticleSpringNetwork *network = createNetwork(world);
+    INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, build);
+
+    // Every particle has at most 8 links, so greedy colouring needs at most 15
+    size_t colors = INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, getColorCount);
+    TEST_ASSERT_TRUE(colors >= 4 && colors <= 15);
+    TEST_ASSERT_FALSE(network->_overflow);
+    TEST_ASSERT_EQUAL_UINT32(linkCount, network->_colorStart[colors]);
+
+    for (size_t c = 0; c < colors; c++) {
+        int seen[NUMBER_OF_PARTICLES] = {0};
+        for (size_t s = network->_colorStart[c]; s < network->_colorStart[c + 1]; s++) {
+            TEST_ASSERT_EQUAL_INT(0, seen[network->_first[s]]++);
+            TEST_ASSERT_EQUAL_INT(0, seen[network->_second[s]]++);
+        }
+    }
+
+    CLASS_METHOD_AS(ParticleSpringNetworkClass, &particleSpringNetworkClass, free, network);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+}
+
+void test_result_does_not_depend_on_thread_count(void) {
+    ParticleWorld *world = createCloth();
+    ParticleSpringNetwork *network = createNetwork(world);
+
+    buReal first[3][NUMBER_OF_PARTICLES];
+    for (unsigned threads = 1; threads <= 4; threads++) {
+        INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, setThreadCount, threads);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, clearAccumulators);
+        INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, updateForces, 0.01);
+        for (int i = 0; i < NUMBER_OF_PARTICLES; i++) {
+            for (int k = 0; k < 3; k++) {
+                if (threads == 1) {
+                    first[k][i] = world->_arrays.forceAccum[k][i];
+                } else {
+                    TEST_ASSERT_TRUE(first[k][i] == world->_arrays.forceAccum[k][i]);
+                }
+            }
+        }
+    }
+
+    CLASS_METHOD_AS(ParticleSpringNetworkClass, &particleSpringNetworkClass, free, network);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+}
+
+void test_overflow_colour_for_hubs(void) {
+    // A hub with more springs than there are colours
+    ParticleWorldCreateClass();
+    ParticleSpringNetworkCreateClass();
+    enum { SPOKES = PSN_MAX_COLORS + 6 };
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, SPOKES + 1);
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, (buVector3){0.0, 0.0, 0.0}, (buVector3){0.0, 0.0, 0.0}, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+    ParticleSpringNetwork *network = CLASS_METHOD_AS(ParticleSpringNetworkClass, &particleSpringNetworkClass, new_instance, world);
+    for (uint32_t i = 1; i <= SPOKES; i++) {
+        buReal angle = (buReal)i;
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, (buVector3){buCos(angle) * 2, buSin(angle) * 2, 0.0}, (buVector3){0.0, 0.0, 0.0}, (buVector3){0.0, 0.0, 0.0}, 0.99, 1.0);
+        INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, addSpring, 0, i, 1.0, 1.0);
+    }
+
+    INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, setThreadCount, 3);
+    INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, updateForces, 0.01);
+    TEST_ASSERT_TRUE(network->_overflow);
+    TEST_ASSERT_EQUAL_UINT32(PSN_MAX_COLORS + 1, INSTANCE_METHOD_AS(ParticleSpringNetworkVTable, network, getColorCount));
+
+    // Every spoke is stretched by 1 and pulls the hub outwards
+    buVector3 hub = {0.0, 0.0, 0.0};
+    for (uint32_t i = 1; i <= SPOKES; i++) {
+        buReal angle = (buReal)i;
+        hub = buVector3Add(hub, (buVector3){buCos(angle), buSin(angle), 0.0});
+        TEST_ASSERT_FLOAT_WITHIN(EPSILON, -buCos(angle), world->_arrays.forceAccum[0][i]);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, hub.x, world->_arrays.forceAccum[0][0]);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, hub.y, world->_arrays.forceAccum[1][0]);
+
+    CLASS_METHOD_AS(ParticleSpringNetworkClass, &particleSpringNetworkClass, free, network);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+}
+
+void test_simd_kernel_matches_scalar_kernel_exactly(void) {
+    enum { COUNT = 37 };
+    buReal difference[3][COUNT], scalarForce[3][COUNT], simdForce[3][COUNT];
+    buReal restLength[COUNT], springConstant[COUNT], minStretch[COUNT];
+    srand(5);
+    for (int s = 0; s < COUNT; s++) {
+        for (int k = 0; k < 3; k++) {
+            difference[k][s] = (s == 7) ? 0.0f : (buReal)rand() / RAND_MAX * 4 - 2; // one zero-length spring
+        }
+        restLength[s] = (buReal)rand() / RAND_MAX * 2;
+        springConstant[s] = (buReal)rand() / RAND_MAX * 5;
+        minStretch[s] = (s % 3 == 0) ? 0.0f : -INFINITY; // some bungees
+    }
+
+    buReal *const d[3] = {difference[0], difference[1], difference[2]};
+    buReal *const scalar[3] = {scalarForce[0], scalarForce[1], scalarForce[2]};
+    buReal *const simd[3] = {simdForce[0], simdForce[1], simdForce[2]};
+    buSpringForcesScalar(d, restLength, springConstant, minStretch, scalar, 0, COUNT);
+    buSpringForcesSIMD(d, restLength, springConstant, minStretch, simd, 1, COUNT); // unaligned start
+    buSpringForcesSIMD(d, restLength, springConstant, minStretch, simd, 0, 1);
+    for (int s = 0; s < COUNT; s++) {
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_TRUE(scalarForce[k][s] == simdForce[k][s]);
+        }
+    }
+    TEST_ASSERT_TRUE(scalarForce[0][7] == 0.0f);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_network_matches_pair_generators);
+    RUN_TEST(test_colors_do_not_share_particles);
+    RUN_TEST(test_result_does_not_depend_on_thread_count);
+    RUN_TEST(test_overflow_colour_for_hubs);
+    RUN_TEST(test_simd_kernel_matches_scalar_kernel_exactly);
+    return UNITY_END();
+}
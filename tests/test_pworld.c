@@ -0,0 +1,314 @@
+#include "unity/src/unity.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/oop.h"
+#include "../src/budgie/cparticle.h"
+#include "../src/budgie/pworld.h"
+#include "../src/budgie/pintegrate.h"
+#include <math.h>
+
+#define EPSILON 1e-6
+#define NUMBER_OF_PARTICLES 37
+#define DURATION ((buReal)1.0 / 600.0)
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void particleState(size_t i, buVector3 *position, buVector3 *velocity, buVector3 *acceleration, buReal *damping, buReal *inverseMass) {
+    *position = (buVector3){(buReal)i, (buReal)(2 * i), (buReal)-1.0 * i};
+    *velocity = (buVector3){(buReal)1.0 + i, (buReal)-0.5 * i, (buReal)3.0};
+    *acceleration = (buVector3){(buReal)0.0, (buReal)-9.81, (buReal)0.1 * i};
+    *damping = (buReal)0.5 + (buReal)0.01 * i;
+    *inverseMass = (i % 7 == 0) ? (buReal)0.0 : (buReal)1.0 / (1 + i); // some infinite masses
+}
+
+void test_view_reads_and_writes_world_state(void) {
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, 4);
+    size_t i = INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, (buVector3){1.0, 2.0, 3.0}, (buVector3){4.0, 5.0, 6.0}, (buVector3){0.0, -1.0, 0.0}, 0.9, 0.5);
+    TEST_ASSERT_EQUAL_UINT32(0, i);
+    TEST_ASSERT_EQUAL_UINT32(1, INSTANCE_METHOD_AS(ParticleWorldVTable, world, getCount));
+
+    Particle *p = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i);
+    TEST_ASSERT_EQUAL_PTR(p, INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i));
+    buVector3 position = INSTANCE_METHOD_AS(ParticleVTable, p, getPosition);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 2.0, position.y);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 2.0, INSTANCE_METHOD_AS(ParticleVTable, p, getMass));
+
+    INSTANCE_METHOD_AS(ParticleVTable, p, setVelocity, (buVector3){-1.0, 0.0, 0.0});
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, -1.0, world->_arrays.velocity[0][i]);
+
+    INSTANCE_METHOD_AS(ParticleVTable, p, addForce, (buVector3){1.0, 1.0, 1.0});
+    INSTANCE_METHOD_AS(ParticleVTable, p, addForce, (buVector3){1.0, 0.0, 0.0});
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 2.0, INSTANCE_METHOD_AS(ParticleVTable, p, getForceAccum).x);
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, clearAccumulators);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.0, INSTANCE_METHOD_AS(ParticleVTable, p, getForceAccum).x);
+
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+}
+
+void test_integrateAll_matches_integrate(void) {
+    // Start small so that adding particles forces the arrays to grow
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, 1);
+    Particle *reference[NUMBER_OF_PARTICLES];
+
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 position, velocity, acceleration;
+        buReal damping, inverseMass;
+        particleState(i, &position, &velocity, &acceleration, &damping, &inverseMass);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, position, velocity, acceleration, damping, inverseMass);
+        reference[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, reference[i], set, position, velocity, acceleration, damping, inverseMass);
+    }
+
+    for (int step = 0; step < 10; step++) {
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, integrateAll, DURATION);
+        for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+            INSTANCE_METHOD_AS(ParticleVTable, reference[i], integrate, DURATION);
+        }
+    }
+
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        Particle *view = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, i);
+        buVector3 expectedPosition = INSTANCE_METHOD_AS(ParticleVTable, reference[i], getPosition);
+        buVector3 expectedVelocity = INSTANCE_METHOD_AS(ParticleVTable, reference[i], getVelocity);
+        buVector3 position = INSTANCE_METHOD_AS(ParticleVTable, view, getPosition);
+        buVector3 velocity = INSTANCE_METHOD_AS(ParticleVTable, view, getVelocity);
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_FLOAT_WITHIN(EPSILON, expectedPosition.v[k], position.v[k]);
+            TEST_ASSERT_FLOAT_WITHIN(EPSILON, expectedVelocity.v[k], velocity.v[k]);
+        }
+        CLASS_METHOD(&particleClass, free, (Object *)reference[i]);
+    }
+
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+}
+
+void test_view_integrate_matches_integrateAll(void) {
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, 2);
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, (buVector3){0.0, 0.0, 0.0}, (buVector3){1.0, 2.0, 0.0}, (buVector3){0.0, -9.81, 0.0}, 0.8, 1.0);
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, (buVector3){0.0, 0.0, 0.0}, (buVector3){1.0, 2.0, 0.0}, (buVector3){0.0, -9.81, 0.0}, 0.8, 1.0);
+
+    Particle *a = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, 0);
+    Particle *b = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, 1);
+    INSTANCE_METHOD_AS(ParticleVTable, a, integrate, DURATION);
+    INSTANCE_METHOD_AS(ParticleVTable, b, integrate, DURATION);
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, integrateAll, DURATION);
+
+    buVector3 va = INSTANCE_METHOD_AS(ParticleVTable, a, getVelocity);
+    buVector3 vb = INSTANCE_METHOD_AS(ParticleVTable, b, getVelocity);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, va.y, vb.y);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.0, INSTANCE_METHOD_AS(ParticleVTable, a, getPosition).z);
+
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+}
+
+// Runs one of the array kernels against separately integrated Particles
+static void checkKernelMatchesIntegrate(void (*kernel)(const ParticleArrays *, const buReal *, size_t, size_t, buReal)) {
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    Particle *reference[NUMBER_OF_PARTICLES];
+    buReal dampingFactor[NUMBER_OF_PARTICLES];
+
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 position, velocity, acceleration;
+        buReal damping, inverseMass;
+        particleState(i, &position, &velocity, &acceleration, &damping, &inverseMass);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, position, velocity, acceleration, damping, inverseMass);
+        reference[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, reference[i], set, position, velocity, acceleration, damping, inverseMass);
+    }
+    buDampingFactors(world->_arrays.damping, dampingFactor, 0, NUMBER_OF_PARTICLES, DURATION);
+
+    for (int step = 0; step < 10; step++) {
+        // Odd split so both the vector body and the scalar tail are used
+        kernel(&world->_arrays, dampingFactor, 0, 5, DURATION);
+        kernel(&world->_arrays, dampingFactor, 5, NUMBER_OF_PARTICLES, DURATION);
+        for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+            INSTANCE_METHOD_AS(ParticleVTable, reference[i], integrate, DURATION);
+        }
+    }
+
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 expectedPosition = INSTANCE_METHOD_AS(ParticleVTable, reference[i], getPosition);
+        buVector3 expectedVelocity = INSTANCE_METHOD_AS(ParticleVTable, reference[i], getVelocity);
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_FLOAT_WITHIN(EPSILON, expectedPosition.v[k], world->_arrays.position[k][i]);
+            TEST_ASSERT_FLOAT_WITHIN(EPSILON, expectedVelocity.v[k], world->_arrays.velocity[k][i]);
+        }
+        CLASS_METHOD(&particleClass, free, (Object *)reference[i]);
+    }
+
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+}
+
+void test_scalar_kernel_matches_integrate(void) {
+    checkKernelMatchesIntegrate(buIntegrateArraysScalar);
+}
+
+void test_simd_kernel_matches_integrate(void) {
+    checkKernelMatchesIntegrate(buIntegrateArraysSIMD);
+}
+
+void test_simd_kernel_matches_scalar_kernel_exactly(void) {
+    ParticleWorld *scalar = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    ParticleWorld *simd = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    buReal dampingFactor[NUMBER_OF_PARTICLES];
+
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 position, velocity, acceleration;
+        buReal damping, inverseMass;
+        particleState(i, &position, &velocity, &acceleration, &damping, &inverseMass);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, scalar, add, position, velocity, acceleration, damping, inverseMass);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, simd, add, position, velocity, acceleration, damping, inverseMass);
+    }
+    buDampingFactors(scalar->_arrays.damping, dampingFactor, 0, NUMBER_OF_PARTICLES, DURATION);
+
+    for (int step = 0; step < 100; step++) {
+        buIntegrateArraysScalar(&scalar->_arrays, dampingFactor, 0, NUMBER_OF_PARTICLES, DURATION);
+        buIntegrateArraysSIMD(&simd->_arrays, dampingFactor, 0, NUMBER_OF_PARTICLES, DURATION);
+    }
+
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_TRUE(scalar->_arrays.position[k][i] == simd->_arrays.position[k][i]);
+            TEST_ASSERT_TRUE(scalar->_arrays.velocity[k][i] == simd->_arrays.velocity[k][i]);
+        }
+    }
+
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, scalar);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, simd);
+}
+
+// Adds the same particles to both worlds, with acceleration replaced by the given one
+static void addParticles(ParticleWorld *world, buVector3 acceleration) {
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 position, velocity, ignored;
+        buReal damping, inverseMass;
+        particleState(i, &position, &velocity, &ignored, &damping, &inverseMass);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, add, position, velocity, acceleration, damping, inverseMass);
+    }
+}
+
+void test_gravity_field_matches_acceleration(void) {
+    const buVector3 gravity = {0.0, -9.81, 0.0};
+    ParticleWorld *field = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    ParticleWorld *manual = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    addParticles(field, (buVector3){0.0, 0.0, 0.0});
+    addParticles(manual, gravity);
+    INSTANCE_METHOD_AS(ParticleWorldVTable, field, addField, PW_FIELD_ACCELERATION, gravity);
+
+    for (int step = 0; step < 10; step++) {
+        INSTANCE_METHOD_AS(ParticleWorldVTable, field, integrateAll, DURATION);
+        INSTANCE_METHOD_AS(ParticleWorldVTable, manual, integrateAll, DURATION);
+    }
+
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_TRUE(manual->_arrays.position[k][i] == field->_arrays.position[k][i]);
+            TEST_ASSERT_TRUE(manual->_arrays.velocity[k][i] == field->_arrays.velocity[k][i]);
+        }
+    }
+
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, field);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, manual);
+}
+
+void test_force_field_is_scaled_by_inverse_mass(void) {
+    const buVector3 wind = {2.0, 0.0, -1.0};
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    addParticles(world, (buVector3){0.0, 0.0, 0.0});
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, addField, PW_FIELD_FORCE, wind);
+
+    Particle *reference[NUMBER_OF_PARTICLES];
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 position, velocity, ignored;
+        buReal damping, inverseMass;
+        particleState(i, &position, &velocity, &ignored, &damping, &inverseMass);
+        reference[i] = (Particle *)CLASS_METHOD(&particleClass, new_instance);
+        INSTANCE_METHOD_AS(ParticleVTable, reference[i], set, position, velocity, buVector3Scalar(wind, inverseMass), damping, inverseMass);
+    }
+
+    for (int step = 0; step < 10; step++) {
+        INSTANCE_METHOD_AS(ParticleWorldVTable, world, integrateAll, DURATION);
+        for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+            INSTANCE_METHOD_AS(ParticleVTable, reference[i], integrate, DURATION);
+        }
+    }
+
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        buVector3 expectedVelocity = INSTANCE_METHOD_AS(ParticleVTable, reference[i], getVelocity);
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_FLOAT_WITHIN(EPSILON, expectedVelocity.v[k], world->_arrays.velocity[k][i]);
+        }
+        CLASS_METHOD(&particleClass, free, (Object *)reference[i]);
+    }
+
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+}
+
+void test_excluded_group_ignores_field(void) {
+    ParticleWorld *world = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    ParticleWorld *still = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    addParticles(world, (buVector3){0.0, 0.0, 0.0});
+    addParticles(still, (buVector3){0.0, 0.0, 0.0});
+    size_t gravity = INSTANCE_METHOD_AS(ParticleWorldVTable, world, addField, PW_FIELD_ACCELERATION, (buVector3){0.0, -9.81, 0.0});
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, setGroupExcluded, gravity, 3, true);
+
+    // Interleaved runs of both groups
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        if ((i / 4) % 2) INSTANCE_METHOD_AS(ParticleWorldVTable, world, setGroup, i, 3);
+    }
+    INSTANCE_METHOD_AS(ParticleWorldVTable, world, integrateAll, DURATION);
+    INSTANCE_METHOD_AS(ParticleWorldVTable, still, integrateAll, DURATION);
+    INSTANCE_METHOD_AS(ParticleVTable, INSTANCE_METHOD_AS(ParticleWorldVTable, world, getParticle, 4), integrate, DURATION);
+    INSTANCE_METHOD_AS(ParticleVTable, INSTANCE_METHOD_AS(ParticleWorldVTable, still, getParticle, 4), integrate, DURATION);
+
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        if (world->_arrays.inverseMass[i] <= 0.0f) continue;
+        bool excluded = INSTANCE_METHOD_AS(ParticleWorldVTable, world, getGroup, i) == 3;
+        TEST_ASSERT_EQUAL(excluded, world->_arrays.velocity[1][i] == still->_arrays.velocity[1][i]);
+    }
+
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, world);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, still);
+}
+
+void test_simd_field_kernel_matches_scalar_field_kernel_exactly(void) {
+    ParticleWorld *scalar = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    ParticleWorld *simd = CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, new_instance, NUMBER_OF_PARTICLES);
+    buReal dampingFactor[NUMBER_OF_PARTICLES];
+    const buFieldTerms terms = {{0.0, -9.81, 0.0}, {1.5, 0.25, -3.0}};
+
+    addParticles(scalar, (buVector3){0.1, 0.0, -0.2});
+    addParticles(simd, (buVector3){0.1, 0.0, -0.2});
+    buDampingFactors(scalar->_arrays.damping, dampingFactor, 0, NUMBER_OF_PARTICLES, DURATION);
+
+    for (int step = 0; step < 100; step++) {
+        buIntegrateArraysFieldScalar(&scalar->_arrays, dampingFactor, &terms, 0, NUMBER_OF_PARTICLES, DURATION);
+        buIntegrateArraysFieldSIMD(&simd->_arrays, dampingFactor, &terms, 0, NUMBER_OF_PARTICLES, DURATION);
+    }
+
+    for (size_t i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        for (int k = 0; k < 3; k++) {
+            TEST_ASSERT_TRUE(scalar->_arrays.position[k][i] == simd->_arrays.position[k][i]);
+            TEST_ASSERT_TRUE(scalar->_arrays.velocity[k][i] == simd->_arrays.velocity[k][i]);
+        }
+    }
+
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, scalar);
+    CLASS_METHOD_AS(ParticleWorldClass, &particleWorldClass, free, simd);
+}
+
+int main(void) {
+    ParticleWorldCreateClass();
+    UNITY_BEGIN();
+    RUN_TEST(test_view_reads_and_writes_world_state);
+    RUN_TEST(test_integrateAll_matches_integrate);
+    RUN_TEST(test_view_integrate_matches_integrateAll);
+    RUN_TEST(test_scalar_kernel_matches_integrate);
+    RUN_TEST(test_simd_kernel_matches_integrate);
+    RUN_TEST(test_simd_kernel_matches_scalar_kernel_exactly);
+    RUN_TEST(test_gravity_field_matches_acceleration);
+    RUN_TEST(test_force_field_is_scaled_by_inverse_mass);
+    RUN_TEST(test_excluded_group_ignores_field);
+    RUN_TEST(test_simd_field_kernel_matches_scalar_field_kernel_exactly);
+    return UNITY_END();
+}
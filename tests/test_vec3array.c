@@ -0,0 +1,164 @@
+#include "unity/src/unity.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/alloc.h"
+#include "../src/budgie/vec3array.h"
+#include <math.h>
+
+#define EPSILON 1e-6
+#define COUNT 37 // not a multiple of any register width
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static buVector3 a[COUNT + 1], b[COUNT + 1];
+
+static void fill(void) {
+    for (int i = 0; i < COUNT + 1; i++) {
+        a[i] = (buVector3){(buReal)0.5 * i, (buReal)1.0 - i, (buReal)0.25 * (i % 5)};
+        b[i] = (buVector3){(buReal)-1.0, (buReal)0.1 * i, (buReal)2.0 + i};
+    }
+    a[3] = (buVector3){0.0, 0.0, 0.0}; // zero vector for normalize
+}
+
+// Copies packed vectors into component arrays
+static void toSoA(buReal *soa[3], const buVector3 *v, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < 3; k++) {
+            soa[k][i] = v[i].v[k];
+        }
+    }
+}
+
+static void allocSoA(buReal *soa[3], size_t offset) {
+    for (int k = 0; k < 3; k++) {
+        soa[k] = (buReal *)buAlignedAlloc((COUNT + 1) * sizeof(buReal)) + offset;
+    }
+}
+
+static void freeSoA(buReal *soa[3], size_t offset) {
+    for (int k = 0; k < 3; k++) {
+        buAlignedFree(soa[k] - offset);
+    }
+}
+
+static void assertVector(buVector3 expected, buVector3 actual) {
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, expected.x, actual.x);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, expected.y, actual.y);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, expected.z, actual.z);
+}
+
+void test_buVec3ArrayAxpy(void) {
+    // Run from an odd start as well so the alignment peel is exercised
+    for (size_t offset = 0; offset < 2; offset++) {
+        buVector3 y[COUNT + 1];
+        fill();
+        for (size_t i = 0; i < COUNT + 1; i++) y[i] = a[i];
+        buVec3ArrayAxpy(y + offset, 0.5, b + offset, COUNT);
+        for (size_t i = offset; i < COUNT + offset; i++) {
+            assertVector(buVector3Add(a[i], buVector3Scalar(b[i], 0.5)), y[i]);
+        }
+    }
+}
+
+void test_buVec3ArrayAxpySoA(void) {
+    for (size_t offset = 0; offset < 2; offset++) {
+        buReal *y[3], *x[3];
+        allocSoA(y, offset);
+        allocSoA(x, offset);
+        fill();
+        toSoA(y, a, COUNT);
+        toSoA(x, b, COUNT);
+        buVec3ArrayAxpySoA(y, -2.0, x, COUNT);
+        for (size_t i = 0; i < COUNT; i++) {
+            buVector3 expected = buVector3Add(a[i], buVector3Scalar(b[i], -2.0));
+            assertVector(expected, (buVector3){y[0][i], y[1][i], y[2][i]});
+        }
+        freeSoA(y, offset);
+        freeSoA(x, offset);
+    }
+}
+
+void test_buVec3ArrayScale(void) {
+    buReal *v[3];
+    allocSoA(v, 1);
+    fill();
+    toSoA(v, a, COUNT);
+    buVec3ArrayScale(a, 3.0, COUNT);
+    buVec3ArrayScaleSoA(v, 3.0, COUNT);
+    fill();
+    for (size_t i = 0; i < COUNT; i++) {
+        buVector3 expected = buVector3Scalar(a[i], 3.0);
+        buVector3 packed = a[i];
+        buVec3ArrayScale(&packed, 3.0, 1);
+        assertVector(expected, packed);
+        assertVector(expected, (buVector3){v[0][i], v[1][i], v[2][i]});
+    }
+    freeSoA(v, 1);
+}
+
+void test_buVec3ArrayDot(void) {
+    buReal packed[COUNT], soa[COUNT];
+    buReal *va[3], *vb[3];
+    allocSoA(va, 0);
+    allocSoA(vb, 0);
+    fill();
+    toSoA(va, a, COUNT);
+    toSoA(vb, b, COUNT);
+    buVec3ArrayDot(packed, a, b, COUNT);
+    buVec3ArrayDotSoA(soa, va, vb, COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        TEST_ASSERT_FLOAT_WITHIN(EPSILON, buVector3Dot(a[i], b[i]), packed[i]);
+        TEST_ASSERT_FLOAT_WITHIN(EPSILON, buVector3Dot(a[i], b[i]), soa[i]);
+    }
+    freeSoA(va, 0);
+    freeSoA(vb, 0);
+}
+
+void test_buVec3ArrayNorm(void) {
+    buReal packed[COUNT], soa[COUNT + 1];
+    buReal *v[3];
+    allocSoA(v, 0);
+    fill();
+    toSoA(v, b, COUNT);
+    buVec3ArrayNorm(packed, b, COUNT);
+    buVec3ArrayNormSoA(soa + 1, v, COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        TEST_ASSERT_FLOAT_WITHIN(EPSILON, buVector3Norm(b[i]), packed[i]);
+        TEST_ASSERT_FLOAT_WITHIN(EPSILON, buVector3Norm(b[i]), soa[i + 1]);
+    }
+    freeSoA(v, 0);
+}
+
+void test_buVec3ArrayNormalize(void) {
+    for (size_t offset = 0; offset < 2; offset++) {
+        buReal *v[3];
+        allocSoA(v, offset);
+        fill();
+        toSoA(v, a, COUNT);
+        buVec3ArrayNormalize(a + offset, COUNT);
+        buVec3ArrayNormalizeSoA(v, COUNT);
+        buVector3 normalized[COUNT + 1];
+        for (size_t i = 0; i < COUNT + 1; i++) normalized[i] = a[i];
+        fill();
+        for (size_t i = 0; i < COUNT; i++) {
+            buVector3 original = a[i];
+            buVector3 expected = buVector3SquareNorm(original) == 0.0 ? original : buVector3Normalise(original);
+            assertVector(expected, (buVector3){v[0][i], v[1][i], v[2][i]});
+            original = a[i + offset];
+            expected = buVector3SquareNorm(original) == 0.0 ? original : buVector3Normalise(original);
+            assertVector(expected, normalized[i + offset]);
+        }
+        freeSoA(v, offset);
+    }
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_buVec3ArrayAxpy);
+    RUN_TEST(test_buVec3ArrayAxpySoA);
+    RUN_TEST(test_buVec3ArrayScale);
+    RUN_TEST(test_buVec3ArrayDot);
+    RUN_TEST(test_buVec3ArrayNorm);
+    RUN_TEST(test_buVec3ArrayNormalize);
+    return UNITY_END();
+}
@@ -0,0 +1,65 @@
+#include "unity/src/unity.h"
+#include "../src/budgie/core.h"
+#include "../src/budgie/vector3a.h"
+#include <math.h>
+
+#define EPSILON 1e-6
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void assertMatches(buVector3 expected, buVector3A actual) {
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, expected.x, actual.x);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, expected.y, actual.y);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, expected.z, actual.z);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.0, actual.w);
+}
+
+void test_buVector3A_alignment(void) {
+    buVector3A v[2];
+    TEST_ASSERT_EQUAL_UINT32(4 * sizeof(buReal), sizeof(buVector3A));
+    TEST_ASSERT_EQUAL_UINT32(0, (size_t)&v[1] % BU_VECTOR3A_ALIGNMENT);
+}
+
+void test_buVector3A_conversion(void) {
+    buVector3 v = {1.0, -2.0, 3.5};
+    buVector3A a = buVector3AFromVector3(v);
+    assertMatches(v, a);
+    buVector3 back = buVector3AToVector3(a);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 3.5, back.z);
+}
+
+void test_buVector3A_arithmetic_matches_core(void) {
+    buVector3 a = {1.0, -2.0, 0.5};
+    buVector3 b = {4.0, 5.0, -6.0};
+    buVector3A aa = buVector3AFromVector3(a);
+    buVector3A ba = buVector3AFromVector3(b);
+
+    assertMatches(buVector3Add(a, b), buVector3AAdd(aa, ba));
+    assertMatches(buVector3Difference(a, b), buVector3ADifference(aa, ba));
+    assertMatches(buVector3Scalar(a, 2.5), buVector3AScalar(aa, 2.5));
+    assertMatches(buVector3ComponentProduct(a, b), buVector3AComponentProduct(aa, ba));
+    assertMatches(buVector3Add(a, buVector3Scalar(b, -0.5)), buVector3AAddScaled(aa, ba, -0.5));
+    assertMatches(buVector3Cross(a, b), buVector3ACross(aa, ba));
+}
+
+void test_buVector3A_norms_match_core(void) {
+    buVector3 a = {1.0, -2.0, 0.5};
+    buVector3 b = {4.0, 5.0, -6.0};
+    buVector3A aa = buVector3AFromVector3(a);
+    buVector3A ba = buVector3AFromVector3(b);
+
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, buVector3Dot(a, b), buVector3ADot(aa, ba));
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, buVector3SquareNorm(b), buVector3ASquareNorm(ba));
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, buVector3Norm(b), buVector3ANorm(ba));
+    assertMatches(buVector3Normalise(b), buVector3ANormalise(ba));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_buVector3A_alignment);
+    RUN_TEST(test_buVector3A_conversion);
+    RUN_TEST(test_buVector3A_arithmetic_matches_core);
+    RUN_TEST(test_buVector3A_norms_match_core);
+    return UNITY_END();
+}